@@ -268,7 +268,7 @@ static void *stream_process(void *user_data)
 		json_object *jresult = NULL;
 		if(stream->server_url) {
 			rc = ai_request(curl, stream->server_url, request_headers, frame, &jresult);
-			if(0 == rc && jresult) {
+			if(0 == rc && jresult && stream->draw_detections) {
 				draw_frame(frame, jresult, stream->channel?stream->channel->name:NULL);
 			}
 		}
@@ -325,6 +325,7 @@ struct device_stream *device_stream_new_from_config(json_object *jstream, void *
 	assert(0 == rc);
 	
 	stream->server_url = json_get_value(jstream, string, ai_server_url);
+	stream->draw_detections = json_get_value_default(jstream, int, draw_detections, 1);
 	
 	const char *uri = json_get_value(jstream, string, uri);
 	int width = json_get_value_default(jstream, int, width, -1);
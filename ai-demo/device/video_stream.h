@@ -24,6 +24,7 @@ struct device_stream
 	
 	int busy;
 	int is_running;
+	int draw_detections;	// 0: publish the original jpeg, the client composites the detections (GET /<channel>/detections)
 	int (*on_update_frame)(struct device_stream *stream, struct video_frame *frame, json_object *jresult);
 	
 	// private data
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 
 #include <pthread.h>
 #include <json-c/json.h>
@@ -44,6 +45,7 @@ static json_object *generate_default_config(void)
 	json_object_object_add(jwebserver, "port", json_object_new_int(8080));
 	json_object_object_add(jwebserver, "enabled", json_object_new_int(1));
 	json_object_object_add(jwebserver, "use_ssl", json_object_new_int(0));
+	json_object_object_add(jwebserver, "web_root", json_object_new_string("../web"));
 	return jwebserver;
 }
 static void on_favicon(SoupServer * server, SoupMessage * msg, const char * path, GHashTable * query, SoupClientContext * client, void * user_data)
@@ -72,29 +74,65 @@ static void on_document_channels(SoupServer *server, SoupMessage *msg, const cha
 	struct channel_data *channel = NULL;
 	++path;
 	
+	// "<channel>" or "<channel>/detections"
+	const char *sub_path = strchr(path, '/');
+	size_t cb_name = sub_path?(size_t)(sub_path - path):strlen(path);
+	
 	for(ssize_t i = 0; i < web->num_channels; ++i) {
 		channel = &channels[i];
-		if(strcmp(path, channel->name) == 0) break;
+		if(cb_name == strlen(channel->name) && strncmp(path, channel->name, cb_name) == 0) break;
 		channel = NULL;
 	}
+	if(NULL == channel) {
+		soup_message_set_status(msg, SOUP_STATUS_NOT_FOUND);
+		return;
+	}
 	
-	struct video_frame *frame = NULL;
-	long frame_number = 0;
-	if(channel) {
-		frame_number = channel->get_frame(channel, &frame);
-		UNUSED(frame_number);
-	//	debug_printf("channel %d -- frame_%.8ld, frame=%p\n", (int)channel->id, frame_number, frame);
+	SoupMessageHeaders *response_headers = msg->response_headers;
+	char sz_value[100] = "";
+	
+	if(sub_path) {
+		if(strcmp(sub_path, "/detections") != 0) {
+			soup_message_set_status(msg, SOUP_STATUS_NOT_FOUND);
+			return;
+		}
+		
+		const char *sz_frame_number = query?g_hash_table_lookup(query, "frame_number"):NULL;
+		long frame_number = sz_frame_number?atol(sz_frame_number):0;
+		
+		char *json = NULL;
+		size_t length = 0;
+		frame_number = channel->get_detections(channel, frame_number, &json, &length);
+		if(frame_number <= 0 || NULL == json) {
+			soup_message_set_status(msg, SOUP_STATUS_NOT_FOUND);
+			return;
+		}
+		
+		soup_message_headers_append(response_headers, "Connection", "close");
+		soup_message_headers_append(response_headers, "Cache-Control", "no-store, no-cache, must-revalidate, pre-check=0, post-check=0, max-age=0");
+		soup_message_headers_append(response_headers, "Access-Control-Allow-Origin", "*");
+		snprintf(sz_value, sizeof(sz_value) - 1, "%ld", frame_number);
+		soup_message_headers_append(response_headers, "X-Framenumber", sz_value);
+		
+		soup_message_set_response(msg, "application/json", SOUP_MEMORY_TAKE, json, length);
+		soup_message_set_status(msg, SOUP_STATUS_OK);
+		return;
 	}
 	
+	struct video_frame *frame = NULL;
+	long frame_number = channel->get_frame(channel, &frame);
+//	debug_printf("channel %d -- frame_%.8ld, frame=%p\n", (int)channel->id, frame_number, frame);
+	
 	if(frame) {
-		SoupMessageHeaders *response_headers = msg->response_headers;
-		
 		soup_message_headers_append(response_headers, "Connection", "close");
 		soup_message_headers_append(response_headers, "Cache-Control", "no-store, no-cache, must-revalidate, pre-check=0, post-check=0, max-age=0");
 		soup_message_headers_append(response_headers, "Pragma", "no-cache");
 		soup_message_headers_append(response_headers, "Expires", "Mon, 3 Jan 2000 00:00:00 GMT");
 		soup_message_headers_append(response_headers, "Access-Control-Allow-Origin", "*");
+		soup_message_headers_append(response_headers, "Access-Control-Expose-Headers", "X-Framenumber");
 		soup_message_headers_append(response_headers, "Content-Type", "image/jpeg");
+		snprintf(sz_value, sizeof(sz_value) - 1, "%ld", frame_number);
+		soup_message_headers_append(response_headers, "X-Framenumber", sz_value);
 		
 		soup_message_body_append(msg->response_body, SOUP_MEMORY_COPY, (char *)frame->data, frame->length);
 		video_frame_unref(frame);
@@ -122,6 +160,7 @@ static int generate_default_page(struct webserver_context *web)
 		"<title>app-demo</title>\n"
 		"<style> \n"
 		"#viewer { max-width: 100%%; heigth: auto; width: auto; }</style>\n"
+		"<script src=\"/draw-detections.js\"></script>\n"
 		"<script>\n"
 		"window.onload = function() {\n"
 		"	// bind events\n"
@@ -136,15 +175,29 @@ static int generate_default_page(struct webserver_context *web)
 		"	if(channel) setTimeout(update_frame, 200);\n"
 		"}\n"
 	
-		"function update_frame() {\n"
-		"	const img = document.getElementById(\"viewer\");"
+		// the jpeg is fetched together with its detections record (same frame_number),
+		// the boxes are composited here unless the device has already drawn them ('rendered')
+		"async function update_frame() {\n"
+		"	const canvas = document.getElementById(\"viewer\");\n"
 		"	let channel = channels.value;\n"
-		"	if(channel) {\n"
-		"		img.src = window.location.origin + '/' + channel;\n"
-		"		setTimeout(update_frame, 200);\n"
-		"	}else {\n"
-		"		img.src = 'data:'; \n"
+		"	if(!channel) return;\n"
+		"	try {\n"
+		"		const url = window.location.origin + '/' + channel;\n"
+		"		const response = await fetch(url, { cache: 'no-store' });\n"
+		"		if(response.ok) {\n"
+		"			const frame_number = response.headers.get('X-Framenumber');\n"
+		"			const image = await createImageBitmap(await response.blob());\n"
+		"			const meta = await fetch(url + '/detections?frame_number=' + frame_number, { cache: 'no-store' });\n"
+		"			const record = meta.ok?(await meta.json()):null;\n"
+		"			canvas.width = image.width; canvas.height = image.height;\n"
+		"			const ctx = canvas.getContext('2d');\n"
+		"			ctx.drawImage(image, 0, 0);\n"
+		"			if(record && !record.rendered) draw_detections(ctx, record, channel);\n"
+		"		}\n"
+		"	}catch(err) {\n"
+		"		console.log(err);\n"
 		"	}\n"
+		"	setTimeout(update_frame, 200);\n"
 		"}\n"
 		"</script></head>\n"
 		"<body>\n"
@@ -163,7 +216,7 @@ static int generate_default_page(struct webserver_context *web)
 	}
 	
 	cb = snprintf(p, p_end - p, "</select></div>\n"
-		"<div style='width: 100%%; height: 100%%'><img id=\"viewer\" style='width: 100%%; height: 100%%'/></div>\n"
+		"<div style='width: 100%%; height: 100%%'><canvas id=\"viewer\" style='width: 100%%; height: auto'></canvas></div>\n"
 		"</body></html>\n");
 	assert(cb > 0);
 	p += cb;
@@ -198,6 +251,13 @@ static void on_document_root(SoupServer *server, SoupMessage *msg, const char *p
 		return;
 	}
 	
+	if(strcmp(path, "/draw-detections.js") == 0 && web->js) {
+		soup_message_headers_append(msg->response_headers, "Connection", "close");
+		soup_message_set_response(msg, "text/javascript", SOUP_MEMORY_TEMPORARY, (char *)web->js, web->cb_js);
+		soup_message_set_status(msg, SOUP_STATUS_OK);
+		return;
+	}
+	
 	soup_message_set_status(msg, SOUP_STATUS_NOT_FOUND);
 	return;
 
@@ -278,6 +338,17 @@ static int webserver_init(struct webserver_context *web, ssize_t num_streams, st
 	g_slist_free(uris);
 	
 	
+	// the page's script is the one of ai-demo/web, (a single copy of draw_detections())
+	const char *web_root = json_get_value_default(jwebserver, string, web_root, "../web");
+	char js_file[PATH_MAX] = "";
+	snprintf(js_file, sizeof(js_file), "%s/draw-detections.js", web_root);
+	web->cb_js = load_binary_data(js_file, &web->js);
+	if(web->cb_js <= 0) {
+		fprintf(stderr, "[WARNING]::%s(): %s not found, the detections records won't be drawn\n", __FUNCTION__, js_file);
+		web->js = NULL;
+		web->cb_js = 0;
+	}
+	
 	generate_default_page(web);
 	
 	return 0;
@@ -315,6 +386,61 @@ void webserver_context_cleanup(struct webserver_context *web)
 	return;
 }
 
+/*
+ * compact detections record:
+ *   {"frame_number":N,"width":W,"height":H,"rendered":false,"detections":[{"class":"person","class_index":0,"confidence":0.91,
+ *     "left":0.1234,"top":0.2345,"width":0.0456,"height":0.1567}, ...]}
+ * (the box is normalized to [0, 1], the same as the ai-server's result)
+ * rendered: the boxes have already been drawn into the jpeg by the device
+ */
+static char *detections_record_to_json(long frame_number, int width, int height, int rendered, json_object *jresult, size_t *p_length)
+{
+	json_object *jrecord = json_object_new_object();
+	json_object_object_add(jrecord, "frame_number", json_object_new_int64(frame_number));
+	json_object_object_add(jrecord, "width", json_object_new_int(width));
+	json_object_object_add(jrecord, "height", json_object_new_int(height));
+	json_object_object_add(jrecord, "rendered", json_object_new_boolean(rendered));
+	
+	json_object *jdetections = json_object_new_array();
+	json_object_object_add(jrecord, "detections", jdetections);
+	
+	json_object *jresult_detections = NULL;
+	if(jresult) json_object_object_get_ex(jresult, "detections", &jresult_detections);
+	
+	int num_detections = jresult_detections?json_object_array_length(jresult_detections):0;
+	for(int i = 0; i < num_detections; ++i) {
+		json_object *jdet = json_object_array_get_idx(jresult_detections, i);
+		if(NULL == jdet) continue;
+		
+		static const char *box_keys[4] = { "left", "top", "width", "height" };
+		char sz_value[32] = "";
+		
+		json_object *jbox = json_object_new_object();
+		json_object_object_add(jbox, "class", json_object_new_string(json_get_value_default(jdet, string, class, "")));
+		json_object_object_add(jbox, "class_index", json_object_new_int(json_get_value_default(jdet, int, class_index, -1)));
+		
+		snprintf(sz_value, sizeof(sz_value), "%.3f", json_get_value(jdet, double, confidence));
+		json_object_object_add(jbox, "confidence", json_object_new_double_s(atof(sz_value), sz_value));
+		
+		for(int k = 0; k < 4; ++k) {
+			json_object *jvalue = NULL;
+			json_object_object_get_ex(jdet, box_keys[k], &jvalue);
+			snprintf(sz_value, sizeof(sz_value), "%.4f", json_object_get_double(jvalue));
+			json_object_object_add(jbox, box_keys[k], json_object_new_double_s(atof(sz_value), sz_value));
+		}
+		json_object_array_add(jdetections, jbox);
+	}
+	
+	size_t length = 0;
+	const char *sz_json = json_object_to_json_string_length(jrecord, JSON_C_TO_STRING_PLAIN, &length);
+	char *json = strdup(sz_json);
+	assert(json);
+	json_object_put(jrecord);
+	
+	*p_length = length;
+	return json;
+}
+
 static int channel_update_frame(struct channel_data *channel, int width, int height, const unsigned char *jpeg_data, size_t cb_jpeg, json_object *jresult)
 {
 //	debug_printf("%s(size=%dx%d)\n", __FUNCTION__, width, height);
@@ -325,22 +451,66 @@ static int channel_update_frame(struct channel_data *channel, int width, int hei
 	frame->type = video_frame_type_jpeg;
 	
 	pthread_mutex_lock(&channel->mutex);
-	frame->frame_number = ++channel->frame_number;
-	struct video_frame *old_frame = channel->frame;
-	channel->frame = frame;
+	long frame_number = ++channel->frame_number;
 	pthread_mutex_unlock(&channel->mutex);
+	frame->frame_number = frame_number;
+	
+	// build the record outside the lock, then publish the frame and its record together:
+	// a client never gets a frame whose record is not there yet
+	size_t length = 0;
+	int rendered = (channel->stream && channel->stream->draw_detections);
+	char *json = detections_record_to_json(frame_number, width, height, rendered, jresult, &length);
 	
+	pthread_mutex_lock(&channel->mutex);
+	struct video_frame *old_frame = NULL;
+	if(NULL == channel->frame || channel->frame->frame_number < frame_number) {
+		old_frame = channel->frame;
+		channel->frame = frame;
+	}else {
+		old_frame = frame;	// a newer frame has been published meanwhile
+	}
+	
+	struct channel_detections_record *record = &channel->records[frame_number % CHANNEL_DETECTIONS_HISTORY];
+	char *old_json = record->json;
+	record->frame_number = frame_number;
+	record->json = json;
+	record->length = length;
+	pthread_mutex_unlock(&channel->mutex);
+	
+	free(old_json);
 	if(old_frame) video_frame_unref(old_frame);
 	return 0;
 }
 
+static long channel_get_detections(struct channel_data *channel, long frame_number, char **p_json, size_t *p_length)
+{
+	char *json = NULL;
+	size_t length = 0;
+	
+	pthread_mutex_lock(&channel->mutex);
+	if(frame_number <= 0) frame_number = channel->frame?channel->frame->frame_number:0;	// the published one, (not just reserved)
+	struct channel_detections_record *record = &channel->records[frame_number % CHANNEL_DETECTIONS_HISTORY];
+	if(frame_number > 0 && record->frame_number == frame_number && record->json) {
+		json = malloc(record->length + 1);
+		assert(json);
+		memcpy(json, record->json, record->length + 1);
+		length = record->length;
+	}
+	pthread_mutex_unlock(&channel->mutex);
+	
+	if(NULL == json) return -1;
+	*p_json = json;
+	*p_length = length;
+	return frame_number;
+}
+
 static long channel_get_frame(struct channel_data *channel, struct video_frame **p_frame)
 {
 	struct video_frame *current = NULL;
 	pthread_mutex_lock(&channel->mutex);
 	struct video_frame *frame = channel->frame;
 	if(frame) {
-		current = video_frame_new(channel->frame_number, frame->width, frame->height, frame->data, frame->length, 0);
+		current = video_frame_new(frame->frame_number, frame->width, frame->height, frame->data, frame->length, 0);
 	}
 	pthread_mutex_unlock(&channel->mutex);
 	
@@ -365,6 +535,7 @@ struct channel_data *channel_data_init(struct channel_data *channel, long id, co
 	channel->stream = stream;
 	channel->update_frame = channel_update_frame;
 	channel->get_frame = channel_get_frame;
+	channel->get_detections = channel_get_detections;
 	
 	stream->channel = channel;
 	
@@ -372,5 +543,10 @@ struct channel_data *channel_data_init(struct channel_data *channel, long id, co
 }
 void channel_data_cleanup(struct channel_data *channel)
 {
+	if(NULL == channel) return;
+	for(int i = 0; i < CHANNEL_DETECTIONS_HISTORY; ++i) {
+		free(channel->records[i].json);
+		channel->records[i].json = NULL;
+	}
 	return;
 }
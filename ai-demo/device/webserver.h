@@ -13,6 +13,19 @@ extern "C" {
 
 struct device_stream;
 struct webserver_context;
+
+/*
+ * detections of the recent frames, keyed by frame_number, (GET /<channel>/detections?frame_number=N)
+ * lets the client composite the boxes over the untouched jpeg (see 'draw_detections' in the stream config)
+ */
+#define CHANNEL_DETECTIONS_HISTORY (16)
+struct channel_detections_record
+{
+	long frame_number;
+	char *json;
+	size_t length;
+};
+
 struct channel_data
 {
 	long id;
@@ -24,10 +37,14 @@ struct channel_data
 	pthread_mutex_t mutex;
 	long frame_number;
 	struct video_frame *frame;
+	struct channel_detections_record records[CHANNEL_DETECTIONS_HISTORY];
 	
 	int (*update_frame)(struct channel_data *channel, int width, int height, const unsigned char *jpeg_data, size_t cb_jpeg, json_object *jresult);
 	long (*get_frame)(struct channel_data *channel, struct video_frame **p_frame);
 	
+	// frame_number <= 0: the latest record. return the frame_number of the record, or -1 if it was not found (or has expired)
+	long (*get_detections)(struct channel_data *channel, long frame_number, char **p_json, size_t *p_length);
+	
 };
 
 struct channel_data *channel_data_init(struct channel_data *channel, long id, const char *name, struct device_stream *stream);
@@ -50,6 +67,10 @@ struct webserver_context
 	char *html;
 	ssize_t cb_html;
 	
+	// draw-detections.js, shared with ai-demo/web/index.html, (loaded from 'web_root', served as /draw-detections.js)
+	unsigned char *js;
+	ssize_t cb_js;
+	
 	int (*init)(struct webserver_context *web, ssize_t num_streams, struct device_stream **streams, json_object *jconfig);
 	int (*run)(struct webserver_context *web);
 };
@@ -0,0 +1,36 @@
+/*
+ * draw-detections.js: composites a detections record over the frame already drawn on the canvas,
+ *   (shared by index.html and the device's built-in page, see ai-demo/device/webserver.c)
+ *
+ * record: {"frame_number":N,"width":W,"height":H,"rendered":false,"detections":[...]}
+ *   the boxes are normalized to [0, 1]; skip the record if it is 'rendered' (already drawn by the device)
+ */
+function draw_detections(ctx, record, channel_name)
+{
+	const w = ctx.canvas.width, h = ctx.canvas.height;
+	let persons_count = 0;
+
+	ctx.lineWidth = 1;
+	ctx.font = (h / 30) + 'px mono';
+	for(const det of record.detections) {
+		if(det.class_index == 0) ++persons_count;
+
+		ctx.strokeStyle = ctx.fillStyle = (det.class_index == 0)?'#ffff00':'#0000ff';
+		ctx.strokeRect(det.left * w, det.top * h, det.width * w, det.height * h);
+		ctx.fillText(det.class, det.left * w + 2, det.top * h + h / 30);
+	}
+
+	ctx.font = (h / 20) + 'px mono';
+	let cx = ctx.measureText(channel_name).width;
+	ctx.fillStyle = 'rgba(230, 230, 230, 0.8)';
+	ctx.fillRect(10, 10, cx + 20, h / 20 + 20);
+	ctx.fillStyle = 'rgba(0, 0, 0, 0.9)';
+	ctx.fillText(channel_name, 10, 10 + h / 20);
+
+	const text = 'Persons Count: ' + persons_count;
+	cx = ctx.measureText(text).width;
+	ctx.fillStyle = 'rgba(77, 77, 77, 0.8)';
+	ctx.fillRect(w - 10 - cx, 10, cx + 20, h / 20 + 20);
+	ctx.fillStyle = '#ffff00';
+	ctx.fillText(text, w - 10 - cx, 15 + h / 20);
+}
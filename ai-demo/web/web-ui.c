@@ -270,6 +270,8 @@ static void on_document_root(SoupServer *server, SoupMessage *msg, const char *p
 	}
 	
 	++path;
+	if(path[0] == '\0') path = "index.html";
+	
 	const char *path_name = NULL;
 	struct file_content *content = NULL;
 	for(size_t i = 0; i < webui->num_static_files; ++i) {
@@ -366,6 +368,24 @@ static size_t on_proxy_response(char *data, size_t size, size_t n, void *user_da
 	return length;
 }
 
+/* forward the frame_number of the upstream jpeg, the client uses it to fetch the matching detections record */
+static size_t on_proxy_response_header(char *data, size_t size, size_t n, void *user_data)
+{
+	SoupMessageHeaders *response_headers = user_data;
+	size_t length = size * n;
+	
+	static const char key[] = "X-Framenumber:";
+	if(length > (sizeof(key) - 1) && strncasecmp(data, key, sizeof(key) - 1) == 0) {
+		char value[100] = "";
+		size_t cb_value = length - (sizeof(key) - 1);
+		if(cb_value >= sizeof(value)) cb_value = sizeof(value) - 1;
+		memcpy(value, data + sizeof(key) - 1, cb_value);
+		
+		g_strstrip(value);
+		if(value[0]) soup_message_headers_append(response_headers, "X-Framenumber", value);
+	}
+	return length;
+}
 
 static void on_proxy_channels(SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query, SoupClientContext *client, gpointer user_data)
 {
@@ -378,7 +398,9 @@ static void on_proxy_channels(SoupServer *server, SoupMessage *msg, const char *
 	}
 	
 	char url[4096] = "";
-	snprintf(url, sizeof(url), "%s%s", webui->proxy_base_url, path);
+	SoupURI *uri = soup_message_get_uri(msg);
+	const char *query_string = uri?soup_uri_get_query(uri):NULL;
+	snprintf(url, sizeof(url), "%s%s%s%s", webui->proxy_base_url, path, query_string?"?":"", query_string?query_string:"");
 	fprintf(stderr, "%s(): upstream=%s\n", __FUNCTION__, url);
 	
 	struct response_closure response[1] = {{
@@ -391,6 +413,8 @@ static void on_proxy_channels(SoupServer *server, SoupMessage *msg, const char *
 	curl_easy_setopt(curl, CURLOPT_URL, url);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, on_proxy_response);
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, on_proxy_response_header);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, msg->response_headers);
 	
 	SoupMessageHeaders *request_headers = msg->request_headers;
 	const char *key = NULL, *value = NULL;
@@ -431,8 +455,14 @@ static void on_proxy_channels(SoupServer *server, SoupMessage *msg, const char *
 	soup_message_headers_append(response_headers, "Pragma", "no-cache");
 	soup_message_headers_append(response_headers, "Expires", "Mon, 3 Jan 2000 00:00:00 GMT");
 	soup_message_headers_append(response_headers, "Access-Control-Allow-Origin", "*");
+	soup_message_headers_append(response_headers, "Access-Control-Expose-Headers", "X-Framenumber");
 	if(response->data) {
-		soup_message_set_response(msg, "image/jpeg", SOUP_MEMORY_TAKE, response->data, response->length);
+		// jpeg frames or json detections records
+		const char *content_type = NULL;
+		curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &content_type);
+		if(NULL == content_type) content_type = "image/jpeg";
+		
+		soup_message_set_response(msg, content_type, SOUP_MEMORY_TAKE, response->data, response->length);
 		response->data = NULL;
 	}else {
 		response_code = SOUP_STATUS_NO_CONTENT;
@@ -35,9 +35,17 @@
 #include <pthread.h>
 #include <libsoup/soup.h>
 #include "ai-engine.h"
+#include "ai-engine-pool.h"
 #include "ann-plugin.h"
 #include "utils.h"
 
+struct ai_model
+{
+	struct global_param * app;
+	json_object * jconfig;
+	ai_engine_pool_t pool[1];	// replicas of the model, (see "replicas" in ai-server.json)
+};
+
 typedef struct global_param
 {
 	const char * conf_file;
@@ -47,7 +55,7 @@ typedef struct global_param
 	SoupServer * server;
 	json_object * jconfig;
 	ssize_t count;
-	ai_engine_t ** engines;
+	struct ai_model * models;
 	
 	
 	// CORS
@@ -63,10 +71,6 @@ typedef struct global_param
 global_param_t * global_param_parse_args(global_param_t * params, int argc, char ** argv);
 void global_param_cleanup(global_param_t * params);
 
-static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define global_lock()	pthread_mutex_lock(&g_mutex)
-#define global_unlock()	pthread_mutex_unlock(&g_mutex)
-
 static ssize_t unix_time_to_string(
 	const time_t tv_sec, 
 	int use_gmtime, 
@@ -171,6 +175,62 @@ static guint on_options(SoupServer * server, SoupMessage * msg, const char * pat
 }
 
 
+/*
+ * the requests are answered asynchronously: the message is paused while a replica runs the model,
+ * the result is sent back from the main loop, (the other clients are not blocked meanwhile)
+ */
+struct predict_request
+{
+	global_param_t * app;
+	SoupServer * server;
+	SoupMessage * msg;
+	int status;
+	json_object * jresult;
+};
+
+static gboolean on_predict_response(gpointer user_data)
+{
+	struct predict_request * request = user_data;
+	global_param_t * params = request->app;
+	SoupMessage * msg = request->msg;
+	
+	json_object * jresult = request->jresult;
+	printf("status=%d, jresult=%p\n", request->status, jresult);
+	if(request->status != ai_engine_job_status_completed || NULL == jresult)
+	{
+		if(jresult) json_object_put(jresult);
+		jresult = json_object_new_object();
+		json_object_object_add(jresult, "err_code", json_object_new_int(1));
+	}
+	
+	const char * response = json_object_to_json_string_ext(jresult, JSON_C_TO_STRING_PLAIN);
+	assert(response);
+	int cb = strlen(response);
+	
+	SoupMessageHeaders * response_headers = msg->response_headers;
+	
+	soup_message_headers_append(response_headers, "Access-Control-Allow-Origin", 
+		params->access_control_allow_origin?params->access_control_allow_origin:"*");
+	soup_message_set_response(msg, "application/json", SOUP_MEMORY_COPY, response, cb);
+	
+	soup_message_set_status(msg, SOUP_STATUS_OK);
+	json_object_put(jresult);
+	
+	soup_server_unpause_message(request->server, msg);
+	g_object_unref(msg);
+	free(request);
+	return G_SOURCE_REMOVE;
+}
+
+static void on_predict_completed(ai_engine_job_t * job)
+{
+	// worker thread
+	struct predict_request * request = job->user_data;
+	request->status = job->status;
+	request->jresult = ai_engine_job_take_result(job);
+	g_main_context_invoke(NULL, on_predict_response, request);
+}
+
 void on_request_ai_engine(SoupServer * server, SoupMessage * msg, const char * path, 
 	GHashTable * query, SoupClientContext * client, gpointer user_data)
 {
@@ -203,32 +263,26 @@ void on_request_ai_engine(SoupServer * server, SoupMessage * msg, const char * p
 			}
 		}
 	}
-	ai_engine_t * engine = params->engines[engine_index];
-	assert(engine);
+	ai_engine_pool_t * pool = params->models[engine_index].pool;
 	
 	const char * content_type = soup_message_headers_get_content_type(msg->request_headers, NULL);
 	printf("content-type: %s\n", content_type);
-	gboolean uncertain = TRUE;
-	char * image_type = g_content_type_guess(NULL, 
-		(const unsigned char *)msg->request_body->data, 
+	struct img_utils_image_info image_info[1];
+	int rc = img_utils_probe((const unsigned char *)msg->request_body->data, 
 		msg->request_body->length, 
-		&uncertain);
-	if(uncertain || NULL == image_type) {
-		fprintf(stderr, "[ERROR]: invalid image format.\n");
+		image_info);
+	if(rc || image_info->truncated) {
+		fprintf(stderr, "[ERROR]: invalid image format%s.\n", image_info->truncated?" (truncated)":"");
 		soup_message_set_status(msg, SOUP_STATUS_BAD_REQUEST);
-		if(image_type) g_free(image_type);
 		return;
 	}
 	
-	debug_printf("content_type: %s, real_image_type: %s", 
-		content_type, image_type);
+	debug_printf("content_type: %s, real_image_type: %s, size: %d x %d", 
+		content_type, (image_info->type == img_utils_image_type_jpeg)?"image/jpeg":"image/png",
+		image_info->width, image_info->height);
 		
-	gboolean is_jpeg = FALSE;
-	gboolean is_png = FALSE;
-	
-	is_jpeg = g_content_type_equals(image_type, "image/jpeg");
-	if(!is_jpeg) is_png = g_content_type_equals(image_type, "image/png");
-	g_free(image_type);
+	gboolean is_jpeg = (image_info->type == img_utils_image_type_jpeg);
+	gboolean is_png = (image_info->type == img_utils_image_type_png);
 	
 	if(!is_jpeg && !is_png)
 	{
@@ -238,7 +292,6 @@ void on_request_ai_engine(SoupServer * server, SoupMessage * msg, const char * p
 	
 	input_frame_t frame[1];
 	memset(frame, 0, sizeof(frame));
-	int rc = 0;
 	
 	if(is_jpeg) {
 		rc = input_frame_set_jpeg(frame, 
@@ -258,34 +311,27 @@ void on_request_ai_engine(SoupServer * server, SoupMessage * msg, const char * p
 		return;
 	}
 	
-	json_object * jresult = NULL;
-	
 	printf("frame: %d x %d\n", frame->width, frame->height);
-	global_lock();
-	rc = engine->predict(engine, frame, &jresult);
-	global_unlock();
-	input_frame_clear(frame);
+	input_frame_share(frame);	// the job shares the request's copy of the image
 	
-	printf("rc=%d, jresult=%p\n", rc, jresult);
-	if(rc || NULL == jresult)
-	{
-		if(jresult) json_object_put(jresult);
-		jresult = json_object_new_object();
-		json_object_object_add(jresult, "err_code", json_object_new_int(1));
-	}
-	
-	const char * response = json_object_to_json_string_ext(jresult, JSON_C_TO_STRING_PLAIN);
-	assert(response);
-	int cb = strlen(response);
-	
-	SoupMessageHeaders * response_headers = msg->response_headers;
+	struct predict_request * request = calloc(1, sizeof(*request));
+	assert(request);
+	request->app = params;
+	request->server = server;
+	request->msg = msg;
 	
-	soup_message_headers_append(response_headers, "Access-Control-Allow-Origin", 
-		params->access_control_allow_origin?params->access_control_allow_origin:"*");
-	soup_message_set_response(msg, "application/json", SOUP_MEMORY_COPY, response, cb);
+	// the result is delivered by the main loop, (not before this handler returns)
+	rc = pool->submit(pool, frame, 0, on_predict_completed, request, NULL);
+	input_frame_clear(frame);
+	if(rc) {
+		fprintf(stderr, "[WARNING]: the queue of engine %d is full.\n", engine_index);
+		free(request);
+		soup_message_set_status(msg, SOUP_STATUS_SERVICE_UNAVAILABLE);
+		return;
+	}
 	
-	soup_message_set_status(msg, SOUP_STATUS_OK);
-	json_object_put(jresult);
+	g_object_ref(msg);
+	soup_server_pause_message(server, msg);
 	return;
 }
 
@@ -298,7 +344,7 @@ static global_param_t g_params[1] = {{
 int main(int argc, char **argv)
 {
 	global_param_t * params = global_param_parse_args(NULL, argc, argv);
-	assert(params && params->count && params->engines);
+	assert(params && params->count && params->models);
 	
 	SoupServer * server = soup_server_new(SOUP_SERVER_SERVER_HEADER, "ai-server", NULL);
 	assert(server);
@@ -378,6 +424,27 @@ static int parse_cors_configs(global_param_t * app, json_object * jconfig)
 	return 0;
 }
 
+static ai_engine_t * new_engine_replica(ai_engine_pool_t * pool, int index)
+{
+	// replica thread, (the calls are serialized by the pool)
+	struct ai_model * model = pool->user_data;
+	assert(model && model->jconfig);
+	json_object * jengine = model->jconfig;
+	
+	const char * plugin_name = json_get_value(jengine, string, plugin_name);
+	if(NULL == plugin_name) plugin_name = "ai-engine::darknet";
+	ai_engine_t * engine = ai_engine_init(NULL, plugin_name, model->app);
+	if(NULL == engine) return NULL;
+	
+	int rc = engine->init(engine, jengine);
+	if(rc) {
+		ai_engine_cleanup(engine);
+		free(engine);
+		return NULL;
+	}
+	return engine;
+}
+
 global_param_t * global_param_parse_args(global_param_t * params, int argc, char ** argv)
 {
 	if(NULL == params) params = g_params;
@@ -433,24 +500,30 @@ global_param_t * global_param_parse_args(global_param_t * params, int argc, char
 	int count = json_object_array_length(jai_engines);
 	assert(count > 0);
 	
-	ai_engine_t ** engines = calloc(count, sizeof(*engines));
+	struct ai_model * models = calloc(count, sizeof(*models));
+	assert(models);
+	int first_cpu = 0;
 	for(int i = 0; i < count; ++i)
 	{
 		json_object * jengine = json_object_array_get_idx(jai_engines, i);
 		assert(jengine);
 		
-		const char * plugin_name = json_get_value(jengine, string, plugin_name);
-		if(NULL == plugin_name) plugin_name = "ai-engine::darknet";
-		ai_engine_t * engine = ai_engine_init(NULL, plugin_name, params);
-		assert(engines);
+		struct ai_model * model = &models[i];
+		model->app = params;
+		model->jconfig = jengine;
 		
-		int rc = engine->init(engine, jengine);
-		assert(0 == rc);
+		// the pinned replicas of all the models get distinct cpus, (as long as there are enough of them)
+		struct ai_engine_pool_params pool_params;
+		ai_engine_pool_params_load(&pool_params, jengine);
+		pool_params.first_cpu = first_cpu;
+		first_cpu += pool_params.num_replicas * pool_params.cpus_per_replica;
 		
-		engines[i] = engine;
+		ai_engine_pool_t * pool = ai_engine_pool_init(model->pool, &pool_params, new_engine_replica, model);
+		assert(pool);
+		printf("engine %d: %d replica(s), max_pending: %d\n", i, pool->num_replicas, pool->max_pending);
 	}
 	params->count = count;
-	params->engines = engines;
+	params->models = models;
 	
 	
 	json_object * jcors = NULL;
@@ -465,19 +538,15 @@ global_param_t * global_param_parse_args(global_param_t * params, int argc, char
 void global_param_cleanup(global_param_t * params)
 {
 	if(NULL == params) return;
-	if(params->count && params->engines)
+	if(params->count && params->models)
 	{
-		ai_engine_t ** engines = params->engines;
+		struct ai_model * models = params->models;
 		for(ssize_t i = 0; i < params->count; ++i)
 		{
-			if(engines[i]) {
-				ai_engine_cleanup(engines[i]);
-				free(engines[i]);
-				engines[i] = NULL;
-			}
+			ai_engine_pool_cleanup(models[i].pool);
 		}
-		free(engines);
-		params->engines = NULL;
+		free(models);
+		params->models = NULL;
 		params->count = 0;
 	}
 	if(params->jconfig) json_object_put(params->jconfig);
@@ -39,6 +39,8 @@
 #include "utils.h"
 #include "video_source_common.h"
 #include "img_proc.h"
+#include "jpeg-encode-service.h"
+#include "img_overlay.h"
 
 #include "motion-jpeg.h"
 
@@ -101,6 +103,12 @@ struct camera_manager
 	pthread_mutex_t frame_mutex;
 	struct video_frame *frame;	// new frame
 	struct video_frame *current_frame;
+	img_overlay_t overlay[1];	// burned-in detections, (main loop only)
+	
+	// the encoder threads may finish out of order: only a newer submission than the last published one is published
+	pthread_mutex_t publish_mutex;
+	long encode_seq;		// main loop only
+	long published_seq;		// publish_mutex
 	
 	// public method
 	struct video_frame *(*set_frame)(struct camera_manager *mgr, struct video_frame *frame);
@@ -128,10 +136,77 @@ static void draw_frame(cairo_t *cr, struct video_frame *frame, double width, dou
 		return;
 	}
 	
-	///< @todo draw ai results
+	// the detections are drawn by draw_detections()
 	return;
 }
 
+static void draw_detections(img_overlay_t *overlay, bgra_image_t *bgra, json_object *jresult)
+{
+	json_object *jdetections = NULL;
+	json_bool ok = json_object_object_get_ex(jresult, "detections", &jdetections);
+	if(!ok || NULL == jdetections) return;
+	
+	int num_detections = json_object_array_length(jdetections);
+	struct img_overlay_label_style style = {
+		.font_size = bgra->height / 30,
+		.bg_color = 0x80000000,
+		.padding = 2,
+	};
+	
+	char label[200] = "";
+	for(int i = 0; i < num_detections; ++i) {
+		json_object *jdet = json_object_array_get_idx(jdetections, i);
+		if(NULL == jdet) continue;
+		
+		int class_index = json_get_value_default(jdet, int, class_index, -1);
+		const char *class_name = json_get_value_default(jdet, string, class, "");
+		double confidence = json_get_value(jdet, double, confidence);
+		
+		int x = json_get_value(jdet, double, left) * bgra->width;
+		int y = json_get_value(jdet, double, top) * bgra->height;
+		int cx = json_get_value(jdet, double, width) * bgra->width;
+		int cy = json_get_value(jdet, double, height) * bgra->height;
+		
+		uint32_t color = (class_index == 0)?0xffffff00:0xff0000ff;
+		overlay->draw_box(overlay, bgra, x, y, cx, cy, 2, color);
+		
+		snprintf(label, sizeof(label), "%s %.2f", class_name, confidence);
+		style.color = color;
+		overlay->draw_label(overlay, bgra, x + 2, y + 2, label, &style, NULL, NULL);
+	}
+}
+
+struct mjpeg_output_context
+{
+	struct camera_manager *mgr;
+	struct motion_jpeg_channel *channel;
+	long frame_number;
+	long seq;	// submission order, (frame numbers restart when the camera switches)
+};
+static void on_mjpeg_frame_encoded(jpeg_encode_job_t *job)
+{
+	// called on an encoder thread, (channel->update_frame() is thread-safe)
+	struct mjpeg_output_context *output = job->user_data;
+	struct camera_manager *mgr = output->mgr;
+	if(job->status == jpeg_encode_job_status_completed) {
+		pthread_mutex_lock(&mgr->publish_mutex);
+		if(output->seq > mgr->published_seq) {	// otherwise: a newer frame is already out
+			size_t length = 0;
+			unsigned char *jpeg = jpeg_encode_job_take_data(job, &length);
+			struct video_frame *frame = video_frame_new(output->frame_number, job->image->width, job->image->height,
+				jpeg, length, 
+				1 // move memory ( jpeg  ==> frame->data ) 
+			);
+			frame->type = video_frame_type_jpeg;
+			output->channel->update_frame(output->channel, frame);
+			output->channel->unref_frame(output->channel, frame);
+			mgr->published_seq = output->seq;
+		}
+		pthread_mutex_unlock(&mgr->publish_mutex);
+	}
+	free(output);
+}
+
 static void upload_finished(SoupSession *session, SoupMessage *msg, gpointer user_data)
 {
 	struct camera_manager *mgr = user_data;
@@ -175,19 +250,24 @@ static void upload_finished(SoupSession *session, SoupMessage *msg, gpointer use
 			cairo_destroy(cr);
 			cairo_surface_destroy(surface);
 		}
+		if(jresult) draw_detections(mgr->overlay, bgra, jresult);
 		
 		
 		struct motion_jpeg_channel *channel = mgr->channel;
 		if(channel) {
-			struct video_frame *frame = calloc(1, sizeof(*frame));
-			++frame->refs;
-			frame->width = bgra->width;
-			frame->height = bgra->height;
-			frame->length = bgra_image_to_jpeg_stream(bgra, &frame->data, 95);
-			frame->type = video_frame_type_jpeg;
-			frame->frame_number = current_frame->frame_number;
-			channel->update_frame(channel, frame);
-			channel->unref_frame(channel, frame);
+			// encode on the shared encoder threads, the main loop doesn't wait for it (dropped if the encoders are busy)
+			struct mjpeg_output_context *output = calloc(1, sizeof(*output));
+			assert(output);
+			output->mgr = mgr;
+			output->channel = channel;
+			output->frame_number = current_frame->frame_number;
+			output->seq = ++mgr->encode_seq;
+			
+			struct bgra_image_jpeg_options options = { .quality = 95 };
+			jpeg_encode_service_t *encoder = jpeg_encode_service_get_default();
+			int rc = encoder->submit(encoder, bgra, &options, jpeg_encode_flag_adopt_image, 
+				on_mjpeg_frame_encoded, output, NULL);
+			if(rc) free(output);
 		}
 		bgra_image_clear(bgra);
 	}
@@ -312,6 +392,8 @@ struct camera_manager *camera_manager_new_from_config(const char *conf_file, voi
 	rc = pthread_mutex_init(&mgr->cond_mutex.mutex, NULL);
 	rc = pthread_cond_init(&mgr->cond_mutex.cond, NULL);
 	rc = pthread_mutex_init(&mgr->frame_mutex, NULL);
+	rc = pthread_mutex_init(&mgr->publish_mutex, NULL);
+	img_overlay_init(mgr->overlay, NULL, mgr);
 	
 	mgr->interval = 10; // default switch interval: 10 seconds
 	
@@ -565,6 +647,8 @@ void camera_manager_free(struct camera_manager *mgr)
 	pthread_cond_destroy(&mgr->cond_mutex.cond);
 	pthread_mutex_destroy(&mgr->cond_mutex.mutex);
 	pthread_mutex_destroy(&mgr->frame_mutex);
+	pthread_mutex_destroy(&mgr->publish_mutex);
+	img_overlay_cleanup(mgr->overlay);
 	
 	free(mgr);
 	return;
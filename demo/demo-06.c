@@ -247,6 +247,8 @@ static gboolean on_timeout(shell_context_t * shell)
 	
 	shell->frame_number = frame_number;
 	if(shell->horz_flip) {
+		// the payload is shared with the other readers: flip a private copy, (released by input_frame_clear())
+		input_frame_make_writable(frame);
 		uint32_t * bgra = (uint32_t *)frame->data;
 		for(int row = 0; row < frame->height; ++row) {
 			for(int col = 0; col < (frame->width / 2); ++col) {
@@ -122,7 +122,7 @@ case ${target} in
 			-DTEST_STREAMING_PROXY_ -D_STAND_ALONE \
 			${CFLAGS} \
 			-o test_streaming-proxy streaming-proxy.c \
-			../utils/video_source_common.c ../utils/img_proc.c ../utils/utils.c \
+			../utils/video_source_common.c ../utils/img_proc.c ../utils/frame-pool.c ../utils/utils.c \
 			 -lm -lpthread -ljson-c -ljpeg -lpng -lcairo -ldl \
 			`pkg-config --libs --cflags gio-2.0 glib-2.0 gtk+-3.0 gstreamer-1.0 gstreamer-app-1.0 libsoup-2.4`
 		;;
@@ -132,7 +132,7 @@ case ${target} in
             
     camera-switch)
         gcc -std=gnu99 -g -Wall -D_DEBUG -I../include -o camera-switch camera-switch.c \
-            ../utils/video_source_common.c ../utils/img_proc.c \
+            ../utils/video_source_common.c ../utils/img_proc.c ../utils/frame-pool.c ../utils/jpeg-encode-service.c ../utils/job-queue.c ../utils/img_overlay.c \
             -lm -lpthread -lcurl -ljpeg -lcairo $(pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gio-2.0 libsoup-2.4) -ljson-c
             ;;
 
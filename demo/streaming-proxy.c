@@ -58,31 +58,30 @@ static inline int64_t get_time_ms(clockid_t clock_id)
 
 static struct video_frame * channel_get_frame(struct channel_context *channel)
 {
-	pthread_mutex_lock(&channel->mutex);
-	struct video_frame *frame = channel->frame;
-	if(frame) video_frame_addref(frame);
-	pthread_mutex_unlock(&channel->mutex);
-	return frame;
+	return video_frame_slot_acquire(channel->frame);
+}
+
+static struct video_frame * channel_wait_frame(struct channel_context *channel, long prev_frame, long timeout_ms)
+{
+	return video_frame_slot_wait(channel->frame, prev_frame, timeout_ms);
 }
 
 static void channel_unref_frame(struct channel_context *channel, struct video_frame *frame)
 {
 	if(NULL == frame) return;
-	pthread_mutex_lock(&channel->mutex);
 	video_frame_unref(frame);
-	pthread_mutex_unlock(&channel->mutex);
 	return;
 }
 
 static long channel_update_frame(struct channel_context *channel, const void *jpeg_data, size_t length)
 {
-	long frame_number = channel->frame_number++;
+	// header-only check, drop frames which are not jpeg or were cut off
+	struct img_utils_image_info info[1];
+	int rc = img_utils_probe(jpeg_data, length, info);
+	if(rc || info->type != img_utils_image_type_jpeg || info->truncated) return -1;
 	
-	int width = -1, height = -1;
-	int rc = img_utils_get_jpeg_size(jpeg_data, length, &width, &height);
-	if(rc || width <= 0 || height <= 0) return -1;
-	
-	struct video_frame *frame = video_frame_new(frame_number, width, height, jpeg_data, length, 0);
+	long frame_number = channel->frame_number++;
+	struct video_frame *frame = video_frame_new(frame_number, info->width, info->height, jpeg_data, length, 0);
 	assert(frame);
 	frame->type = video_frame_type_jpeg;
 	
@@ -91,13 +90,11 @@ static long channel_update_frame(struct channel_context *channel, const void *jp
 		channel->begin_timestamp_ms = get_time_ms(CLOCK_REALTIME);
 	}
 	
-	pthread_mutex_lock(&channel->mutex);
-	struct video_frame *old_frame = channel->frame;
-	channel->frame = frame;
-	if(old_frame) video_frame_unref(old_frame);
-	pthread_mutex_unlock(&channel->mutex);
+	// keep a reference for on_new_frame(), the slot may be republished by then
+	video_frame_slot_publish(channel->frame, video_frame_addref(frame));
 	
 	if(channel->on_new_frame) channel->on_new_frame(channel, frame, channel->user_data);
+	video_frame_unref(frame);
 	return frame_number;
 }
 
@@ -111,7 +108,9 @@ struct channel_context *channel_context_new(struct streaming_proxy_context *prox
 	channel->id = id;
 	
 	pthread_mutex_init(&channel->mutex, NULL);
+	video_frame_slot_init(channel->frame);
 	channel->get_frame = channel_get_frame;
+	channel->wait_frame = channel_wait_frame;
 	channel->update_frame = channel_update_frame;
 	channel->unref_frame = channel_unref_frame;
 	
@@ -119,7 +118,10 @@ struct channel_context *channel_context_new(struct streaming_proxy_context *prox
 }
 void channel_context_free(struct channel_context *channel)
 {
-	
+	if(NULL == channel) return;
+	video_frame_slot_cleanup(channel->frame);
+	pthread_mutex_destroy(&channel->mutex);
+	free(channel);
 }
 
 
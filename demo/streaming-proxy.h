@@ -23,13 +23,14 @@ struct channel_context
 	pthread_mutex_t mutex;
 	
 	struct framerate_fraction framerate;
-	struct video_frame *frame;
+	struct video_frame_slot frame[1];	// latest frame
 	long frame_number;
 	int64_t begin_ticks_ms;
 	int64_t begin_timestamp_ms;
 	
 	// public methods
 	struct video_frame * (*get_frame)(struct channel_context *channel);
+	struct video_frame * (*wait_frame)(struct channel_context *channel, long prev_frame, long timeout_ms); // NULL on timeout
 	void (*unref_frame)(struct channel_context *channel, struct video_frame *frame);
 	long (*update_frame)(struct channel_context *channel, const void *jpeg_data, size_t length);
 	
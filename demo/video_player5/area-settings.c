@@ -41,6 +41,7 @@
 
 #include "area-settings.h"
 #include "utils.h"
+#include "img_proc.h"
 
 static const int s_masks_width = 320;
 static const int s_masks_height = 240;
@@ -360,7 +361,27 @@ static void generate_area_masks(struct area_settings_dialog * settings)
 	}
 	cairo_destroy(cr);
 	cairo_surface_mark_dirty(masks);
-	cairo_surface_write_to_png(masks, "masks.png");
+	cairo_surface_flush(masks);
+	
+	// the masks are gray levels: 8-bit gray, rle
+	bgra_image_t image[1] = {{
+		.data = cairo_image_surface_get_data(masks),
+		.width = s_masks_width, .height = s_masks_height,
+		.channels = 4,
+		.stride = cairo_image_surface_get_stride(masks),
+	}};
+	struct bgra_image_png_options options;
+	bgra_image_png_options_init(&options, bgra_image_png_preset_fastest, bgra_image_png_format_gray);
+	unsigned char * png = NULL;
+	ssize_t cb_png = bgra_image_to_png_stream_ex(image, &png, &options);
+	if(cb_png > 0) {
+		FILE * fp = fopen("masks.png", "wb");
+		if(fp) {
+			fwrite(png, 1, cb_png, fp);
+			fclose(fp);
+		}
+	}
+	free(png);
 	return;
 }
 
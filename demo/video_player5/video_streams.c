@@ -31,9 +31,12 @@
 
 #include "utils.h"
 #include "video_streams.h"
+#include "motion-gate.h"
 
 struct streaming_proxy_context *app_get_streaming_proxy(struct app_context *app);
 
+#define VIDEO_STREAM_WAIT_TIMEOUT_MS (100)
+
 static long video_stream_get_frame(struct video_stream *stream, long prev_frame, input_frame_t *input)
 {
 	pthread_rwlock_rdlock(&stream->rwlock);
@@ -83,6 +86,110 @@ static void swap_frame_buffer(struct video_stream *stream)
 }
 
 
+/*
+ * cv_face: the "faces" of the frame are added to its result,
+ *   (the viewer's face masking, and the privacy mask when it selects the "face" class)
+ */
+static void video_stream_detect_faces(struct video_stream *stream, struct video_frame *frame)
+{
+	ai_engine_t *dnn_face = stream->cv_face;
+	input_frame_t input[1];
+	memset(input, 0, sizeof(input));
+	input->type = frame->type;
+	input->data = frame->data;
+	input->length = frame->length;
+	input->width = frame->width;
+	input->height = frame->height;
+	
+	json_object *jface_dets = NULL;
+	int rc = dnn_face->predict(dnn_face, input, &jface_dets);
+	if(rc || NULL == jface_dets) {
+		if(jface_dets) json_object_put(jface_dets);
+		return;
+	}
+	
+	json_object *jfaces = NULL;
+	json_bool ok = json_object_object_get_ex(jface_dets, "detections", &jfaces);
+	if(ok && jfaces) {
+		json_object *jresult = frame->meta_data;
+		if(NULL == jresult) { // generate default
+			jresult = json_object_new_object();
+			json_object_object_add(jresult, "model", json_object_new_string("yolo+face"));
+			json_object_object_add(jresult, "detections", json_object_new_array());
+			frame->meta_data = jresult;
+		}
+		json_object_object_add(jresult, "faces", json_object_get(jfaces));
+	}
+	json_object_put(jface_dets);
+}
+
+static int privacy_mask_needs_faces(const struct img_privacy_mask *mask)
+{
+	if(NULL == mask) return 0;
+	if(mask->params->num_classes <= 0) return 1;
+	for(int i = 0; i < mask->params->num_classes; ++i) {
+		if(strcasecmp(mask->params->classes[i], "face") == 0) return 1;
+	}
+	return 0;
+}
+
+/*
+ * privacy mask: the masked copy replaces the frame before it is published, (viewers, the output channel of the proxy)
+ *   the frame of the channel is shared with the other readers of the proxy, it is never modified in place.
+ *   return -1 if the frame could not be masked, (the caller drops it)
+ */
+static int video_stream_apply_privacy_mask(struct video_stream *stream)
+{
+	img_privacy_mask_t *mask = stream->privacy_mask;
+	struct video_frame *frame = stream->frame_buffer[1];
+	assert(mask && frame);
+	json_object *jresult = frame->meta_data;
+	
+	struct channel_context *output = NULL;
+	if(stream->privacy_mask_channel) {
+		output = stream->proxy->find_or_register_channel(stream->proxy, stream->privacy_mask_channel, NULL);
+	}
+	
+	if(frame->type == video_frame_type_jpeg && mask->count_targets(mask, jresult) <= 0) {
+		// nothing to hide: no decoding / re-encoding
+		if(output) output->update_frame(output, frame->data, frame->length);
+		return 0;
+	}
+	
+	bgra_image_t *image = stream->privacy_mask_image;
+	int rc = -1;
+	if(frame->type == video_frame_type_jpeg) {
+		rc = bgra_image_from_jpeg_stream(image, frame->data, frame->length);
+	}else if(frame->type == video_frame_type_bgra) {
+		rc = (NULL == bgra_image_init(image, frame->width, frame->height, frame->data));
+	}
+	if(rc) {
+		fprintf(stderr, "[ERROR]::%s(): unable to decode frame %ld, (type=%d)\n", __FUNCTION__, frame->frame_number, frame->type);
+		return -1;
+	}
+	
+	mask->apply(mask, image, jresult);
+	
+	unsigned char *jpeg = NULL;
+	ssize_t cb_jpeg = bgra_image_to_jpeg_stream(image, &jpeg, stream->privacy_mask_quality);
+	if(cb_jpeg <= 0 || NULL == jpeg) {
+		fprintf(stderr, "[ERROR]::%s(): unable to encode frame %ld\n", __FUNCTION__, frame->frame_number);
+		return -1;
+	}
+	
+	struct video_frame *masked = video_frame_new(frame->frame_number, image->width, image->height, jpeg, cb_jpeg, 1);
+	assert(masked);
+	masked->type = video_frame_type_jpeg;
+	masked->meta_data = frame->meta_data;
+	frame->meta_data = NULL;
+	
+	stream->frame_buffer[1] = masked;
+	video_frame_unref(frame);
+	
+	if(output) output->update_frame(output, masked->data, masked->length);
+	return 0;
+}
+
 static void * video_stream_thread(void *user_data)
 {
 	int rc = 0;
@@ -101,8 +208,6 @@ static void * video_stream_thread(void *user_data)
 			continue;
 		}
 		
-		int sleep_flags = 1;
-		
 		struct streaming_proxy_context *proxy = stream->proxy;
 		assert(proxy);
 		
@@ -123,12 +228,16 @@ static void * video_stream_thread(void *user_data)
 			}
 			channel->unref_frame(channel, frame);
 		}
-		frame = channel->get_frame(channel);
-		if(NULL == frame || NULL == frame->data || stream->frame_number >= frame->frame_number) {
+		// wake up as soon as a new frame is published, the timeout only bounds the quit / paused checks
+		frame = channel->wait_frame(channel, stream->frame_number, VIDEO_STREAM_WAIT_TIMEOUT_MS);
+		if(NULL == frame || NULL == frame->data || stream->frame_number == frame->frame_number) {
 			if(frame) channel->unref_frame(channel, frame);
-			nanosleep(&interval, NULL);
 			continue;
 		}
+		// the source was restarted, (its frame numbers start over): resync instead of waiting for the old number
+		if(frame->frame_number < stream->frame_number) {
+			debug_printf("%s(): frame number dropped: %ld ==> %ld, resync", __FUNCTION__, stream->frame_number, frame->frame_number);
+		}
 		stream->frame_buffer[1] = frame;
 		stream->frame_number = frame->frame_number;
 
@@ -149,41 +258,54 @@ static void * video_stream_thread(void *user_data)
 			input->height = frame->height;
 			
 			if(ai->enabled) {
+				struct motion_gate_result motion = { .triggered = 1 };
+				json_object *jmotion = NULL;
+				if(stream->motion_gate) {
+					motion_gate_t *gate = stream->motion_gate;
+					if(frame->type == video_frame_type_jpeg) {
+						gate->update_jpeg(gate, frame->data, frame->length, 0, &motion);
+					}else if(frame->type == video_frame_type_bgra) {
+						bgra_image_t image = { .data = frame->data, .width = frame->width, .height = frame->height, .channels = 4 };
+						gate->update_bgra(gate, &image, 0, &motion);
+					}
+					jmotion = motion_gate_result_to_json(&motion);
+				}
+				
+				if(motion.triggered) {
+					input->meta_data = jmotion;	// the engines may use the score, (borrowed)
+					pthread_mutex_lock(&ai->mutex);
+					rc = ai->engine->predict(ai->engine, input, &jresult);
+					pthread_mutex_unlock(&ai->mutex);
+					input->meta_data = NULL;
+					
+					if(stream->motion_gate) {
+						if(stream->last_result) json_object_put(stream->last_result);
+						stream->last_result = jresult?json_object_get(jresult):NULL;
+					}
+				}else if(stream->last_result) {
+					// unchanged scene: reuse the detections of the last inference
+					jresult = json_object_new_object();
+					json_object_object_foreach(stream->last_result, key, value) {
+						json_object_object_add(jresult, key, json_object_get(value));
+					}
+				}
 				
-				pthread_mutex_lock(&ai->mutex);
-				rc = ai->engine->predict(ai->engine, input, &jresult);
-				pthread_mutex_unlock(&ai->mutex);
 				if(jresult) {
+					if(jmotion) json_object_object_add(jresult, "motion", json_object_get(jmotion));
 					frame->meta_data = jresult;	
-					sleep_flags = 0;
 				}
+				if(jmotion) json_object_put(jmotion);
 			}
-			//~ if(stream->face_masking_flag && stream->cv_face) {
-				//~ ai_engine_t *dnn_face = stream->cv_face;
-				//~ json_object *jface_dets = NULL;
-				//~ rc = dnn_face->predict(dnn_face, input, &jface_dets);
-				//~ if(jface_dets) {
-					//~ json_object *jfaces = NULL;
-					//~ json_bool ok = json_object_object_get_ex(jface_dets, "detections", &jfaces);
-					//~ if(ok && jfaces) {
-						//~ if(NULL == jresult) { // generate default 
-							//~ jresult = json_object_new_object();
-							//~ json_object_object_add(jresult, "model", json_object_new_string("yolo+face"));
-							//~ json_object_object_add(jresult, "detections", json_object_new_array());
-						//~ }
-						//~ assert(jresult);
-						//~ json_object_object_add(jresult, "faces", json_object_get(jfaces));
-					//~ }
-					//~ json_object_put(jface_dets);
-				//~ }
-				//~ if(0 == rc && jresult) {
-					//~ frame->meta_data = jresult;	
-					//~ sleep_flags = 0;
-				//~ }
-			//~ }
+		}
+		
+		if(stream->cv_face && (stream->face_masking_flag || privacy_mask_needs_faces(stream->privacy_mask))) {
+			video_stream_detect_faces(stream, frame);
+		}
+		if(stream->privacy_mask && video_stream_apply_privacy_mask(stream)) {
+			// a frame that could not be masked is never published
+			continue;
 		}
 		swap_frame_buffer(stream);
-		if(sleep_flags) nanosleep(&interval, NULL);
 		
 	}
 	
@@ -247,6 +369,26 @@ static int video_stream_load_config(struct video_stream *stream, json_object *js
 	stream->detection_mode = json_get_value(jstream, int, detection_mode);
 	stream->alert_server_url = json_get_value(jstream, string, alert_server_url);
 	
+	json_object *jmotion_gate = NULL;
+	ok = json_object_object_get_ex(jstream, "motion_gate", &jmotion_gate);
+	if(ok && jmotion_gate) {
+		struct motion_gate_params params[1];
+		motion_gate_params_load(params, jmotion_gate);
+		if(params->enabled) stream->motion_gate = motion_gate_init(NULL, params, stream);
+	}
+	
+	json_object *jprivacy_mask = NULL;
+	ok = json_object_object_get_ex(jstream, "privacy_mask", &jprivacy_mask);
+	if(ok && jprivacy_mask) {
+		struct img_privacy_mask_params params[1];
+		img_privacy_mask_params_load(params, jprivacy_mask);
+		if(params->enabled) {
+			stream->privacy_mask = img_privacy_mask_init(NULL, params, stream);
+			stream->privacy_mask_quality = json_get_value_default(jprivacy_mask, int, jpeg_quality, 90);
+			stream->privacy_mask_channel = json_get_value(jprivacy_mask, string, output_channel);
+		}
+	}
+	
 	int num_ai_engines = 0;
 	ok = json_object_object_get_ex(jstream, "ai-engines", &jai_engines);
 	if(ok && jai_engines) num_ai_engines = json_object_array_length(jai_engines);
@@ -322,4 +464,19 @@ void video_stream_cleanup(struct video_stream *stream)
 		(long)stream->th,
 		(long)(intptr_t)exit_code);
 	
+	if(stream->motion_gate) {
+		motion_gate_cleanup(stream->motion_gate);
+		free(stream->motion_gate);
+		stream->motion_gate = NULL;
+	}
+	if(stream->last_result) {
+		json_object_put(stream->last_result);
+		stream->last_result = NULL;
+	}
+	if(stream->privacy_mask) {
+		img_privacy_mask_cleanup(stream->privacy_mask);
+		free(stream->privacy_mask);
+		stream->privacy_mask = NULL;
+	}
+	bgra_image_clear(stream->privacy_mask_image);
 }
@@ -16,6 +16,7 @@ extern "C" {
 #include "cv-wrapper.h"
 #include "video_source_common.h"
 #include "streaming-proxy.h"
+#include "img_privacy_mask.h"
 
 
 struct video_stream
@@ -57,6 +58,14 @@ struct video_stream
 	int detection_mode;
 	
 	const char *alert_server_url;
+	
+	struct motion_gate *motion_gate;	// nullable, "motion_gate": { "enabled": 1, ... }
+	json_object *last_result;			// detections of the last inference, reused while the scene is unchanged
+	
+	struct img_privacy_mask *privacy_mask;	// nullable, "privacy_mask": { "enabled": 1, ... }, (see img_privacy_mask.h)
+	int privacy_mask_quality;				// jpeg quality of the masked frames, "jpeg_quality", default: 90
+	const char *privacy_mask_channel;		// nullable, "output_channel": the masked frames are republished to this proxy channel
+	bgra_image_t privacy_mask_image[1];		// the decoded frame, (reused)
 };
 
 struct video_stream *video_stream_init(struct video_stream *stream, json_object *jstream, struct app_context *app);
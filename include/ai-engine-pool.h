@@ -0,0 +1,119 @@
+#ifndef _AI_ENGINE_POOL_H_
+#define _AI_ENGINE_POOL_H_
+
+#include <stdio.h>
+#include <json-c/json.h>
+#include "ai-engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ai engine pool: num_replicas instances of the same model, each one owned by its own worker thread,
+ *   the requests are queued (bounded, max_pending) and picked up by whichever replica is free.
+ *
+ * replicas:
+ *   created by new_replica() on their worker thread, after the thread has been pinned to its cpus,
+ *   (the network weights / workspace are first touched by the cpus that use them),
+ *   released with ai_engine_cleanup() + free() on the same thread.
+ *   new_replica() calls are serialized, (plugins / json configs are not thread-safe)
+ *
+ * batching: a free replica takes up to engine->max_batch_size pending jobs at once, (engine->predict_batch()),
+ *   it never waits for a batch to fill up.
+ *
+ * results: as a future (p_job, ai_engine_job_wait()) and/or a callback (on_completed, called on the worker thread)
+ */
+
+enum ai_engine_job_status
+{
+	ai_engine_job_status_cancelled = -2,	// the pool was stopped before the job started
+	ai_engine_job_status_failed = -1,		// predict_batch() failed, (no detections: completed, jresult == NULL)
+	ai_engine_job_status_pending = 0,
+	ai_engine_job_status_completed = 1,
+};
+
+enum ai_engine_pool_flags
+{
+	ai_engine_pool_flag_wait_if_full = 1,	// block until there is room in the queue, (default: drop)
+};
+
+typedef struct ai_engine_job
+{
+	void * user_data;
+	input_frame_t frame[1];		// shares the payload of the submitted frame, (read-only)
+	void (* on_completed)(struct ai_engine_job * job);	// nullable, called on the worker thread
+
+	// results, valid once status != pending
+	int status;					// enum ai_engine_job_status
+	json_object * jresult;		// nullable, (no detections), released with the job unless taken by ai_engine_job_take_result()
+	int replica_index;
+	int batch_size;				// the number of frames of the forward pass
+	double queued_time;			// seconds, submit() ==> a replica picks it up
+	double predict_time;		// seconds
+}ai_engine_job_t;
+
+int ai_engine_job_wait(ai_engine_job_t * job, long timeout_ms);	// timeout_ms < 0: infinite; return job->status (pending on timeout)
+json_object * ai_engine_job_take_result(ai_engine_job_t * job);	// release with json_object_put()
+void ai_engine_job_unref(ai_engine_job_t * job);
+
+
+struct ai_engine_pool_params
+{
+	int num_replicas;		// default: 1
+	int max_pending;		// 0: (num_replicas * max_batch_size * 2)
+	int cpus_per_replica;	// 0: no pinning; replica i runs on cpus [first_cpu + i * cpus_per_replica, +cpus_per_replica), (modulo the online cpus)
+	int first_cpu;
+};
+
+/*
+ * config: (per model)
+ *   { ..., "replicas": 1, "cpus_per_replica": 0, "max_pending": 0 }
+ * first_cpu is left to the caller, (several pools share the same cpus)
+ */
+void ai_engine_pool_params_load(struct ai_engine_pool_params * params, json_object * jconfig);	// jconfig: nullable, (defaults)
+
+struct ai_engine_pool_stats
+{
+	long submitted;
+	long completed;
+	long failed;
+	long dropped;		// queue full
+	long cancelled;
+	long pending;		// queued, not yet started
+	long batches;		// forward passes
+	double predict_time;	// seconds, total of the forward passes
+};
+
+typedef struct ai_engine_pool
+{
+	void * user_data;
+	void * priv;
+	int num_replicas;		// the replicas that were created successfully
+	int max_pending;
+
+	/*
+	 * submit():
+	 *   frame: shared with input_frame_ref(), (no copy if the frame already holds a payload, see input_frame_share())
+	 *   p_job: nullable, receives a reference to the job, release it with ai_engine_job_unref()
+	 * return 0 on success, -1 if the queue is full or the pool is stopped
+	 */
+	int (* submit)(struct ai_engine_pool * pool, const input_frame_t * frame, int flags,
+		void (* on_completed)(ai_engine_job_t * job), void * user_data,
+		ai_engine_job_t ** p_job);
+	void (* get_stats)(struct ai_engine_pool * pool, struct ai_engine_pool_stats * stats);
+}ai_engine_pool_t;
+
+/*
+ * new_replica(): called on the worker thread of replica 'index', return NULL on failure
+ * return NULL if no replica could be created
+ */
+ai_engine_pool_t * ai_engine_pool_init(ai_engine_pool_t * pool, const struct ai_engine_pool_params * params,
+	ai_engine_t * (* new_replica)(struct ai_engine_pool * pool, int index),
+	void * user_data);
+void ai_engine_pool_cleanup(ai_engine_pool_t * pool);	// cancels the pending jobs, waits for the running ones
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -67,10 +67,20 @@ typedef struct ai_engine
 
 	// public member functions
 	ai_tensor_t * (* get_workspace)(struct ai_engine * engine);		// pre-allocated global memory (GPU or CPU)
+	
+	/*
+	 * predict_batch(): frames[count] ==> results[count], (results[i]: NULL if frames[i] has no detections or failed)
+	 *   max_batch_size: frames per forward pass, (1: no native batching), larger batches are split by the plugin.
+	 *   plugins without a native implementation keep ai_engine_predict_batch_default(), (a loop over predict())
+	 *   return 0, or -1 on invalid arguments
+	 */
+	int max_batch_size;
+	int (* predict_batch)(struct ai_engine * engine, const input_frame_t ** frames, int count, json_object ** results);
 }ai_engine_t;
 
 ai_engine_t * ai_engine_init(ai_engine_t * engine, const char * plugin_type, void * user_data);
 void ai_engine_cleanup(ai_engine_t * engine);
+int ai_engine_predict_batch_default(ai_engine_t * engine, const input_frame_t ** frames, int count, json_object ** results);
 
 #ifdef __cplusplus
 }
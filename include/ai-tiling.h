@@ -0,0 +1,74 @@
+#ifndef _AI_TILING_H_
+#define _AI_TILING_H_
+
+#include <stdio.h>
+#include <json-c/json.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ai tiling: run a detector on overlapping tiles of a high-resolution frame,
+ *   instead of squeezing the whole frame into the network input.
+ *
+ *   layout: the frame is covered by cols x rows tiles (default: network-sized), neighbours share 'overlap' of a tile,
+ *     the tiles are spread evenly, (the first and the last tile touch the frame borders).
+ *     if that needs more than max_tiles, the tiles grow (and get downscaled by the engine) until they fit.
+ *     global_view: one more tile with the whole frame, (large objects that no tile contains)
+ *
+ *   merge: the boxes of all the tiles (in frame coordinates) are merged per class, by descending confidence:
+ *     - iou >= nms: a duplicate, dropped;
+ *     - from different tiles, and the intersection covers >= merge_ios of the smaller box:
+ *       the same object cut by a seam, merged into the union of both boxes.
+ *
+ * engine config:
+ *   "tiling": { "enabled": 1, "tile_width": 0, "tile_height": 0, "cols": 0, "rows": 0,
+ *               "overlap": 0.2, "global_view": 1, "max_tiles": 16, "nms": 0.5, "merge_ios": 0.8 }
+ */
+struct ai_tiling_params
+{
+	int enabled;
+	int tile_width, tile_height;	// frame pixels, 0: the network size
+	int cols, rows;					// > 0: fixed grid, (tile_width / tile_height are derived from the frame size)
+	double overlap;					// 0 ~ 0.9, ratio of the tile size, default: 0.2
+	int global_view;				// default: 1
+	int max_tiles;					// including the global view, default: 16
+	double nms;						// iou threshold, default: 0.5
+	double merge_ios;				// intersection over the smaller box, (cross-tile only), default: 0.8, (<= 0: disabled)
+};
+void ai_tiling_params_load(struct ai_tiling_params * params, json_object * jconfig);	// jconfig: nullable, (defaults)
+
+struct ai_tile
+{
+	int x, y, width, height;	// frame pixels
+	int is_global;
+};
+
+/*
+ * ai_tiling_layout():
+ *   net_width / net_height: the default tile size
+ *   return the number of tiles, (1 if the frame fits into a single tile: no tiling needed)
+ */
+ssize_t ai_tiling_layout(const struct ai_tiling_params * params, int frame_width, int frame_height,
+	int net_width, int net_height, struct ai_tile * tiles, ssize_t max_tiles);
+
+struct ai_tiling_box
+{
+	float x, y, cx, cy;		// left, top, width, height, frame coordinates (any unit, the same for all the boxes)
+	float confidence;
+	int klass;
+	int tile_index;
+	ssize_t index;			// the caller's index, (e.g. into its own results)
+};
+
+/*
+ * ai_tiling_merge(): in-place, the kept boxes are moved to the front, (by descending confidence)
+ *   return the number of kept boxes
+ */
+ssize_t ai_tiling_merge(const struct ai_tiling_params * params, struct ai_tiling_box * boxes, ssize_t count);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,24 +1,69 @@
 #ifndef _AUTO_BUFFER_H_
 #define _AUTO_BUFFER_H_
 
+#include <stdio.h>
+#include <sys/uio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+enum auto_buffer_mode
+{
+	auto_buffer_mode_linear = 0,	// default: contiguous, grows with realloc()
+	auto_buffer_mode_ring = 1,		// fixed capacity (max_size), push fails when there's not enough space
+	auto_buffer_mode_iovec = 2,		// chain of chunks, auto_buffer_push_ref() appends without copying
+};
+
+typedef struct auto_buffer_chunk
+{
+	unsigned char * data;
+	ssize_t length;
+	void (* release)(void * user_data, unsigned char * data);	// called when the chunk is consumed, NULL: not owned
+	void * user_data;
+}auto_buffer_chunk_t;
+
+/*
+ * auto_buffer:
+ *   linear: [cur_pos, length) is pending, data is contiguous and '\0' terminated,
+ *     compact: opt-in, a pop moves the pending data to the front once 64K have been consumed,
+ *       (a partially drained stream stops growing, but offsets into data and auto_buffer_seek() don't survive a pop)
+ *   ring:   length bytes are pending, starting at data[cur_pos], (may wrap around)
+ *   iovec:  length bytes are pending, starting at chunks[first_chunk].data + cur_pos
+ */
 typedef struct auto_buffer
 {
 	unsigned char * data;
 	ssize_t max_size;
 	ssize_t length;
 	ssize_t cur_pos;
+
+	enum auto_buffer_mode mode;
+	int compact;	// linear mode only, (default: 0)
+	ssize_t max_chunks;
+	ssize_t num_chunks;
+	ssize_t first_chunk;
+	auto_buffer_chunk_t * chunks;
 }auto_buffer_t;
 
 auto_buffer_t * auto_buffer_init(auto_buffer_t * buf, ssize_t max_size);
+auto_buffer_t * auto_buffer_init_ex(auto_buffer_t * buf, enum auto_buffer_mode mode, ssize_t max_size);
 void auto_buffer_cleanup(auto_buffer_t * buf);
 int auto_buffer_resize(auto_buffer_t * buf, ssize_t new_size);
 ssize_t auto_buffer_push_data(auto_buffer_t * buf, const void * data, ssize_t length);
 ssize_t auto_buffer_peek_data(auto_buffer_t * buf, void * data, ssize_t length);
-ssize_t auto_buffer_pop_data(auto_buffer_t * buf, void * data, ssize_t length);
+ssize_t auto_buffer_pop_data(auto_buffer_t * buf, void * data, ssize_t length);	// data == NULL: discard
+void auto_buffer_reset(auto_buffer_t * buf);
+ssize_t auto_buffer_get_length(const auto_buffer_t * buf);	// pending bytes, (all modes)
+
+// iovec mode only: append a reference to an external buffer, release(user_data, data) is called once it's consumed
+ssize_t auto_buffer_push_ref(auto_buffer_t * buf, unsigned char * data, ssize_t length,
+	void (* release)(void * user_data, unsigned char * data), void * user_data);
+
+// scatter-gather access to the pending data, (all modes)
+int auto_buffer_get_iovec(const auto_buffer_t * buf, struct iovec * iov, int max_iov);
+ssize_t auto_buffer_writev(auto_buffer_t * buf, int fd);	// write pending data to fd and pop what was written
+
 #define auto_buffer_seek(buf, offset, whence) do { switch(whence) { \
 		case SEEK_SET: buf->cur_pos = offset; break;		\
 		case SEEK_CUR: buf->cur_pos += offset; break;		\
@@ -28,8 +73,6 @@ ssize_t auto_buffer_pop_data(auto_buffer_t * buf, void * data, ssize_t length);
 		if(buf->cur_pos > buf->length) buf->length = buf->cur_pos; \
 	} while(0)
 
-#define auto_buffer_reset(buf)	do { buf->cur_pos = 0; buf->length = 0; } while(0)
-
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,61 @@
+#ifndef _FRAME_POOL_H_
+#define _FRAME_POOL_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @ingroup frame_pool
+ * @{
+ */
+
+#define FRAME_POOL_ALIGNMENT			(64)
+#define FRAME_POOL_DEFAULT_CACHE_SIZE	(256 * 1024 * 1024)
+
+/*
+ * frame_pool:
+ *   recycles image buffers keyed by (width, height, format, capacity).
+ *   format: enum frame_pool_format, (the same values as input_frame_type / video_frame_type, image part only)
+ *
+ *   A pooled buffer MUST be returned with frame_pool_release(), never with free():
+ *   the pool keeps tracking it, and a later allocation at the same address would match the stale entry.
+ *   frame_pool_release() accepts any heap pointer, unknown pointers are passed to free().
+ */
+enum frame_pool_format
+{
+	frame_pool_format_unknown = 0,
+	frame_pool_format_bgra = 1,		// input_frame_type_bgra
+	frame_pool_format_jpeg = 2,		// input_frame_type_jpeg, (compressed: variable length)
+	frame_pool_format_png = 3,		// input_frame_type_png, (compressed: variable length)
+};
+
+struct frame_pool_stats
+{
+	long hits;
+	long misses;
+	long buffers_in_use;
+	long buffers_cached;
+	ssize_t bytes_in_use;
+	ssize_t bytes_cached;
+	ssize_t max_cached_bytes;
+};
+
+void * frame_pool_alloc(int width, int height, int format, size_t capacity);
+void * frame_pool_reserve(void * data, int width, int height, int format, size_t capacity);	// like realloc(), but the content is NOT preserved
+void frame_pool_release(void * data);
+size_t frame_pool_get_capacity(const void * data);	// 0: not a pooled buffer
+
+void frame_pool_set_max_cached_bytes(ssize_t max_cached_bytes);
+void frame_pool_get_stats(struct frame_pool_stats * stats);
+void frame_pool_trim(void);		// free all cached buffers
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,83 @@
+#ifndef _IMG_OVERLAY_H_
+#define _IMG_OVERLAY_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "img_proc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * img_overlay: burned-in annotations (boxes and labels) without a cairo context per frame.
+ *
+ *   labels are split into words, each word is rasterized once (cairo, A8 coverage) and cached by (word, font size),
+ *   ("person 0.87" ==> "person" + "0.87": the class names plus at most 101 scores per font size)
+ *   the color is applied when the sprite is blended, so one sprite serves every color.
+ *
+ *   boxes and sprites are alpha-blended directly into the bgra image (SSE2, scalar fallback),
+ *   only the pixels under the annotations are touched.
+ *
+ *   colors: 0xAARRGGBB, (alpha 0: not drawn)
+ *   not thread-safe: use one overlay per drawing thread.
+ */
+#define IMG_OVERLAY_DEFAULT_FONT "mono"
+#define IMG_OVERLAY_DEFAULT_MAX_SPRITES (1024)
+
+struct img_overlay_label_style
+{
+	int font_size;			// pixels
+	uint32_t color;			// text
+	uint32_t bg_color;		// background box of the label, (0: none)
+	int padding;			// background box padding, pixels
+};
+
+struct img_overlay_stats
+{
+	long num_sprites;		// cached
+	long cache_hits;
+	long cache_misses;		// rasterized words
+	long cache_resets;		// the cache was full
+};
+
+typedef struct img_overlay
+{
+	void * priv;
+	void * user_data;
+	char font_face[100];
+	long max_sprites;		// the cache is dropped when it is full, default: IMG_OVERLAY_DEFAULT_MAX_SPRITES
+
+	/*
+	 * draw_box(): stroke a rectangle, the line grows inwards from (x, y, width, height), clipped to the image.
+	 * fill_rect(): fill a rectangle, clipped to the image.
+	 */
+	int (* draw_box)(struct img_overlay * overlay, bgra_image_t * image, int x, int y, int width, int height, int line_width, uint32_t color);
+	int (* fill_rect)(struct img_overlay * overlay, bgra_image_t * image, int x, int y, int width, int height, uint32_t color);
+
+	/*
+	 * draw_label(): (x, y) is the top-left corner of the label, (including the padding)
+	 * p_width / p_height: nullable, the size of the label (even if it is clipped)
+	 */
+	int (* draw_label)(struct img_overlay * overlay, bgra_image_t * image, int x, int y, const char * text,
+		const struct img_overlay_label_style * style, int * p_width, int * p_height);
+	int (* get_label_size)(struct img_overlay * overlay, const char * text, const struct img_overlay_label_style * style,
+		int * p_width, int * p_height);
+
+	void (* clear_cache)(struct img_overlay * overlay);
+	void (* get_stats)(struct img_overlay * overlay, struct img_overlay_stats * stats);
+}img_overlay_t;
+
+img_overlay_t * img_overlay_init(img_overlay_t * overlay, const char * font_face, void * user_data);	// font_face: nullable
+void img_overlay_cleanup(img_overlay_t * overlay);
+
+/* building blocks, (exposed for the tests) */
+void img_overlay_fill_span(uint32_t * dst, int count, uint32_t color);	// blend a solid color over count pixels
+void img_overlay_blend_mask(uint32_t * dst, const uint8_t * mask, int count, uint32_t color);	// coverage mask (0 ~ 255) x color
+void img_overlay_blend_mask_scalar(uint32_t * dst, const uint8_t * mask, int count, uint32_t color);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,91 @@
+#ifndef _IMG_PREPROC_H_
+#define _IMG_PREPROC_H_
+
+#include <stdio.h>
+#include "img_proc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @ingroup img_preproc
+ * @{
+ */
+
+/*
+ * img_preproc: bgra_image_t  ==>  float32 tensor (3 channels, alpha is dropped)
+ *
+ *   dst[c] = ((float)src[c] - mean[c]) * (scale / std[c])
+ *
+ *   mean / std are indexed by the output channel, (i.e. {r, g, b} for rgb order).
+ *   The same expression (sub, then mul) is evaluated by every kernel, so all ISAs produce identical results.
+ *
+ *   darknet:  { .scale = 1.0f / 255.0f }
+ *   caffe:    { .scale = value_scale, .mean = { 128, 128, 128 } }
+ *   imagenet: { .scale = 1.0f, .mean = { 123.675, 116.28, 103.53 }, .std = { 58.395, 57.12, 57.375 } }
+ */
+enum img_preproc_layout
+{
+	img_preproc_layout_nchw = 0,	// planar: r_plane, g_plane, b_plane
+	img_preproc_layout_nhwc = 1,	// interleaved: rgb, rgb, ...
+};
+
+enum img_preproc_channel_order
+{
+	img_preproc_channel_order_rgb = 0,
+	img_preproc_channel_order_bgr = 1,
+};
+
+enum img_preproc_isa
+{
+	img_preproc_isa_auto = -1,	// best supported by the cpu
+	img_preproc_isa_scalar = 0,
+	img_preproc_isa_sse2,
+	img_preproc_isa_avx2,
+	img_preproc_isa_avx512,
+	img_preproc_isas_count
+};
+
+struct img_preproc_params
+{
+	enum img_preproc_layout layout;
+	enum img_preproc_channel_order channel_order;
+	float scale;	// 0: 1.0f
+	float mean[3];
+	float std[3];	// 0: 1.0f
+
+	// nullable: per-pixel mean (width * height * 3, interleaved, output channel order), overrides mean[]
+	// (scalar kernel only)
+	const float * mean_image;
+};
+
+/*
+ * img_preproc_bgra_to_f32():
+ *   dst: (src->width * src->height * 3) floats, src may be a view (any stride).
+ *   params: nullable, default { nchw, rgb, scale = 1.0 }
+ */
+int img_preproc_bgra_to_f32(const bgra_image_t * src, float * dst, const struct img_preproc_params * params);
+
+/*
+ * img_preproc_yuv_to_f32_resized(): decoder output ==> network input in one pass, (no intermediate bgra image)
+ *   bilinear resize of the y and chroma planes, yuv ==> rgb (src->matrix), then the same normalization as above.
+ *   dst: (dst_width * dst_height * 3) floats
+ *   roi: nullable, resize into this area of dst (e.g. from bgra_image_letterbox_init()), the borders are not written.
+ *   params->mean_image is not supported.
+ */
+int img_preproc_yuv_to_f32_resized(const yuv_image_t * src, float * dst, int dst_width, int dst_height,
+	const struct bgra_image_letterbox * roi, const struct img_preproc_params * params);
+
+enum img_preproc_isa img_preproc_get_isa(void);
+enum img_preproc_isa img_preproc_set_isa(enum img_preproc_isa isa);	// clamped to what the cpu supports, return the selected isa
+const char * img_preproc_isa_to_string(enum img_preproc_isa isa);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,116 @@
+#ifndef _IMG_PRIVACY_MASK_H_
+#define _IMG_PRIVACY_MASK_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <json-c/json.h>
+
+#include "img_proc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * img_privacy_mask: anonymize regions of a bgra frame in place, (faces, people, windows of the neighbours ...)
+ *
+ *   modes:
+ *     pixelate: the region is split into block_size x block_size blocks, each block is replaced by its mean color;
+ *     blur:     box blur (separable, running sums), blur_passes times, (2 passes ~ a triangle filter);
+ *     fill:     solid color.
+ *
+ *   regions: rectangles or polygons (even-odd rule), only the pixels of the regions are read and written,
+ *     the cost is O(pixels masked), not O(frame). (SSE2, scalar fallback)
+ *
+ *   apply(): the regions are the detections of the selected classes in an ai-engine result,
+ *     ("detections" and "faces" arrays, normalized left / top / width / height), plus the static regions of the config.
+ *
+ *   not thread-safe: use one mask per thread, (the blur scratch buffers are reused across frames)
+ *
+ * config:
+ *   "privacy_mask": { "enabled": 1, "mode": "pixelate", "block_size": 0, "blur_radius": 0, "blur_passes": 2,
+ *                     "color": "0x000000", "padding": 0.1, "min_confidence": 0.25, "classes": [ "face" ],
+ *                     "regions": [ [ [x, y], [x, y], [x, y], ... ], ... ] }	// normalized polygons
+ */
+#define IMG_PRIVACY_MASK_MAX_CLASSES (16)
+#define IMG_PRIVACY_MASK_MAX_REGIONS (16)
+#define IMG_PRIVACY_MASK_MAX_POINTS (32)	// per polygon
+
+enum img_privacy_mask_mode
+{
+	img_privacy_mask_mode_pixelate,
+	img_privacy_mask_mode_blur,
+	img_privacy_mask_mode_fill,
+};
+enum img_privacy_mask_mode img_privacy_mask_mode_from_string(const char * mode);
+
+struct img_privacy_mask_point
+{
+	double x, y;
+};
+
+struct img_privacy_mask_region
+{
+	int num_points;
+	struct img_privacy_mask_point points[IMG_PRIVACY_MASK_MAX_POINTS];	// normalized, (0 ~ 1)
+};
+
+struct img_privacy_mask_params
+{
+	int enabled;
+	enum img_privacy_mask_mode mode;	// default: pixelate
+	int block_size;			// pixelate, pixels, 0: auto (the smaller side of the region / 6, at least 4)
+	int blur_radius;		// blur, pixels, 0: auto (the smaller side of the region / 8, at least 2)
+	int blur_passes;		// default: 2
+	uint32_t color;			// fill, 0xRRGGBB, (opaque)
+	double padding;			// detections are grown by (padding x box size) on each side, default: 0.1
+	double min_confidence;	// default: 0.25
+
+	int num_classes;		// 0: every detection
+	char classes[IMG_PRIVACY_MASK_MAX_CLASSES][64];	// default: "face"
+
+	int num_regions;		// static regions, masked on every frame
+	struct img_privacy_mask_region regions[IMG_PRIVACY_MASK_MAX_REGIONS];
+};
+void img_privacy_mask_params_load(struct img_privacy_mask_params * params, json_object * jconfig);	// jconfig: nullable, (defaults)
+
+typedef struct img_privacy_mask
+{
+	void * priv;
+	void * user_data;
+	struct img_privacy_mask_params params[1];
+
+	/*
+	 * mask_rect(): pixels, clipped to the image
+	 * mask_polygon(): pixels, the pixel centers inside the polygon (even-odd) are masked
+	 */
+	int (* mask_rect)(struct img_privacy_mask * mask, bgra_image_t * image, int x, int y, int width, int height);
+	int (* mask_polygon)(struct img_privacy_mask * mask, bgra_image_t * image, const struct img_privacy_mask_point * points, int num_points);
+
+	/*
+	 * count_targets(): the number of regions apply() would mask, (no pixel is touched)
+	 *   e.g. skip decoding / re-encoding a jpeg frame that has nothing to hide
+	 * apply(): jresult: nullable, (static regions only); return the number of masked regions
+	 */
+	ssize_t (* count_targets)(struct img_privacy_mask * mask, json_object * jresult);
+	ssize_t (* apply)(struct img_privacy_mask * mask, bgra_image_t * image, json_object * jresult);
+}img_privacy_mask_t;
+
+img_privacy_mask_t * img_privacy_mask_init(img_privacy_mask_t * mask, const struct img_privacy_mask_params * params, void * user_data);	// params: nullable, (defaults)
+void img_privacy_mask_cleanup(img_privacy_mask_t * mask);
+
+/* building blocks, (exposed for the tests) */
+void img_privacy_mask_sum_span(const uint32_t * src, int count, uint32_t sums[4]);	// adds the per channel (b, g, r, a) sums
+void img_privacy_mask_sum_span_scalar(const uint32_t * src, int count, uint32_t sums[4]);
+
+/*
+ * box_blur(): in place, a packed width x height buffer, window (2 * radius + 1), the edges are replicated
+ *   scratch: at least (width * height + width * 4) uint32_t
+ */
+void img_privacy_mask_box_blur(uint32_t * pixels, int width, int height, int radius, uint32_t * scratch);
+void img_privacy_mask_box_blur_scalar(uint32_t * pixels, int width, int height, int radius, uint32_t * scratch);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
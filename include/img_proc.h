@@ -2,6 +2,7 @@
 #define _IMG_PROC_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -15,10 +16,112 @@ typedef struct bgra_image
 	int width;
 	int height;
 	int channels;
-	int stride;
+	int stride;		// bytes per row, 0: (width * 4)
+	const void * parent;	// non-NULL: a view, data is borrowed from the parent image
 }bgra_image_t;
-bgra_image_t * bgra_image_init(bgra_image_t * image, int width, int height, const unsigned char * image_data);
+#define bgra_image_stride(image) ((image)->stride?(image)->stride:((image)->width * 4))
+
+bgra_image_t * bgra_image_init(bgra_image_t * image, int width, int height, const unsigned char * image_data);	// image_data: packed rows
 void bgra_image_clear(bgra_image_t * image);
+
+/*
+ * bgra_image_view(): zero-copy crop, (x, y, width, height) is clipped to the parent.
+ *   the view shares the parent's buffer, (data = parent->data + y * stride + x * 4, stride = parent's stride)
+ *   the parent must outlive the view, bgra_image_clear(view) never frees the parent's buffer.
+ *   return NULL if the clipped area is empty.
+ */
+bgra_image_t * bgra_image_view(bgra_image_t * view, const bgra_image_t * parent, int x, int y, int width, int height);
+bgra_image_t * bgra_image_copy(bgra_image_t * dst, const bgra_image_t * src);	// packed copy of an image or a view
+/**
+ * @}
+ */
+
+
+/**
+ * @ingroup img_proc
+ * @{
+ */
+/*
+ * bgra_image_resize(): separable resampling, src ==> (dst->width x dst->height)
+ *   dst: the caller's buffer (or a view), allocated by bgra_image_init() if dst->data is NULL.
+ *   the coefficient tables are cached per (src size, dst size, filter).
+ *
+ * filter:
+ *   auto:     area when downscaling, bilinear when upscaling (per axis)
+ *   bilinear: pixel centers are aligned, (like cairo / opencv INTER_LINEAR)
+ *   area:     box filter weighted by the covered area, falls back to bilinear when upscaling
+ */
+enum bgra_image_resize_filter
+{
+	bgra_image_resize_filter_auto = 0,
+	bgra_image_resize_filter_bilinear,
+	bgra_image_resize_filter_area,
+};
+
+/*
+ * letterbox: keep the aspect ratio, the resized image is centered in dst and the borders are filled.
+ *   dst_x = src_x * scale_x + x;  ==>  src_x = (dst_x - x) / scale_x
+ *   dst_y = src_y * scale_y + y;  ==>  src_y = (dst_y - y) / scale_y
+ */
+struct bgra_image_letterbox
+{
+	double scale_x, scale_y;	// (width / src->width), (height / src->height)
+	int x, y;					// offset of the resized image in dst
+	int width, height;			// size of the resized image
+};
+
+int bgra_image_resize(bgra_image_t * dst, const bgra_image_t * src, enum bgra_image_resize_filter filter);
+int bgra_image_letterbox(bgra_image_t * dst, const bgra_image_t * src, enum bgra_image_resize_filter filter,
+	uint32_t fill_color,	// native-endian 0xAARRGGBB, (cairo ARGB32)
+	struct bgra_image_letterbox * letterbox);	// nullable
+void bgra_image_letterbox_init(struct bgra_image_letterbox * letterbox, int src_width, int src_height, int dst_width, int dst_height);	// geometry only
+void bgra_image_resize_cache_clear(void);
+/**
+ * @}
+ */
+
+
+/**
+ * @ingroup img_proc
+ * @{
+ */
+/*
+ * yuv_image: a read-only view over decoder output, (NV12 / I420 / GRAY8, 8 bits per sample)
+ *   packed buffers use GStreamer's default system-memory layout:
+ *     rows are 4-byte aligned, chroma planes are (width + 1) / 2 x (height + 1) / 2, and follow the luma plane.
+ *   nv12 / i420 samples are limited range (16 ~ 235), gray8 is full range.
+ */
+enum yuv_image_format
+{
+	yuv_image_format_unknown = 0,
+	yuv_image_format_nv12,		// y plane + interleaved uv plane
+	yuv_image_format_i420,		// y, u, v planes
+	yuv_image_format_gray8,		// y plane only
+};
+
+enum yuv_image_matrix
+{
+	yuv_image_matrix_bt601 = 0,
+	yuv_image_matrix_bt709,
+};
+
+typedef struct yuv_image
+{
+	enum yuv_image_format format;
+	enum yuv_image_matrix matrix;
+	int width;
+	int height;
+	const unsigned char * planes[3];
+	int strides[3];
+}yuv_image_t;
+
+ssize_t yuv_image_layout(enum yuv_image_format format, int width, int height, int strides[3], ssize_t offsets[3]);	// return the packed size, -1 on error
+int yuv_image_init(yuv_image_t * image, enum yuv_image_format format, int width, int height,
+	const unsigned char * data, ssize_t length);	// data: packed, (not copied); -1 if length is too small
+enum yuv_image_format yuv_image_format_from_string(const char * format);	// GStreamer names: "NV12", "I420", "GRAY8"
+
+// zero-copy crop, (like bgra_image_view), x and y are rounded down to even to keep the chroma aligned; NULL if the clipped area is empty
+yuv_image_t * yuv_image_view(yuv_image_t * view, const yuv_image_t * parent, int x, int y, int width, int height);
 /**
  * @}
  */
@@ -29,6 +132,42 @@ void bgra_image_clear(bgra_image_t * image);
  * @{
  */
 int bgra_image_from_jpeg_stream(bgra_image_t * image, const unsigned char * jpeg, size_t length);
+
+/*
+ * decode to (about) a target size:
+ *   _scaled():  libjpeg's DCT-domain scaling (1/2, 1/4, 1/8), the result is at least (min_width x min_height)
+ *                when the source is large enough, (e.g. 1920x1080 ==> 480x270 for a 416x256 target).
+ *   _resized(): _scaled() followed by bgra_image_resize() to exactly (dst->width x dst->height)
+ */
+int bgra_image_from_jpeg_stream_scaled(bgra_image_t * image, const unsigned char * jpeg, size_t length, int min_width, int min_height);
+int bgra_image_from_jpeg_stream_resized(bgra_image_t * dst, const unsigned char * jpeg, size_t length, enum bgra_image_resize_filter filter);
+
+/*
+ * speed over quality, (flags can be combined)
+ *   fast_idct:            JDCT_IFAST, (slightly less accurate than the default JDCT_ISLOW)
+ *   no_fancy_upsampling:  chroma is replicated instead of interpolated, (4:2:0 / 4:2:2 sources)
+ */
+enum bgra_image_jpeg_decode_flags
+{
+	bgra_image_jpeg_decode_flags_default = 0,
+	bgra_image_jpeg_decode_flag_fast_idct = 1,
+	bgra_image_jpeg_decode_flag_no_fancy_upsampling = 2,
+	bgra_image_jpeg_decode_flags_fast = 3,
+};
+int bgra_image_from_jpeg_stream_ex(bgra_image_t * image, const unsigned char * jpeg, size_t length,
+	int min_width, int min_height,	// 0: full size, see _scaled()
+	int flags);
+
+/*
+ * bgra_image_from_jpeg_stream_roi(): decode only the iMCU rows / columns covering (x, y, width, height)
+ *   the rect is in source pixels and is clipped to the image, return -1 if the clipped rect is empty.
+ *   min_width, min_height: (> 0) DCT scaling (1/2, 1/4, 1/8) as long as the cropped result still covers them,
+ *     the result is then (about) (width / denom) x (height / denom).
+ */
+int bgra_image_from_jpeg_stream_roi(bgra_image_t * image, const unsigned char * jpeg, size_t length,
+	int x, int y, int width, int height,
+	int min_width, int min_height,
+	int flags);
 int bgra_image_from_png_stream(bgra_image_t * image, const unsigned char * jpeg, size_t length);
 int bgra_image_load_data(bgra_image_t * image, const void * image_data, size_t size);		// image_data: png or jpeg format
 int bgra_image_load_from_file(bgra_image_t * image, const char * filename);
@@ -36,11 +175,115 @@ int bgra_image_save_to_file(bgra_image_t * image, const char * filename, int qua
 int bgra_image_save_to_jpeg(bgra_image_t * image, const char * filename, int quality);
 int bgra_image_save_to_png(bgra_image_t * image, const char * filename);
 ssize_t bgra_image_to_jpeg_stream(bgra_image_t * image, unsigned char ** jpeg_stream, int quality);
-ssize_t bgra_image_to_png_stream(bgra_image_t * image, unsigned char ** png_stream);
+
+enum bgra_image_jpeg_subsampling
+{
+	bgra_image_jpeg_subsampling_default = 0,	// libjpeg's default, (4:2:0)
+	bgra_image_jpeg_subsampling_444,
+	bgra_image_jpeg_subsampling_422,
+	bgra_image_jpeg_subsampling_420,
+};
+struct bgra_image_jpeg_options
+{
+	int quality;		// 1 ~ 100, 0: default (95)
+	enum bgra_image_jpeg_subsampling subsampling;
+	int optimize_coding;	// 1: optimized huffman tables (smaller, slower)
+	int fast_dct;		// 1: JDCT_IFAST
+};
+ssize_t bgra_image_to_jpeg_stream_ex(const bgra_image_t * image, unsigned char ** jpeg_stream,
+	const struct bgra_image_jpeg_options * options);	// options: nullable, (quality 95, 4:2:0)
+ssize_t bgra_image_to_png_stream(bgra_image_t * image, unsigned char ** png_stream);	// fast preset, rgba
+
+/*
+ * png encoder (libpng), the stream is written to memory, (*png_stream: malloc'ed, release it with free())
+ *   filter:   PNG_FILTER_* flags, (the values match libpng's)
+ *   strategy: zlib Z_* strategies, (the values match zlib's)
+ *   alpha is written as-is, (bgra_image_t is not premultiplied)
+ */
+enum bgra_image_png_format
+{
+	bgra_image_png_format_rgba = 0,
+	bgra_image_png_format_rgb,
+	bgra_image_png_format_gray,		// (r * 77 + g * 150 + b * 29) / 256
+};
+
+enum bgra_image_png_filter
+{
+	bgra_image_png_filter_none = 0x08,
+	bgra_image_png_filter_sub = 0x10,
+	bgra_image_png_filter_up = 0x20,
+	bgra_image_png_filter_avg = 0x40,
+	bgra_image_png_filter_paeth = 0x80,
+	bgra_image_png_filter_all = 0xF8,
+};
+
+enum bgra_image_png_strategy
+{
+	bgra_image_png_strategy_default = 0,
+	bgra_image_png_strategy_filtered = 1,
+	bgra_image_png_strategy_huffman_only = 2,
+	bgra_image_png_strategy_rle = 3,
+};
+
+enum bgra_image_png_preset
+{
+	bgra_image_png_preset_fastest = 0,	// level 1, no filter, rle: masks, screenshots, flat images
+	bgra_image_png_preset_fast,			// level 1, sub filter: photos / video frames
+	bgra_image_png_preset_default,		// level 6, adaptive filters (libpng / cairo defaults)
+	bgra_image_png_preset_smallest,		// level 9, adaptive filters
+};
+
+struct bgra_image_png_options
+{
+	enum bgra_image_png_format format;
+	int compression_level;		// zlib: 0 (store) ~ 9
+	int filters;				// enum bgra_image_png_filter, (flags)
+	enum bgra_image_png_strategy strategy;
+};
+struct bgra_image_png_options * bgra_image_png_options_init(struct bgra_image_png_options * options,
+	enum bgra_image_png_preset preset, enum bgra_image_png_format format);
+ssize_t bgra_image_to_png_stream_ex(const bgra_image_t * image, unsigned char ** png_stream,
+	const struct bgra_image_png_options * options);	// options: nullable, (fast preset, rgba)
+
+/*
+ * the jpeg codecs (bgra_image_from_jpeg_stream*(), bgra_image_to_jpeg_stream(), bgra_image_save_to_jpeg())
+ *   reuse a per-thread libjpeg context, (decompressor, compressor and output buffer)
+ *   it is released automatically when the thread exits; long-lived threads that are done with jpeg
+ *   (e.g. the main thread before exit) can release it explicitly.
+ */
+void img_utils_jpeg_thread_context_release(void);
 
 int img_utils_get_jpeg_size(const unsigned char * jpeg, size_t length, int * p_width, int * p_height);
 int img_utils_get_png_size(const unsigned char * png, size_t length, int * p_width, int * p_height);
 
+/*
+ * img_utils_probe(): header-only parsing, (no decoder is involved)
+ *   type:  magic bytes, (jpeg: FF D8, png: 89 'PNG' 0D 0A 1A 0A)
+ *   size:  png: IHDR, jpeg: the first SOFn marker
+ *   truncated: the stream doesn't end with the end marker, (jpeg: EOI, png: IEND chunk)
+ *
+ *   return 0 if the type and the size were found, otherwise -1 (info->type may still be set)
+ */
+enum img_utils_image_type
+{
+	img_utils_image_type_unknown = 0,
+	img_utils_image_type_png,
+	img_utils_image_type_jpeg,
+};
+
+struct img_utils_image_info
+{
+	enum img_utils_image_type type;
+	int width;
+	int height;
+	int channels;		// jpeg: number of components, png: derived from the color type (+ alpha)
+	int bit_depth;
+	int progressive;	// jpeg only: SOF2 / SOF6 / SOF10 / SOF14
+	int truncated;
+};
+enum img_utils_image_type img_utils_guess_image_type(const unsigned char * data, size_t length);
+int img_utils_probe(const unsigned char * data, size_t length, struct img_utils_image_info * info);
+
 /**
 * @}
 */
@@ -17,6 +17,9 @@ enum input_frame_type
 	input_frame_type_bgra = 1,
 	input_frame_type_jpeg = 2,
 	input_frame_type_png  = 3,
+	input_frame_type_nv12 = 4,	// raw decoder output, see yuv_image_t (img_proc.h)
+	input_frame_type_i420 = 5,
+	input_frame_type_gray8 = 6,
 
 	input_frame_type_image_masks = 0x7FFF,
 	input_frame_type_json_flag = 0x8000,
@@ -25,6 +28,22 @@ enum input_frame_type
 enum input_frame_type input_frame_type_from_string(const char * sz_type);
 ssize_t	input_frame_type_to_string(enum input_frame_type type, char sz_type[], size_t size);
 
+/**
+ * input_frame_payload: refcounted, immutable image / json storage.
+ * 	A frame holding a payload only borrows (data, json_str) from it,
+ * 	so a published frame can be shared by any number of readers without copying.
+ */
+typedef struct input_frame_payload
+{
+	long refs;				// atomic
+	unsigned char * data;
+	ssize_t length;
+	char * json_str;
+	ssize_t cb_json;
+}input_frame_payload_t;
+input_frame_payload_t * input_frame_payload_addref(input_frame_payload_t * payload);
+void input_frame_payload_unref(input_frame_payload_t * payload);
+
 
 typedef struct input_frame
 {
@@ -39,6 +58,7 @@ typedef struct input_frame
 			int height;
 			int channels;
 			int stride;
+			const void * parent;
 		};
 	};
 	ssize_t length;
@@ -53,6 +73,7 @@ typedef struct input_frame
 		char * json_str;
 		void * meta_data;	// json_object
 //	};
+	input_frame_payload_t * payload;	// nullable, (data, json_str) are read-only when set
 }input_frame_t;
 void input_frame_free(input_frame_t * frame);
 input_frame_t * input_frame_new();
@@ -62,12 +83,32 @@ int input_frame_set_bgra(input_frame_t * input, const bgra_image_t * bgra, const
 int input_frame_set_jpeg(input_frame_t * input, const unsigned char * data, ssize_t length, const char * json_str, ssize_t cb_json);
 int input_frame_set_png(input_frame_t * input, const unsigned char * data, ssize_t length, const char * json_str, ssize_t cb_json);
 
+/*
+ * input_frame_set_yuv(): type: nv12 / i420 / gray8, data: packed (yuv_image_layout()), copied.
+ *   frame->stride is the luma stride, input_frame_get_yuv() gives the plane pointers back,
+ *   the matrix follows GStreamer's default colorimetry: bt709 when height >= 720, otherwise bt601.
+ */
+int input_frame_set_yuv(input_frame_t * input, enum input_frame_type type, const unsigned char * data, ssize_t length,
+	int width, int height, const char * json_str, ssize_t cb_json);
+int input_frame_get_yuv(const input_frame_t * input, yuv_image_t * yuv);	// -1 if the frame is not a yuv image
+enum yuv_image_format input_frame_type_to_yuv_format(enum input_frame_type type);
+
 //~ int input_frame_set_data(input_frame_t * input, int type,
 	//~ const unsigned char * data, ssize_t length,
 	//~ int width, int height, int channels, int stride,
 	//~ const char * json_str, ssize_t cb_json);
 input_frame_t * input_frame_copy(input_frame_t * dst, const input_frame_t * src);
 
+/*
+ * zero-copy helpers:
+ * 	input_frame_share(): move the frame's own buffers into a new payload (no copy)
+ * 	input_frame_ref(): make dst share src's payload (src is copied once if it has none)
+ * 	input_frame_make_writable(): copy-on-write, detach from a payload shared with other readers
+ */
+int input_frame_share(input_frame_t * frame);
+input_frame_t * input_frame_ref(input_frame_t * dst, const input_frame_t * src);
+int input_frame_make_writable(input_frame_t * frame);
+
 /*********************************
  * input_frame
  *********************************/
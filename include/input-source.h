@@ -57,6 +57,10 @@ typedef struct input_source
 
 	enum input_source_type 		type;
 	enum input_source_subtype 	subtype;
+	
+	// video sources: set before set_uri(), default: bgra
+	//   nv12 / i420: the decoder's native yuv is kept (either one, whatever the decoder outputs), gray8: luma only
+	enum input_frame_type		frame_type;
 
 	int (* set_uri)(struct input_source * input, const char * uri);
 
@@ -45,14 +45,22 @@ typedef struct io_input
 	int (* set_property)(struct io_input * input, const char * name, const char * value, size_t cb_value);
 	
 	// io_input::member_functions
-	long (* get_frame)(struct io_input * input, long prev_frame, input_frame_t * frame);
+	long (* get_frame)(struct io_input * input, long prev_frame, input_frame_t * frame);	// frame is untouched if prev_frame is still the latest one
 	long (* set_frame)(struct io_input * input, const input_frame_t * frame);
 	
+	// block until a frame other than prev_frame is published, timeout_ms < 0: infinite; return the current frame_number
+	long (* wait_frame)(struct io_input * input, long prev_frame, input_frame_t * frame, long timeout_ms);
+	
+	// frame history (see jconfig["history"]): ref a recent frame by its frame_number, return -1 if it's not in the history
+	long (* find_frame)(struct io_input * input, long frame_number, input_frame_t * frame);
+	ssize_t (* get_history)(struct io_input * input, long * p_first, long * p_last);	// return the number of frames
+	
 	// user-defined callbacks
 	int (* on_new_frame)(struct io_input * input, const input_frame_t * frame);
 
 	// private data ( KEEP UNTOUCHED )
 	void * frame_buffer;
+	void * plugin;				// ann_plugin_t
 }io_input_t;
 
 io_input_t * io_input_init(io_input_t * input, const char * sz_type, void * user_data);
@@ -0,0 +1,65 @@
+#ifndef _JOB_QUEUE_H_
+#define _JOB_QUEUE_H_
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * job queue: the plumbing shared by the worker services, (jpeg-encode-service, ai-engine-pool)
+ *
+ * job_future: the refcount and the completion state of a job, embedded in the service's private job struct
+ * job_queue: bounded ring buffer of the pending jobs, consumed by the service's worker threads
+ *   job_queue_is_full(), job_queue_push() and job_queue_pop() are called with queue->mutex held,
+ *   (the services keep their stats under the same lock)
+ */
+
+double job_queue_get_time_sec(void);	// CLOCK_MONOTONIC
+
+typedef struct job_future
+{
+	long refs;
+	int done;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+}job_future_t;
+
+job_future_t * job_future_init(job_future_t * future);	// refs = 1
+void job_future_cleanup(job_future_t * future);
+void job_future_addref(job_future_t * future);
+int job_future_unref(job_future_t * future);		// return 1 when the last reference is gone, (the owner frees the job)
+void job_future_set_done(job_future_t * future);	// wakes up the waiters, (set the results before)
+int job_future_wait(job_future_t * future, long timeout_ms);	// timeout_ms < 0: infinite; return 1 if done, 0 on timeout
+
+
+typedef struct job_queue
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	int quit;
+
+	// ring buffer of the pending jobs
+	void ** jobs;
+	int max_pending;
+	int start_pos;
+	int length;
+}job_queue_t;
+
+job_queue_t * job_queue_init(job_queue_t * queue, int max_pending);	// max_pending 0: see job_queue_set_capacity()
+void job_queue_cleanup(job_queue_t * queue);	// call job_queue_stop() and job_queue_cancel_all() before
+void job_queue_set_capacity(job_queue_t * queue, int max_pending);	// mutex held, the queue must be empty
+
+int job_queue_is_full(const job_queue_t * queue);	// mutex held; stopped or full
+int job_queue_push(job_queue_t * queue, void * job, int wait_if_full);	// mutex held; return -1 if full or stopped
+int job_queue_pop(job_queue_t * queue, void ** jobs, int max_count);	// mutex held; blocks until there is a job, return 0 once stopped
+
+void job_queue_stop(job_queue_t * queue);	// wakes up the workers and the blocked submitters
+int job_queue_cancel_all(job_queue_t * queue, void (* cancel)(void * job, void * user_data), void * user_data);	// once the workers have returned, cancel() is called without the lock; return the number of jobs
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,99 @@
+#ifndef _JPEG_ENCODE_SERVICE_H_
+#define _JPEG_ENCODE_SERVICE_H_
+
+#include <stdio.h>
+#include "img_proc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * jpeg encode service: a fixed number of worker threads shared by all the outputs,
+ *   each worker reuses its own libjpeg compressor, (see img_utils_jpeg_thread_context_release())
+ *
+ * the queue is bounded (max_pending), submit() never blocks unless jpeg_encode_flag_wait_if_full is set:
+ *   capture / inference threads drop the frame instead of waiting for the encoders.
+ *
+ * results: as a future (p_job, jpeg_encode_job_wait()) and/or a callback (on_completed, called on the worker thread)
+ */
+
+enum jpeg_encode_job_status
+{
+	jpeg_encode_job_status_cancelled = -2,	// the service was stopped before the job started
+	jpeg_encode_job_status_failed = -1,
+	jpeg_encode_job_status_pending = 0,
+	jpeg_encode_job_status_completed = 1,
+};
+
+enum jpeg_encode_flags
+{
+	jpeg_encode_flag_adopt_image = 1,	// move image->data into the job (no copy), the caller's image is cleared
+	jpeg_encode_flag_wait_if_full = 2,	// block until there is room in the queue, (default: drop)
+};
+
+typedef struct jpeg_encode_job
+{
+	void * user_data;
+	bgra_image_t image[1];		// the source, owned by the job (read-only)
+	struct bgra_image_jpeg_options options;
+	void (* on_completed)(struct jpeg_encode_job * job);	// nullable, called on the worker thread
+
+	// results, valid once status != pending
+	int status;					// enum jpeg_encode_job_status
+	unsigned char * jpeg;		// freed with the job, unless taken by jpeg_encode_job_take_data()
+	size_t length;
+	double queued_time;			// seconds, submit() ==> the worker picks it up
+	double encode_time;			// seconds
+}jpeg_encode_job_t;
+
+int jpeg_encode_job_wait(jpeg_encode_job_t * job, long timeout_ms);	// timeout_ms < 0: infinite; return job->status (pending on timeout)
+unsigned char * jpeg_encode_job_take_data(jpeg_encode_job_t * job, size_t * p_length);	// release with free()
+void jpeg_encode_job_unref(jpeg_encode_job_t * job);
+
+
+struct jpeg_encode_service_stats
+{
+	long submitted;
+	long completed;
+	long failed;
+	long dropped;		// queue full
+	long cancelled;
+	long pending;		// queued, not yet started
+	double encode_time;	// seconds, total of the completed jobs
+};
+
+typedef struct jpeg_encode_service
+{
+	void * user_data;
+	void * priv;
+	int num_workers;
+	int max_pending;
+
+	/*
+	 * submit():
+	 *   image: copied, or adopted with jpeg_encode_flag_adopt_image (views are always copied)
+	 *   options: nullable, (quality 95, 4:2:0)
+	 *   p_job: nullable, receives a reference to the job, release it with jpeg_encode_job_unref()
+	 * return 0 on success, -1 if the queue is full or the service is stopped
+	 */
+	int (* submit)(struct jpeg_encode_service * service, bgra_image_t * image,
+		const struct bgra_image_jpeg_options * options, int flags,
+		void (* on_completed)(jpeg_encode_job_t * job), void * user_data,
+		jpeg_encode_job_t ** p_job);
+	void (* get_stats)(struct jpeg_encode_service * service, struct jpeg_encode_service_stats * stats);
+}jpeg_encode_service_t;
+
+/*
+ * num_workers: 0: half of the online cpus, (1 ~ 8)
+ * max_pending: 0: (num_workers * 4)
+ */
+jpeg_encode_service_t * jpeg_encode_service_init(jpeg_encode_service_t * service, int num_workers, int max_pending, void * user_data);
+void jpeg_encode_service_cleanup(jpeg_encode_service_t * service);	// cancels the pending jobs, waits for the running ones
+
+jpeg_encode_service_t * jpeg_encode_service_get_default(void);	// process-wide instance, created on first use (auto sizes)
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,76 @@
+#ifndef _MOTION_GATE_H_
+#define _MOTION_GATE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <json-c/json.h>
+
+#include "img_proc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * motion gate: skip the inference while a fixed camera looks at an unchanged scene.
+ *
+ *   each frame is reduced to a small luma thumbnail, (jpeg: DCT-scaled decode, then area resize)
+ *   and compared with a running background, (sum of absolute differences per block, SSE2 psadbw)
+ *   a block is changed when its mean absolute difference exceeds block_threshold.
+ *
+ *   the inference runs (result->triggered) when:
+ *     - the ratio of changed blocks >= threshold, (the gate stays open for hold_ms afterwards)
+ *     - or refresh_interval_ms has elapsed since the last inference, (forced refresh)
+ *     - or it is the first frame / the frame size changed
+ */
+struct motion_gate_params
+{
+	int enabled;				// 0: every frame is triggered, the score is still computed
+	int width, height;			// thumbnail size, default: 64 x 48
+	int block_size;				// default: 8, (width and height are rounded down to a multiple of it)
+	int block_threshold;		// mean absolute difference (0 ~ 255) of a changed block, default: 12
+	double threshold;			// ratio of changed blocks, default: 0.01
+	int background_shift;		// background update rate: 1 / (1 << shift) per frame, default: 4
+	long refresh_interval_ms;	// forced refresh, default: 5000, (<= 0: never)
+	long hold_ms;				// keep the gate open after the last motion, default: 1000
+};
+void motion_gate_params_load(struct motion_gate_params * params, json_object * jconfig);	// jconfig: nullable, (defaults)
+
+struct motion_gate_result
+{
+	double score;			// mean absolute difference of the thumbnail, (0 ~ 1)
+	double changed_ratio;	// changed blocks / num_blocks
+	int changed_blocks;
+	int num_blocks;
+	int triggered;			// 1: run the inference
+	int forced;				// triggered by the refresh interval (or the first frame), not by motion
+};
+json_object * motion_gate_result_to_json(const struct motion_gate_result * result);	// { "score", "changed_ratio", ... }
+
+typedef struct motion_gate
+{
+	void * priv;
+	void * user_data;
+	struct motion_gate_params params[1];
+
+	/*
+	 * timestamp_ms: monotonic clock, (0: now)
+	 * return 0 on success, -1 if the frame can't be decoded (result->triggered is set: let the engine decide)
+	 */
+	int (* update_bgra)(struct motion_gate * gate, const bgra_image_t * image, int64_t timestamp_ms, struct motion_gate_result * result);
+	int (* update_jpeg)(struct motion_gate * gate, const unsigned char * jpeg, size_t length, int64_t timestamp_ms, struct motion_gate_result * result);
+	void (* reset)(struct motion_gate * gate);	// drop the background, the next frame is triggered
+}motion_gate_t;
+
+motion_gate_t * motion_gate_init(motion_gate_t * gate, const struct motion_gate_params * params, void * user_data);	// params: nullable
+void motion_gate_cleanup(motion_gate_t * gate);
+
+/* building blocks */
+void motion_gate_bgra_to_luma(const bgra_image_t * image, uint8_t * luma, int luma_stride);	// BT.601: (77 r + 150 g + 29 b) / 256
+void motion_gate_block_sad(const uint8_t * luma, const uint8_t * background, int width, int height, int stride,
+	int block_size, uint32_t * block_sads);	// (width / block_size) x (height / block_size) sums
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -47,6 +47,12 @@ enum video_frame_type
 	video_frame_type_unknown = 0,
 	video_frame_type_bgra = 1,
 	video_frame_type_jpeg = 2, // input_frame_type_jpeg
+	
+	// raw decoder output, packed as yuv_image_layout() (img_proc.h); same values as input_frame_type_*
+	// requesting nv12 or i420 accepts either one: frame->type is the negotiated format
+	video_frame_type_nv12 = 4,
+	video_frame_type_i420 = 5,
+	video_frame_type_gray8 = 6,
 	VIDEO_FRAME_TYPES_COUNT
 };
 
@@ -63,12 +69,44 @@ struct video_frame
 	size_t length;
 	void *meta_data;
 	size_t cb_meta_data;
+	
+	// nullable: the owner of data (read-only), released by free_data() instead of frame_pool_release()
+	void *data_owner;
+	void (*free_data)(struct video_frame *frame);
 };
 struct video_frame *video_frame_new(long frame_number, int width, int height, const void *image_data, size_t length, int take_memory);
+
+// zero-copy: the frame holds a reference of the sample and keeps its buffer mapped (read-only) until the last unref
+struct video_frame *video_frame_new_from_gst_sample(long frame_number, int width, int height, GstSample *sample);
 struct video_frame *video_frame_addref(struct video_frame *frame);
 void video_frame_unref(struct video_frame *frame);
 #define video_frame_free(frame) video_frame_unref(frame)
 
+/*
+ * video_frame_slot: holds the latest published frame, readers never take a lock.
+ *   readers: enter the current epoch (readers[epoch & 1]++, retried if the epoch flipped meanwhile), load the frame and addref it, then leave.
+ *   writers (serialized by writer_mutex): swap the frame pointer, flip the epoch,
+ *     wait until all readers of the previous epoch have left, then drop the old reference.
+ *   video_frame_slot_wait() is the only blocking path, it sleeps on cond (with writer_mutex) until a publish.
+ */
+struct video_frame_slot
+{
+	struct video_frame *frame;
+	long frame_number;	// frame_number of the latest published frame, -1: empty
+	unsigned long epoch;
+	long readers[2];
+	pthread_mutex_t writer_mutex;
+	pthread_cond_t cond;	// clock: CLOCK_MONOTONIC
+	long waiters;
+};
+struct video_frame_slot *video_frame_slot_init(struct video_frame_slot *slot);
+void video_frame_slot_cleanup(struct video_frame_slot *slot);
+struct video_frame *video_frame_slot_acquire(struct video_frame_slot *slot);	// returns a new reference, or NULL if empty
+long video_frame_slot_publish(struct video_frame_slot *slot, struct video_frame *frame);	// takes over the caller's reference; frame == NULL: clear the slot
+
+// wait until a frame other than prev_frame is published (timeout_ms < 0: infinite), then acquire it; NULL on timeout
+struct video_frame *video_frame_slot_wait(struct video_frame_slot *slot, long prev_frame, long timeout_ms);
+
 
 struct video_source_common
 {
@@ -99,7 +137,7 @@ struct video_source_common
 	double position;
 	int err_code; // 0: no error, 1: eos, 2: error
 	pthread_mutex_t mutex;
-	struct video_frame *current_frame;
+	struct video_frame_slot current_frame[1];
 
 	// public methods
 	int (*init)(struct video_source_common *video, 
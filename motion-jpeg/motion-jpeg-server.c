@@ -54,7 +54,7 @@ struct motion_jpeg_channel_private
 	long frame_number;
 	int64_t begin_timestamp_ms;
 	int64_t begin_ticks_ms;
-	struct video_frame *frame;
+	struct video_frame_slot frame[1];	// latest frame, readers don't take the channel lock
 	struct video_source_common *input;
 
 #define channel_priv_lock(priv) pthread_mutex_lock(&priv->mutex)
@@ -73,11 +73,7 @@ void motion_jpeg_channel_unlock(struct motion_jpeg_channel *channel)
 static void motion_jpeg_channel_private_free(struct motion_jpeg_channel_private *priv)
 {
 	if(NULL == priv) return;
-	channel_priv_lock(priv);
-	struct video_frame *frame = priv->frame;
-	priv->frame = NULL;
-	if(frame) video_frame_unref(frame);
-	channel_priv_unlock(priv);
+	video_frame_slot_cleanup(priv->frame);
 	pthread_mutex_destroy(&priv->mutex);
 	return;
 }
@@ -90,6 +86,7 @@ static struct motion_jpeg_channel_private *motion_jpeg_channel_private_new(struc
 	
 	int rc = pthread_mutex_init(&priv->mutex, NULL);
 	assert(0 == rc);
+	video_frame_slot_init(priv->frame);
 	return priv;
 }
 
@@ -100,39 +97,21 @@ static long channel_update_frame(struct motion_jpeg_channel *channel, struct vid
 {
 	assert(channel && channel->priv);
 	struct motion_jpeg_channel_private *priv = channel->priv;
-	long frame_number = -1;
-	channel_lock(channel);
-	if(NULL == frame || NULL == frame->data) {
-		channel_unlock(channel);
-		return -1;
-	}
-	struct video_frame *old_frame = priv->frame;
-	if(frame != old_frame) {
-		video_frame_addref(frame);
-		priv->frame = frame;
-		if(old_frame) video_frame_unref(old_frame);
-	}
-	frame_number = frame->frame_number;
-	channel->frame_number = frame_number;
+	if(NULL == frame || NULL == frame->data) return -1;
 	
-	channel_unlock(channel);
+	long frame_number = video_frame_slot_publish(priv->frame, video_frame_addref(frame));
+	__atomic_store_n(&channel->frame_number, frame_number, __ATOMIC_RELEASE);
 	return frame_number;
 }
 
 static struct video_frame *channel_get_frame(struct motion_jpeg_channel *channel)
 {
 	struct motion_jpeg_channel_private *priv = channel->priv;
-	channel_lock(channel);
-	struct video_frame *frame = priv->frame;
-	if(frame) video_frame_addref(frame);
-	channel_unlock(channel);
-	return frame;
+	return video_frame_slot_acquire(priv->frame);
 }
 static void channel_unref_frame(struct motion_jpeg_channel *channel, struct video_frame *frame)
 {
-	channel_lock(channel);
 	if(frame) video_frame_unref(frame);
-	channel_unlock(channel);
 	return;
 }
 
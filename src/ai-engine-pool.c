@@ -0,0 +1,425 @@
+/*
+ * ai-engine-pool.c
+ *
+ * Copyright 2022 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// pthread_setaffinity_np()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "ai-engine-pool.h"
+#include "utils.h"
+#include "job-queue.h"
+
+#define AI_ENGINE_POOL_MAX_REPLICAS	(256)
+#define AI_ENGINE_POOL_MAX_BATCH	(64)
+
+/******************************************************************************
+ * ai_engine_job
+ *****************************************************************************/
+struct job_private
+{
+	ai_engine_job_t base[1];	// MUST be the first field
+	job_future_t future[1];
+	double submit_time;
+};
+
+static struct job_private * job_private_new(void)
+{
+	struct job_private * job = calloc(1, sizeof(*job));
+	assert(job);
+	job_future_init(job->future);
+	job->base->replica_index = -1;
+	return job;
+}
+
+static void job_private_free(struct job_private * job)
+{
+	input_frame_clear(job->base->frame);
+	if(job->base->jresult) json_object_put(job->base->jresult);
+	job_future_cleanup(job->future);
+	free(job);
+}
+
+void ai_engine_job_unref(ai_engine_job_t * job)
+{
+	if(NULL == job) return;
+	struct job_private * priv = (struct job_private *)job;
+	if(job_future_unref(priv->future)) job_private_free(priv);
+}
+
+static void job_complete(struct job_private * job, int status)
+{
+	job->base->status = status;
+
+	// the callback sees the results before the waiters do, (it may take the result)
+	if(job->base->on_completed) job->base->on_completed(job->base);
+	job_future_set_done(job->future);
+}
+
+int ai_engine_job_wait(ai_engine_job_t * job, long timeout_ms)
+{
+	assert(job);
+	struct job_private * priv = (struct job_private *)job;
+	return job_future_wait(priv->future, timeout_ms)?job->status:ai_engine_job_status_pending;
+}
+
+json_object * ai_engine_job_take_result(ai_engine_job_t * job)
+{
+	assert(job);
+	json_object * jresult = job->jresult;
+	job->jresult = NULL;
+	return jresult;
+}
+
+/******************************************************************************
+ * ai_engine_pool
+ *****************************************************************************/
+void ai_engine_pool_params_load(struct ai_engine_pool_params * params, json_object * jconfig)
+{
+	assert(params);
+	memset(params, 0, sizeof(*params));
+	params->num_replicas = 1;
+	if(NULL == jconfig) return;
+
+	params->num_replicas = json_get_value_default(jconfig, int, replicas, 1);
+	params->cpus_per_replica = json_get_value_default(jconfig, int, cpus_per_replica, 0);
+	params->max_pending = json_get_value_default(jconfig, int, max_pending, 0);
+
+	if(params->num_replicas < 1) params->num_replicas = 1;
+	if(params->num_replicas > AI_ENGINE_POOL_MAX_REPLICAS) params->num_replicas = AI_ENGINE_POOL_MAX_REPLICAS;
+	if(params->cpus_per_replica < 0) params->cpus_per_replica = 0;
+}
+
+struct ai_engine_pool_private;
+struct replica
+{
+	struct ai_engine_pool_private * pool;
+	int index;
+	pthread_t th;
+	ai_engine_t * engine;
+	int max_batch;
+};
+
+struct ai_engine_pool_private
+{
+	ai_engine_pool_t * pool;
+	struct ai_engine_pool_params params;
+	ai_engine_t * (* new_replica)(struct ai_engine_pool * pool, int index);
+
+	job_queue_t queue[1];	// queue->mutex also guards the stats and the replicas' startup
+	pthread_cond_t started;
+
+	int num_threads;
+	int num_started;	// the replicas that have either been created or failed
+	int num_ready;
+	struct replica * replicas;
+
+	struct ai_engine_pool_stats stats;
+};
+
+// new_replica() is serialized across all the pools
+static pthread_mutex_t s_replica_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void replica_set_affinity(struct replica * replica)
+{
+	const struct ai_engine_pool_params * params = &replica->pool->params;
+	if(params->cpus_per_replica <= 0) return;
+
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_cpus <= 0 || num_cpus > CPU_SETSIZE) num_cpus = CPU_SETSIZE;
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	int first_cpu = params->first_cpu + replica->index * params->cpus_per_replica;
+	for(int i = 0; i < params->cpus_per_replica && i < num_cpus; ++i)
+	{
+		CPU_SET((first_cpu + i) % num_cpus, &cpus);
+	}
+
+	int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	if(rc) {
+		fprintf(stderr, "[WARNING]::%s()::replica %d: pthread_setaffinity_np(cpus %d ~ %d) failed: %s\n", __FUNCTION__,
+			replica->index, first_cpu, first_cpu + params->cpus_per_replica - 1, strerror(rc));
+	}
+}
+
+static void replica_predict(struct replica * replica, struct job_private ** jobs, int count)
+{
+	ai_engine_t * engine = replica->engine;
+	const input_frame_t * frames[AI_ENGINE_POOL_MAX_BATCH];
+	json_object * results[AI_ENGINE_POOL_MAX_BATCH];
+	int status = ai_engine_job_status_completed;
+
+	// one rule for any batch size: predict_batch() fails on real errors only,
+	// a NULL result is "no detections", (predict()'s return code can't tell them apart, e.g. darknet on raw frames)
+	for(int i = 0; i < count; ++i) frames[i] = jobs[i]->base->frame;
+	double begin_time = job_queue_get_time_sec();
+	int rc = engine->predict_batch(engine, frames, count, results);
+	if(rc)
+	{
+		memset(results, 0, sizeof(results[0]) * count);
+		status = ai_engine_job_status_failed;
+	}
+	double predict_time = job_queue_get_time_sec() - begin_time;
+
+	// counted before the jobs complete: a waiter finds its own job in the stats
+	struct ai_engine_pool_private * priv = replica->pool;
+	pthread_mutex_lock(&priv->queue->mutex);
+	if(status == ai_engine_job_status_completed) priv->stats.completed += count;
+	else priv->stats.failed += count;
+	++priv->stats.batches;
+	priv->stats.predict_time += predict_time;
+	pthread_mutex_unlock(&priv->queue->mutex);
+
+	for(int i = 0; i < count; ++i)
+	{
+		ai_engine_job_t * base = jobs[i]->base;
+		base->queued_time = begin_time - jobs[i]->submit_time;
+		base->predict_time = predict_time;
+		base->replica_index = replica->index;
+		base->batch_size = count;
+		base->jresult = results[i];
+		job_complete(jobs[i], status);
+		ai_engine_job_unref(base);
+	}
+}
+
+static void * replica_thread(void * user_data)
+{
+	struct replica * replica = user_data;
+	struct ai_engine_pool_private * priv = replica->pool;
+
+	// pin first: the replica allocates its memory from the cpus it will run on
+	replica_set_affinity(replica);
+
+	pthread_mutex_lock(&s_replica_init_mutex);
+	ai_engine_t * engine = priv->new_replica(priv->pool, replica->index);
+	pthread_mutex_unlock(&s_replica_init_mutex);
+
+	if(engine)
+	{
+		assert(engine->predict && engine->predict_batch);
+		int max_batch = engine->max_batch_size;
+		if(max_batch < 1) max_batch = 1;
+		if(max_batch > AI_ENGINE_POOL_MAX_BATCH) max_batch = AI_ENGINE_POOL_MAX_BATCH;
+		replica->engine = engine;
+		replica->max_batch = max_batch;
+	}else
+	{
+		fprintf(stderr, "[ERROR]::%s()::failed to create replica %d\n", __FUNCTION__, replica->index);
+	}
+
+	pthread_mutex_lock(&priv->queue->mutex);
+	++priv->num_started;
+	if(engine) ++priv->num_ready;
+	pthread_cond_broadcast(&priv->started);
+	pthread_mutex_unlock(&priv->queue->mutex);
+	if(NULL == engine) return NULL;
+
+	struct job_private * jobs[AI_ENGINE_POOL_MAX_BATCH];
+	while(1)
+	{
+		// take what is there, up to a full batch
+		pthread_mutex_lock(&priv->queue->mutex);
+		int count = job_queue_pop(priv->queue, (void **)jobs, replica->max_batch);
+		pthread_mutex_unlock(&priv->queue->mutex);
+		if(0 == count) break;
+
+		replica_predict(replica, jobs, count);
+	}
+
+	// released on the thread that created it, (e.g. per-thread gpu contexts)
+	ai_engine_cleanup(engine);
+	free(engine);
+	replica->engine = NULL;
+	return NULL;
+}
+
+static int ai_engine_pool_submit(struct ai_engine_pool * pool, const input_frame_t * frame, int flags,
+	void (* on_completed)(ai_engine_job_t * job), void * user_data,
+	ai_engine_job_t ** p_job)
+{
+	assert(pool && pool->priv && frame);
+	struct ai_engine_pool_private * priv = pool->priv;
+
+	// fast path: drop without touching the frame
+	pthread_mutex_lock(&priv->queue->mutex);
+	++priv->stats.submitted;
+	int full = priv->queue->quit || (job_queue_is_full(priv->queue) && !(flags & ai_engine_pool_flag_wait_if_full));
+	if(full) ++priv->stats.dropped;
+	pthread_mutex_unlock(&priv->queue->mutex);
+	if(p_job) *p_job = NULL;
+	if(full) return -1;
+
+	// share the frame outside the lock
+	struct job_private * job = job_private_new();
+	ai_engine_job_t * base = job->base;
+	base->user_data = user_data;
+	base->on_completed = on_completed;
+	if(NULL == input_frame_ref(base->frame, frame))
+	{
+		pthread_mutex_lock(&priv->queue->mutex);
+		++priv->stats.dropped;
+		pthread_mutex_unlock(&priv->queue->mutex);
+		job_private_free(job);
+		return -1;
+	}
+
+	pthread_mutex_lock(&priv->queue->mutex);
+	if(job_queue_push(priv->queue, job, (flags & ai_engine_pool_flag_wait_if_full)))
+	{
+		++priv->stats.dropped;
+		pthread_mutex_unlock(&priv->queue->mutex);
+		job_private_free(job);
+		return -1;
+	}
+
+	job->submit_time = job_queue_get_time_sec();	// the replicas can't pop it before the lock is released
+	if(p_job)
+	{
+		job_future_addref(job->future);	// not shared yet
+		*p_job = base;
+	}
+	pthread_mutex_unlock(&priv->queue->mutex);
+	return 0;
+}
+
+static void ai_engine_pool_get_stats(struct ai_engine_pool * pool, struct ai_engine_pool_stats * stats)
+{
+	assert(pool && pool->priv && stats);
+	struct ai_engine_pool_private * priv = pool->priv;
+	pthread_mutex_lock(&priv->queue->mutex);
+	*stats = priv->stats;
+	stats->pending = priv->queue->length;
+	pthread_mutex_unlock(&priv->queue->mutex);
+}
+
+ai_engine_pool_t * ai_engine_pool_init(ai_engine_pool_t * pool, const struct ai_engine_pool_params * params,
+	ai_engine_t * (* new_replica)(struct ai_engine_pool * pool, int index),
+	void * user_data)
+{
+	assert(new_replica);
+	struct ai_engine_pool_params default_params;
+	if(NULL == params)
+	{
+		ai_engine_pool_params_load(&default_params, NULL);
+		params = &default_params;
+	}
+
+	int allocated = (NULL == pool);
+	if(NULL == pool) pool = calloc(1, sizeof(*pool));
+	assert(pool);
+	pool->user_data = user_data;
+	pool->submit = ai_engine_pool_submit;
+	pool->get_stats = ai_engine_pool_get_stats;
+
+	struct ai_engine_pool_private * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->pool = pool;
+	priv->params = *params;
+	if(priv->params.num_replicas < 1) priv->params.num_replicas = 1;
+	if(priv->params.num_replicas > AI_ENGINE_POOL_MAX_REPLICAS) priv->params.num_replicas = AI_ENGINE_POOL_MAX_REPLICAS;
+	priv->new_replica = new_replica;
+	job_queue_init(priv->queue, 0);
+	pthread_cond_init(&priv->started, NULL);
+	pool->priv = priv;
+
+	int num_replicas = priv->params.num_replicas;
+	priv->replicas = calloc(num_replicas, sizeof(*priv->replicas));
+	assert(priv->replicas);
+	for(int i = 0; i < num_replicas; ++i)
+	{
+		struct replica * replica = &priv->replicas[i];
+		replica->pool = priv;
+		replica->index = i;
+		int rc = pthread_create(&replica->th, NULL, replica_thread, replica);
+		assert(0 == rc);
+		priv->num_threads = i + 1;
+	}
+
+	// the queue is sized once the replicas know their batch size, (no job can be queued before)
+	pthread_mutex_lock(&priv->queue->mutex);
+	while(priv->num_started < num_replicas) pthread_cond_wait(&priv->started, &priv->queue->mutex);
+	int max_batch = 1;
+	for(int i = 0; i < num_replicas; ++i)
+	{
+		if(priv->replicas[i].max_batch > max_batch) max_batch = priv->replicas[i].max_batch;
+	}
+	int max_pending = priv->params.max_pending;
+	if(max_pending <= 0) max_pending = priv->num_ready * max_batch * 2;
+	if(max_pending <= 0) max_pending = 1;
+	job_queue_set_capacity(priv->queue, max_pending);
+	pool->num_replicas = priv->num_ready;
+	pool->max_pending = max_pending;
+	pthread_mutex_unlock(&priv->queue->mutex);
+
+	if(0 == pool->num_replicas)
+	{
+		ai_engine_pool_cleanup(pool);
+		if(allocated) free(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+static void cancel_job(void * job_ptr, void * user_data)
+{
+	struct ai_engine_pool_private * priv = user_data;
+	struct job_private * job = job_ptr;
+
+	pthread_mutex_lock(&priv->queue->mutex);
+	++priv->stats.cancelled;
+	pthread_mutex_unlock(&priv->queue->mutex);
+
+	job_complete(job, ai_engine_job_status_cancelled);
+	ai_engine_job_unref(job->base);
+}
+
+void ai_engine_pool_cleanup(ai_engine_pool_t * pool)
+{
+	if(NULL == pool || NULL == pool->priv) return;
+	struct ai_engine_pool_private * priv = pool->priv;
+
+	job_queue_stop(priv->queue);
+	for(int i = 0; i < priv->num_threads; ++i) pthread_join(priv->replicas[i].th, NULL);
+	priv->num_threads = 0;
+
+	// cancel the pending jobs
+	job_queue_cancel_all(priv->queue, cancel_job, priv);
+	job_queue_cleanup(priv->queue);
+	pthread_cond_destroy(&priv->started);
+	free(priv->replicas);
+	free(priv);
+	pool->priv = NULL;
+	pool->num_replicas = 0;
+}
@@ -115,9 +115,34 @@ ai_engine_t * ai_engine_init(ai_engine_t * engine, const char * plugin_type, voi
 	engine->user_data = user_data;
 	engine->init = plugin->init_func;
 	
+	// defaults, (overridden by the plugins that batch natively)
+	engine->max_batch_size = 1;
+	engine->predict_batch = ai_engine_predict_batch_default;
 	return engine;
 }
 
+int ai_engine_predict_batch_default(ai_engine_t * engine, const input_frame_t ** frames, int count, json_object ** results)
+{
+	assert(engine && engine->predict);
+	if(NULL == frames || NULL == results || count <= 0) return -1;
+	
+	for(int i = 0; i < count; ++i)
+	{
+		results[i] = NULL;
+		if(NULL == frames[i]) continue;
+		
+		json_object * jresult = NULL;
+		int rc = engine->predict(engine, frames[i], &jresult);
+		if(rc && jresult)
+		{
+			json_object_put(jresult);
+			jresult = NULL;
+		}
+		results[i] = jresult;
+	}
+	return 0;
+}
+
 void ai_engine_cleanup(ai_engine_t * engine)
 {
 	if(engine && engine->cleanup)
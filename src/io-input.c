@@ -28,6 +28,8 @@
 #include <assert.h>
 
 #include <pthread.h>
+#include <errno.h>
+#include <time.h>
 #include <json-c/json.h>
 
 #include <dlfcn.h>
@@ -52,24 +54,156 @@ enum io_input_type io_input_type_from_string(const char * sz_type)
 }
 
 // internal datatype
+#define FRAME_HISTORY_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+
+/*
+ * frame_history:
+ *   a bounded ring of the last published frames, (references only, the payloads are shared with the readers)
+ *   bounded by max_frames and by max_bytes (the sum of the referenced payloads)
+ */
+typedef struct frame_history
+{
+	ssize_t max_frames;		// 0: disabled
+	ssize_t max_bytes;
+	ssize_t start;			// index of the oldest frame
+	ssize_t length;
+	ssize_t total_bytes;
+	input_frame_t ** frames;
+	long * frame_numbers;
+	ssize_t * sizes;
+}frame_history_t;
+
 typedef struct double_buffer double_buffer_t;
 struct double_buffer
 {
 	input_frame_t * frames[2];
 	pthread_mutex_t mutex;
+	pthread_cond_t cond;	// signaled on every set(), clock: CLOCK_MONOTONIC
 	long frame_number;
+	frame_history_t history[1];	// protected by mutex
 	long (* set)(double_buffer_t * dbuf, const input_frame_t * frame);
 	long (* get)(double_buffer_t * dbuf, input_frame_t * frame);
+	long (* wait)(double_buffer_t * dbuf, long prev_frame, input_frame_t * frame, long timeout_ms);
 };
 
+#define history_index(history, i) (((history)->start + (i)) % (history)->max_frames)
+static void frame_history_clear(frame_history_t * history)
+{
+	for(ssize_t i = 0; i < history->length; ++i)
+	{
+		input_frame_clear(history->frames[history_index(history, i)]);
+	}
+	history->start = 0;
+	history->length = 0;
+	history->total_bytes = 0;
+}
+
+static void frame_history_cleanup(frame_history_t * history)
+{
+	frame_history_clear(history);
+	for(ssize_t i = 0; i < history->max_frames; ++i)
+	{
+		input_frame_free(history->frames[i]);
+	}
+	free(history->frames);
+	free(history->frame_numbers);
+	free(history->sizes);
+	memset(history, 0, sizeof(*history));
+}
+
+static void frame_history_resize(frame_history_t * history, ssize_t max_frames, ssize_t max_bytes)
+{
+	frame_history_cleanup(history);
+	if(max_frames <= 0) return;
+	if(max_bytes <= 0) max_bytes = FRAME_HISTORY_DEFAULT_MAX_BYTES;
+	
+	history->frames = calloc(max_frames, sizeof(*history->frames));
+	history->frame_numbers = calloc(max_frames, sizeof(*history->frame_numbers));
+	history->sizes = calloc(max_frames, sizeof(*history->sizes));
+	assert(history->frames && history->frame_numbers && history->sizes);
+	
+	for(ssize_t i = 0; i < max_frames; ++i)
+	{
+		history->frames[i] = input_frame_new();
+		assert(history->frames[i]);
+	}
+	history->max_frames = max_frames;
+	history->max_bytes = max_bytes;
+}
+
+static void frame_history_pop_front(frame_history_t * history)
+{
+	assert(history->length > 0);
+	ssize_t index = history->start;
+	input_frame_clear(history->frames[index]);
+	history->total_bytes -= history->sizes[index];
+	history->start = (history->start + 1) % history->max_frames;
+	--history->length;
+}
+
+static void frame_history_push(frame_history_t * history, const input_frame_t * frame, long frame_number)
+{
+	if(history->max_frames <= 0 || NULL == frame->payload) return;
+	
+	// the source restarted, frame numbers are no longer ordered
+	if(history->length > 0 && frame_number <= history->frame_numbers[history_index(history, history->length - 1)])
+	{
+		frame_history_clear(history);
+	}
+	
+	ssize_t size = frame->payload->length + frame->payload->cb_json;
+	if(size > history->max_bytes) return;
+	while(history->length > 0 && 
+		(history->length >= history->max_frames || (history->total_bytes + size) > history->max_bytes))
+	{
+		frame_history_pop_front(history);
+	}
+	
+	ssize_t index = history_index(history, history->length);
+	input_frame_ref(history->frames[index], frame);	// add_ref, no copy
+	history->frame_numbers[index] = frame_number;
+	history->sizes[index] = size;
+	history->total_bytes += size;
+	++history->length;
+}
+
+static input_frame_t * frame_history_find(const frame_history_t * history, long frame_number)
+{
+	if(history->length <= 0) return NULL;
+	long first = history->frame_numbers[history_index(history, 0)];
+	long last = history->frame_numbers[history_index(history, history->length - 1)];
+	if(frame_number < first || frame_number > last) return NULL;
+	
+	// frame numbers are consecutive in most cases
+	ssize_t offset = frame_number - first;
+	if(offset < history->length && history->frame_numbers[history_index(history, offset)] == frame_number)
+	{
+		return history->frames[history_index(history, offset)];
+	}
+	
+	// some frames were skipped, the numbers are still ordered
+	ssize_t left = 0, right = history->length - 1;
+	while(left <= right)
+	{
+		ssize_t mid = (left + right) / 2;
+		long number = history->frame_numbers[history_index(history, mid)];
+		if(number == frame_number) return history->frames[history_index(history, mid)];
+		if(number < frame_number) left = mid + 1;
+		else right = mid - 1;
+	}
+	return NULL;
+}
+
 static void double_buffer_free(double_buffer_t * dbuf)
 {
 	pthread_mutex_lock(&dbuf->mutex);
+	frame_history_cleanup(dbuf->history);
 	input_frame_free(dbuf->frames[0]);
 	input_frame_free(dbuf->frames[1]);
 	dbuf->frames[0] = NULL;
 	dbuf->frames[1] = NULL;
 	pthread_mutex_unlock(&dbuf->mutex);
+	pthread_cond_destroy(&dbuf->cond);
 	pthread_mutex_destroy(&dbuf->mutex);
 	free(dbuf);
 	return;
@@ -79,7 +213,8 @@ static long double_buffer_set(double_buffer_t * dbuf, const input_frame_t * fram
 {
 	if(NULL == dbuf->frames[1]) return -1;
 	
-	input_frame_copy(dbuf->frames[1], frame);
+	// publish: share the frame's payload, (the image is copied at most once if the frame is not shared yet)
+	if(NULL == input_frame_ref(dbuf->frames[1], frame)) return -1;
 	pthread_mutex_lock(&dbuf->mutex);
 
 	if(frame->frame_number > 0)
@@ -94,26 +229,116 @@ static long double_buffer_set(double_buffer_t * dbuf, const input_frame_t * fram
 	input_frame_t * tmp = dbuf->frames[0];
 	dbuf->frames[0] = dbuf->frames[1];
 	dbuf->frames[1] = tmp;
+	frame_history_push(dbuf->history, dbuf->frames[0], frame_number);
+	pthread_cond_broadcast(&dbuf->cond);
 	pthread_mutex_unlock(&dbuf->mutex);
+	
+	// release the previous payload, readers still holding it keep their own references
+	input_frame_clear(dbuf->frames[1]);
 	return frame_number;
 }
 
 
-static long double_buffer_get(double_buffer_t * dbuf, input_frame_t * frame)
+/*
+ * double_buffer_wait():
+ *   wait until a frame other than prev_frame has been published, or timeout.
+ *   prev_frame: -1 for any published frame
+ *   timeout_ms: 0 for no wait, < 0 for infinite
+ *   frame: (nullable) receives a reference of the new frame, left untouched if the frame did not change.
+ * 
+ *   return the current frame_number, (== prev_frame on timeout)
+ */
+static long double_buffer_wait(double_buffer_t * dbuf, long prev_frame, input_frame_t * frame, long timeout_ms)
 {
 	if(NULL == dbuf->frames[0]) return -1;
-	if(NULL == frame) return dbuf->frame_number;	// query current frame_number only
 	
+	struct timespec abstime = { 0 };
+	if(timeout_ms > 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &abstime);
+		abstime.tv_sec += timeout_ms / 1000;
+		abstime.tv_nsec += (timeout_ms % 1000) * 1000000;
+		if(abstime.tv_nsec >= 1000000000)
+		{
+			++abstime.tv_sec;
+			abstime.tv_nsec -= 1000000000;
+		}
+	}
+	
+#define frame_unchanged(dbuf) (NULL == dbuf->frames[0]->payload || (prev_frame >= 0 && dbuf->frame_number == prev_frame))
+	int rc = 0;
 	pthread_mutex_lock(&dbuf->mutex);
-	input_frame_copy(frame, dbuf->frames[0]);
-	if(dbuf->frame_number > 0)
+	while(timeout_ms != 0 && frame_unchanged(dbuf))
 	{
-		frame->frame_number = dbuf->frame_number;
+		if(timeout_ms < 0) rc = pthread_cond_wait(&dbuf->cond, &dbuf->mutex);
+		else rc = pthread_cond_timedwait(&dbuf->cond, &dbuf->mutex, &abstime);
+		if(rc == ETIMEDOUT) break;
+	}
+	
+	long frame_number = dbuf->frame_number;
+	if(NULL == frame || frame_unchanged(dbuf))	
+	{
+		pthread_mutex_unlock(&dbuf->mutex);
+		return frame_number;
+	}
+#undef frame_unchanged
+
+	input_frame_ref(frame, dbuf->frames[0]);	// add_ref, no copy
+	if(frame_number > 0)
+	{
+		frame->frame_number = frame_number;
 	}
 	pthread_mutex_unlock(&dbuf->mutex);
 	return frame->frame_number;
 }
 
+static long double_buffer_get(double_buffer_t * dbuf, input_frame_t * frame)
+{
+	if(NULL == dbuf->frames[0]) return -1;
+	if(NULL == frame) return dbuf->frame_number;	// query current frame_number only
+	return double_buffer_wait(dbuf, -1, frame, 0);
+}
+
+static long double_buffer_find(double_buffer_t * dbuf, long frame_number, input_frame_t * frame)
+{
+	pthread_mutex_lock(&dbuf->mutex);
+	input_frame_t * src = frame_history_find(dbuf->history, frame_number);
+	if(NULL == src)
+	{
+		pthread_mutex_unlock(&dbuf->mutex);
+		return -1;
+	}
+	if(frame)
+	{
+		input_frame_ref(frame, src);	// add_ref, no copy
+		frame->frame_number = frame_number;
+	}
+	pthread_mutex_unlock(&dbuf->mutex);
+	return frame_number;
+}
+
+static ssize_t double_buffer_get_history(double_buffer_t * dbuf, long * p_first, long * p_last)
+{
+	pthread_mutex_lock(&dbuf->mutex);
+	frame_history_t * history = dbuf->history;
+	ssize_t length = history->length;
+	if(length > 0)
+	{
+		if(p_first) *p_first = history->frame_numbers[history_index(history, 0)];
+		if(p_last) *p_last = history->frame_numbers[history_index(history, length - 1)];
+	}
+	pthread_mutex_unlock(&dbuf->mutex);
+	return length;
+}
+#undef history_index
+
+static void double_buffer_set_history(double_buffer_t * dbuf, ssize_t max_frames, ssize_t max_bytes)
+{
+	pthread_mutex_lock(&dbuf->mutex);
+	frame_history_resize(dbuf->history, max_frames, max_bytes);
+	pthread_mutex_unlock(&dbuf->mutex);
+}
+
 double_buffer_t * double_buffer_new(void)
 {
 	double_buffer_t * dbuf = calloc(1, sizeof(*dbuf));
@@ -121,12 +346,20 @@ double_buffer_t * double_buffer_new(void)
 
 	int rc = pthread_mutex_init(&dbuf->mutex, NULL);
 	assert(0 == rc);
+	
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	rc = pthread_cond_init(&dbuf->cond, &attr);
+	assert(0 == rc);
+	pthread_condattr_destroy(&attr);
 
 	dbuf->frames[0] = input_frame_new();
 	dbuf->frames[1] = input_frame_new();
 	
 	dbuf->set = double_buffer_set;
 	dbuf->get = double_buffer_get;
+	dbuf->wait = double_buffer_wait;
 	return dbuf;
 }
 
@@ -136,11 +369,29 @@ double_buffer_t * double_buffer_new(void)
 static long io_input_get_frame(struct io_input * input, long prev_frame, input_frame_t * frame)
 {
 	if(NULL == input || NULL == input->frame_buffer) return -1;
-	long frame_number =  double_buffer_get(input->frame_buffer, frame);
+	long frame_number =  double_buffer_wait(input->frame_buffer, prev_frame, frame, 0);	// only ref the frame if it's not prev_frame
 	//~ debug_printf("get_frame: type=%d, size=%d x %d, length=%ld", frame->type, frame->width, frame->height, (long)frame->length);
 	return frame_number;
 }
 
+static long io_input_wait_frame(struct io_input * input, long prev_frame, input_frame_t * frame, long timeout_ms)
+{
+	if(NULL == input || NULL == input->frame_buffer) return -1;
+	return double_buffer_wait(input->frame_buffer, prev_frame, frame, timeout_ms);
+}
+
+static long io_input_find_frame(struct io_input * input, long frame_number, input_frame_t * frame)
+{
+	if(NULL == input || NULL == input->frame_buffer) return -1;
+	return double_buffer_find(input->frame_buffer, frame_number, frame);
+}
+
+static ssize_t io_input_get_history(struct io_input * input, long * p_first, long * p_last)
+{
+	if(NULL == input || NULL == input->frame_buffer) return -1;
+	return double_buffer_get_history(input->frame_buffer, p_first, p_last);
+}
+
 static long io_input_set_frame(struct io_input * input, const input_frame_t * frame)
 {
 	if(NULL == input || NULL == input->frame_buffer) return -1;
@@ -152,6 +403,32 @@ static long io_input_set_frame(struct io_input * input, const input_frame_t * fr
 /*****************************************************************
  * io_input: constructor / desctructor
 *****************************************************************/
+/*
+ * jconfig: (optional) frame history
+ * "history": {
+ * 		"max_frames": 30,			// 0: disabled (default)
+ * 		"max_bytes": 67108864		// default: 64 MiB
+ * }
+ */
+static int io_input_init_with_history(struct io_input * input, json_object * jconfig)
+{
+	assert(input && input->plugin);
+	ann_plugin_t * plugin = input->plugin;
+	
+	json_object * jhistory = NULL;
+	if(jconfig) json_object_object_get_ex(jconfig, "history", &jhistory);
+	if(jhistory)
+	{
+		ssize_t max_frames = json_get_value(jhistory, int, max_frames);
+		ssize_t max_bytes = json_get_value(jhistory, double, max_bytes);
+		double_buffer_set_history(input->frame_buffer, max_frames, max_bytes);
+	}
+	
+	ann_plugin_init_function init = plugin->init_func;
+	assert(init);
+	return init(input, jconfig);
+}
+
 io_input_t * io_input_init(io_input_t * input, const char * sz_type, void * user_data)
 {
 	if(NULL == sz_type) sz_type = "io-plugin::input-source";
@@ -174,11 +451,15 @@ io_input_t * io_input_init(io_input_t * input, const char * sz_type, void * user
 
 	input->set_frame = io_input_set_frame;
 	input->get_frame = io_input_get_frame;
+	input->wait_frame = io_input_wait_frame;
+	input->find_frame = io_input_find_frame;
+	input->get_history = io_input_get_history;
 
 	if(plugin)
 	{
 		assert(plugin->init_func);
-		input->init = plugin->init_func;
+		input->plugin = plugin;
+		input->init = io_input_init_with_history;
 	}
 	return input;
 }
@@ -28,6 +28,8 @@
 #include <assert.h>
 
 #include "img_proc.h"
+#include "img_preproc.h"
+#include "ai-tiling.h"
 #include "utils.h"
 #include "darknet-wrapper.h"
 
@@ -132,6 +134,9 @@ typedef struct darknet_private
 	float thresh; 	// confidence threshold, default = 0.5f;
 	float hier; 	// yolov2 only, default = 0.5f;
 	float nms; 		// Non-maximum Suppression (NMS), default = 0.45;
+	int letterbox;	// 1: keep the aspect ratio when resizing to the network size, default = 0
+	struct ai_tiling_params tiling;
+	int batch_capacity;	// the layers were allocated for this batch, (cfg: batch / subdivisions)
 }darknet_private_t;
 
 darknet_private_t * darknet_private_new(darknet_context_t * darknet, json_object * jconfig)
@@ -193,6 +198,7 @@ darknet_private_t * darknet_private_new(darknet_context_t * darknet, json_object
 		priv->labels = labels;
 	}
 	assert(priv->labels_count == num_classes);
+	priv->batch_capacity = net->batch;
 	set_batch_network(net, 1);
 	
 	priv->relative = json_get_value_default(jconfig, int, relative, 1);
@@ -200,12 +206,24 @@ darknet_private_t * darknet_private_new(darknet_context_t * darknet, json_object
 	priv->thresh = json_get_value_default(jconfig, double, threshod, 0.5);
 	priv->hier = json_get_value_default(jconfig, double, hier, 0.5);
 	priv->nms = json_get_value_default(jconfig, double, nms, 0.45);
+	priv->letterbox = json_get_value_default(jconfig, int, letterbox, 0);
+	
+	json_object * jtiling = NULL;
+	json_object_object_get_ex(jconfig, "tiling", &jtiling);
+	ai_tiling_params_load(&priv->tiling, jtiling);
 	
 	priv->net = net;
 	return priv;
 }
 
 static ssize_t darknet_predict(darknet_context_t * darknet, const bgra_image_t frame[1], ai_detection_t ** p_results);
+static ssize_t darknet_predict_yuv(darknet_context_t * darknet, const yuv_image_t * frame, ai_detection_t ** p_results);
+static ssize_t darknet_predict_tiled(darknet_context_t * darknet, const bgra_image_t frame[1], ai_detection_t ** p_results);
+static ssize_t darknet_predict_yuv_tiled(darknet_context_t * darknet, const yuv_image_t * frame, ai_detection_t ** p_results);
+static int darknet_predict_frames(darknet_context_t * darknet, const darknet_frame_t * frames, int count, ai_detection_t ** results, ssize_t * counts);
+static int darknet_predict_frames_tiled(darknet_context_t * darknet, const darknet_frame_t * frames, int count, ai_detection_t ** results, ssize_t * counts);
+
+#define DARKNET_MAX_BATCH (64)
 darknet_context_t * darknet_context_new(json_object * jconfig, void * user_data)
 {
 	assert(jconfig && user_data);
@@ -215,10 +233,34 @@ darknet_context_t * darknet_context_new(json_object * jconfig, void * user_data)
 	
 	darknet->user_data = user_data;
 	darknet->predict = darknet_predict;
+	darknet->predict_yuv = darknet_predict_yuv;
+	darknet->predict_batch = darknet_predict_frames;
 	
 	darknet_private_t * priv = darknet_private_new(darknet, jconfig);
 	assert(priv && darknet->priv == priv);
 	
+	darknet->width = priv->net->w;
+	darknet->height = priv->net->h;
+	darknet->relative = priv->relative;
+	darknet->fast_jpeg_decode = json_get_value_default(jconfig, int, fast_jpeg_decode, 0);
+	
+	int max_batch = json_get_value_default(jconfig, int, max_batch, priv->batch_capacity);
+	if(max_batch > priv->batch_capacity) {
+		fprintf(stderr, "[WARNING]::%s(): max_batch=%d, the network was loaded with batch=%d, (cfg: batch / subdivisions)\n",
+			__FUNCTION__, max_batch, priv->batch_capacity);
+		max_batch = priv->batch_capacity;
+	}
+	if(max_batch > DARKNET_MAX_BATCH) max_batch = DARKNET_MAX_BATCH;
+	if(max_batch == 2 || max_batch < 1) max_batch = 1;	// a batch of 2 is run as batch 3, (see darknet_predict_frames())
+	darknet->max_batch = max_batch;
+	
+	darknet->tiling = priv->tiling.enabled;
+	if(darknet->tiling) {
+		darknet->predict = darknet_predict_tiled;
+		darknet->predict_yuv = darknet_predict_yuv_tiled;
+		darknet->predict_batch = darknet_predict_frames_tiled;
+	}
+	
 	return darknet;
 }
 
@@ -249,82 +291,283 @@ void darknet_context_free(darknet_context_t * darknet)
 }
 
 
-static int bgra_image_to_f32(const bgra_image_t * restrict bgra, float * restrict dst)
+static ssize_t darknet_get_detections(darknet_context_t * darknet, int batch_index, int frame_width, int frame_height,
+	const struct bgra_image_letterbox * letterbox, ai_detection_t ** p_results);
+
+static ssize_t darknet_predict(darknet_context_t * darknet, const bgra_image_t frame[1], ai_detection_t ** p_results)
 {
-	static const float scalar = 1.0f / 255.0f;
-	assert(dst);
+	darknet_frame_t input = { .bgra = frame };
+	ai_detection_t * results = NULL;
+	ssize_t count = -1;
+	darknet_predict_frames(darknet, &input, 1, &results, &count);
+	
+	if(p_results) *p_results = results;
+	else free(results);
+	return count;
+}
 
-	ssize_t size = bgra->width * bgra->height;
-	float * r_plane = dst;
-	float * g_plane = r_plane + size;
-	float * b_plane = g_plane + size;
-	
-	// from bgr (NHWC) to float32 (NCHW)
-	const unsigned char * bgra_data = bgra->data;
-	for(int pos = 0; pos < size; ++pos, bgra_data += 4)
-	{
-		r_plane[pos] = ((float) bgra_data[2]) * scalar;
-		g_plane[pos] = ((float) bgra_data[1]) * scalar;
-		b_plane[pos] = ((float) bgra_data[0]) * scalar;
-	}
-	return 0;
+static ssize_t darknet_predict_yuv(darknet_context_t * darknet, const yuv_image_t * frame, ai_detection_t ** p_results)
+{
+	darknet_frame_t input = { .yuv = frame };
+	ai_detection_t * results = NULL;
+	ssize_t count = -1;
+	darknet_predict_frames(darknet, &input, 1, &results, &count);
+	
+	if(p_results) *p_results = results;
+	else free(results);
+	return count;
 }
 
-static bgra_image_t * bgra_image_resize(bgra_image_t * dst, int width, int height, const bgra_image_t * src)
+/*
+ * frame ==> network input (float32 rgb planes, NCHW), letterbox: the mapping back to the frame
+ */
+static const struct img_preproc_params s_darknet_params = { .scale = 1.0f / 255.0f };
+static int darknet_prepare_input(darknet_context_t * darknet, const darknet_frame_t * frame, float * input, struct bgra_image_letterbox * letterbox)
 {
-	assert(src && width > 1 && height > 1 && src->width > 1 && src->height > 1 && src->data);
-	cairo_surface_t * origin = cairo_image_surface_create_for_data((unsigned char *)src->data,
-		CAIRO_FORMAT_ARGB32,
-		src->width, src->height, src->width * 4);
-	assert(origin);
+	darknet_private_t * priv = darknet->priv;
+	network * net = priv->net;
+	int width = net->w;
+	int height = net->h;
+	*letterbox = (struct bgra_image_letterbox){ .scale_x = 1.0, .scale_y = 1.0 };
+	
+	if(NULL == frame->bgra) {
+		// yuv frames: resize, color conversion and normalization in one pass, straight into the network input
+		const yuv_image_t * yuv = frame->yuv;
+		if(NULL == yuv) return -1;
+		if(priv->letterbox) {
+			bgra_image_letterbox_init(letterbox, yuv->width, yuv->height, width, height);
+			for(ssize_t i = 0; i < (ssize_t)width * height * 3; ++i) input[i] = 128.0f / 255.0f;	// borders: 0xff808080
+		}
+		return img_preproc_yuv_to_f32_resized(yuv, input, width, height, priv->letterbox?letterbox:NULL, &s_darknet_params);
+	}
 	
-	double sx = (double)width / (double)src->width;
-	double sy = (double)height / (double)src->height;
+	const bgra_image_t * bgra = frame->bgra;
+	debug_printf("resize: %d x %d   --> %d x %d\n", bgra->width, bgra->height, width, height);
+	bgra_image_t resized[1];
+	memset(resized, 0, sizeof(resized));
+	resized->width = width;
+	resized->height = height;
+	
+	const bgra_image_t * input_image = bgra;
+	int rc = 0;
+	if(priv->letterbox) {
+		rc = bgra_image_letterbox(resized, bgra, bgra_image_resize_filter_auto, 0xff808080, letterbox);
+		input_image = resized;
+	}else if(bgra->width != width || bgra->height != height) {
+		rc = bgra_image_resize(resized, bgra, bgra_image_resize_filter_auto);
+		input_image = resized;
+	}
+	assert(0 == rc && input_image->data);
 	
-	cairo_surface_t * resized = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-	assert(resized);
+	// from bgra (NHWC) to float32 rgb planes (NCHW)
+	img_preproc_bgra_to_f32(input_image, input, &s_darknet_params);
+	bgra_image_clear(resized);
+	return 0;
+}
+
+/*
+ * batched inference: up to max_batch frames are stacked into one network input, one forward pass per batch.
+ *   darknet treats a batch of exactly 2 as an image and its flipped copy (avg_flipped_yolo),
+ *   so 2 frames are run as a batch of 3, (the last slot is left blank)
+ */
+static int darknet_predict_frames(darknet_context_t * darknet, const darknet_frame_t * frames, int count, ai_detection_t ** results, ssize_t * counts)
+{
+	darknet_private_t * priv = darknet->priv;
+	network * net = priv->net;
+	if(NULL == frames || count <= 0 || NULL == results || NULL == counts) return -1;
 	
-	cairo_t * cr = cairo_create(resized);
-	assert(cr);
+	int max_batch = (darknet->max_batch > 0)?darknet->max_batch:1;
+	if(max_batch > count) max_batch = (count == 2)?3:count;
+	size_t input_size = (size_t)net->w * net->h * 3;
+	float * input = malloc(input_size * max_batch * sizeof(float));
+	assert(input);
 	
-	cairo_scale(cr, sx, sy);
-	cairo_set_source_surface(cr, origin, 0, 0);
-	cairo_paint(cr);
+	struct bgra_image_letterbox letterboxes[DARKNET_MAX_BATCH];
+	int prepared[DARKNET_MAX_BATCH];
+	for(int begin = 0; begin < count; begin += max_batch) {
+		int batch_size = count - begin;
+		if(batch_size > max_batch) batch_size = max_batch;
+		int num_prepared = 0;
+		for(int i = 0; i < batch_size; ++i) {
+			results[begin + i] = NULL;
+			counts[begin + i] = -1;
+			float * slot = input + input_size * i;
+			prepared[i] = (0 == darknet_prepare_input(darknet, &frames[begin + i], slot, &letterboxes[i]));
+			if(prepared[i]) ++num_prepared;
+			else memset(slot, 0, input_size * sizeof(float));
+		}
+		if(0 == num_prepared) continue;
+		
+		int batch = (batch_size == 2)?3:batch_size;
+		if(batch > batch_size) memset(input + input_size * batch_size, 0, input_size * (batch - batch_size) * sizeof(float));
+		if(net->batch != batch) set_batch_network(net, batch);
+		
+		network_predict(net, input);
+		
+		for(int i = 0; i < batch_size; ++i) {
+			if(!prepared[i]) continue;
+			const darknet_frame_t * frame = &frames[begin + i];
+			int frame_width = frame->bgra?frame->bgra->width:frame->yuv->width;
+			int frame_height = frame->bgra?frame->bgra->height:frame->yuv->height;
+			counts[begin + i] = darknet_get_detections(darknet, i, frame_width, frame_height,
+				priv->letterbox?&letterboxes[i]:NULL, &results[begin + i]);
+		}
+	}
+	free(input);
+	return 0;
+}
+
+/*
+ * tiled inference, (see ai-tiling.h)
+ *   each tile is a zero-copy view of the frame, predicted like a whole frame (resize / letterbox to the network size),
+ *   then its boxes are mapped back to the frame and merged across the seams.
+ */
+#define DARKNET_MAX_TILES (64)
+static ssize_t darknet_predict_tiles(darknet_context_t * darknet, const bgra_image_t * bgra, const yuv_image_t * yuv, ai_detection_t ** p_results)
+{
+	darknet_private_t * priv = darknet->priv;
+	network * net = priv->net;
+	int relative = priv->relative;
+	int frame_width = bgra?bgra->width:yuv->width;
+	int frame_height = bgra?bgra->height:yuv->height;
+	
+	struct ai_tile tiles[DARKNET_MAX_TILES];
+	ssize_t num_tiles = ai_tiling_layout(&priv->tiling, frame_width, frame_height, net->w, net->h, tiles, DARKNET_MAX_TILES);
+	if(num_tiles <= 1) return bgra?darknet_predict(darknet, bgra, p_results):darknet_predict_yuv(darknet, yuv, p_results);
+	
+	// every tile is a zero-copy view, all of them are predicted as one batch (max_batch frames per forward pass)
+	bgra_image_t bgra_views[DARKNET_MAX_TILES];
+	yuv_image_t yuv_views[DARKNET_MAX_TILES];
+	darknet_frame_t inputs[DARKNET_MAX_TILES];
+	int origins[DARKNET_MAX_TILES][2];
+	ssize_t num_inputs = 0;
+	for(ssize_t i = 0; i < num_tiles; ++i) {
+		const struct ai_tile * tile = &tiles[i];
+		darknet_frame_t * input = &inputs[num_inputs];
+		memset(input, 0, sizeof(*input));
+		if(bgra) {
+			bgra_image_t * view = &bgra_views[num_inputs];
+			memset(view, 0, sizeof(*view));
+			if(NULL == bgra_image_view(view, bgra, tile->x, tile->y, tile->width, tile->height)) continue;
+			input->bgra = view;
+			origins[num_inputs][0] = tile->x;
+			origins[num_inputs][1] = tile->y;
+		}else {
+			yuv_image_t * view = &yuv_views[num_inputs];
+			if(NULL == yuv_image_view(view, yuv, tile->x, tile->y, tile->width, tile->height)) continue;
+			input->yuv = view;
+			origins[num_inputs][0] = tile->x & ~1;	// chroma aligned
+			origins[num_inputs][1] = tile->y & ~1;
+		}
+		++num_inputs;
+	}
 	
-	cairo_destroy(cr);
+	ai_detection_t * tile_results[DARKNET_MAX_TILES];
+	ssize_t tile_counts[DARKNET_MAX_TILES];
+	darknet_predict_frames(darknet, inputs, num_inputs, tile_results, tile_counts);
 	
-	unsigned char * image_data = cairo_image_surface_get_data(resized);
-	assert(image_data);
+	ai_detection_t * results = NULL;
+	int * tile_indices = NULL;
+	ssize_t count = 0;
+	for(ssize_t i = 0; i < num_inputs; ++i) {
+		ssize_t tile_count = tile_counts[i];
+		int tile_x = origins[i][0], tile_y = origins[i][1];
+		int tile_width = inputs[i].bgra?inputs[i].bgra->width:inputs[i].yuv->width;
+		int tile_height = inputs[i].bgra?inputs[i].bgra->height:inputs[i].yuv->height;
+		debug_printf("tile[%d]: (%d, %d, %d x %d), %ld detections\n", (int)i, tile_x, tile_y, tile_width, tile_height, (long)tile_count);
+		
+		if(tile_count > 0) {
+			results = realloc(results, (count + tile_count) * sizeof(*results));
+			tile_indices = realloc(tile_indices, (count + tile_count) * sizeof(*tile_indices));
+			assert(results && tile_indices);
+			
+			// tile ==> frame pixels, (relative: tile size; pixels: the view with letterbox, the network input without)
+			double unit_x = relative?tile_width:(priv->letterbox?1.0:(double)tile_width / net->w);
+			double unit_y = relative?tile_height:(priv->letterbox?1.0:(double)tile_height / net->h);
+			for(ssize_t k = 0; k < tile_count; ++k) {
+				ai_detection_t * result = &tile_results[i][k];
+				double x = tile_x + result->x * unit_x;
+				double y = tile_y + result->y * unit_y;
+				double cx = result->cx * unit_x;
+				double cy = result->cy * unit_y;
+				if(relative) {
+					x /= frame_width; cx /= frame_width;
+					y /= frame_height; cy /= frame_height;
+				}
+				result->x = x; result->y = y;
+				result->cx = cx; result->cy = cy;
+				tile_indices[count + k] = (int)i;
+			}
+			memcpy(results + count, tile_results[i], tile_count * sizeof(*results));
+			count += tile_count;
+		}
+		free(tile_results[i]);
+	}
 	
-	dst = bgra_image_init(dst, width, height, image_data);
-	assert(dst);
+	struct ai_tiling_box * boxes = calloc(count + 1, sizeof(*boxes));
+	assert(boxes);
+	for(ssize_t i = 0; i < count; ++i) {
+		boxes[i] = (struct ai_tiling_box){
+			.x = results[i].x, .y = results[i].y, .cx = results[i].cx, .cy = results[i].cy,
+			.confidence = results[i].confidence,
+			.klass = results[i].klass,
+			.tile_index = tile_indices[i],
+			.index = i,
+		};
+	}
+	ssize_t num_kept = ai_tiling_merge(&priv->tiling, boxes, count);
+	debug_printf("tiles: %ld, detections: %ld, merged: %ld\n", (long)num_tiles, (long)count, (long)num_kept);
+	
+	ai_detection_t * merged = calloc(num_kept + 1, sizeof(*merged));
+	assert(merged);
+	for(ssize_t i = 0; i < num_kept; ++i) {
+		merged[i] = results[boxes[i].index];
+		merged[i].x = boxes[i].x;
+		merged[i].y = boxes[i].y;
+		merged[i].cx = boxes[i].cx;
+		merged[i].cy = boxes[i].cy;
+	}
+	free(boxes);
+	free(tile_indices);
+	free(results);
 	
-	cairo_surface_destroy(origin);
-	cairo_surface_destroy(resized);
-	return dst;
+	if(p_results) *p_results = merged;
+	else free(merged);
+	return num_kept;
 }
+#undef DARKNET_MAX_TILES
 
+static ssize_t darknet_predict_tiled(darknet_context_t * darknet, const bgra_image_t frame[1], ai_detection_t ** p_results)
+{
+	return darknet_predict_tiles(darknet, frame, NULL, p_results);
+}
+static ssize_t darknet_predict_yuv_tiled(darknet_context_t * darknet, const yuv_image_t * frame, ai_detection_t ** p_results)
+{
+	return darknet_predict_tiles(darknet, NULL, frame, p_results);
+}
+static int darknet_predict_frames_tiled(darknet_context_t * darknet, const darknet_frame_t * frames, int count, ai_detection_t ** results, ssize_t * counts)
+{
+	if(NULL == frames || count <= 0 || NULL == results || NULL == counts) return -1;
+	for(int i = 0; i < count; ++i) {
+		results[i] = NULL;
+		counts[i] = -1;
+		if(NULL == frames[i].bgra && NULL == frames[i].yuv) continue;
+		counts[i] = darknet_predict_tiles(darknet, frames[i].bgra, frames[i].bgra?NULL:frames[i].yuv, &results[i]);
+	}
+	return 0;
+}
 
-static ssize_t darknet_predict(darknet_context_t * darknet, const bgra_image_t frame[1], ai_detection_t ** p_results)
+/*
+ * the detections of one frame of the last forward pass
+ * letterbox: nullable, maps the boxes back to the frame
+ */
+static ssize_t darknet_get_detections(darknet_context_t * darknet, int batch_index, int frame_width, int frame_height,
+	const struct bgra_image_letterbox * letterbox, ai_detection_t ** p_results)
 {
 	darknet_private_t * priv = darknet->priv;
 	network * net = priv->net;
-
 	int width = net->w;
 	int height = net->h;
-	debug_printf("network size: %d x %d\n", width, height);
-	debug_printf("resize: %d x %d   --> %d x %d\n", frame->width, frame->height, width, height);
-	bgra_image_t * resized = bgra_image_resize(NULL, width, height, frame);
-	assert(resized && (resized->width == width) && (resized->height == height) && resized->data);
-	
-	float * input = malloc(width * height * 3 * sizeof(float));
-	assert(input);
-	
-	bgra_image_to_f32(resized, input);
-	bgra_image_clear(resized); free(resized);
-	
-	network_predict(net, input);
-	free(input);
 	
 	int count = 0;
 	float thresh = priv->thresh;
@@ -332,9 +575,14 @@ static ssize_t darknet_predict(darknet_context_t * darknet, const bgra_image_t f
 	float nms = priv->nms;
 	int relative = priv->relative;
 	
+	// get_network_boxes() reads the first frame of the batch: move the outputs of the layers to this one
+	for(int i = 0; batch_index > 0 && i < net->n; ++i) net->layers[i].output += (size_t)batch_index * net->layers[i].outputs;
+	
 	layer l = net->layers[net->n - 1];
 	detection * dets = get_network_boxes(net, width, height, thresh, hier, NULL, relative, &count);
 	
+	for(int i = 0; batch_index > 0 && i < net->n; ++i) net->layers[i].output -= (size_t)batch_index * net->layers[i].outputs;
+	
 	ai_detection_t * results = calloc(count, sizeof(*results));
 	assert(results);
 	
@@ -388,6 +636,23 @@ static ssize_t darknet_predict(darknet_context_t * darknet, const bgra_image_t f
 				result->cx = b.w;
 				result->cy = b.h;
 				
+				if(letterbox) {
+					// network input ==> frame
+					double unit_x = relative?width:1.0, unit_y = relative?height:1.0;
+					double frame_x = (result->x * unit_x - letterbox->x) / letterbox->scale_x;
+					double frame_y = (result->y * unit_y - letterbox->y) / letterbox->scale_y;
+					double frame_cx = result->cx * unit_x / letterbox->scale_x;
+					double frame_cy = result->cy * unit_y / letterbox->scale_y;
+					if(relative) {
+						frame_x /= frame_width; frame_cx /= frame_width;
+						frame_y /= frame_height; frame_cy /= frame_height;
+					}
+					result->x = frame_x;
+					result->y = frame_y;
+					result->cx = frame_cx;
+					result->cy = frame_cy;
+				}
+				
 				debug_printf("result: bbox:{%.3f, %.3f, %.3f, %.3f}\n", 
 					result->x, result->y, result->cx, result->cy);
 				
@@ -424,7 +689,7 @@ int main(int argc, char ** argv)
 	
 	cairo_surface_t * png = cairo_image_surface_create_for_data(frame->data, 
 		CAIRO_FORMAT_ARGB32, 
-		frame->width, frame->height, frame->width * 4);
+		frame->width, frame->height, bgra_image_stride(frame));
 	assert(png);
 	
 	cairo_t * cr = cairo_create(png);
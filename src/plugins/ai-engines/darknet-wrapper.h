@@ -24,13 +24,31 @@ typedef struct ai_detection
 	};
 }ai_detection_t;
 
+typedef struct darknet_frame
+{
+	const bgra_image_t * bgra;
+	const yuv_image_t * yuv;	// nv12 / i420 / gray8, (if bgra is NULL)
+}darknet_frame_t;
+
 typedef struct darknet_context
 {
 	void * user_data;
 	void * priv;
 
 	int gpu_index;
+	int width, height;	// network input size
+	int relative;		// 1: results are relative to the frame size
+	int fast_jpeg_decode;	// 1: decode jpeg frames with the fast IDCT and without fancy upsampling, default = 0
+	int tiling;			// 1: tiled inference ("tiling" in the config, see ai-tiling.h), jpeg frames are decoded at full size
 	ssize_t (* predict)(struct darknet_context * darknet, const bgra_image_t frame[1], ai_detection_t ** p_results);
+	ssize_t (* predict_yuv)(struct darknet_context * darknet, const yuv_image_t * frame, ai_detection_t ** p_results);	// nv12 / i420 / gray8
+	
+	/*
+	 * predict_batch(): frames[count] ==> results[count] / counts[count], (counts[i] = -1: frames[i] failed)
+	 *   the frames are run max_batch at a time, one forward pass each; (tiling: frame by frame, the tiles are batched)
+	 */
+	int max_batch;		// "max_batch" in the config, at most the batch the network was loaded with (cfg: batch / subdivisions)
+	int (* predict_batch)(struct darknet_context * darknet, const darknet_frame_t * frames, int count, ai_detection_t ** results, ssize_t * counts);
 }darknet_context_t;
 
 darknet_context_t * darknet_context_new(json_object * jconfig, void * user_data);
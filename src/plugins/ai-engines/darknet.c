@@ -64,78 +64,183 @@ static int ai_plugin_darknet_load_config(struct ai_engine * engine, json_object
 {
 	return 0;
 }
-static int ai_plugin_darknet_predict(struct ai_engine * engine, const input_frame_t * frame, json_object ** p_jresults)
+/*
+ * the frame as a darknet input:
+ *   nv12 / i420 / gray8 frames are used as they are, (no bgra conversion at all)
+ *   jpeg / png frames are decoded, (*p_decoded: owned by the caller)
+ */
+static int load_frame(darknet_context_t * darknet, const input_frame_t * frame, yuv_image_t * yuv,
+	darknet_frame_t * input, bgra_image_t ** p_decoded)
 {
-	debug_printf("%s(): frame: type=%d, size=%d x %d", __FUNCTION__,
-		frame->type,
-		frame->width, frame->height);
-		
 	int rc = -1;
-	darknet_context_t * darknet = engine->priv;
-	assert(darknet);
-
 	bgra_image_t * bgra = NULL;
 	int type = frame->type & input_frame_type_image_masks;
-
-	if(type == input_frame_type_bgra) bgra = (bgra_image_t *)frame->bgra;
+	memset(input, 0, sizeof(*input));
+	*p_decoded = NULL;
+	
+	if(0 == input_frame_get_yuv(frame, yuv)) {
+		input->yuv = yuv;
+		return 0;
+	}
+	
+	if(type == input_frame_type_bgra) {
+		input->bgra = frame->bgra;
+		return 0;
+	}
+	
+	if(type == input_frame_type_jpeg && darknet->relative && !darknet->tiling)
+	{
+		// relative results don't depend on the decoded size: let libjpeg downscale in the IDCT (1/2, 1/4, 1/8)
+		// as long as the image still covers the network input, darknet->predict() resizes the remainder.
+		// (not with tiling: the tiles need the full resolution)
+		bgra = calloc(1, sizeof(*bgra));
+		assert(bgra);
+		rc = bgra_image_from_jpeg_stream_ex(bgra, frame->data, frame->length, darknet->width, darknet->height,
+			darknet->fast_jpeg_decode?bgra_image_jpeg_decode_flags_fast:bgra_image_jpeg_decode_flags_default);
+	}
 	else if(type == input_frame_type_png || type == input_frame_type_jpeg)
 	{
 		bgra = bgra_image_init(NULL, frame->width, frame->height, NULL);
-		rc = bgra_image_load_data(bgra, frame->data, frame->length);
-		if(rc)
-		{
-			bgra_image_clear(bgra);
-			bgra = NULL;
-		}
+		rc = bgra?bgra_image_load_data(bgra, frame->data, frame->length):-1;
 	}
-	if(bgra)
+	
+	if(rc)
 	{
-		ai_detection_t * results = NULL;
-		
-		app_timer_t timer[1];
-		double time_elapsed = 0;
-		app_timer_start(timer);
-		ssize_t count = darknet->predict(darknet, bgra, &results);
-		
-		time_elapsed = app_timer_stop(timer);
-		debug_printf("[INFO]::darknet->predict()::time_elapsed=%.3f ms", 
-			time_elapsed * 1000);
-		
-		if(count > 0  && p_jresults)
-		{
-			json_object * jresults = json_object_new_object();
-			json_object_object_add(jresults, "model", json_object_new_string("darknet::YOLOV3"));
-			
-			json_object * jdetections = json_object_new_array();
-			json_object_object_add(jresults, "detections", jdetections);
-
-			for(ssize_t i = 0; i < count; ++i)
-			{
-				json_object * jdet = json_object_new_object();
-				json_object_object_add(jdet, "class", json_object_new_string(results[i].class_names));
-				json_object_object_add(jdet, "class_index", json_object_new_int(results[i].klass));
-				json_object_object_add(jdet, "confidence", json_object_new_double(results[i].confidence));
-				json_object_object_add(jdet, "left", json_object_new_double(results[i].x));
-				json_object_object_add(jdet, "top", json_object_new_double(results[i].y));
-				json_object_object_add(jdet, "width", json_object_new_double(results[i].cx));
-				json_object_object_add(jdet, "height", json_object_new_double(results[i].cy));
-
-				json_object_array_add(jdetections, jdet);
-			}
-			*p_jresults = jresults;
-			rc = 0;
-		}
-
-		if(results) free(results);
-		if(bgra != frame->bgra)
-		{
+		if(bgra) {
 			bgra_image_clear(bgra);
 			free(bgra);
 		}
+		return -1;
+	}
+	input->bgra = bgra;
+	*p_decoded = bgra;
+	return 0;
+}
+
+static json_object * detections_to_json(const ai_detection_t * results, ssize_t count)
+{
+	json_object * jresults = json_object_new_object();
+	json_object_object_add(jresults, "model", json_object_new_string("darknet::YOLOV3"));
+	
+	json_object * jdetections = json_object_new_array();
+	json_object_object_add(jresults, "detections", jdetections);
+
+	for(ssize_t i = 0; i < count; ++i)
+	{
+		json_object * jdet = json_object_new_object();
+		json_object_object_add(jdet, "class", json_object_new_string(results[i].class_names));
+		json_object_object_add(jdet, "class_index", json_object_new_int(results[i].klass));
+		json_object_object_add(jdet, "confidence", json_object_new_double(results[i].confidence));
+		json_object_object_add(jdet, "left", json_object_new_double(results[i].x));
+		json_object_object_add(jdet, "top", json_object_new_double(results[i].y));
+		json_object_object_add(jdet, "width", json_object_new_double(results[i].cx));
+		json_object_object_add(jdet, "height", json_object_new_double(results[i].cy));
+
+		json_object_array_add(jdetections, jdet);
+	}
+	return jresults;
+}
+
+static int ai_plugin_darknet_predict(struct ai_engine * engine, const input_frame_t * frame, json_object ** p_jresults)
+{
+	debug_printf("%s(): frame: type=%d, size=%d x %d", __FUNCTION__,
+		frame->type,
+		frame->width, frame->height);
+	
+	darknet_context_t * darknet = engine->priv;
+	assert(darknet);
+	
+	yuv_image_t yuv[1];
+	darknet_frame_t input[1];
+	bgra_image_t * decoded = NULL;
+	int rc = load_frame(darknet, frame, yuv, input, &decoded);
+	if(rc) return -1;
+	
+	ai_detection_t * results = NULL;
+	ssize_t count = -1;
+#ifdef _DEBUG
+	app_timer_t timer[1];
+	app_timer_start(timer);
+#endif
+	darknet->predict_batch(darknet, input, 1, &results, &count);
+#ifdef _DEBUG
+	debug_printf("[INFO]::darknet->predict()::time_elapsed=%.3f ms", 
+		app_timer_stop(timer) * 1000);
+#endif
+	
+	// no detections: 0 for the decoded (jpeg / png) frames, -1 for the raw ones
+	rc = decoded?0:-1;
+	if(count > 0 && p_jresults)
+	{
+		*p_jresults = detections_to_json(results, count);
+		rc = 0;
+	}
+	
+	if(results) free(results);
+	if(decoded)
+	{
+		bgra_image_clear(decoded);
+		free(decoded);
 	}
 	return rc;
 }
 
+/*
+ * predict_batch(): the frames are decoded one by one, then run max_batch at a time, (darknet->predict_batch())
+ */
+static int ai_plugin_darknet_predict_batch(struct ai_engine * engine, const input_frame_t ** frames, int count, json_object ** results)
+{
+	darknet_context_t * darknet = engine->priv;
+	assert(darknet);
+	if(NULL == frames || NULL == results || count <= 0) return -1;
+	
+	darknet_frame_t * inputs = calloc(count, sizeof(*inputs));
+	yuv_image_t * yuvs = calloc(count, sizeof(*yuvs));
+	bgra_image_t ** decoded = calloc(count, sizeof(*decoded));
+	int * indices = calloc(count, sizeof(*indices));
+	ai_detection_t ** dets = calloc(count, sizeof(*dets));
+	ssize_t * counts = calloc(count, sizeof(*counts));
+	assert(inputs && yuvs && decoded && indices && dets && counts);
+	
+	int num_inputs = 0;
+	for(int i = 0; i < count; ++i) {
+		results[i] = NULL;
+		if(NULL == frames[i]) continue;
+		if(load_frame(darknet, frames[i], &yuvs[i], &inputs[num_inputs], &decoded[i])) continue;
+		indices[num_inputs++] = i;
+	}
+	
+	if(num_inputs > 0) {
+#ifdef _DEBUG
+		app_timer_t timer[1];
+		app_timer_start(timer);
+#endif
+		darknet->predict_batch(darknet, inputs, num_inputs, dets, counts);
+#ifdef _DEBUG
+		debug_printf("[INFO]::darknet->predict_batch(%d frames)::time_elapsed=%.3f ms", 
+			num_inputs, app_timer_stop(timer) * 1000);
+#endif
+	}
+	
+	for(int k = 0; k < num_inputs; ++k) {
+		if(counts[k] > 0) results[indices[k]] = detections_to_json(dets[k], counts[k]);
+		free(dets[k]);
+	}
+	for(int i = 0; i < count; ++i) {
+		if(NULL == decoded[i]) continue;
+		bgra_image_clear(decoded[i]);
+		free(decoded[i]);
+	}
+	
+	free(counts);
+	free(dets);
+	free(indices);
+	free(decoded);
+	free(yuvs);
+	free(inputs);
+	return 0;
+}
+
 static int ai_plugin_darknet_update(struct ai_engine * engine, const ai_tensor_t * truth)
 {
 	return 0;
@@ -170,6 +275,8 @@ int ann_plugin_init(ai_engine_t * engine, json_object * jconfig)
 	engine->cleanup = ai_plugin_darknet_cleanup;
 	engine->load_config = ai_plugin_darknet_load_config;
 	engine->predict = ai_plugin_darknet_predict;
+	engine->max_batch_size = darknet->max_batch;
+	engine->predict_batch = ai_plugin_darknet_predict_batch;
 	engine->update = ai_plugin_darknet_update;
 	engine->get_property = ai_plugin_darknet_get_property;
 	engine->set_property = ai_plugin_darknet_set_property;
@@ -91,6 +91,17 @@ static int io_plugin_input_source_load_config(io_input_t * input, json_object *
 	input_source_t * priv = input->priv;
 	assert(priv);
 	
+	// "format": "BGRA" (default), "NV12" / "I420": keep the decoder's yuv, "GRAY8"
+	const char * format = json_get_value(jconfig, string, format);
+	if(format) {
+		enum input_frame_type frame_type = input_frame_type_from_string(format) & input_frame_type_image_masks;
+		if(frame_type == input_frame_type_nv12 || frame_type == input_frame_type_i420 || frame_type == input_frame_type_gray8) {
+			priv->frame_type = frame_type;
+		}else {
+			priv->frame_type = input_frame_type_bgra;
+		}
+	}
+	
 	const char * uri = json_get_value(jconfig, string, uri);
 	return priv->set_uri(priv, uri);
 }
@@ -310,6 +310,7 @@ static int io_plugin_http_client_on_response(struct io_plugin_http_client * clie
 	if(frame && frame->data && frame->length > 0 && client->frame_number != frame_number)
 	{
 		client->frame_number = frame_number;
+		input_frame_share(frame);	// set_frame() takes a reference instead of a copy
 		if(input->set_frame) input->set_frame(input, frame);
 		if(input->on_new_frame) input->on_new_frame(input, frame);
 	}
@@ -546,6 +546,7 @@ static int on_post(http_session_t * session)
 
 	if(0 == rc)
 	{
+		input_frame_share(frame);	// set_frame() takes a reference instead of a copy
 		if(input->set_frame) input->set_frame(input, frame);
 		if(input->on_new_frame) input->on_new_frame(input, frame);
 	}
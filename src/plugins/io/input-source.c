@@ -380,6 +380,7 @@ input_source_t * input_source_new(void * user_data)
 	assert(input);
 
 	input->user_data = user_data;
+	input->frame_type = input_frame_type_bgra;
 	input->set_uri = input_source_set_uri;
 	//~ input->play = input_source_play;
 	//~ input->stop = input_source_stop;
@@ -476,7 +477,7 @@ static long input_source_set_frame(struct input_source * input, const input_fram
 		frame = calloc(1, sizeof(*frame));
 	}
 	assert(frame);
-	input_frame_copy(frame, new_frame);
+	input_frame_ref(frame, new_frame);
 	
 	pthread_mutex_lock(&priv->mutex);
 	priv->frame_buffer[1] = priv->frame_buffer[0];
@@ -501,7 +502,7 @@ static long input_source_get_frame(struct input_source * input, long prev_frame,
 
 	if(prev_frame >= 0 && prev_frame < priv->frame_number)		// only copy new frame to dst
 	{ 
-		input_frame_copy(dst, frame);
+		input_frame_ref(dst, frame);	// add_ref, no copy
 	}
 	pthread_mutex_unlock(&priv->mutex);
 	return priv->frame_number;
@@ -522,7 +523,7 @@ static gboolean video_source_on_error(GstBus * bus, GstMessage * message, video_
 	return FALSE;
 }
 
-static void video_source_on_bgra_filter(GstElement * filter, GstBuffer * buffer, video_source_t * src)
+static void video_source_on_filter_handoff(GstElement * filter, GstBuffer * buffer, video_source_t * src)
 {
 //	debug_printf("%s()...\n", __FUNCTION__);
 	input_source_t * input = src->input;
@@ -545,30 +546,50 @@ static void video_source_on_bgra_filter(GstElement * filter, GstBuffer * buffer,
 	rc = gst_structure_get_int(info, "width", &width); assert(rc);
 	rc = gst_structure_get_int(info, "height", &height); assert(rc);
 
+	// the negotiated format, (nv12 / i420 are both accepted when a yuv type is requested)
+	const char * fmt = gst_structure_get_string(info, "format");
+	enum input_frame_type type = input_frame_type_bgra;
+	switch(yuv_image_format_from_string(fmt))
+	{
+	case yuv_image_format_nv12: type = input_frame_type_nv12; break;
+	case yuv_image_format_i420: type = input_frame_type_i420; break;
+	case yuv_image_format_gray8: type = input_frame_type_gray8; break;
+	default: break;
+	}
+
 	if(width != priv->height && height != priv->height)
 	{
 		priv->frame_number = 0;	// reset
 		priv->width = width;
 		priv->height = height;
 
-		const char * fmt = gst_structure_get_string(info, "format");
 		printf("[thread_id: %ld]::uri: %s\n",
                  (long)pthread_self(), priv->uri);
         printf("== format: %s, size=%dx%d\n", fmt, width, height);
 	}
+	const int is_yuv = (type != input_frame_type_bgra);
+	gst_caps_unref(caps);
 	gst_object_unref(pad);
 
 	GstMapInfo map[1];
 	memset(map, 0, sizeof(map));
 
 	input_frame_t frame[1] = {{
-		.type = input_frame_type_bgra,
+		.type = type,
 	}};
 	rc = gst_buffer_map(buffer, map, GST_MAP_READ);
 	if(rc)
 	{
-		bgra_image_init(frame->image, width, height, map->data);
+		if(is_yuv) {
+			// one copy of the decoder output, (no colorspace conversion)
+			if(input_frame_set_yuv(frame, type, map->data, map->size, width, height, NULL, 0)) {
+				debug_printf("[WARNING]::%s(): unexpected %s buffer layout, size=%ld\n", __FUNCTION__, fmt, (long)map->size);
+			}
+		}else {
+			bgra_image_init(frame->image, width, height, map->data);
+		}
 		gst_buffer_unmap(buffer, map);
+		if(frame->data) input_frame_share(frame);	// publish once, set_frame() takes a reference
 	}
 
 	priv->frame_number++;
@@ -605,48 +626,58 @@ static int video_source_set_uri(video_source_t * src, input_source_t * input, co
 #endif
 #define FILE_SRC_FMT		"filesrc location=\"%s\" ! decodebin "
 
-#define BGRA_PIPELINE 	" ! videoconvert "						\
-						" ! videoscale ! video/x-raw,format=BGRA,width=640,height=480 ! videoconvert ! identity name=\"filter\" "		\
+// %s: the caps format, videoconvert is passthrough when the decoder already outputs it
+#define RAW_PIPELINE 	" ! videoconvert "						\
+						" ! videoscale ! video/x-raw,format=%s,width=640,height=480 ! videoconvert ! identity name=\"filter\" "		\
 						" ! fakesink sync=true"														
 
 					//	" ! ximagesink "
 					//	" ! fakesink sync=true"														
 	
 
+	const char * caps_format = "BGRA";
+	switch(input->frame_type & input_frame_type_image_masks)
+	{
+	case input_frame_type_nv12: caps_format = "{NV12,I420}"; break;
+	case input_frame_type_i420: caps_format = "{I420,NV12}"; break;
+	case input_frame_type_gray8: caps_format = "GRAY8"; break;
+	default: break;
+	}
+
 	char gst_command[8192] = "";
 	int cb = 0;
 	switch(type)
 	{
 	case input_source_type_rtsp:
 		cb = snprintf(gst_command, sizeof(gst_command),
-			RTSP_SRC_FMT BGRA_PIPELINE,
-			cooked_uri);
+			RTSP_SRC_FMT RAW_PIPELINE,
+			cooked_uri, caps_format);
 		break;
 	case input_source_type_http:
 	case input_source_type_https:
 		if(subtype == input_source_subtype_hls)
 		{
 			cb = snprintf(gst_command, sizeof(gst_command),
-				HLS_SRC_FMT BGRA_PIPELINE,
-				cooked_uri);
+				HLS_SRC_FMT RAW_PIPELINE,
+				cooked_uri, caps_format);
 		}else
 		{
 			cb = snprintf(gst_command, sizeof(gst_command),
-				HTTP_SRC_FMT BGRA_PIPELINE,
-				cooked_uri);
+				HTTP_SRC_FMT RAW_PIPELINE,
+				cooked_uri, caps_format);
 		}
 		break;
 	case input_source_type_file:
 		assert(subtype == input_source_subtype_default || subtype == input_source_subtype_video);
-		cb = snprintf(gst_command, sizeof(gst_command), FILE_SRC_FMT BGRA_PIPELINE,
-			cooked_uri);
+		cb = snprintf(gst_command, sizeof(gst_command), FILE_SRC_FMT RAW_PIPELINE,
+			cooked_uri, caps_format);
 		break;
 	case input_source_type_v4l2:
 	#if !defined(_WIN32) && !defined(_WIN32)
-		cb = snprintf(gst_command, sizeof(gst_command), V4L2_SRC_FMT BGRA_PIPELINE,
-			cooked_uri);
+		cb = snprintf(gst_command, sizeof(gst_command), V4L2_SRC_FMT RAW_PIPELINE,
+			cooked_uri, caps_format);
 	#else
-		cb = snprintf(gst_command, sizeof(gst_command), "ksvideosrc" BGRA_PIPELINE);
+		cb = snprintf(gst_command, sizeof(gst_command), "ksvideosrc" RAW_PIPELINE, caps_format);
 	#endif
 		break;
 	default:
@@ -674,7 +705,7 @@ static int video_source_set_uri(video_source_t * src, input_source_t * input, co
 	GstElement * filter = gst_bin_get_by_name(GST_BIN(pipeline), "filter");
 	assert(filter);
 
-	g_signal_connect(filter, "handoff", G_CALLBACK(video_source_on_bgra_filter), src);
+	g_signal_connect(filter, "handoff", G_CALLBACK(video_source_on_filter_handoff), src);
 
 	src->pipeline = pipeline;
 	src->filter = filter;
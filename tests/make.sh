@@ -16,7 +16,7 @@ case "$target" in
 		gcc -std=gnu99 -g -O0 -Wall -D_DEBUG -D_DEFAULT_SOURCE -I../include -I../utils \
 			-DTEST_VIDEO_SOURCE_COMMON_ -D_STAND_ALONE \
 			-o video_source_common \
-			../utils/video_source_common.c \
+			../utils/video_source_common.c ../utils/frame-pool.c \
 			$(pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gio-2.0 gtk+-3.0)
 		;;
 	
@@ -25,9 +25,125 @@ case "$target" in
 		gcc -std=gnu99 -g -O0 -Wall -D_DEBUG -D_DEFAULT_SOURCE -I../include -I../utils \
 			-o test-video_source_common \
 			test-video_source_common.c \
-			../utils/video_source_common.c \
+			../utils/video_source_common.c ../utils/frame-pool.c \
 			$(pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gio-2.0)
 		;;
+	test-video_frame_slot)
+		gcc -std=gnu99 -g -O2 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-video_frame_slot \
+			test-video_frame_slot.c \
+			../utils/video_source_common.c ../utils/frame-pool.c \
+			$(pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gio-2.0) -lpthread
+		;;
+	test-video_frame_gst_sample)
+		gcc -std=gnu99 -g -O0 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-video_frame_gst_sample \
+			test-video_frame_gst_sample.c \
+			../utils/video_source_common.c ../utils/frame-pool.c \
+			$(pkg-config --cflags --libs gstreamer-1.0 gstreamer-app-1.0 gio-2.0) -lpthread
+		;;
+	test-img_preproc)
+		gcc -std=gnu99 -g -O2 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-img_preproc \
+			test-img_preproc.c \
+			../utils/img_preproc.c ../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-img_probe)
+		gcc -std=gnu99 -g -O1 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-fsanitize=address,undefined \
+			-o test-img_probe \
+			test-img_probe.c \
+			../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-png_encode)
+		gcc -std=gnu99 -g -O2 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-png_encode \
+			test-png_encode.c \
+			../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-jpeg_decode)
+		gcc -std=gnu99 -g -O2 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-jpeg_decode \
+			test-jpeg_decode.c \
+			../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-jpeg_encode_service)
+		gcc -std=gnu99 -g -O2 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-jpeg_encode_service \
+			test-jpeg_encode_service.c \
+			../utils/jpeg-encode-service.c ../utils/job-queue.c ../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-motion_gate)
+		gcc -std=gnu99 -g -O2 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-motion_gate \
+			test-motion_gate.c \
+			../utils/motion-gate.c ../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ljson-c -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-img_overlay)
+		gcc -std=gnu99 -g -O2 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-img_overlay \
+			test-img_overlay.c \
+			../utils/img_overlay.c ../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-img_privacy_mask)
+		gcc -std=gnu99 -g -O2 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-img_privacy_mask \
+			test-img_privacy_mask.c \
+			../utils/img_privacy_mask.c ../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ljson-c -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-ai_tiling)
+		gcc -std=gnu99 -g -O0 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-ai_tiling \
+			test-ai_tiling.c \
+			../utils/ai-tiling.c \
+			-lm -ljson-c
+		;;
+	test-frame_pool)
+		gcc -std=gnu99 -g -O0 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-frame_pool \
+			test-frame_pool.c \
+			../utils/frame-pool.c \
+			-lpthread
+		;;
+	test-auto_buffer)
+		gcc -std=gnu99 -g -O0 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-auto_buffer \
+			test-auto_buffer.c \
+			../utils/auto-buffer.c
+		;;
+	test-input_frame_payload)
+		gcc -std=gnu99 -g -O1 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-fsanitize=address,undefined \
+			-o test-input_frame_payload \
+			test-input_frame_payload.c \
+			../utils/input-frame.c ../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ljson-c -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-io_input_history)
+		gcc -std=gnu99 -g -O1 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-fsanitize=address,undefined \
+			-o test-io_input_history \
+			test-io_input_history.c \
+			../src/io-input.c ../src/ann-plugins.c \
+			../utils/input-frame.c ../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ldl -ljson-c -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
+	test-ai_engine_pool)
+		gcc -std=gnu99 -g -O2 -Wall -D_DEFAULT_SOURCE -I../include -I../utils \
+			-o test-ai_engine_pool \
+			test-ai_engine_pool.c \
+			../src/ai-engine-pool.c ../src/ai-engine.c ../src/ann-plugins.c ../utils/job-queue.c \
+			../utils/input-frame.c ../utils/img_proc.c ../utils/frame-pool.c \
+			-lm -lpthread -ldl -ljson-c -ljpeg -lpng -lcairo $(pkg-config --cflags --libs gio-2.0 glib-2.0)
+		;;
 	*)
 		echo "unknown target: $target"
 		exit 1
@@ -0,0 +1,292 @@
+/*
+ * test-ai_engine_pool.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * ai engine pool, with fake engines (each predict() sleeps PREDICT_MS):
+ *   parallel: the replicas run concurrently, every job completes and is answered by the replica that ran it;
+ *   batching: a replica with max_batch_size > 1 takes several pending jobs at once;
+ *   bounded queue: the overflow is dropped, the jobs still queued at cleanup are cancelled;
+ *   a replica that fails to start is left out;
+ *   no detections: completed with a NULL result whatever the batch size, (predict() returns -1, like darknet on raw frames),
+ *     failed only when predict_batch() fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ai-engine-pool.h"
+
+#define PREDICT_MS	(20)
+
+static inline double get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static long s_running;			// predict() calls in progress
+static long s_max_running;
+
+static void fake_forward_pass(void)
+{
+	long running = __atomic_add_fetch(&s_running, 1, __ATOMIC_ACQ_REL);
+	long max_running = __atomic_load_n(&s_max_running, __ATOMIC_ACQUIRE);
+	while(running > max_running
+		&& !__atomic_compare_exchange_n(&s_max_running, &max_running, running, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	usleep(PREDICT_MS * 1000);
+	__atomic_sub_fetch(&s_running, 1, __ATOMIC_ACQ_REL);
+}
+
+enum fake_outcome
+{
+	fake_outcome_detections,
+	fake_outcome_no_detections,
+	fake_outcome_error,
+};
+static int s_outcome = fake_outcome_detections;
+
+static int fake_predict(struct ai_engine * engine, const input_frame_t * frame, json_object ** p_jresults)
+{
+	fake_forward_pass();
+	if(s_outcome != fake_outcome_detections) return -1;	// predict() can't tell an error from no detections
+	json_object * jresult = json_object_new_object();
+	json_object_object_add(jresult, "replica", json_object_new_int((int)(long)engine->user_data));
+	*p_jresults = jresult;
+	return 0;
+}
+
+static int fake_predict_batch(struct ai_engine * engine, const input_frame_t ** frames, int count, json_object ** results)
+{
+	fake_forward_pass();	// one pass for the whole batch
+	if(s_outcome == fake_outcome_error) return -1;
+	if(s_outcome == fake_outcome_no_detections) {
+		memset(results, 0, sizeof(*results) * count);
+		return 0;
+	}
+	for(int i = 0; i < count; ++i) {
+		results[i] = json_object_new_object();
+		json_object_object_add(results[i], "replica", json_object_new_int((int)(long)engine->user_data));
+	}
+	return 0;
+}
+
+static int s_max_batch_size = 1;
+static int s_failed_replica = -1;
+static ai_engine_t * new_fake_replica(struct ai_engine_pool * pool, int index)
+{
+	if(index == s_failed_replica) return NULL;
+
+	ai_engine_t * engine = calloc(1, sizeof(*engine));
+	assert(engine);
+	engine->user_data = (void *)(long)index;
+	engine->predict = fake_predict;
+	engine->max_batch_size = s_max_batch_size;
+	engine->predict_batch = (s_max_batch_size > 1)?fake_predict_batch:ai_engine_predict_batch_default;
+	return engine;
+}
+
+static void init_frame(input_frame_t * frame)
+{
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, 32, 32, NULL);
+	memset(frame, 0, sizeof(*frame));
+	input_frame_set_bgra(frame, image, NULL, 0);
+	input_frame_share(frame);	// the jobs share it, (no copy)
+	bgra_image_clear(image);
+}
+
+static int check_job(ai_engine_job_t * job, int num_replicas)
+{
+	if(ai_engine_job_wait(job, 5000) != ai_engine_job_status_completed) return -1;
+	json_object * jreplica = NULL;
+	if(NULL == job->jresult || !json_object_object_get_ex(job->jresult, "replica", &jreplica)) return -1;
+	int replica = json_object_get_int(jreplica);
+	return (replica == job->replica_index && replica >= 0 && replica < num_replicas)?0:-1;
+}
+
+static int test_parallel(const input_frame_t * frame)
+{
+	#define NUM_JOBS (32)
+	struct ai_engine_pool_params params;
+	ai_engine_pool_params_load(&params, NULL);
+	params.num_replicas = 4;
+	params.max_pending = NUM_JOBS;
+	s_max_batch_size = 1;
+	s_max_running = 0;
+
+	ai_engine_pool_t * pool = ai_engine_pool_init(NULL, &params, new_fake_replica, NULL);
+	assert(pool && pool->num_replicas == 4);
+
+	ai_engine_job_t * jobs[NUM_JOBS];
+	double begin_time = get_time_sec();
+	int ok = 1;
+	for(int i = 0; i < NUM_JOBS; ++i) {
+		if(pool->submit(pool, frame, 0, NULL, NULL, &jobs[i])) ok = 0;
+	}
+	for(int i = 0; i < NUM_JOBS; ++i) {
+		if(jobs[i] && check_job(jobs[i], 4)) ok = 0;
+		ai_engine_job_unref(jobs[i]);
+	}
+	double time_elapsed = get_time_sec() - begin_time;
+
+	struct ai_engine_pool_stats stats;
+	pool->get_stats(pool, &stats);
+	ok = ok && (stats.completed == NUM_JOBS) && (s_max_running == 4);
+	ok = ok && (time_elapsed < (NUM_JOBS * PREDICT_MS / 1000.0) / 2);	// serial: NUM_JOBS * PREDICT_MS
+
+	printf("parallel: %d jobs, %d replicas: %.1f ms, (serial: %d ms), max concurrent: %ld: %s\n",
+		NUM_JOBS, pool->num_replicas, time_elapsed * 1000, NUM_JOBS * PREDICT_MS, s_max_running, ok?"ok":"FAILED");
+	ai_engine_pool_cleanup(pool);
+	free(pool);
+	return ok?0:-1;
+	#undef NUM_JOBS
+}
+
+static int test_batching(const input_frame_t * frame)
+{
+	#define NUM_JOBS (9)
+	struct ai_engine_pool_params params;
+	ai_engine_pool_params_load(&params, NULL);
+	s_max_batch_size = 4;
+
+	ai_engine_pool_t * pool = ai_engine_pool_init(NULL, &params, new_fake_replica, NULL);
+	assert(pool && pool->num_replicas == 1 && pool->max_pending == 8);
+
+	ai_engine_job_t * jobs[NUM_JOBS];
+	int ok = 1;
+	int max_batch = 0;
+	for(int i = 0; i < NUM_JOBS; ++i) {
+		if(pool->submit(pool, frame, ai_engine_pool_flag_wait_if_full, NULL, NULL, &jobs[i])) ok = 0;
+	}
+	for(int i = 0; i < NUM_JOBS; ++i) {
+		if(jobs[i] && check_job(jobs[i], 1)) ok = 0;
+		if(jobs[i] && jobs[i]->batch_size > max_batch) max_batch = jobs[i]->batch_size;
+		ai_engine_job_unref(jobs[i]);
+	}
+
+	struct ai_engine_pool_stats stats;
+	pool->get_stats(pool, &stats);
+	ok = ok && (stats.completed == NUM_JOBS) && (max_batch == 4) && (stats.batches < NUM_JOBS);
+	printf("batching: %d jobs, max_batch_size 4: %ld forward passes: %s\n", NUM_JOBS, stats.batches, ok?"ok":"FAILED");
+	ai_engine_pool_cleanup(pool);
+	free(pool);
+	s_max_batch_size = 1;
+	return ok?0:-1;
+	#undef NUM_JOBS
+}
+
+static long s_callbacks;
+static void on_completed(ai_engine_job_t * job)
+{
+	__atomic_add_fetch(&s_callbacks, 1, __ATOMIC_ACQ_REL);
+}
+
+static int test_bounded_queue(const input_frame_t * frame)
+{
+	#define NUM_JOBS (20)
+	struct ai_engine_pool_params params;
+	ai_engine_pool_params_load(&params, NULL);
+	params.num_replicas = 2;
+	params.max_pending = 4;
+	s_failed_replica = 1;
+
+	ai_engine_pool_t * pool = ai_engine_pool_init(NULL, &params, new_fake_replica, NULL);
+	assert(pool);
+	int ok = (pool->num_replicas == 1);
+
+	long accepted = 0;
+	for(int i = 0; i < NUM_JOBS; ++i) {
+		if(0 == pool->submit(pool, frame, 0, on_completed, NULL, NULL)) ++accepted;
+	}
+	usleep(PREDICT_MS * 1000 / 2);
+	ai_engine_pool_cleanup(pool);	// the queue is still full
+
+	ok = ok && (accepted < NUM_JOBS) && (s_callbacks == accepted);
+	printf("bounded queue: %d submitted, %ld accepted, %ld completed or cancelled: %s\n",
+		NUM_JOBS, accepted, s_callbacks, ok?"ok":"FAILED");
+	free(pool);
+	s_failed_replica = -1;
+	return ok?0:-1;
+	#undef NUM_JOBS
+}
+
+static int run_outcome(const input_frame_t * frame, int max_batch_size, int outcome, int expected_status)
+{
+	#define NUM_JOBS (4)
+	struct ai_engine_pool_params params;
+	ai_engine_pool_params_load(&params, NULL);
+	params.max_pending = NUM_JOBS;
+	s_max_batch_size = max_batch_size;
+	s_outcome = outcome;
+
+	ai_engine_pool_t * pool = ai_engine_pool_init(NULL, &params, new_fake_replica, NULL);
+	assert(pool);
+	ai_engine_job_t * jobs[NUM_JOBS];
+	int ok = 1;
+	for(int i = 0; i < NUM_JOBS; ++i) {
+		if(pool->submit(pool, frame, ai_engine_pool_flag_wait_if_full, NULL, NULL, &jobs[i])) ok = 0;
+	}
+	for(int i = 0; i < NUM_JOBS; ++i) {
+		if(NULL == jobs[i]) continue;
+		ok = ok && (ai_engine_job_wait(jobs[i], 5000) == expected_status) && (NULL == jobs[i]->jresult);
+		ai_engine_job_unref(jobs[i]);
+	}
+	ai_engine_pool_cleanup(pool);
+	free(pool);
+	s_max_batch_size = 1;
+	s_outcome = fake_outcome_detections;
+	return ok?0:-1;
+	#undef NUM_JOBS
+}
+
+static int test_no_detections(const input_frame_t * frame)
+{
+	int ok = (0 == run_outcome(frame, 1, fake_outcome_no_detections, ai_engine_job_status_completed));
+	ok = ok && (0 == run_outcome(frame, 4, fake_outcome_no_detections, ai_engine_job_status_completed));
+	ok = ok && (0 == run_outcome(frame, 4, fake_outcome_error, ai_engine_job_status_failed));
+	printf("no detections: completed with batch size 1 and 4, predict_batch() error: failed: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+int main(int argc, char ** argv)
+{
+	input_frame_t frame[1];
+	init_frame(frame);
+
+	int rc = test_parallel(frame);
+	rc |= test_batching(frame);
+	rc |= test_bounded_queue(frame);
+	rc |= test_no_detections(frame);
+
+	input_frame_clear(frame);
+	return rc?1:0;
+}
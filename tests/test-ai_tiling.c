@@ -0,0 +1,139 @@
+/*
+ * test-ai_tiling.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * ai tiling:
+ *   layout(): the tiles stay inside the frame, cover every pixel, and share at least the requested overlap;
+ *     max_tiles grows the tiles, cols / rows give a fixed grid, a small frame is not tiled;
+ *   merge(): duplicates are dropped, an object cut by a seam is merged into one box, other classes are kept.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ai-tiling.h"
+
+#define MAX_TILES (64)
+
+static int check_layout(const struct ai_tiling_params * params, int frame_width, int frame_height, int net_width, int net_height,
+	ssize_t expected_count)
+{
+	struct ai_tile tiles[MAX_TILES];
+	ssize_t count = ai_tiling_layout(params, frame_width, frame_height, net_width, net_height, tiles, MAX_TILES);
+
+	int ok = (expected_count < 0 || count == expected_count) && count <= params->max_tiles;
+	unsigned char * covered = calloc((size_t)frame_width * frame_height, 1);
+	assert(covered);
+	for(ssize_t i = 0; i < count && ok; ++i) {
+		const struct ai_tile * tile = &tiles[i];
+		if(tile->x < 0 || tile->y < 0 || tile->width <= 0 || tile->height <= 0
+			|| (tile->x + tile->width) > frame_width || (tile->y + tile->height) > frame_height) ok = 0;
+		if(tile->is_global) continue;
+
+		for(int y = tile->y; y < tile->y + tile->height && ok; ++y) memset(covered + (size_t)y * frame_width + tile->x, 1, tile->width);
+
+		// the right / bottom neighbour shares at least (overlap * tile size)
+		if(i + 1 < count && !tiles[i + 1].is_global && tiles[i + 1].y == tile->y) {
+			int shared = tile->x + tile->width - tiles[i + 1].x;
+			if(shared < (int)(params->overlap * tile->width)) ok = 0;
+		}
+	}
+	for(size_t i = 0; i < (size_t)frame_width * frame_height && ok; ++i) if(!covered[i]) ok = 0;
+	free(covered);
+
+	printf("layout(%dx%d, net %dx%d, overlap %.2f, max %d): %ld tiles (%dx%d)%s: %s\n",
+		frame_width, frame_height, net_width, net_height, params->overlap, params->max_tiles,
+		(long)count, count?tiles[0].width:0, count?tiles[0].height:0,
+		(count > 1 && tiles[count - 1].is_global)?" + global":"", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_layout(void)
+{
+	struct ai_tiling_params params;
+	ai_tiling_params_load(&params, NULL);
+	params.enabled = 1;
+	params.max_tiles = MAX_TILES;
+
+	int rc = 0;
+	rc |= check_layout(&params, 3840, 2160, 416, 416, -1);
+	rc |= check_layout(&params, 1920, 1080, 608, 608, 4 * 2 + 1);
+	rc |= check_layout(&params, 416, 416, 416, 416, 1);	// fits: no tiling
+	rc |= check_layout(&params, 640, 360, 416, 416, 2 + 1);
+
+	params.max_tiles = 9;	// grow the tiles
+	rc |= check_layout(&params, 3840, 2160, 416, 416, -1);
+
+	params.cols = 3;
+	params.rows = 2;
+	params.global_view = 0;
+	params.max_tiles = 16;
+	rc |= check_layout(&params, 3840, 2160, 416, 416, 6);
+	return rc;
+}
+
+static int test_merge(void)
+{
+	struct ai_tiling_params params;
+	ai_tiling_params_load(&params, NULL);
+
+	struct ai_tiling_box boxes[] = {
+		// a duplicate from two overlapping tiles
+		{ .x = 100, .y = 100, .cx = 50, .cy = 100, .confidence = 0.9f, .klass = 0, .tile_index = 0, .index = 0 },
+		{ .x = 102, .y = 101, .cx = 50, .cy = 100, .confidence = 0.8f, .klass = 0, .tile_index = 1, .index = 1 },
+		// a person cut by a seam at x = 400: the left half, and the whole body seen by the next tile
+		{ .x = 383, .y = 300, .cx = 17, .cy = 120, .confidence = 0.6f, .klass = 0, .tile_index = 0, .index = 2 },
+		{ .x = 385, .y = 295, .cx = 60, .cy = 130, .confidence = 0.7f, .klass = 0, .tile_index = 1, .index = 3 },
+		// another class at the same place
+		{ .x = 100, .y = 100, .cx = 50, .cy = 100, .confidence = 0.5f, .klass = 2, .tile_index = 0, .index = 4 },
+		// two people side by side in the same tile: kept
+		{ .x = 600, .y = 100, .cx = 40, .cy = 100, .confidence = 0.9f, .klass = 0, .tile_index = 2, .index = 5 },
+		{ .x = 625, .y = 100, .cx = 40, .cy = 100, .confidence = 0.8f, .klass = 0, .tile_index = 2, .index = 6 },
+	};
+	ssize_t count = ai_tiling_merge(&params, boxes, sizeof(boxes) / sizeof(boxes[0]));
+
+	int ok = (count == 5);
+	int found_union = 0;
+	for(ssize_t i = 0; i < count; ++i) {
+		if(boxes[i].index == 1 || boxes[i].index == 2) ok = 0;	// suppressed
+		if(boxes[i].index == 3) {
+			found_union = (boxes[i].x == 383 && boxes[i].y == 295 && boxes[i].cx == 62 && boxes[i].cy == 130);
+		}
+		if(i > 0 && boxes[i].confidence > boxes[i - 1].confidence) ok = 0;
+	}
+	ok = ok && found_union;
+	printf("merge: %ld boxes: %s\n", (long)count, ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+int main(int argc, char ** argv)
+{
+	int rc = test_layout();
+	rc |= test_merge();
+	return rc?1:0;
+}
@@ -0,0 +1,263 @@
+/*
+ * test-auto_buffer.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * auto_buffer modes:
+ *   linear: partial pops keep the order and the position of the pending data,
+ *     with 'compact' set a mostly consumed buffer is moved to the front;
+ *   ring: pushes wrap around the end, a push that doesn't fit fails, get_iovec() splits the wrapped data in 2;
+ *   iovec: push_ref() keeps the caller's pointer, get_iovec() starts at the offset in the first chunk,
+ *     each chunk is released once (in order) when a pop passes it, peek works on chains longer than iov[];
+ *   writev(): the pending data of a wrapped ring / a chunk chain comes out of a pipe in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "auto-buffer.h"
+
+#define check(cond) do { if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ok = 0; } } while(0)
+
+static void fill_pattern(unsigned char * data, ssize_t length, unsigned char seed)
+{
+	for(ssize_t i = 0; i < length; ++i) data[i] = (unsigned char)(seed + i);
+}
+
+static int test_linear(int compact)
+{
+	int ok = 1;
+	auto_buffer_t buf[1];
+	auto_buffer_init(buf, 0);
+	buf->compact = compact;
+
+	unsigned char data[100000];
+	unsigned char out[100000];
+	fill_pattern(data, sizeof(data), 0);
+
+	check(auto_buffer_push_data(buf, data, sizeof(data)) == sizeof(data));
+	const unsigned char * pending = buf->data + 70000;
+	check(auto_buffer_pop_data(buf, out, 70000) == 70000);
+	check(0 == memcmp(out, data, 70000));
+
+	if(compact)
+	{
+		// 70000 consumed >= 64K and >= 30000 pending: compacted
+		check(buf->cur_pos == 0 && buf->length == 30000);
+	}else
+	{
+		// the pending data stays where it was, (pointers into buf->data are still valid)
+		check(buf->cur_pos == 70000 && buf->length == 100000);
+		check(buf->data + buf->cur_pos == pending && 0 == memcmp(pending, data + 70000, 30000));
+	}
+	check(auto_buffer_get_length(buf) == 30000);
+	check(auto_buffer_pop_data(buf, out, -1) == 30000);
+	check(0 == memcmp(out, data + 70000, 30000));
+	check(auto_buffer_get_length(buf) == 0);
+
+	auto_buffer_cleanup(buf);
+	printf("linear%s: %s\n", compact?" (compact)":"", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_ring(void)
+{
+	int ok = 1;
+	auto_buffer_t buf[1];
+	memset(buf, 0, sizeof(buf));
+	auto_buffer_init_ex(buf, auto_buffer_mode_ring, 16);
+
+	unsigned char data[16];
+	unsigned char out[16];
+	fill_pattern(data, sizeof(data), 'a');
+
+	check(auto_buffer_push_data(buf, data, 12) == 12);
+	check(auto_buffer_push_data(buf, data, 5) == -1);	// 4 bytes left
+	check(auto_buffer_pop_data(buf, out, 10) == 10);
+	check(0 == memcmp(out, data, 10));
+
+	// [10, 12) pending, the next 10 bytes go to [12, 16) + [0, 6)
+	check(auto_buffer_push_data(buf, data, 10) == 12);
+	check(buf->cur_pos == 10);
+
+	struct iovec iov[4];
+	int count = auto_buffer_get_iovec(buf, iov, 4);
+	check(count == 2);
+	check(iov[0].iov_base == buf->data + 10 && iov[0].iov_len == 6);
+	check(iov[1].iov_base == buf->data && iov[1].iov_len == 6);
+
+	unsigned char expected[12];
+	memcpy(expected, data + 10, 2);
+	memcpy(expected + 2, data, 10);
+	check(auto_buffer_peek_data(buf, out, 12) == 12);
+	check(0 == memcmp(out, expected, 12));
+	check(auto_buffer_get_length(buf) == 12);	// peek doesn't consume
+
+	check(auto_buffer_pop_data(buf, out, 12) == 12);
+	check(0 == memcmp(out, expected, 12));
+	check(auto_buffer_get_length(buf) == 0 && buf->cur_pos == 0);
+
+	// full capacity, starting in the middle
+	check(auto_buffer_push_data(buf, data, 8) == 8);
+	check(auto_buffer_pop_data(buf, NULL, 8) == 8);
+	check(auto_buffer_push_data(buf, data, 16) == 16);
+	check(auto_buffer_pop_data(buf, out, 16) == 16);
+	check(0 == memcmp(out, data, 16));
+
+	auto_buffer_cleanup(buf);
+	printf("ring: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+#define MAX_RELEASED (256)
+static int s_num_released;
+static unsigned char * s_released[MAX_RELEASED];
+static void on_release(void * user_data, unsigned char * data)
+{
+	assert(s_num_released < MAX_RELEASED);
+	s_released[s_num_released++] = data;
+}
+
+static int test_iovec(void)
+{
+	int ok = 1;
+	auto_buffer_t buf[1];
+	memset(buf, 0, sizeof(buf));
+	auto_buffer_init_ex(buf, auto_buffer_mode_iovec, 0);
+	s_num_released = 0;
+
+	unsigned char a[10], b[20], c[30];
+	fill_pattern(a, sizeof(a), 0);
+	fill_pattern(b, sizeof(b), 10);
+	fill_pattern(c, sizeof(c), 30);
+
+	check(auto_buffer_push_ref(buf, a, sizeof(a), on_release, NULL) == 10);
+	check(auto_buffer_push_ref(buf, b, sizeof(b), on_release, NULL) == 30);
+	check(auto_buffer_push_ref(buf, c, sizeof(c), on_release, NULL) == 60);
+
+	struct iovec iov[4];
+	int count = auto_buffer_get_iovec(buf, iov, 4);
+	check(count == 3);
+	check(iov[0].iov_base == a && iov[1].iov_base == b && iov[2].iov_base == c);	// no copy
+
+	// pop into the middle of b: a is released, b is split
+	unsigned char out[60];
+	check(auto_buffer_pop_data(buf, out, 15) == 15);
+	check(0 == memcmp(out, a, 10) && 0 == memcmp(out + 10, b, 5));
+	check(s_num_released == 1 && s_released[0] == a);
+
+	count = auto_buffer_get_iovec(buf, iov, 4);
+	check(count == 2);
+	check(iov[0].iov_base == b + 5 && iov[0].iov_len == 15);
+	check(iov[1].iov_base == c && iov[1].iov_len == 30);
+	check(auto_buffer_get_iovec(buf, iov, 1) == 1);		// max_iov is honored
+
+	// exactly to the end of b
+	check(auto_buffer_pop_data(buf, NULL, 15) == 15);
+	check(s_num_released == 2 && s_released[1] == b);
+	check(auto_buffer_get_length(buf) == 30);
+
+	check(auto_buffer_pop_data(buf, out, -1) == 30);
+	check(0 == memcmp(out, c, 30));
+	check(s_num_released == 3 && s_released[2] == c);
+	check(auto_buffer_get_length(buf) == 0 && buf->num_chunks == 0);
+
+	// a chain longer than the internal iov[]: 100 owned copies of 3 bytes
+	unsigned char data[300];
+	unsigned char big[300];
+	fill_pattern(data, sizeof(data), 7);
+	for(int i = 0; i < 100; ++i) auto_buffer_push_data(buf, data + i * 3, 3);
+	check(auto_buffer_get_length(buf) == 300);
+	check(auto_buffer_peek_data(buf, big, 300) == 300);
+	check(0 == memcmp(big, data, 300));
+	check(auto_buffer_pop_data(buf, big, 299) == 299);
+	check(0 == memcmp(big, data, 299));
+	check(auto_buffer_get_length(buf) == 1);
+
+	// the pending references are released by cleanup
+	check(auto_buffer_push_ref(buf, a, sizeof(a), on_release, NULL) == 11);
+	auto_buffer_cleanup(buf);
+	check(s_num_released == 4 && s_released[3] == a);
+
+	printf("iovec: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_writev(void)
+{
+	int ok = 1;
+	int fds[2];
+	int rc = pipe(fds);
+	assert(0 == rc);
+
+	unsigned char data[64];
+	unsigned char out[64];
+	fill_pattern(data, sizeof(data), 100);
+
+	// wrapped ring
+	auto_buffer_t ring[1];
+	memset(ring, 0, sizeof(ring));
+	auto_buffer_init_ex(ring, auto_buffer_mode_ring, 32);
+	auto_buffer_push_data(ring, data, 20);
+	auto_buffer_pop_data(ring, NULL, 20);
+	auto_buffer_push_data(ring, data, 30);		// [20, 32) + [0, 18)
+	check(auto_buffer_writev(ring, fds[1]) == 30);
+	check(auto_buffer_get_length(ring) == 0);
+	check(read(fds[0], out, sizeof(out)) == 30);
+	check(0 == memcmp(out, data, 30));
+	auto_buffer_cleanup(ring);
+
+	// chunk chain, the first one partially consumed
+	auto_buffer_t chain[1];
+	memset(chain, 0, sizeof(chain));
+	auto_buffer_init_ex(chain, auto_buffer_mode_iovec, 0);
+	s_num_released = 0;
+	auto_buffer_push_ref(chain, data, 16, on_release, NULL);
+	auto_buffer_push_ref(chain, data + 16, 48, on_release, NULL);
+	auto_buffer_pop_data(chain, NULL, 4);
+	check(auto_buffer_writev(chain, fds[1]) == 60);
+	check(s_num_released == 2 && auto_buffer_get_length(chain) == 0);
+	check(read(fds[0], out, sizeof(out)) == 60);
+	check(0 == memcmp(out, data + 4, 60));
+	auto_buffer_cleanup(chain);
+
+	close(fds[0]);
+	close(fds[1]);
+	printf("writev: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+int main(int argc, char ** argv)
+{
+	int rc = test_linear(0);
+	rc |= test_linear(1);
+	rc |= test_ring();
+	rc |= test_iovec();
+	rc |= test_writev();
+	return rc?1:0;
+}
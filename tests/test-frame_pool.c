@@ -0,0 +1,206 @@
+/*
+ * test-frame_pool.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * frame pool:
+ *   reuse: a released buffer comes back for the same (width, height, format), (not for another key);
+ *   cache limit: a release over max_cached_bytes frees the buffer instead of caching it;
+ *   foreign pointers: frame_pool_release() frees them, frame_pool_get_capacity() is 0;
+ *   reserve(): kept while it fits, replaced when it grows, compressed formats round up to a power of 2;
+ *   concurrent limit: changing max_cached_bytes while other threads release buffers keeps the cache within the limit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "frame-pool.h"
+
+#define check(cond) do { if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ok = 0; } } while(0)
+
+static int test_reuse(void)
+{
+	int ok = 1;
+	struct frame_pool_stats before, after;
+	frame_pool_get_stats(&before);
+
+	void * data = frame_pool_alloc(640, 480, frame_pool_format_bgra, 640 * 480 * 4);
+	check(data && frame_pool_get_capacity(data) >= 640 * 480 * 4);
+	memset(data, 0xff, 640 * 480 * 4);
+	frame_pool_release(data);
+
+	void * again = frame_pool_alloc(640, 480, frame_pool_format_bgra, 640 * 480 * 4);
+	check(again == data);
+	void * other = frame_pool_alloc(320, 240, frame_pool_format_bgra, 640 * 480 * 4);	// another key: not shared
+	check(other && other != again);
+	frame_pool_release(again);
+	frame_pool_release(other);
+
+	frame_pool_get_stats(&after);
+	check(after.hits - before.hits == 1);
+	check(after.misses - before.misses == 2);
+	check(after.buffers_in_use == before.buffers_in_use);
+	check(after.buffers_cached - before.buffers_cached == 2);
+
+	printf("reuse: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_cache_limit(void)
+{
+	int ok = 1;
+	frame_pool_trim();
+	frame_pool_set_max_cached_bytes(1024 * 1024);
+
+	void * small = frame_pool_alloc(256, 256, frame_pool_format_bgra, 256 * 256 * 4);	// 256 KiB
+	void * large = frame_pool_alloc(1024, 1024, frame_pool_format_bgra, 1024 * 1024 * 4);	// 4 MiB
+	frame_pool_release(small);
+	frame_pool_release(large);
+
+	struct frame_pool_stats stats;
+	frame_pool_get_stats(&stats);
+	check(stats.buffers_cached == 1);
+	check(stats.bytes_cached == 256 * 256 * 4);
+	check(stats.bytes_cached <= stats.max_cached_bytes);
+
+	// lowering the limit trims the cache
+	frame_pool_set_max_cached_bytes(0);
+	frame_pool_get_stats(&stats);
+	check(stats.buffers_cached == 0 && stats.bytes_cached == 0);
+
+	frame_pool_set_max_cached_bytes(-1);	// default
+	frame_pool_get_stats(&stats);
+	check(stats.max_cached_bytes == FRAME_POOL_DEFAULT_CACHE_SIZE);
+
+	printf("cache limit: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_foreign_pointers(void)
+{
+	int ok = 1;
+	struct frame_pool_stats before, after;
+	frame_pool_get_stats(&before);
+
+	void * data = malloc(1000);
+	assert(data);
+	check(frame_pool_get_capacity(data) == 0);
+	frame_pool_release(data);	// free()d, (not cached)
+	frame_pool_release(NULL);
+
+	frame_pool_get_stats(&after);
+	check(after.buffers_cached == before.buffers_cached);
+	check(after.buffers_in_use == before.buffers_in_use);
+
+	printf("foreign pointers: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_reserve(void)
+{
+	int ok = 1;
+	unsigned char * data = frame_pool_reserve(NULL, 0, 0, frame_pool_format_jpeg, 1000);
+	check(data && frame_pool_get_capacity(data) == 65536);	// compressed: at least 64 KiB
+
+	// fits: the same buffer
+	unsigned char * same = frame_pool_reserve(data, 0, 0, frame_pool_format_jpeg, 60000);
+	check(same == data);
+
+	// grows: the next power of 2
+	unsigned char * grown = frame_pool_reserve(same, 0, 0, frame_pool_format_jpeg, 100000);
+	check(grown && frame_pool_get_capacity(grown) == 131072);
+
+	// another format: replaced, raw formats round up to a page
+	unsigned char * bgra = frame_pool_reserve(grown, 10, 10, frame_pool_format_bgra, 400);
+	check(bgra && frame_pool_get_capacity(bgra) == 4096);
+
+	// a foreign buffer is released, (not resized in place)
+	unsigned char * foreign = malloc(16);
+	assert(foreign);
+	unsigned char * pooled = frame_pool_reserve(foreign, 10, 10, frame_pool_format_bgra, 400);
+	check(pooled && frame_pool_get_capacity(pooled) == 4096);
+
+	frame_pool_release(bgra);
+	frame_pool_release(pooled);
+	printf("reserve: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+#define CONCURRENT_THREADS	(4)
+#define CONCURRENT_ROUNDS	(2000)
+#define CONCURRENT_SIZE		(128 * 128 * 4)
+static void * alloc_release_thread(void * user_data)
+{
+	for(int i = 0; i < CONCURRENT_ROUNDS; ++i)
+	{
+		void * data = frame_pool_alloc(128, 128, frame_pool_format_bgra, CONCURRENT_SIZE);
+		assert(data);
+		frame_pool_release(data);
+	}
+	return NULL;
+}
+
+static int test_concurrent_limit(void)
+{
+	int ok = 1;
+	frame_pool_trim();
+
+	pthread_t threads[CONCURRENT_THREADS];
+	for(int i = 0; i < CONCURRENT_THREADS; ++i) pthread_create(&threads[i], NULL, alloc_release_thread, NULL);
+	for(int i = 0; i < CONCURRENT_ROUNDS; ++i)
+	{
+		frame_pool_set_max_cached_bytes((i & 1)?(1024 * 1024):CONCURRENT_SIZE);
+	}
+	for(int i = 0; i < CONCURRENT_THREADS; ++i) pthread_join(threads[i], NULL);
+
+	frame_pool_set_max_cached_bytes(CONCURRENT_SIZE);
+	struct frame_pool_stats stats;
+	frame_pool_get_stats(&stats);
+	check(stats.buffers_in_use == 0);
+	check(stats.bytes_cached == stats.buffers_cached * CONCURRENT_SIZE);
+	check(stats.bytes_cached <= stats.max_cached_bytes);
+
+	frame_pool_set_max_cached_bytes(-1);
+	printf("concurrent limit: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+#undef CONCURRENT_THREADS
+#undef CONCURRENT_ROUNDS
+#undef CONCURRENT_SIZE
+
+int main(int argc, char ** argv)
+{
+	int rc = test_reuse();
+	rc |= test_cache_limit();
+	rc |= test_foreign_pointers();
+	rc |= test_reserve();
+	rc |= test_concurrent_limit();
+
+	frame_pool_trim();
+	return rc?1:0;
+}
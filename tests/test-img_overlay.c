@@ -0,0 +1,260 @@
+/*
+ * test-img_overlay.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * img_overlay:
+ *   blend_mask() / fill_span(): the SIMD path must match the scalar reference (any length, any alpha);
+ *   draw_box(): only the pixels of the box are touched;
+ *   draw_label(): the words are rasterized once, then served from the cache.
+ *
+ * usage: test-img_overlay [num_frames=100]
+ *   benchmark: 1080p frame, 20 / 100 / 500 boxes with "class 0.87" labels,
+ *   img_overlay vs. the cairo path (cairo_rectangle + cairo_stroke + cairo_show_text per box)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include <cairo/cairo.h>
+
+#include "img_proc.h"
+#include "img_overlay.h"
+
+static inline double get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static int test_blend_kernels(void)
+{
+	enum { max_count = 67 };
+	uint32_t src[max_count], dst[max_count], expected[max_count];
+	uint8_t mask[max_count];
+	static const uint32_t colors[] = { 0xffff0000, 0x80ffff00, 0x010000ff, 0xfe123456 };
+
+	int ok = 1;
+	for(int count = 1; count <= max_count && ok; ++count) {
+		for(size_t c = 0; c < sizeof(colors) / sizeof(colors[0]); ++c) {
+			for(int i = 0; i < count; ++i) {
+				src[i] = ((uint32_t)rand() << 16) ^ rand();
+				mask[i] = (i % 5 == 0)?0:((i % 7 == 0)?255:(rand() & 0xff));
+			}
+
+			memcpy(dst, src, sizeof(*dst) * count);
+			memcpy(expected, src, sizeof(*expected) * count);
+			img_overlay_blend_mask(dst, mask, count, colors[c]);
+			img_overlay_blend_mask_scalar(expected, mask, count, colors[c]);
+			if(memcmp(dst, expected, sizeof(*dst) * count) != 0) ok = 0;
+
+			// fill_span == blend_mask with a full mask
+			memset(mask, 255, count);
+			memcpy(dst, src, sizeof(*dst) * count);
+			memcpy(expected, src, sizeof(*expected) * count);
+			img_overlay_fill_span(dst, count, colors[c]);
+			img_overlay_blend_mask_scalar(expected, mask, count, colors[c]);
+			if(memcmp(dst, expected, sizeof(*dst) * count) != 0) ok = 0;
+		}
+	}
+
+	// opaque color over any background ==> the color, 50% gray over black ==> 0x80
+	uint32_t pixel = 0xff000000;
+	img_overlay_fill_span(&pixel, 1, 0x80ffffff);
+	if(pixel != 0xff808080) ok = 0;
+
+	printf("blend kernels: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_draw(void)
+{
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, 320, 240, NULL);
+	memset(image->data, 0, image->width * image->height * 4);
+
+	img_overlay_t overlay[1];
+	memset(overlay, 0, sizeof(overlay));
+	img_overlay_init(overlay, NULL, NULL);
+
+	// box: (10, 20, 100, 50), line_width 3, clipped box at the right edge
+	overlay->draw_box(overlay, image, 10, 20, 100, 50, 3, 0xff00ff00);
+	overlay->draw_box(overlay, image, 300, 200, 100, 100, 2, 0xff0000ff);
+
+	int ok = 1;
+	const uint32_t * pixels = (const uint32_t *)image->data;
+	long touched = 0;
+	for(int y = 0; y < image->height; ++y) {
+		for(int x = 0; x < image->width; ++x) {
+			uint32_t pixel = pixels[y * image->width + x];
+			int inside = (x >= 10 && x < 110 && y >= 20 && y < 70);
+			int edge = inside && (x < 13 || x >= 107 || y < 23 || y >= 67);
+			int clipped_edge = (x >= 300 && y >= 200) && (x < 302 || y < 202);
+			uint32_t expected = edge?0xff00ff00:(clipped_edge?0xff0000ff:0);
+			if(pixel != expected) ok = 0;
+			if(pixel) ++touched;
+		}
+	}
+	printf("draw_box: %s (%ld pixels)\n", ok?"ok":"FAILED", touched);
+
+	// label: the same words are rasterized once
+	struct img_overlay_label_style style = { .font_size = 16, .color = 0xffffffff, .bg_color = 0xc0000000, .padding = 2 };
+	int width = 0, height = 0;
+	overlay->draw_label(overlay, image, 20, 100, "person 0.87", &style, &width, &height);
+	overlay->draw_label(overlay, image, 20, 140, "person 0.87", &style, NULL, NULL);
+	overlay->draw_label(overlay, image, 20, 180, "car  0.87", &style, NULL, NULL);
+
+	int label_width = 0, label_height = 0;
+	overlay->get_label_size(overlay, "person 0.87", &style, &label_width, &label_height);
+
+	struct img_overlay_stats stats;
+	overlay->get_stats(overlay, &stats);
+	int label_ok = (stats.num_sprites == 4 && stats.cache_misses == 4)	// "person", " ", "0.87", "car"
+		&& (width > 0 && height > 0 && width == label_width && height == label_height);
+	printf("draw_label: %s (label %dx%d, sprites=%ld, hits=%ld, misses=%ld)\n", label_ok?"ok":"FAILED",
+		width, height, stats.num_sprites, stats.cache_hits, stats.cache_misses);
+
+	img_overlay_cleanup(overlay);
+	bgra_image_clear(image);
+	return (ok && label_ok)?0:-1;
+}
+
+/******************************************************************************
+ * benchmark
+ *****************************************************************************/
+static const char * s_class_names[] = { "person", "bicycle", "car", "motorbike", "bus", "truck", "dog", "cat" };
+#define NUM_CLASSES (sizeof(s_class_names) / sizeof(s_class_names[0]))
+
+struct box
+{
+	int x, y, width, height;
+	int class_index;
+	char label[64];
+};
+
+static void generate_boxes(struct box * boxes, int count, int width, int height)
+{
+	for(int i = 0; i < count; ++i) {
+		struct box * box = &boxes[i];
+		box->width = 40 + rand() % 200;
+		box->height = 60 + rand() % 300;
+		box->x = rand() % (width - box->width);
+		box->y = rand() % (height - box->height);
+		box->class_index = rand() % NUM_CLASSES;
+		snprintf(box->label, sizeof(box->label), "%s %.2f", s_class_names[box->class_index], (double)(rand() % 101) / 100.0);
+	}
+}
+
+static void draw_cairo(bgra_image_t * image, const struct box * boxes, int count)
+{
+	cairo_surface_t * surface = cairo_image_surface_create_for_data(image->data, CAIRO_FORMAT_RGB24,
+		image->width, image->height, bgra_image_stride(image));
+	cairo_t * cr = cairo_create(surface);
+	double font_size = (double)image->height / 30;
+	cairo_set_line_width(cr, 2);
+	cairo_set_font_size(cr, font_size);
+	cairo_select_font_face(cr, IMG_OVERLAY_DEFAULT_FONT, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	for(int i = 0; i < count; ++i) {
+		const struct box * box = &boxes[i];
+		cairo_set_source_rgba(cr, box->class_index == 0, box->class_index == 0, box->class_index != 0, 1);
+		cairo_rectangle(cr, box->x, box->y, box->width, box->height);
+		cairo_stroke(cr);
+		cairo_move_to(cr, box->x + 2, box->y + font_size);
+		cairo_show_text(cr, box->label);
+	}
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+}
+
+static void draw_overlay(img_overlay_t * overlay, bgra_image_t * image, const struct box * boxes, int count)
+{
+	struct img_overlay_label_style style = { .font_size = image->height / 30 };
+	for(int i = 0; i < count; ++i) {
+		const struct box * box = &boxes[i];
+		uint32_t color = (box->class_index == 0)?0xffffff00:0xff0000ff;
+		overlay->draw_box(overlay, image, box->x, box->y, box->width, box->height, 2, color);
+		style.color = color;
+		overlay->draw_label(overlay, image, box->x + 2, box->y + 2, box->label, &style, NULL, NULL);
+	}
+}
+
+static void benchmark(int num_frames)
+{
+	static const int num_boxes_list[] = { 20, 100, 500 };
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, 1920, 1080, NULL);
+	memset(image->data, 0x40, image->width * image->height * 4);
+
+	img_overlay_t overlay[1];
+	memset(overlay, 0, sizeof(overlay));
+	img_overlay_init(overlay, NULL, NULL);
+
+	struct box * boxes = calloc(500, sizeof(*boxes));
+	assert(boxes);
+	for(size_t t = 0; t < sizeof(num_boxes_list) / sizeof(num_boxes_list[0]); ++t) {
+		int count = num_boxes_list[t];
+		generate_boxes(boxes, count, image->width, image->height);
+
+		double time_cairo = 0, time_overlay = 0;
+		for(int i = 0; i < num_frames; ++i) {
+			double start = get_time_sec();
+			draw_cairo(image, boxes, count);
+			double middle = get_time_sec();
+			draw_overlay(overlay, image, boxes, count);
+			time_cairo += middle - start;
+			time_overlay += get_time_sec() - middle;
+		}
+		printf("%4d boxes: cairo %8.3f ms/frame, img_overlay %8.3f ms/frame (x%.1f)\n", count,
+			time_cairo * 1000.0 / num_frames, time_overlay * 1000.0 / num_frames,
+			time_overlay > 0?(time_cairo / time_overlay):0);
+	}
+
+	struct img_overlay_stats stats;
+	overlay->get_stats(overlay, &stats);
+	printf("sprites: %ld, hits: %ld, misses: %ld\n", stats.num_sprites, stats.cache_hits, stats.cache_misses);
+
+	free(boxes);
+	img_overlay_cleanup(overlay);
+	bgra_image_clear(image);
+}
+
+int main(int argc, char ** argv)
+{
+	int num_frames = (argc > 1)?atoi(argv[1]):100;
+	if(num_frames <= 0) num_frames = 100;
+
+	int rc = test_blend_kernels();
+	rc |= test_draw();
+	if(rc) return 1;
+
+	benchmark(num_frames);
+	return 0;
+}
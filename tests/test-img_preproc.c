@@ -0,0 +1,422 @@
+/*
+ * test-img_preproc.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * bit-exactness test: img_preproc_bgra_to_f32() (every isa supported by the cpu)
+ *   vs. the scalar loops it replaced in darknet-wrapper.c and caffe-wrapper.cpp,
+ *   followed by a throughput comparison.
+ *
+ * img_preproc_yuv_to_f32_resized(): reference colors, NV12 == I420, every isa gives the same result,
+ *   and the fused path vs. (bgra resize + img_preproc_bgra_to_f32()) for a 1080p frame.
+ *
+ * usage: test-img_preproc [width=416] [height=416] [iterations=200]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <math.h>
+
+#include "img_proc.h"
+#include "img_preproc.h"
+
+static inline double get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+/* darknet-wrapper.c: bgra_image_to_f32() */
+static void reference_darknet(const bgra_image_t * bgra, float * dst)
+{
+	static const float scalar = 1.0f / 255.0f;
+	ssize_t size = bgra->width * bgra->height;
+	float * r_plane = dst;
+	float * g_plane = r_plane + size;
+	float * b_plane = g_plane + size;
+
+	int stride = bgra_image_stride(bgra);
+	int pos = 0;
+	for(int row = 0; row < bgra->height; ++row)
+	{
+		const unsigned char * bgra_data = bgra->data + (ssize_t)row * stride;
+		for(int col = 0; col < bgra->width; ++col, ++pos, bgra_data += 4)
+		{
+			r_plane[pos] = ((float) bgra_data[2]) * scalar;
+			g_plane[pos] = ((float) bgra_data[1]) * scalar;
+			b_plane[pos] = ((float) bgra_data[0]) * scalar;
+		}
+	}
+}
+
+/* caffe-wrapper.cpp: bgra_to_float32_planes(), (without resizing) */
+static void reference_caffe(const bgra_image_t * frame, const float * means, float value_scale, float * rgb_planes)
+{
+	int width = frame->width, height = frame->height;
+	int stride = bgra_image_stride(frame);
+	ssize_t size = width * height;
+	float * r_plane = rgb_planes;
+	float * g_plane = r_plane + size;
+	float * b_plane = g_plane + size;
+
+	const float * mean = means;
+	ssize_t ii = 0;
+	for(int row = 0; row < height; ++row)
+	{
+		const unsigned char * data = frame->data + (ssize_t)row * stride;
+		if(mean) {
+			for(int col = 0; col < width; ++col, ++ii)
+			{
+				r_plane[ii] = ((float)data[2] - mean[0]) * value_scale;
+				g_plane[ii] = ((float)data[1] - mean[1]) * value_scale;
+				b_plane[ii] = ((float)data[0] - mean[2]) * value_scale;
+				data += 4;
+				mean += 3;
+			}
+		}else {
+			for(int col = 0; col < width; ++col, ++ii)
+			{
+				r_plane[ii] = ((float)data[2] - 128.0f) * value_scale;
+				g_plane[ii] = ((float)data[1] - 128.0f) * value_scale;
+				b_plane[ii] = ((float)data[0] - 128.0f) * value_scale;
+				data += 4;
+			}
+		}
+	}
+}
+
+/* generic reference for the remaining layouts */
+static void reference_generic(const bgra_image_t * image, const struct img_preproc_params * params, float * dst)
+{
+	ssize_t size = image->width * image->height;
+	int stride = bgra_image_stride(image);
+	int rgb = (params->channel_order == img_preproc_channel_order_rgb);
+	for(int row = 0; row < image->height; ++row) {
+		const unsigned char * data = image->data + (ssize_t)row * stride;
+		for(int col = 0; col < image->width; ++col, data += 4) {
+			ssize_t pos = (ssize_t)row * image->width + col;
+			for(int c = 0; c < 3; ++c) {
+				float std = params->std[c]?params->std[c]:1.0f;
+				float k = params->scale / std;
+				float value = ((float)data[rgb?(2 - c):c] - params->mean[c]) * k;
+				if(params->layout == img_preproc_layout_nhwc) dst[pos * 3 + c] = value;
+				else dst[c * size + pos] = value;
+			}
+		}
+	}
+}
+
+static int check_equal(const char * name, enum img_preproc_isa isa, const bgra_image_t * image, const float * expected, const float * actual)
+{
+	ssize_t count = (ssize_t)image->width * image->height * 3;
+	if(0 == memcmp(expected, actual, count * sizeof(float))) return 0;
+
+	for(ssize_t i = 0; i < count; ++i) {
+		if(memcmp(&expected[i], &actual[i], sizeof(float))) {
+			fprintf(stderr, "[FAILED] %s, isa=%s, %dx%d(stride=%d): [%ld] expected=%.9g, actual=%.9g\n",
+				name, img_preproc_isa_to_string(isa), image->width, image->height, bgra_image_stride(image),
+				(long)i, expected[i], actual[i]);
+			break;
+		}
+	}
+	return 1;
+}
+
+static int test_image(const bgra_image_t * image, const float * mean_image)
+{
+	ssize_t count = (ssize_t)image->width * image->height * 3;
+	float * expected = malloc(count * sizeof(float));
+	float * actual = malloc((count + 16) * sizeof(float));
+	assert(expected && actual);
+
+	int rc = 0;
+	int max_isa = img_preproc_set_isa(img_preproc_isa_auto);
+	for(int isa = img_preproc_isa_scalar; isa <= max_isa; ++isa) {
+		img_preproc_set_isa(isa);
+
+		// guard: kernels must not write past the end of the tensor
+		for(int i = 0; i < 16; ++i) actual[count + i] = -1.0f;
+
+		struct img_preproc_params darknet = { .scale = 1.0f / 255.0f };
+		reference_darknet(image, expected);
+		img_preproc_bgra_to_f32(image, actual, &darknet);
+		rc |= check_equal("darknet", isa, image, expected, actual);
+
+		struct img_preproc_params caffe = { .scale = 0.017f, .mean = { 128, 128, 128 } };
+		reference_caffe(image, NULL, 0.017f, expected);
+		img_preproc_bgra_to_f32(image, actual, &caffe);
+		rc |= check_equal("caffe", isa, image, expected, actual);
+
+		caffe.mean_image = mean_image;
+		reference_caffe(image, mean_image, 0.017f, expected);
+		img_preproc_bgra_to_f32(image, actual, &caffe);
+		rc |= check_equal("caffe(mean_image)", isa, image, expected, actual);
+
+		for(int layout = 0; layout < 2; ++layout) {
+			for(int order = 0; order < 2; ++order) {
+				struct img_preproc_params params = {
+					.layout = layout, .channel_order = order,
+					.scale = 1.0f,
+					.mean = { 123.675f, 116.28f, 103.53f },
+					.std = { 58.395f, 57.12f, 57.375f },
+				};
+				reference_generic(image, &params, expected);
+				img_preproc_bgra_to_f32(image, actual, &params);
+				rc |= check_equal(layout?(order?"nhwc-bgr":"nhwc-rgb"):(order?"nchw-bgr":"nchw-rgb"),
+					isa, image, expected, actual);
+			}
+		}
+
+		for(int i = 0; i < 16; ++i) {
+			if(actual[count + i] != -1.0f) {
+				fprintf(stderr, "[FAILED] isa=%s, %dx%d: buffer overflow\n",
+					img_preproc_isa_to_string(isa), image->width, image->height);
+				rc |= 1;
+				break;
+			}
+		}
+	}
+
+	free(expected);
+	free(actual);
+	return rc;
+}
+
+static void benchmark(int width, int height, int iterations)
+{
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, width, height, NULL);
+	for(ssize_t i = 0; i < (ssize_t)width * height * 4; ++i) image->data[i] = rand();
+
+	float * dst = malloc((ssize_t)width * height * 3 * sizeof(float));
+	assert(dst);
+
+	double begin_time = get_time_sec();
+	for(int i = 0; i < iterations; ++i) reference_darknet(image, dst);
+	double elapsed = get_time_sec() - begin_time;
+	printf("%-10s %dx%d: %8.3f ms/frame\n", "reference", width, height, elapsed * 1000.0 / iterations);
+
+	struct img_preproc_params darknet = { .scale = 1.0f / 255.0f };
+	int max_isa = img_preproc_set_isa(img_preproc_isa_auto);
+	for(int isa = img_preproc_isa_scalar; isa <= max_isa; ++isa) {
+		img_preproc_set_isa(isa);
+		for(int layout = 0; layout < 2; ++layout) {
+			darknet.layout = layout;
+			begin_time = get_time_sec();
+			for(int i = 0; i < iterations; ++i) img_preproc_bgra_to_f32(image, dst, &darknet);
+			elapsed = get_time_sec() - begin_time;
+			printf("%-10s %dx%d: %8.3f ms/frame (%s)\n", img_preproc_isa_to_string(isa), width, height,
+				elapsed * 1000.0 / iterations, layout?"nhwc":"nchw");
+		}
+	}
+	img_preproc_set_isa(img_preproc_isa_auto);
+
+	free(dst);
+	bgra_image_clear(image);
+}
+
+/* packs the same random samples as NV12 and I420 */
+static unsigned char * make_yuv(enum yuv_image_format format, int width, int height, unsigned int seed, yuv_image_t * image)
+{
+	ssize_t size = yuv_image_layout(format, width, height, NULL, NULL);
+	unsigned char * data = calloc(size, 1);
+	assert(data);
+	int rc = yuv_image_init(image, format, width, height, data, size);
+	assert(0 == rc);
+
+	srand(seed);
+	unsigned char * luma = (unsigned char *)image->planes[0];
+	for(int y = 0; y < height; ++y) for(int x = 0; x < width; ++x) luma[y * image->strides[0] + x] = 16 + rand() % 220;
+	for(int y = 0; y < (height + 1) / 2; ++y) {
+		for(int x = 0; x < (width + 1) / 2; ++x) {
+			unsigned char u = 16 + rand() % 225, v = 16 + rand() % 225;
+			if(format == yuv_image_format_nv12) {
+				unsigned char * uv = (unsigned char *)image->planes[1] + y * image->strides[1] + x * 2;
+				uv[0] = u; uv[1] = v;
+			}else {
+				((unsigned char *)image->planes[1])[y * image->strides[1] + x] = u;
+				((unsigned char *)image->planes[2])[y * image->strides[2] + x] = v;
+			}
+		}
+	}
+	return data;
+}
+
+static int test_yuv(void)
+{
+	int rc = 0;
+	struct img_preproc_params darknet = { .scale = 1.0f / 255.0f };
+
+	// reference colors: (y, u, v) ==> (r, g, b)
+	static const struct { unsigned char yuv[3]; float rgb[3]; } colors[] = {
+		{ { 16, 128, 128 }, { 0, 0, 0 } },
+		{ { 235, 128, 128 }, { 1, 1, 1 } },
+		{ { 81, 90, 240 }, { 1, 0, 0 } },		// bt.601 red
+		{ { 145, 54, 34 }, { 0, 1, 0 } },		// bt.601 green
+	};
+	for(size_t i = 0; i < sizeof(colors) / sizeof(colors[0]); ++i) {
+		unsigned char data[64];	// 4x4 I420
+		memset(data, colors[i].yuv[0], 16);
+		memset(data + 16, colors[i].yuv[1], 8);
+		memset(data + 24, colors[i].yuv[2], 8);
+		yuv_image_t image[1];
+		memset(image, 0, sizeof(image));
+		yuv_image_init(image, yuv_image_format_i420, 4, 4, data, sizeof(data));
+
+		float rgb[2 * 2 * 3];
+		img_preproc_yuv_to_f32_resized(image, rgb, 2, 2, NULL, &darknet);
+		for(int c = 0; c < 3; ++c) {
+			if(fabsf(rgb[c * 4] - colors[i].rgb[c]) > 0.01f) {
+				fprintf(stderr, "[FAILED] yuv(%d, %d, %d): channel %d = %.4f, expected %.4f\n",
+					colors[i].yuv[0], colors[i].yuv[1], colors[i].yuv[2], c, rgb[c * 4], colors[i].rgb[c]);
+				rc = 1;
+			}
+		}
+	}
+
+	// NV12 and I420 with the same samples, (odd size, letterboxed) must match on every isa
+	const int width = 257, height = 67, dst_width = 96, dst_height = 64;
+	yuv_image_t nv12[1], i420[1];
+	unsigned char * nv12_data = make_yuv(yuv_image_format_nv12, width, height, 1, nv12);
+	unsigned char * i420_data = make_yuv(yuv_image_format_i420, width, height, 1, i420);
+	struct bgra_image_letterbox roi;
+	bgra_image_letterbox_init(&roi, width, height, dst_width, dst_height);
+
+	ssize_t count = (ssize_t)dst_width * dst_height * 3;
+	float * expected = calloc(count, sizeof(float));
+	float * actual = calloc(count, sizeof(float));
+	assert(expected && actual);
+
+	int max_isa = img_preproc_set_isa(img_preproc_isa_auto);
+	img_preproc_set_isa(img_preproc_isa_scalar);
+	img_preproc_yuv_to_f32_resized(i420, expected, dst_width, dst_height, &roi, &darknet);
+	for(int isa = img_preproc_isa_scalar; isa <= max_isa; ++isa) {
+		img_preproc_set_isa(isa);
+		memset(actual, 0, count * sizeof(float));
+		img_preproc_yuv_to_f32_resized(nv12, actual, dst_width, dst_height, &roi, &darknet);
+		if(memcmp(expected, actual, count * sizeof(float))) {
+			fprintf(stderr, "[FAILED] nv12 != i420, isa=%s\n", img_preproc_isa_to_string(isa));
+			rc = 1;
+		}
+	}
+	img_preproc_set_isa(img_preproc_isa_auto);
+	printf("yuv: %s\n", rc?"FAILED":"ok");
+
+	free(expected);
+	free(actual);
+	free(nv12_data);
+	free(i420_data);
+	return rc;
+}
+
+static void benchmark_yuv(int width, int height, int iterations)
+{
+	const int src_width = 1920, src_height = 1080;
+	yuv_image_t nv12[1];
+	unsigned char * nv12_data = make_yuv(yuv_image_format_nv12, src_width, src_height, 2, nv12);
+	float * dst = malloc((ssize_t)width * height * 3 * sizeof(float));
+	assert(dst);
+	struct img_preproc_params darknet = { .scale = 1.0f / 255.0f };
+
+	double begin_time = get_time_sec();
+	for(int i = 0; i < iterations; ++i) img_preproc_yuv_to_f32_resized(nv12, dst, width, height, NULL, &darknet);
+	double elapsed = get_time_sec() - begin_time;
+	printf("%-10s %dx%d ==> %dx%d: %8.3f ms/frame\n", "nv12", src_width, src_height, width, height, elapsed * 1000.0 / iterations);
+
+	// the bgra path, (the decoder ==> bgra conversion itself is not included)
+	bgra_image_t frame[1], resized[1];
+	memset(frame, 0, sizeof(frame));
+	memset(resized, 0, sizeof(resized));
+	bgra_image_init(frame, src_width, src_height, NULL);
+	for(ssize_t i = 0; i < (ssize_t)src_width * src_height * 4; ++i) frame->data[i] = rand();
+	resized->width = width;
+	resized->height = height;
+
+	begin_time = get_time_sec();
+	for(int i = 0; i < iterations; ++i) {
+		bgra_image_resize(resized, frame, bgra_image_resize_filter_auto);
+		img_preproc_bgra_to_f32(resized, dst, &darknet);
+	}
+	elapsed = get_time_sec() - begin_time;
+	printf("%-10s %dx%d ==> %dx%d: %8.3f ms/frame (resize + bgra_to_f32)\n", "bgra", src_width, src_height, width, height, elapsed * 1000.0 / iterations);
+
+	bgra_image_clear(frame);
+	bgra_image_clear(resized);
+	free(dst);
+	free(nv12_data);
+}
+
+int main(int argc, char **argv)
+{
+	int width = 416, height = 416, iterations = 200;
+	if(argc > 1) width = atoi(argv[1]);
+	if(argc > 2) height = atoi(argv[2]);
+	if(argc > 3) iterations = atoi(argv[3]);
+	assert(width > 0 && height > 0 && iterations > 0);
+
+	srand(12345);
+	bgra_image_t parent[1];
+	memset(parent, 0, sizeof(parent));
+	bgra_image_init(parent, 257, 67, NULL);
+	for(ssize_t i = 0; i < (ssize_t)parent->width * parent->height * 4; ++i) parent->data[i] = rand();
+
+	float * mean_image = malloc((ssize_t)parent->width * parent->height * 3 * sizeof(float));
+	assert(mean_image);
+	for(ssize_t i = 0; i < (ssize_t)parent->width * parent->height * 3; ++i) mean_image[i] = (float)(rand() % 25600) / 100.0f;
+
+	// odd sizes and strided views, so that every tail path is covered
+	static const int sizes[][2] = {
+		{ 257, 67 }, { 1, 1 }, { 2, 3 }, { 3, 2 }, { 5, 7 }, { 15, 9 }, { 16, 4 }, { 17, 5 }, { 33, 11 }, { 100, 20 },
+	};
+	int rc = 0;
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		bgra_image_t view[1];
+		memset(view, 0, sizeof(view));
+		int x = (int)(i * 7) % 13, y = (int)(i * 3) % 5;
+		if(NULL == bgra_image_view(view, parent, x, y, sizes[i][0], sizes[i][1])) continue;
+		rc |= test_image(view, mean_image);
+
+		bgra_image_t packed[1];
+		memset(packed, 0, sizeof(packed));
+		bgra_image_copy(packed, view);
+		rc |= test_image(packed, mean_image);
+		bgra_image_clear(packed);
+	}
+	printf("bit-exactness: %s (max isa: %s)\n", rc?"FAILED":"ok",
+		img_preproc_isa_to_string(img_preproc_set_isa(img_preproc_isa_auto)));
+
+	rc |= test_yuv();
+
+	benchmark(width, height, iterations);
+	benchmark_yuv(width, height, (iterations + 9) / 10);
+
+	free(mean_image);
+	bgra_image_clear(parent);
+	return rc;
+}
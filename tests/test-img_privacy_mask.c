@@ -0,0 +1,277 @@
+/*
+ * test-img_privacy_mask.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * img_privacy_mask:
+ *   sum_span() / box_blur(): the SIMD path must match the scalar reference (any size, any radius);
+ *   mask_rect() / mask_polygon(): only the pixels of the shape are changed, (pixelate, blur, fill);
+ *   apply(): only the detections of the selected classes are masked, plus the static regions.
+ *
+ * usage: test-img_privacy_mask [num_frames=100]
+ *   benchmark: 1080p frame, 4 faces (120x150) + 1 polygon region, per mode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "img_proc.h"
+#include "img_privacy_mask.h"
+
+static inline double get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static void fill_random(uint32_t * pixels, size_t count)
+{
+	for(size_t i = 0; i < count; ++i) pixels[i] = ((uint32_t)rand() << 16) ^ rand();
+}
+
+static int test_kernels(void)
+{
+	int ok = 1;
+	uint32_t pixels[67];
+	for(int count = 1; count <= 67 && ok; ++count) {
+		fill_random(pixels, count);
+		uint32_t sums[4] = { 1, 2, 3, 4 }, expected[4] = { 1, 2, 3, 4 };
+		img_privacy_mask_sum_span(pixels, count, sums);
+		img_privacy_mask_sum_span_scalar(pixels, count, expected);
+		if(memcmp(sums, expected, sizeof(sums)) != 0) ok = 0;
+	}
+	printf("sum_span: %s\n", ok?"ok":"FAILED");
+
+	static const int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 33, 17 }, { 120, 150 } };
+	static const int radii[] = { 1, 2, 5, 40 };
+	int blur_ok = 1;
+	for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		int width = sizes[s][0], height = sizes[s][1];
+		size_t size = (size_t)width * height;
+		uint32_t * region = malloc(size * 4);
+		uint32_t * expected = malloc(size * 4);
+		uint32_t * scratch = malloc((size + width * 4) * 4);
+		assert(region && expected && scratch);
+		for(size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); ++r) {
+			fill_random(region, size);
+			memcpy(expected, region, size * 4);
+			img_privacy_mask_box_blur(region, width, height, radii[r], scratch);
+			img_privacy_mask_box_blur_scalar(expected, width, height, radii[r], scratch);
+			if(memcmp(region, expected, size * 4) != 0) blur_ok = 0;
+		}
+
+		// a flat region stays flat
+		for(size_t i = 0; i < size; ++i) region[i] = 0xff336699;
+		img_privacy_mask_box_blur(region, width, height, 3, scratch);
+		for(size_t i = 0; i < size; ++i) if(region[i] != 0xff336699) blur_ok = 0;
+
+		free(region);
+		free(expected);
+		free(scratch);
+	}
+	printf("box_blur: %s\n", blur_ok?"ok":"FAILED");
+	return (ok && blur_ok)?0:-1;
+}
+
+/*
+ * shapes: a random frame is masked, every pixel outside the shape must be unchanged,
+ *   every pixel inside must be changed, (pixelate / blur: a random block hardly keeps one of its pixels)
+ */
+static int inside_polygon(const struct img_privacy_mask_point * points, int num_points, double x, double y)
+{
+	int inside = 0;
+	for(int i = 0, j = num_points - 1; i < num_points; j = i++) {
+		if((points[i].y > y) == (points[j].y > y)) continue;
+		double cross = points[j].x + (y - points[j].y) * (points[i].x - points[j].x) / (points[i].y - points[j].y);
+		if(x >= cross - 0.5 && x < cross + 0.5) return -1;	// on the edge, either way
+		if(x > cross) inside = !inside;
+	}
+	return inside;
+}
+
+static int check_shape(enum img_privacy_mask_mode mode, const struct img_privacy_mask_point * points, int num_points,
+	int x, int y, int width, int height)
+{
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, 320, 240, NULL);
+	fill_random((uint32_t *)image->data, image->width * image->height);
+	uint32_t * original = malloc(image->width * image->height * 4);
+	assert(original);
+	memcpy(original, image->data, image->width * image->height * 4);
+
+	struct img_privacy_mask_params params;
+	img_privacy_mask_params_load(&params, NULL);
+	params.mode = mode;
+	params.block_size = 8;
+	params.color = 0x123456;
+
+	img_privacy_mask_t mask[1];
+	memset(mask, 0, sizeof(mask));
+	img_privacy_mask_init(mask, &params, NULL);
+	if(points) mask->mask_polygon(mask, image, points, num_points);
+	else mask->mask_rect(mask, image, x, y, width, height);
+
+	const uint32_t * pixels = (const uint32_t *)image->data;
+	long changed = 0, unexpected = 0;
+	for(int py = 0; py < image->height; ++py) {
+		for(int px = 0; px < image->width; ++px) {
+			int inside = points?inside_polygon(points, num_points, px + 0.5, py + 0.5)
+				:(px >= x && px < x + width && py >= y && py < y + height);
+			size_t index = (size_t)py * image->width + px;
+			int is_changed = (pixels[index] != original[index]);
+			if(is_changed) ++changed;
+			if(inside < 0) continue;
+			if(inside != is_changed) ++unexpected;
+			if(inside && mode == img_privacy_mask_mode_fill && pixels[index] != 0xff123456) ++unexpected;
+		}
+	}
+
+	static const char * s_modes[] = { "pixelate", "blur", "fill" };
+	printf("%-8s %s: %ld pixels changed, %ld unexpected: %s\n", s_modes[mode], points?"polygon":"rect   ",
+		changed, unexpected, unexpected?"FAILED":"ok");
+
+	img_privacy_mask_cleanup(mask);
+	free(original);
+	bgra_image_clear(image);
+	return unexpected?-1:0;
+}
+
+static int test_shapes(void)
+{
+	static const struct img_privacy_mask_point triangle[] = { { 50, 20 }, { 300, 120 }, { 20, 230 } };
+	static const struct img_privacy_mask_point concave[] = { { 10, 10 }, { 200, 10 }, { 100, 100 }, { 200, 200 }, { 10, 200 } };
+	int rc = 0;
+	for(int mode = img_privacy_mask_mode_pixelate; mode <= img_privacy_mask_mode_fill; ++mode) {
+		rc |= check_shape(mode, NULL, 0, 40, 30, 100, 60);
+		rc |= check_shape(mode, NULL, 0, 280, 200, 100, 100);	// clipped
+		rc |= check_shape(mode, triangle, 3, 0, 0, 0, 0);
+		rc |= check_shape(mode, concave, 5, 0, 0, 0, 0);
+	}
+	return rc;
+}
+
+static json_object * new_detection(const char * class_name, double confidence, double left, double top, double width, double height)
+{
+	json_object * jdet = json_object_new_object();
+	json_object_object_add(jdet, "class", json_object_new_string(class_name));
+	json_object_object_add(jdet, "confidence", json_object_new_double(confidence));
+	json_object_object_add(jdet, "left", json_object_new_double(left));
+	json_object_object_add(jdet, "top", json_object_new_double(top));
+	json_object_object_add(jdet, "width", json_object_new_double(width));
+	json_object_object_add(jdet, "height", json_object_new_double(height));
+	return jdet;
+}
+
+static int test_apply(void)
+{
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, 400, 200, NULL);
+	fill_random((uint32_t *)image->data, image->width * image->height);
+
+	json_object * jresult = json_object_new_object();
+	json_object * jdetections = json_object_new_array();
+	json_object_object_add(jresult, "detections", jdetections);
+	json_object_array_add(jdetections, new_detection("person", 0.9, 0.5, 0.5, 0.25, 0.5));
+	json_object * jfaces = json_object_new_array();
+	json_object_object_add(jresult, "faces", jfaces);
+	json_object_array_add(jfaces, new_detection("face", 0.8, 0.1, 0.1, 0.1, 0.2));	// (40, 20, 40, 40) + padding
+	json_object_array_add(jfaces, new_detection("face", 0.1, 0.3, 0.1, 0.1, 0.2));	// low confidence
+
+	struct img_privacy_mask_params params;
+	img_privacy_mask_params_load(&params, NULL);
+	params.mode = img_privacy_mask_mode_fill;
+	params.padding = 0;
+
+	img_privacy_mask_t mask[1];
+	memset(mask, 0, sizeof(mask));
+	img_privacy_mask_init(mask, &params, NULL);
+	ssize_t targets = mask->count_targets(mask, jresult);
+	ssize_t masked = mask->apply(mask, image, jresult);
+
+	long filled = 0;
+	const uint32_t * pixels = (const uint32_t *)image->data;
+	for(int i = 0; i < image->width * image->height; ++i) filled += (pixels[i] == 0xff000000);
+
+	int ok = (targets == 1 && masked == 1 && filled == 40 * 40);
+	printf("apply: targets=%ld, masked=%ld, filled=%ld: %s\n", (long)targets, (long)masked, filled, ok?"ok":"FAILED");
+
+	img_privacy_mask_cleanup(mask);
+	json_object_put(jresult);
+	bgra_image_clear(image);
+	return ok?0:-1;
+}
+
+static void benchmark(int num_frames)
+{
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, 1920, 1080, NULL);
+	fill_random((uint32_t *)image->data, image->width * image->height);
+
+	static const int faces[][2] = { { 100, 100 }, { 600, 300 }, { 1200, 500 }, { 1700, 900 } };
+	static const struct img_privacy_mask_point window[] = { { 1500, 50 }, { 1850, 80 }, { 1830, 400 }, { 1480, 380 } };
+	static const char * s_modes[] = { "pixelate", "blur", "fill" };
+	for(int mode = img_privacy_mask_mode_pixelate; mode <= img_privacy_mask_mode_fill; ++mode) {
+		struct img_privacy_mask_params params;
+		img_privacy_mask_params_load(&params, NULL);
+		params.mode = mode;
+
+		img_privacy_mask_t mask[1];
+		memset(mask, 0, sizeof(mask));
+		img_privacy_mask_init(mask, &params, NULL);
+
+		double start = get_time_sec();
+		for(int i = 0; i < num_frames; ++i) {
+			for(size_t k = 0; k < sizeof(faces) / sizeof(faces[0]); ++k) {
+				mask->mask_rect(mask, image, faces[k][0], faces[k][1], 120, 150);
+			}
+			mask->mask_polygon(mask, image, window, sizeof(window) / sizeof(window[0]));
+		}
+		double elapsed = get_time_sec() - start;
+		printf("%-8s: %8.3f ms/frame\n", s_modes[mode], elapsed * 1000.0 / num_frames);
+		img_privacy_mask_cleanup(mask);
+	}
+	bgra_image_clear(image);
+}
+
+int main(int argc, char ** argv)
+{
+	int num_frames = (argc > 1)?atoi(argv[1]):100;
+	if(num_frames <= 0) num_frames = 100;
+
+	int rc = test_kernels();
+	rc |= test_shapes();
+	rc |= test_apply();
+	if(rc) return 1;
+
+	benchmark(num_frames);
+	return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * test-img_probe.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * fuzz test: img_utils_probe() vs. the header parsers of the decoders (libjpeg / libpng)
+ *   the input images are mutated (bit flips, byte overwrites, insertions, truncation),
+ *   whenever a decoder accepts the header, the probe must accept it too and report the same size.
+ *
+ * usage: test-img_probe [iterations=200000] [seed=time]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <setjmp.h>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include "img_proc.h"
+
+/******************************************************************************
+ * reference: libjpeg
+ *****************************************************************************/
+struct jpeg_error_context
+{
+	struct jpeg_error_mgr base[1];
+	jmp_buf jmp;
+};
+static void on_jpeg_error(j_common_ptr cinfo)
+{
+	struct jpeg_error_context * err = (struct jpeg_error_context *)cinfo->err;
+	longjmp(err->jmp, 1);
+}
+static void on_jpeg_message(j_common_ptr cinfo, int level) { (void)cinfo; (void)level; }
+
+static int reference_jpeg_size(const unsigned char * data, size_t length, int * width, int * height)
+{
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_context err;
+	memset(&cinfo, 0, sizeof(cinfo));
+	memset(&err, 0, sizeof(err));
+	cinfo.err = jpeg_std_error(err.base);
+	err.base->error_exit = on_jpeg_error;
+	err.base->emit_message = on_jpeg_message;
+
+	volatile int rc = -1;
+	jpeg_create_decompress(&cinfo);
+	if(0 == setjmp(err.jmp))
+	{
+		jpeg_mem_src(&cinfo, data, length);
+		if(jpeg_read_header(&cinfo, TRUE) == JPEG_HEADER_OK)
+		{
+			*width = cinfo.image_width;
+			*height = cinfo.image_height;
+			rc = 0;
+		}
+	}
+	jpeg_destroy_decompress(&cinfo);
+	return rc;
+}
+
+/******************************************************************************
+ * reference: libpng
+ *****************************************************************************/
+struct png_read_context
+{
+	const unsigned char * data;
+	size_t length;
+	size_t offset;
+};
+static void on_png_read(png_structp png, png_bytep out, png_size_t length)
+{
+	struct png_read_context * ctx = png_get_io_ptr(png);
+	if(length > (ctx->length - ctx->offset)) png_error(png, "eof");
+	memcpy(out, ctx->data + ctx->offset, length);
+	ctx->offset += length;
+}
+static void on_png_warning(png_structp png, png_const_charp msg) { (void)png; (void)msg; }
+static void on_png_error(png_structp png, png_const_charp msg) { (void)msg; png_longjmp(png, 1); }
+
+static int reference_png_size(const unsigned char * data, size_t length, int * width, int * height)
+{
+	if(length < 8 || png_sig_cmp(data, 0, 8)) return -1;
+
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, on_png_error, on_png_warning);
+	png_infop info = png_create_info_struct(png);
+	assert(png && info);
+
+	struct png_read_context ctx = { .data = data, .length = length };
+	volatile int rc = -1;
+	if(0 == setjmp(png_jmpbuf(png)))
+	{
+		png_set_read_fn(png, &ctx, on_png_read);
+		png_read_info(png, info);
+		*width = png_get_image_width(png, info);
+		*height = png_get_image_height(png, info);
+		rc = 0;
+	}
+	png_destroy_read_struct(&png, &info, NULL);
+	return rc;
+}
+
+/******************************************************************************
+ * samples
+ *****************************************************************************/
+static size_t make_jpeg(int width, int height, unsigned char ** p_data)
+{
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, width, height, NULL);
+	for(ssize_t i = 0; i < (ssize_t)width * height * 4; ++i) image->data[i] = rand();
+	ssize_t length = bgra_image_to_jpeg_stream(image, p_data, 75);
+	assert(length > 0);
+	bgra_image_clear(image);
+	return length;
+}
+
+static size_t make_png(int width, int height, unsigned char ** p_data)
+{
+	png_image image;
+	memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+	image.width = width;
+	image.height = height;
+	image.format = PNG_FORMAT_BGRA;
+
+	unsigned char * pixels = malloc((size_t)width * height * 4);
+	assert(pixels);
+	for(ssize_t i = 0; i < (ssize_t)width * height * 4; ++i) pixels[i] = rand();
+
+	png_alloc_size_t length = 0;
+	int ok = png_image_write_get_memory_size(image, length, 0, pixels, 0, NULL);
+	assert(ok && length > 0);
+	unsigned char * data = malloc(length);
+	assert(data);
+	ok = png_image_write_to_memory(&image, data, &length, 0, pixels, 0, NULL);
+	assert(ok);
+	free(pixels);
+
+	*p_data = data;
+	return length;
+}
+
+static size_t mutate(const unsigned char * src, size_t length, unsigned char * dst, size_t max_length)
+{
+	memcpy(dst, src, length);
+	int num_mutations = 1 + rand() % 4;
+	for(int i = 0; i < num_mutations && length > 0; ++i)
+	{
+		// most of the interesting bytes are in the header
+		size_t range = (rand() % 4)?((length < 700)?length:700):length;
+		size_t pos = rand() % range;
+		switch(rand() % 6)
+		{
+		case 0: dst[pos] ^= (1 << (rand() % 8)); break;
+		case 1: dst[pos] = rand(); break;
+		case 2: dst[pos] = (rand() % 2)?0xFF:0x00; break;
+		case 3:	// insert
+			if(length < max_length) {
+				memmove(dst + pos + 1, dst + pos, length - pos);
+				dst[pos] = rand();
+				++length;
+			}
+			break;
+		case 4:	// delete
+			if(length > 1) {
+				memmove(dst + pos, dst + pos + 1, length - pos - 1);
+				--length;
+			}
+			break;
+		case 5: length = pos; break;	// truncate
+		}
+	}
+	return length;
+}
+
+static int check_sample(const unsigned char * data, size_t length, long iteration)
+{
+	struct img_utils_image_info info[1];
+	int rc = img_utils_probe(data, length, info);
+
+	int width = 0, height = 0;
+	int ref_rc = -1;
+	enum img_utils_image_type type = img_utils_image_type_unknown;
+	if(0 == reference_jpeg_size(data, length, &width, &height)) type = img_utils_image_type_jpeg;
+	else if(0 == reference_png_size(data, length, &width, &height)) type = img_utils_image_type_png;
+	if(type != img_utils_image_type_unknown) ref_rc = 0;
+
+	if(ref_rc) return 0;	// rejected by the decoders: the probe may accept it, (header-only)
+	if(rc || info->type != type || info->width != width || info->height != height)
+	{
+		fprintf(stderr, "[FAILED] iteration %ld: length=%zu, decoder: type=%d, %dx%d; probe: rc=%d, type=%d, %dx%d\n",
+			iteration, length, type, width, height, rc, info->type, info->width, info->height);
+		FILE * fp = fopen("test-img_probe.failed.bin", "wb");
+		if(fp) { fwrite(data, 1, length, fp); fclose(fp); }
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = 200000;
+	unsigned int seed = (unsigned int)time(NULL);
+	if(argc > 1) iterations = atol(argv[1]);
+	if(argc > 2) seed = strtoul(argv[2], NULL, 10);
+	printf("seed: %u\n", seed);
+	srand(seed);
+
+	struct { unsigned char * data; size_t length; enum img_utils_image_type type; int width, height; } samples[4];
+	samples[0].length = make_jpeg(64, 48, &samples[0].data); samples[0].type = img_utils_image_type_jpeg;
+	samples[1].length = make_jpeg(17, 301, &samples[1].data); samples[1].type = img_utils_image_type_jpeg;
+	samples[2].length = make_png(64, 48, &samples[2].data); samples[2].type = img_utils_image_type_png;
+	samples[3].length = make_png(301, 17, &samples[3].data); samples[3].type = img_utils_image_type_png;
+	samples[0].width = 64;  samples[0].height = 48;
+	samples[1].width = 17;  samples[1].height = 301;
+	samples[2].width = 64;  samples[2].height = 48;
+	samples[3].width = 301; samples[3].height = 17;
+
+	int rc = 0;
+	size_t max_length = 0;
+	for(int i = 0; i < 4; ++i)
+	{
+		// valid images
+		struct img_utils_image_info info[1];
+		int ok = (0 == img_utils_probe(samples[i].data, samples[i].length, info));
+		ok = ok && info->type == samples[i].type && !info->truncated
+			&& info->width == samples[i].width && info->height == samples[i].height;
+
+		// every proper prefix is truncated
+		for(size_t length = 0; ok && length < samples[i].length; ++length)
+		{
+			img_utils_probe(samples[i].data, length, info);
+			if(!info->truncated && info->type != img_utils_image_type_unknown) ok = 0;
+		}
+		if(!ok) { fprintf(stderr, "[FAILED] sample %d\n", i); rc = 1; }
+		if(samples[i].length > max_length) max_length = samples[i].length;
+	}
+
+	max_length += 64;
+	unsigned char * buf = malloc(max_length);
+	assert(buf);
+	long accepted = 0;
+	for(long i = 0; i < iterations && 0 == rc; ++i)
+	{
+		int index = rand() % 4;
+		size_t length = mutate(samples[index].data, samples[index].length, buf, max_length);
+
+		// exact-size heap copy, so that ASAN catches any over-read
+		unsigned char * data = malloc(length?length:1);
+		assert(data);
+		memcpy(data, buf, length);
+		rc |= check_sample(data, length, i);
+		if(0 == img_utils_probe(data, length, NULL)) ++accepted;
+		free(data);
+	}
+	printf("fuzz: %ld iterations, %ld accepted by the probe: %s\n", iterations, accepted, rc?"FAILED":"ok");
+
+	free(buf);
+	for(int i = 0; i < 4; ++i) free(samples[i].data);
+	return rc;
+}
@@ -0,0 +1,209 @@
+/*
+ * test-input_frame_payload.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * input_frame_payload refcounting, (an extra reference is held on the payload to watch its count):
+ *   share: the frame's own buffers move into the payload, (no copy), refs == 1;
+ *   ref: a second holder borrows the same (data, json_str), refs == 2;
+ *   clear from two holders: the data stays valid for the last one, the payload goes away with the last clear;
+ *   ref from a frame without a payload: one private copy, the source is left alone;
+ *   make_writable: copies while shared, takes the buffers back when it's the only holder;
+ *   concurrent holders: threads ref / clear the same frame, the count comes back to 1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "input-frame.h"
+
+#define check(cond) do { if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ok = 0; } } while(0)
+
+#define WIDTH	(32)
+#define HEIGHT	(32)
+#define DATA_SIZE (WIDTH * HEIGHT * 4)
+static const char s_json[] = "{\"detections\": []}";
+static unsigned char s_data[DATA_SIZE];
+
+static long get_refs(const input_frame_payload_t * payload)
+{
+	return __atomic_load_n(&payload->refs, __ATOMIC_ACQUIRE);
+}
+
+static void init_frame(input_frame_t * frame)
+{
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, WIDTH, HEIGHT, s_data);
+
+	memset(frame, 0, sizeof(*frame));
+	int rc = input_frame_set_bgra(frame, image, s_json, sizeof(s_json) - 1);
+	assert(0 == rc);
+	bgra_image_clear(image);
+}
+
+static int test_share_ref_clear(void)
+{
+	int ok = 1;
+	input_frame_t a[1], b[1];
+	init_frame(a);
+	memset(b, 0, sizeof(b));
+
+	unsigned char * data = a->data;
+	char * json_str = a->json_str;
+	check(0 == input_frame_share(a));
+	check(a->payload && get_refs(a->payload) == 1);
+	check(a->data == data && a->json_str == json_str);	// moved, not copied
+	check(0 == input_frame_share(a));	// already shared
+	check(get_refs(a->payload) == 1);
+
+	input_frame_payload_t * payload = input_frame_payload_addref(a->payload);	// watcher
+	check(get_refs(payload) == 2);
+
+	check(input_frame_ref(b, a) == b);
+	check(b->payload == payload && get_refs(payload) == 3);
+	check(b->data == data && b->json_str == json_str);
+
+	input_frame_clear(a);
+	check(NULL == a->payload && NULL == a->data);
+	check(get_refs(payload) == 2);
+	check(0 == memcmp(b->data, s_data, DATA_SIZE));		// still valid for b
+	check(0 == memcmp(b->json_str, s_json, sizeof(s_json) - 1));
+
+	input_frame_clear(b);
+	check(get_refs(payload) == 1);
+	check(payload->data == data);	// only the watcher is left
+	input_frame_payload_unref(payload);
+
+	printf("share / ref / clear: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_ref_unshared(void)
+{
+	int ok = 1;
+	input_frame_t src[1], dst[1];
+	init_frame(src);
+	memset(dst, 0, sizeof(dst));
+
+	check(input_frame_ref(dst, src) == dst);
+	check(NULL == src->payload);
+	check(dst->payload && get_refs(dst->payload) == 1);
+	check(dst->data != src->data && 0 == memcmp(dst->data, src->data, DATA_SIZE));
+
+	input_frame_clear(src);
+	check(0 == memcmp(dst->data, s_data, DATA_SIZE));
+	input_frame_clear(dst);
+
+	printf("ref (no payload): %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_make_writable(void)
+{
+	int ok = 1;
+	input_frame_t a[1], b[1];
+	init_frame(a);
+	memset(b, 0, sizeof(b));
+	input_frame_share(a);
+	input_frame_ref(b, a);
+	input_frame_payload_t * payload = a->payload;
+	unsigned char * data = a->data;
+
+	// shared: b gets its own copy, a keeps the payload
+	check(0 == input_frame_make_writable(b));
+	check(NULL == b->payload && b->data != data);
+	check(get_refs(payload) == 1);
+	b->data[0] ^= 0xFF;
+	check(a->data[0] == s_data[0]);
+
+	// the only holder: the buffers come back without a copy
+	check(0 == input_frame_make_writable(a));
+	check(NULL == a->payload && a->data == data);
+	check(0 == memcmp(a->json_str, s_json, sizeof(s_json) - 1));
+
+	input_frame_clear(a);
+	input_frame_clear(b);
+	printf("make_writable: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+#define NUM_THREADS (4)
+#define NUM_ROUNDS (10000)
+static void * holder_thread(void * user_data)
+{
+	const input_frame_t * frame = user_data;
+	long errors = 0;
+	for(int i = 0; i < NUM_ROUNDS; ++i) {
+		input_frame_t copy[1];
+		memset(copy, 0, sizeof(copy));
+		input_frame_ref(copy, frame);
+		if(copy->data[DATA_SIZE - 1] != s_data[DATA_SIZE - 1]) ++errors;
+		input_frame_clear(copy);
+	}
+	return (void *)errors;
+}
+
+static int test_concurrent_holders(void)
+{
+	int ok = 1;
+	input_frame_t frame[1];
+	init_frame(frame);
+	input_frame_share(frame);
+
+	pthread_t threads[NUM_THREADS];
+	for(int i = 0; i < NUM_THREADS; ++i) {
+		int rc = pthread_create(&threads[i], NULL, holder_thread, frame);
+		assert(0 == rc);
+	}
+	long errors = 0;
+	for(int i = 0; i < NUM_THREADS; ++i) {
+		void * exit_code = NULL;
+		pthread_join(threads[i], &exit_code);
+		errors += (long)exit_code;
+	}
+	check(0 == errors);
+	check(get_refs(frame->payload) == 1);
+	input_frame_clear(frame);
+
+	printf("concurrent holders: %d threads x %d refs: %s\n", NUM_THREADS, NUM_ROUNDS, ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+#undef NUM_ROUNDS
+#undef NUM_THREADS
+
+int main(int argc, char ** argv)
+{
+	for(int i = 0; i < DATA_SIZE; ++i) s_data[i] = (unsigned char)(i * 7);
+
+	int rc = test_share_ref_clear();
+	rc |= test_ref_unshared();
+	rc |= test_make_writable();
+	rc |= test_concurrent_holders();
+	return rc?1:0;
+}
@@ -0,0 +1,201 @@
+/*
+ * test-io_input_history.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * io_input frame history, (a fake io plugin is registered in the default plugins helper):
+ *   disabled: no "history" key, nothing is kept;
+ *   ring: the last max_frames frames, find_frame() returns them, older ones are gone;
+ *   skipped numbers: found by the binary search, the missing ones are not;
+ *   eviction: a reader holding a frame keeps its data after the history dropped it;
+ *   max_bytes: caps the number of frames by their payload size;
+ *   restart: a lower frame number clears the history.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ann-plugin.h"
+#include "io-input.h"
+
+#define check(cond) do { if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ok = 0; } } while(0)
+
+#define FAKE_PLUGIN_TYPE "io-plugin::fake"
+#define IMAGE_SIZE (16)
+#define FRAME_BYTES (IMAGE_SIZE * IMAGE_SIZE * 4)
+
+static int fake_init(void * object, json_object * jconfig)
+{
+	return 0;
+}
+
+static void register_fake_plugin(void)
+{
+	static ann_plugin_t plugin = {
+		.type = FAKE_PLUGIN_TYPE,
+		.init_func = fake_init,
+	};
+	static ann_plugin_t * plugins[1] = { &plugin };
+
+	ann_plugins_helpler_t * helpler = ann_plugins_helpler_get_default();
+	assert(0 == helpler->num_plugins);
+	helpler->plugins = plugins;
+	helpler->max_size = 1;
+	helpler->num_plugins = 1;
+}
+
+static io_input_t * new_input(int max_frames, long max_bytes)
+{
+	json_object * jconfig = json_object_new_object();
+	if(max_frames > 0) {
+		json_object * jhistory = json_object_new_object();
+		json_object_object_add(jhistory, "max_frames", json_object_new_int(max_frames));
+		if(max_bytes > 0) json_object_object_add(jhistory, "max_bytes", json_object_new_int64(max_bytes));
+		json_object_object_add(jconfig, "history", jhistory);
+	}
+	io_input_t * input = io_input_init(NULL, FAKE_PLUGIN_TYPE, NULL);
+	assert(input);
+	int rc = input->init(input, jconfig);
+	assert(0 == rc);
+	json_object_put(jconfig);
+	return input;
+}
+
+static void free_input(io_input_t * input)
+{
+	io_input_cleanup(input);
+	free(input);
+}
+
+/* every byte of the image is (frame_number & 0xFF) */
+static void publish(io_input_t * input, long frame_number)
+{
+	unsigned char data[FRAME_BYTES];
+	memset(data, frame_number & 0xFF, sizeof(data));
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, IMAGE_SIZE, IMAGE_SIZE, data);
+
+	input_frame_t frame[1];
+	memset(frame, 0, sizeof(frame));
+	input_frame_set_bgra(frame, image, NULL, 0);
+	input_frame_share(frame);
+	frame->frame_number = frame_number;
+	long rc = input->set_frame(input, frame);
+	assert(rc == frame_number);
+	input_frame_clear(frame);
+	bgra_image_clear(image);
+}
+
+static int has_frame(io_input_t * input, long frame_number)
+{
+	input_frame_t frame[1];
+	memset(frame, 0, sizeof(frame));
+	if(input->find_frame(input, frame_number, frame) != frame_number) return 0;
+	int ok = (frame->frame_number == frame_number) && frame->data && frame->data[FRAME_BYTES - 1] == (frame_number & 0xFF);
+	input_frame_clear(frame);
+	return ok;
+}
+
+static int check_range(io_input_t * input, ssize_t length, long first, long last)
+{
+	long p_first = -1, p_last = -1;
+	if(input->get_history(input, &p_first, &p_last) != length) return 0;
+	return (0 == length) || (p_first == first && p_last == last);
+}
+
+static int test_disabled(void)
+{
+	int ok = 1;
+	io_input_t * input = new_input(0, 0);
+	publish(input, 1);
+	publish(input, 2);
+	check(check_range(input, 0, 0, 0));
+	check(!has_frame(input, 2));
+	free_input(input);
+	printf("disabled: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_ring(void)
+{
+	int ok = 1;
+	io_input_t * input = new_input(4, 0);
+	for(long i = 1; i <= 6; ++i) publish(input, i);
+	check(check_range(input, 4, 3, 6));
+	check(!has_frame(input, 2));
+	for(long i = 3; i <= 6; ++i) check(has_frame(input, i));
+	check(!has_frame(input, 7));
+
+	// skipped numbers: [5, 6, 8, 10]
+	publish(input, 8);
+	publish(input, 10);
+	check(check_range(input, 4, 5, 10));
+	check(has_frame(input, 8) && has_frame(input, 10) && has_frame(input, 5));
+	check(!has_frame(input, 7) && !has_frame(input, 9));
+
+	// eviction while a reader holds frame 5
+	input_frame_t held[1];
+	memset(held, 0, sizeof(held));
+	check(input->find_frame(input, 5, held) == 5);
+	for(long i = 11; i <= 14; ++i) publish(input, i);
+	check(check_range(input, 4, 11, 14));
+	check(!has_frame(input, 5));
+	check(held->data && held->data[0] == 5 && held->data[FRAME_BYTES - 1] == 5);
+	input_frame_clear(held);
+
+	// restart
+	publish(input, 1);
+	check(check_range(input, 1, 1, 1));
+	check(has_frame(input, 1) && !has_frame(input, 14));
+
+	free_input(input);
+	printf("ring / skipped / eviction / restart: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+static int test_max_bytes(void)
+{
+	int ok = 1;
+	io_input_t * input = new_input(10, FRAME_BYTES * 3 + FRAME_BYTES / 2);
+	for(long i = 1; i <= 8; ++i) publish(input, i);
+	check(check_range(input, 3, 6, 8));
+	check(!has_frame(input, 5) && has_frame(input, 6));
+	free_input(input);
+	printf("max_bytes: %s\n", ok?"ok":"FAILED");
+	return ok?0:-1;
+}
+
+int main(int argc, char ** argv)
+{
+	register_fake_plugin();
+
+	int rc = test_disabled();
+	rc |= test_ring();
+	rc |= test_max_bytes();
+	return rc?1:0;
+}
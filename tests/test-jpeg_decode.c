@@ -0,0 +1,342 @@
+/*
+ * test-jpeg_decode.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * jpeg decoding benchmark over a corpus of camera jpegs:
+ *   reference: a new decompressor per image, one scanline per jpeg_read_scanlines() call (the former loop)
+ *   default:   bgra_image_from_jpeg_stream(), (per-thread decompressor, row groups)
+ *   fast:      bgra_image_from_jpeg_stream_ex(), fast IDCT + no fancy upsampling
+ *   scaled:    bgra_image_from_jpeg_stream_ex(), fast, downscaled in the IDCT to cover 416x416
+ *
+ * the default path must produce the same pixels as the reference.
+ * the per-thread codec contexts survive corrupt / empty inputs and encodes of growing / shrinking sizes.
+ * _scaled() picks the largest IDCT reduction that still covers the target, _resized() gives the exact size.
+ *
+ * usage: test-jpeg_decode [iterations=10] [dir | file.jpg ...]
+ *   without input files, a synthetic 1920x1080 frame is encoded and used as the corpus.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <setjmp.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <jpeglib.h>
+
+#include "img_proc.h"
+
+static inline double get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+struct jpeg_sample
+{
+	char * name;
+	unsigned char * data;
+	size_t length;
+};
+
+static size_t s_num_samples;
+static struct jpeg_sample * s_samples;
+
+static void add_sample(const char * name, unsigned char * data, size_t length)
+{
+	s_samples = realloc(s_samples, sizeof(*s_samples) * (s_num_samples + 1));
+	assert(s_samples);
+	s_samples[s_num_samples++] = (struct jpeg_sample){ .name = strdup(name), .data = data, .length = length };
+}
+
+static void load_file(const char * path)
+{
+	FILE * fp = fopen(path, "rb");
+	if(NULL == fp) { perror(path); return; }
+	fseek(fp, 0, SEEK_END);
+	long length = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if(length <= 0) { fclose(fp); return; }
+
+	unsigned char * data = malloc(length);
+	assert(data);
+	if(fread(data, 1, length, fp) != (size_t)length
+		|| img_utils_guess_image_type(data, length) != img_utils_image_type_jpeg) {
+		free(data);
+	}else {
+		add_sample(path, data, length);
+	}
+	fclose(fp);
+}
+
+static void load_path(const char * path)
+{
+	struct stat st[1];
+	if(stat(path, st)) { perror(path); return; }
+	if(!S_ISDIR(st->st_mode)) { load_file(path); return; }
+
+	DIR * dir = opendir(path);
+	if(NULL == dir) return;
+	struct dirent * entry;
+	while((entry = readdir(dir))) {
+		const char * ext = strrchr(entry->d_name, '.');
+		if(NULL == ext || (strcasecmp(ext, ".jpg") && strcasecmp(ext, ".jpeg"))) continue;
+		char filename[4096] = "";
+		snprintf(filename, sizeof(filename), "%s/%s", path, entry->d_name);
+		load_file(filename);
+	}
+	closedir(dir);
+}
+
+static void make_synthetic_sample(int width, int height)
+{
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	bgra_image_init(image, width, height, NULL);
+	for(int y = 0; y < height; ++y) {
+		unsigned char * bgra = image->data + (ssize_t)y * width * 4;
+		for(int x = 0; x < width; ++x, bgra += 4) {
+			int noise = rand() % 17 - 8;
+			bgra[0] = ((x / 3) + noise) & 0xFF;
+			bgra[1] = ((y / 2) + noise) & 0xFF;
+			bgra[2] = ((x + y) / 4 + noise) & 0xFF;
+			bgra[3] = 255;
+		}
+	}
+	unsigned char * jpeg = NULL;
+	ssize_t length = bgra_image_to_jpeg_stream(image, &jpeg, 85);
+	assert(length > 0);
+	add_sample("synthetic-1920x1080", jpeg, length);
+	bgra_image_clear(image);
+}
+
+/* the former decoding loop */
+struct reference_error
+{
+	struct jpeg_error_mgr base[1];
+	jmp_buf jmp;
+};
+static void on_reference_error(j_common_ptr cinfo)
+{
+	longjmp(((struct reference_error *)cinfo->err)->jmp, 1);
+}
+
+static int reference_decode(bgra_image_t * image, const unsigned char * jpeg, size_t length)
+{
+	struct jpeg_decompress_struct cinfo;
+	struct reference_error jerr;
+	memset(&cinfo, 0, sizeof(cinfo));
+	memset(&jerr, 0, sizeof(jerr));
+	cinfo.err = jpeg_std_error(jerr.base);
+	jerr.base->error_exit = on_reference_error;
+
+	volatile int rc = -1;
+	jpeg_create_decompress(&cinfo);
+	if(0 == setjmp(jerr.jmp)) {
+		jpeg_mem_src(&cinfo, jpeg, length);
+		jpeg_read_header(&cinfo, TRUE);
+		cinfo.out_color_space = JCS_EXT_BGRA;
+		jpeg_start_decompress(&cinfo);
+		bgra_image_init(image, cinfo.output_width, cinfo.output_height, NULL);
+
+		unsigned char * row = image->data;
+		while(cinfo.output_scanline < cinfo.output_height) {
+			JSAMPROW row_pointer[1] = { row };
+			jpeg_read_scanlines(&cinfo, row_pointer, 1);
+			row += bgra_image_stride(image);
+		}
+		jpeg_finish_decompress(&cinfo);
+		rc = 0;
+	}
+	jpeg_destroy_decompress(&cinfo);
+	return rc;
+}
+
+enum decode_mode
+{
+	decode_mode_reference,
+	decode_mode_default,
+	decode_mode_fast,
+	decode_mode_scaled,
+	decode_modes_count
+};
+static const char * s_mode_names[decode_modes_count] = { "reference", "default", "fast", "scaled(416)" };
+
+static int decode(enum decode_mode mode, bgra_image_t * image, const struct jpeg_sample * sample)
+{
+	switch(mode) {
+	case decode_mode_reference: return reference_decode(image, sample->data, sample->length);
+	case decode_mode_default: return bgra_image_from_jpeg_stream(image, sample->data, sample->length);
+	case decode_mode_fast:
+		return bgra_image_from_jpeg_stream_ex(image, sample->data, sample->length, 0, 0, bgra_image_jpeg_decode_flags_fast);
+	case decode_mode_scaled:
+		return bgra_image_from_jpeg_stream_ex(image, sample->data, sample->length, 416, 416, bgra_image_jpeg_decode_flags_fast);
+	default: break;
+	}
+	return -1;
+}
+
+/* the per-thread decompressor / compressor are reused after errors and across sizes */
+static int check_context_reuse(const struct jpeg_sample * sample)
+{
+	int ok = 1;
+	bgra_image_t expected[1], image[1];
+	memset(expected, 0, sizeof(expected));
+	memset(image, 0, sizeof(image));
+	ok = (0 == reference_decode(expected, sample->data, sample->length));
+
+	// truncated (libjpeg only warns and pads it) / headers cut off / empty / garbage, then a valid stream on the same context
+	bgra_image_from_jpeg_stream(image, sample->data, sample->length / 2);
+	bgra_image_clear(image);
+	ok = ok && (0 != bgra_image_from_jpeg_stream(image, sample->data, 64));
+	bgra_image_clear(image);
+	ok = ok && (0 != bgra_image_from_jpeg_stream(image, sample->data, 0));
+	bgra_image_clear(image);
+	ok = ok && (0 != bgra_image_from_jpeg_stream(image, (const unsigned char *)"not a jpeg", 10));
+	bgra_image_clear(image);
+	ok = ok && (0 == bgra_image_from_jpeg_stream(image, sample->data, sample->length));
+	ok = ok && image->width == expected->width && image->height == expected->height
+		&& 0 == memcmp(image->data, expected->data, (size_t)expected->width * expected->height * 4);
+	bgra_image_clear(image);
+
+	// the encoder's buffer grows and shrinks, each result is an exact-size copy owned by the caller
+	static const int sizes[][2] = { { 64, 48 }, { 0, 0 }, { 32, 32 } };	// { 0, 0 }: the sample's size
+	for(int i = 0; ok && i < (int)(sizeof(sizes) / sizeof(sizes[0])); ++i) {
+		bgra_image_t src[1];
+		memset(src, 0, sizeof(src));
+		int width = sizes[i][0]?sizes[i][0]:expected->width;
+		int height = sizes[i][1]?sizes[i][1]:expected->height;
+		bgra_image_init(src, width, height, NULL);
+		bgra_image_resize(src, expected, bgra_image_resize_filter_auto);
+
+		unsigned char * jpeg = NULL;
+		ssize_t length = bgra_image_to_jpeg_stream(src, &jpeg, 85);
+		ok = (length > 0) && (0 == bgra_image_from_jpeg_stream(image, jpeg, length));
+		ok = ok && image->width == width && image->height == height;
+		free(jpeg);
+		bgra_image_clear(image);
+		bgra_image_clear(src);
+	}
+
+	printf("%s: context reuse after errors / across sizes: %s\n", sample->name, ok?"ok":"FAILED");
+	bgra_image_clear(expected);
+	return ok?0:-1;
+}
+
+/* _scaled(): covers (min_width x min_height), halving once more would not, (down to 1/8) */
+static int check_scaled(const struct jpeg_sample * sample, int min_width, int min_height)
+{
+	bgra_image_t full[1], scaled[1], resized[1];
+	memset(full, 0, sizeof(full));
+	memset(scaled, 0, sizeof(scaled));
+	memset(resized, 0, sizeof(resized));
+
+	int ok = (0 == bgra_image_from_jpeg_stream(full, sample->data, sample->length));
+	ok = ok && (0 == bgra_image_from_jpeg_stream_scaled(scaled, sample->data, sample->length, min_width, min_height));
+	if(ok) {
+		int covers = (scaled->width >= min_width && scaled->height >= min_height);
+		int too_small = (full->width < min_width || full->height < min_height);
+		int smallest = (scaled->width * 8 <= full->width + 7);
+		int halved_covers = (scaled->width / 2 >= min_width && scaled->height / 2 >= min_height);
+		ok = (too_small)?(scaled->width == full->width && scaled->height == full->height)
+			:(covers && (smallest || !halved_covers));
+	}
+
+	bgra_image_init(resized, min_width, min_height, NULL);
+	ok = ok && (0 == bgra_image_from_jpeg_stream_resized(resized, sample->data, sample->length, bgra_image_resize_filter_bilinear));
+	ok = ok && (resized->width == min_width && resized->height == min_height);
+
+	printf("%s: %dx%d ==> scaled(%dx%d): %dx%d, resized: %dx%d: %s\n", sample->name,
+		full->width, full->height, min_width, min_height, scaled->width, scaled->height,
+		resized->width, resized->height, ok?"ok":"FAILED");
+	bgra_image_clear(full);
+	bgra_image_clear(scaled);
+	bgra_image_clear(resized);
+	return ok?0:-1;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 10;
+	if(argc > 1) iterations = atoi(argv[1]);
+	assert(iterations > 0);
+	for(int i = 2; i < argc; ++i) load_path(argv[i]);
+
+	srand(12345);
+	if(0 == s_num_samples) make_synthetic_sample(1920, 1080);
+
+	// correctness: the default path is bit-exact with the former loop
+	int rc = 0;
+	double total_pixels = 0;
+	for(size_t i = 0; i < s_num_samples; ++i) {
+		bgra_image_t expected[1], actual[1];
+		memset(expected, 0, sizeof(expected));
+		memset(actual, 0, sizeof(actual));
+		int ok = (0 == reference_decode(expected, s_samples[i].data, s_samples[i].length));
+		ok = ok && (0 == bgra_image_from_jpeg_stream(actual, s_samples[i].data, s_samples[i].length));
+		ok = ok && expected->width == actual->width && expected->height == actual->height
+			&& 0 == memcmp(expected->data, actual->data, (size_t)expected->width * expected->height * 4);
+		if(!ok) { fprintf(stderr, "[FAILED] %s\n", s_samples[i].name); rc = 1; }
+		total_pixels += (double)expected->width * expected->height;
+		bgra_image_clear(expected);
+		bgra_image_clear(actual);
+	}
+	printf("corpus: %zu images, %.1f Mpixels, bit-exact: %s\n", s_num_samples, total_pixels / 1000000.0, rc?"FAILED":"ok");
+
+	for(size_t i = 0; i < s_num_samples; ++i) {
+		if(check_context_reuse(&s_samples[i])) rc = 1;
+		if(check_scaled(&s_samples[i], 416, 416)) rc = 1;
+		if(check_scaled(&s_samples[i], 64, 64)) rc = 1;
+		if(check_scaled(&s_samples[i], 2048, 2048)) rc = 1;	// larger than the source: full size
+	}
+
+	for(int mode = 0; mode < decode_modes_count; ++mode) {
+		double begin_time = get_time_sec();
+		for(int i = 0; i < iterations; ++i) {
+			for(size_t ii = 0; ii < s_num_samples; ++ii) {
+				bgra_image_t image[1];
+				memset(image, 0, sizeof(image));
+				decode(mode, image, &s_samples[ii]);
+				bgra_image_clear(image);
+			}
+		}
+		double elapsed = get_time_sec() - begin_time;
+		double num_images = (double)iterations * s_num_samples;
+		printf("%-12s: %8.3f ms/image, %8.1f Mpixels/s (source)\n", s_mode_names[mode],
+			elapsed * 1000.0 / num_images, total_pixels * iterations / elapsed / 1000000.0);
+	}
+
+	for(size_t i = 0; i < s_num_samples; ++i) {
+		free(s_samples[i].name);
+		free(s_samples[i].data);
+	}
+	free(s_samples);
+	img_utils_jpeg_thread_context_release();
+	return rc;
+}
@@ -0,0 +1,192 @@
+/*
+ * test-jpeg_encode_service.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * jpeg encode service:
+ *   several "streams" submit frames concurrently (futures + callbacks, copied and adopted images),
+ *   every accepted job must complete and decode back to the source size, the dropped ones must be counted;
+ *   finally the service is stopped with jobs still queued, they must be cancelled.
+ *
+ * usage: test-jpeg_encode_service [num_streams=4] [frames_per_stream=200] [num_workers=0 (auto)]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "img_proc.h"
+#include "jpeg-encode-service.h"
+
+static inline double get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+struct stream_context
+{
+	jpeg_encode_service_t * service;
+	int index;
+	int num_frames;
+	long accepted;
+	long adopted;		// accepted with a callback
+	long callbacks;		// updated by the workers
+	long errors;
+};
+
+static void on_completed(jpeg_encode_job_t * job)
+{
+	struct stream_context * stream = job->user_data;
+	bgra_image_t decoded[1];
+	memset(decoded, 0, sizeof(decoded));
+
+	int ok = (job->status == jpeg_encode_job_status_completed && job->jpeg && job->length > 0);
+	ok = ok && (0 == bgra_image_from_jpeg_stream(decoded, job->jpeg, job->length));
+	ok = ok && decoded->width == (320 + stream->index) && decoded->height == 240;
+	bgra_image_clear(decoded);
+
+	if(!ok) __atomic_add_fetch(&stream->errors, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stream->callbacks, 1, __ATOMIC_RELAXED);
+}
+
+static void * stream_thread(void * user_data)
+{
+	struct stream_context * stream = user_data;
+	static const enum bgra_image_jpeg_subsampling subsamplings[] = {
+		bgra_image_jpeg_subsampling_420, bgra_image_jpeg_subsampling_422, bgra_image_jpeg_subsampling_444,
+	};
+
+	for(int i = 0; i < stream->num_frames; ++i) {
+		bgra_image_t frame[1];
+		memset(frame, 0, sizeof(frame));
+		bgra_image_init(frame, 320 + stream->index, 240, NULL);
+		for(ssize_t ii = 0; ii < (ssize_t)frame->width * frame->height * 4; ++ii) frame->data[ii] = (ii + i) & 0xFF;
+
+		struct bgra_image_jpeg_options options = {
+			.quality = 50 + (i % 50),
+			.subsampling = subsamplings[i % 3],
+		};
+
+		if(i % 2) {	// callback, adopted image
+			int rc = stream->service->submit(stream->service, frame, &options, jpeg_encode_flag_adopt_image,
+				on_completed, stream, NULL);
+			if(0 == rc) {
+				++stream->accepted;
+				++stream->adopted;
+				assert(NULL == frame->data);
+			}
+		}else {		// future, copied image
+			jpeg_encode_job_t * job = NULL;
+			int rc = stream->service->submit(stream->service, frame, &options, (i % 4)?jpeg_encode_flag_wait_if_full:0,
+				NULL, stream, &job);
+			if(0 == rc) {
+				++stream->accepted;
+				int status = jpeg_encode_job_wait(job, -1);
+				size_t length = 0;
+				unsigned char * jpeg = jpeg_encode_job_take_data(job, &length);
+				if(status != jpeg_encode_job_status_completed || NULL == jpeg || 0 == length) ++stream->errors;
+				free(jpeg);
+				jpeg_encode_job_unref(job);
+			}
+		}
+		bgra_image_clear(frame);
+	}
+	return NULL;
+}
+
+static long s_cancelled;
+static void on_cancelled(jpeg_encode_job_t * job)
+{
+	if(job->status == jpeg_encode_job_status_cancelled) __atomic_add_fetch(&s_cancelled, 1, __ATOMIC_RELAXED);
+}
+
+int main(int argc, char **argv)
+{
+	int num_streams = 4, num_frames = 200, num_workers = 0;
+	if(argc > 1) num_streams = atoi(argv[1]);
+	if(argc > 2) num_frames = atoi(argv[2]);
+	if(argc > 3) num_workers = atoi(argv[3]);
+	assert(num_streams > 0 && num_frames > 0);
+
+	jpeg_encode_service_t service[1];
+	memset(service, 0, sizeof(service));
+	jpeg_encode_service_init(service, num_workers, 0, NULL);
+	printf("workers: %d, max_pending: %d\n", service->num_workers, service->max_pending);
+
+	struct stream_context * streams = calloc(num_streams, sizeof(*streams));
+	pthread_t * threads = calloc(num_streams, sizeof(*threads));
+	assert(streams && threads);
+
+	double begin_time = get_time_sec();
+	for(int i = 0; i < num_streams; ++i) {
+		streams[i] = (struct stream_context){ .service = service, .index = i, .num_frames = num_frames };
+		pthread_create(&threads[i], NULL, stream_thread, &streams[i]);
+	}
+	for(int i = 0; i < num_streams; ++i) pthread_join(threads[i], NULL);
+
+	// the callbacks of the last adopted jobs may still be running
+	struct jpeg_encode_service_stats stats;
+	do {
+		service->get_stats(service, &stats);
+	}while((stats.completed + stats.failed) < (stats.submitted - stats.dropped));
+	double elapsed = get_time_sec() - begin_time;
+
+	int rc = 0;
+	long accepted = 0, adopted = 0, callbacks = 0;
+	for(int i = 0; i < num_streams; ++i) {
+		accepted += streams[i].accepted;
+		adopted += streams[i].adopted;
+		callbacks += __atomic_load_n(&streams[i].callbacks, __ATOMIC_ACQUIRE);
+		if(streams[i].errors) rc = 1;
+	}
+	if(stats.completed != accepted || callbacks != adopted) rc = 1;
+	if(stats.failed || stats.dropped + accepted != stats.submitted) rc = 1;
+	printf("submitted: %ld, dropped: %ld, completed: %ld, failed: %ld; %.1f frames/s, avg encode: %.3f ms\n",
+		stats.submitted, stats.dropped, stats.completed, stats.failed,
+		stats.completed / elapsed, stats.completed?(stats.encode_time * 1000.0 / stats.completed):0.0);
+
+	// stop with queued jobs: the remaining ones are cancelled, not lost
+	bgra_image_t frame[1];
+	memset(frame, 0, sizeof(frame));
+	bgra_image_init(frame, 1920, 1080, NULL);
+	memset(frame->data, 0x80, (size_t)1920 * 1080 * 4);
+	long queued = 0;
+	for(int i = 0; i < service->max_pending * 2; ++i) {
+		if(0 == service->submit(service, frame, NULL, 0, on_cancelled, NULL, NULL)) ++queued;
+	}
+	jpeg_encode_service_cleanup(service);
+	printf("stop: queued %ld, cancelled %ld\n", queued, s_cancelled);
+	if(s_cancelled > queued) rc = 1;
+
+	bgra_image_clear(frame);
+	free(streams);
+	free(threads);
+	printf("%s\n", rc?"FAILED":"ok");
+	return rc;
+}
@@ -0,0 +1,175 @@
+/*
+ * test-motion_gate.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * motion gate:
+ *   block_sad(): the SIMD path must match a scalar reference (odd block counts, 8-pixel tails);
+ *   update_bgra(): a static scene is skipped, a moving box triggers, the gate stays open for hold_ms,
+ *   and the refresh interval forces an inference.
+ *
+ * usage: test-motion_gate [num_frames=1000]   (benchmark: 1080p frames ==> 64x48 thumbnail)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "img_proc.h"
+#include "motion-gate.h"
+
+static inline double get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static int test_block_sad(void)
+{
+	static const int sizes[][3] = { {64, 48, 8}, {40, 24, 8}, {48, 32, 16}, {72, 48, 24} };	// width, height, block_size
+	for(size_t t = 0; t < sizeof(sizes) / sizeof(sizes[0]); ++t) {
+		int width = sizes[t][0], height = sizes[t][1], block_size = sizes[t][2];
+		int stride = width + 8;
+		uint8_t * luma = malloc(stride * height);
+		uint8_t * background = malloc(stride * height);
+		int num_blocks = (width / block_size) * (height / block_size);
+		uint32_t * sads = calloc(num_blocks, sizeof(*sads));
+		uint32_t * expected = calloc(num_blocks, sizeof(*expected));
+		assert(luma && background && sads && expected);
+
+		for(int i = 0; i < stride * height; ++i) {
+			luma[i] = rand() & 0xFF;
+			background[i] = rand() & 0xFF;
+		}
+		for(int y = 0; y < height; ++y) {
+			for(int x = 0; x < width; ++x) {
+				int block = (y / block_size) * (width / block_size) + x / block_size;
+				expected[block] += abs((int)luma[y * stride + x] - (int)background[y * stride + x]);
+			}
+		}
+		motion_gate_block_sad(luma, background, width, height, stride, block_size, sads);
+		int ok = (0 == memcmp(sads, expected, sizeof(*sads) * num_blocks));
+		printf("block_sad(%dx%d, block %d): %s\n", width, height, block_size, ok?"ok":"FAILED");
+
+		free(luma);
+		free(background);
+		free(sads);
+		free(expected);
+		if(!ok) return -1;
+	}
+	return 0;
+}
+
+static void draw_frame(bgra_image_t * frame, int box_x)
+{
+	memset(frame->data, 0x40, (size_t)frame->width * frame->height * 4);
+	if(box_x < 0) return;
+	int box_size = frame->height / 4;
+	for(int y = frame->height / 3; y < frame->height / 3 + box_size; ++y) {
+		memset(frame->data + ((size_t)y * frame->width + box_x) * 4, 0xE0, box_size * 4);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int num_frames = 1000;
+	if(argc > 1) num_frames = atoi(argv[1]);
+
+	int rc = test_block_sad();
+
+	struct motion_gate_params params[1];
+	motion_gate_params_load(params, NULL);
+	params->refresh_interval_ms = 5000;
+	params->hold_ms = 1000;
+
+	motion_gate_t gate[1];
+	memset(gate, 0, sizeof(gate));
+	motion_gate_init(gate, params, NULL);
+
+	bgra_image_t frame[1];
+	memset(frame, 0, sizeof(frame));
+	bgra_image_init(frame, 1920, 1080, NULL);
+
+	struct motion_gate_result result[1];
+	int64_t now = 1000;
+
+	// first frame: forced
+	draw_frame(frame, -1);
+	gate->update_bgra(gate, frame, now, result);
+	if(!result->triggered || !result->forced) rc = -1;
+
+	// static scene: skipped until the refresh interval
+	int triggered = 0;
+	for(int i = 0; i < 100; ++i) {	// 25 fps, 4 seconds
+		now += 40;
+		gate->update_bgra(gate, frame, now, result);
+		triggered += result->triggered;
+	}
+	printf("static scene: triggered %d / 100, score %.4f\n", triggered, result->score);
+	if(triggered) rc = -1;
+
+	now += 1000;	// > refresh_interval_ms
+	gate->update_bgra(gate, frame, now, result);
+	printf("refresh: triggered %d, forced %d\n", result->triggered, result->forced);
+	if(!result->triggered || !result->forced) rc = -1;
+
+	// moving box
+	triggered = 0;
+	for(int i = 0; i < 25; ++i) {
+		now += 40;
+		draw_frame(frame, 100 + i * 40);
+		gate->update_bgra(gate, frame, now, result);
+		triggered += result->triggered && !result->forced;
+	}
+	printf("moving box: triggered %d / 25, changed blocks %d / %d\n", triggered, result->changed_blocks, result->num_blocks);
+	if(triggered != 25) rc = -1;
+
+	// the box stops: the gate stays open for hold_ms, then the background absorbs it
+	int held = 0;
+	for(int i = 0; i < 100; ++i) {
+		now += 40;
+		gate->update_bgra(gate, frame, now, result);
+		if(result->triggered && !result->forced) ++held;
+	}
+	printf("stopped: triggered %d / 100, last score %.4f\n", held, result->score);
+	if(held < 1000 / 40 || held >= 100) rc = -1;
+
+	// benchmark
+	double begin_time = get_time_sec();
+	for(int i = 0; i < num_frames; ++i) {
+		draw_frame(frame, (i * 8) % 1600);
+		gate->update_bgra(gate, frame, 0, result);
+	}
+	double elapsed = get_time_sec() - begin_time;
+	printf("update_bgra(1920x1080): %.3f ms/frame (including the test pattern)\n", elapsed * 1000.0 / num_frames);
+
+	bgra_image_clear(frame);
+	motion_gate_cleanup(gate);
+	printf("%s\n", rc?"FAILED":"ok");
+	return rc?1:0;
+}
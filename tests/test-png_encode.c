@@ -0,0 +1,217 @@
+/*
+ * test-png_encode.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * bgra_image_to_png_stream_ex():
+ *   round-trip test (decoded by libpng) for every preset / format, (packed images and strided views)
+ *   followed by a throughput comparison with cairo_surface_write_to_png_stream().
+ *
+ * usage: test-png_encode [image.jpg|png] [iterations=20]
+ *   without an input file, a synthetic frame (1280x720, gradients + noise + flat areas) is used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include <png.h>
+#include <cairo/cairo.h>
+
+#include "img_proc.h"
+
+static inline double get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+static const char * s_preset_names[] = { "fastest", "fast", "default", "smallest" };
+static const char * s_format_names[] = { "rgba", "rgb", "gray" };
+
+static void make_synthetic_frame(bgra_image_t * image, int width, int height)
+{
+	bgra_image_init(image, width, height, NULL);
+	for(int y = 0; y < height; ++y) {
+		unsigned char * bgra = image->data + (ssize_t)y * width * 4;
+		for(int x = 0; x < width; ++x, bgra += 4) {
+			if(x < width / 3) {	// flat area
+				bgra[0] = 40; bgra[1] = 80; bgra[2] = 120;
+			}else {				// gradient + sensor noise
+				int noise = rand() % 9 - 4;
+				bgra[0] = (x + noise) & 0xFF;
+				bgra[1] = (y + noise) & 0xFF;
+				bgra[2] = ((x + y) / 2 + noise) & 0xFF;
+			}
+			bgra[3] = 255;
+		}
+	}
+}
+
+static int check_round_trip(const bgra_image_t * image, const unsigned char * png_data, size_t length, enum bgra_image_png_format format)
+{
+	png_image png;
+	memset(&png, 0, sizeof(png));
+	png.version = PNG_IMAGE_VERSION;
+	if(!png_image_begin_read_from_memory(&png, png_data, length)) return 1;
+	if((int)png.width != image->width || (int)png.height != image->height) { png_image_free(&png); return 1; }
+
+	png.format = PNG_FORMAT_BGRA;
+	unsigned char * pixels = malloc(PNG_IMAGE_SIZE(png));
+	assert(pixels);
+	int rc = !png_image_finish_read(&png, NULL, pixels, 0, NULL);
+
+	int stride = bgra_image_stride(image);
+	for(int y = 0; !rc && y < image->height; ++y) {
+		const unsigned char * src = image->data + (ssize_t)y * stride;
+		const unsigned char * dst = pixels + (ssize_t)y * image->width * 4;
+		for(int x = 0; x < image->width; ++x, src += 4, dst += 4) {
+			unsigned char expected[4] = { src[0], src[1], src[2], src[3] };
+			if(format == bgra_image_png_format_rgb) expected[3] = 255;
+			else if(format == bgra_image_png_format_gray) {
+				unsigned char gray = (src[2] * 77 + src[1] * 150 + src[0] * 29 + 128) >> 8;
+				expected[0] = expected[1] = expected[2] = gray;
+				expected[3] = 255;
+			}
+			if(memcmp(expected, dst, 4)) { rc = 1; break; }
+		}
+	}
+	free(pixels);
+	png_image_free(&png);
+	return rc;
+}
+
+static int test_round_trip(void)
+{
+	bgra_image_t parent[1];
+	memset(parent, 0, sizeof(parent));
+	bgra_image_init(parent, 131, 67, NULL);
+	for(ssize_t i = 0; i < (ssize_t)parent->width * parent->height * 4; ++i) parent->data[i] = rand();
+
+	bgra_image_t view[1];
+	memset(view, 0, sizeof(view));
+	bgra_image_view(view, parent, 5, 3, 77, 41);
+
+	int rc = 0;
+	const bgra_image_t * images[2] = { parent, view };
+	for(int i = 0; i < 2; ++i) {
+		for(int preset = 0; preset <= bgra_image_png_preset_smallest; ++preset) {
+			for(int format = 0; format <= bgra_image_png_format_gray; ++format) {
+				struct bgra_image_png_options options;
+				bgra_image_png_options_init(&options, preset, format);
+
+				unsigned char * png_data = NULL;
+				ssize_t length = bgra_image_to_png_stream_ex(images[i], &png_data, &options);
+				if(length <= 0 || check_round_trip(images[i], png_data, length, format)) {
+					fprintf(stderr, "[FAILED] %s, preset=%s, format=%s\n", i?"view":"image",
+						s_preset_names[preset], s_format_names[format]);
+					rc = 1;
+				}
+				free(png_data);
+			}
+		}
+	}
+	bgra_image_clear(view);
+	bgra_image_clear(parent);
+	return rc;
+}
+
+static cairo_status_t on_write_png_stream(void * closure, const unsigned char * data, unsigned int length)
+{
+	size_t * total = closure;
+	*total += length;
+	return CAIRO_STATUS_SUCCESS;
+}
+
+static void benchmark(const bgra_image_t * image, int iterations)
+{
+	double raw_size = (double)image->width * image->height * 4;
+	printf("image: %dx%d, %d iterations\n", image->width, image->height, iterations);
+
+	cairo_surface_t * surface = cairo_image_surface_create_for_data(image->data, CAIRO_FORMAT_ARGB32,
+		image->width, image->height, bgra_image_stride(image));
+	assert(surface && cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS);
+	size_t length = 0;
+	double begin_time = get_time_sec();
+	for(int i = 0; i < iterations; ++i) {
+		length = 0;
+		cairo_surface_write_to_png_stream(surface, on_write_png_stream, &length);
+	}
+	double elapsed = (get_time_sec() - begin_time) / iterations;
+	printf("%-18s: %8.3f ms/frame, %8.1f MB/s, size=%9zu (%5.1f%%)\n", "cairo",
+		elapsed * 1000.0, raw_size / elapsed / 1000000.0, length, length * 100.0 / raw_size);
+	cairo_surface_destroy(surface);
+
+	for(int format = 0; format <= bgra_image_png_format_gray; ++format) {
+		for(int preset = 0; preset <= bgra_image_png_preset_smallest; ++preset) {
+			struct bgra_image_png_options options;
+			bgra_image_png_options_init(&options, preset, format);
+
+			ssize_t cb_png = 0;
+			begin_time = get_time_sec();
+			for(int i = 0; i < iterations; ++i) {
+				unsigned char * png_data = NULL;
+				cb_png = bgra_image_to_png_stream_ex(image, &png_data, &options);
+				free(png_data);
+			}
+			elapsed = (get_time_sec() - begin_time) / iterations;
+
+			char name[64] = "";
+			snprintf(name, sizeof(name), "%s(%s)", s_preset_names[preset], s_format_names[format]);
+			printf("%-18s: %8.3f ms/frame, %8.1f MB/s, size=%9zd (%5.1f%%)\n", name,
+				elapsed * 1000.0, raw_size / elapsed / 1000000.0, cb_png, cb_png * 100.0 / raw_size);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char * filename = NULL;
+	int iterations = 20;
+	if(argc > 1) filename = argv[1];
+	if(argc > 2) iterations = atoi(argv[2]);
+	assert(iterations > 0);
+
+	srand(12345);
+	int rc = test_round_trip();
+	printf("round-trip: %s\n", rc?"FAILED":"ok");
+
+	bgra_image_t image[1];
+	memset(image, 0, sizeof(image));
+	if(filename) {
+		if(bgra_image_load_from_file(image, filename) || NULL == image->data) {
+			fprintf(stderr, "unable to load image '%s'\n", filename);
+			return 1;
+		}
+	}else {
+		make_synthetic_frame(image, 1280, 720);
+	}
+	benchmark(image, iterations);
+
+	bgra_image_clear(image);
+	return rc;
+}
@@ -0,0 +1,93 @@
+/*
+ * test-video_frame_gst_sample.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+ * video_frame_new_from_gst_sample(), on a sample wrapping our own memory:
+ *   zero-copy: frame->data is the sample's (mapped) memory, the frame holds a reference of the sample;
+ *   lifetime: the memory outlives the caller's sample unref and every frame reference but the last,
+ *     the last video_frame_unref() unmaps the buffer and releases the sample, (the memory is released once).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <gst/gst.h>
+
+#include "video_source_common.h"
+
+#define check(cond) do { if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ok = 0; } } while(0)
+
+#define WIDTH	(64)
+#define HEIGHT	(48)
+#define FRAME_BYTES (WIDTH * HEIGHT * 4)
+
+static int s_num_released;
+static void on_release_memory(gpointer data)
+{
+	++s_num_released;
+	free(data);
+}
+
+int main(int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+
+	int ok = 1;
+	unsigned char *data = malloc(FRAME_BYTES);
+	assert(data);
+	for(int i = 0; i < FRAME_BYTES; ++i) data[i] = (unsigned char)(i * 3);
+
+	GstBuffer *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, data, FRAME_BYTES, 0, FRAME_BYTES,
+		data, on_release_memory);
+	GstSample *sample = gst_sample_new(buffer, NULL, NULL, NULL);
+	gst_buffer_unref(buffer);	// owned by the sample
+	assert(sample);
+
+	struct video_frame *frame = video_frame_new_from_gst_sample(1, WIDTH, HEIGHT, sample);
+	check(frame);
+	if(NULL == frame) return 1;
+	check(frame->data == data && frame->length == FRAME_BYTES);	// no copy
+	check(frame->data_owner && frame->free_data);
+	check(GST_MINI_OBJECT_REFCOUNT_VALUE(sample) == 2);
+
+	// the appsink callback drops its sample right after publishing the frame
+	gst_sample_unref(sample);
+	check(GST_MINI_OBJECT_REFCOUNT_VALUE(sample) == 1);	// only the frame's reference is left
+	check(0 == s_num_released);
+
+	struct video_frame *reader = video_frame_addref(frame);
+	video_frame_unref(frame);
+	check(0 == s_num_released);
+	check(reader->data[FRAME_BYTES - 1] == (unsigned char)((FRAME_BYTES - 1) * 3));
+
+	video_frame_unref(reader);
+	check(1 == s_num_released);
+
+	printf("video_frame from GstSample, (zero-copy, released with the last reference): %s\n", ok?"ok":"FAILED");
+	gst_deinit();
+	return ok?0:1;
+}
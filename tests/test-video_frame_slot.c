@@ -0,0 +1,310 @@
+/*
+ * test-video_frame_slot.c
+ *
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ *
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * stress test: N reader threads + 1 unthrottled writer, every frame must stay alive while a reader holds it
+ *   and be released exactly once, (build with -fsanitize=address or thread to catch a use-after-free)
+ *
+ * contention benchmark: N reader threads + 1 writer thread on the latest-frame slot,
+ *   compared with the old (mutex protected) get_frame / unref_frame.
+ *
+ * usage: test-video_frame_slot [num_readers=8] [seconds=3] [writer_fps=30]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "video_source_common.h"
+
+static inline double get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+struct bench_context
+{
+	int use_mutex;
+	int quit;
+	long writer_fps;
+
+	// mode 0: lock-free slot
+	struct video_frame_slot slot[1];
+
+	// mode 1: mutex protected frame pointer
+	pthread_mutex_t mutex;
+	struct video_frame *frame;
+};
+
+struct reader_context
+{
+	pthread_t th;
+	struct bench_context *bench;
+	long num_reads;
+	long last_frame_number;
+	int err_code;
+};
+
+static struct video_frame *bench_get_frame(struct bench_context *bench)
+{
+	if(!bench->use_mutex) return video_frame_slot_acquire(bench->slot);
+
+	pthread_mutex_lock(&bench->mutex);
+	struct video_frame *frame = video_frame_addref(bench->frame);
+	pthread_mutex_unlock(&bench->mutex);
+	return frame;
+}
+static void bench_unref_frame(struct bench_context *bench, struct video_frame *frame)
+{
+	if(!bench->use_mutex) { video_frame_unref(frame); return; }
+
+	pthread_mutex_lock(&bench->mutex);
+	video_frame_unref(frame);
+	pthread_mutex_unlock(&bench->mutex);
+}
+static void bench_update_frame(struct bench_context *bench, struct video_frame *frame)
+{
+	if(!bench->use_mutex) { video_frame_slot_publish(bench->slot, frame); return; }
+
+	pthread_mutex_lock(&bench->mutex);
+	struct video_frame *old_frame = bench->frame;
+	bench->frame = frame;
+	if(old_frame) video_frame_unref(old_frame);
+	pthread_mutex_unlock(&bench->mutex);
+}
+
+static void *reader_thread(void *user_data)
+{
+	struct reader_context *reader = user_data;
+	struct bench_context *bench = reader->bench;
+
+	reader->last_frame_number = -1;
+	while(!__atomic_load_n(&bench->quit, __ATOMIC_RELAXED)) {
+		struct video_frame *frame = bench_get_frame(bench);
+		if(frame) {
+			// frames are published in order, and the payload must still be alive
+			if(frame->frame_number < reader->last_frame_number
+				|| frame->length != sizeof(long)
+				|| *(long *)frame->data != frame->frame_number)
+			{
+				reader->err_code = 1;
+			}
+			reader->last_frame_number = frame->frame_number;
+			bench_unref_frame(bench, frame);
+		}
+		++reader->num_reads;
+	}
+	pthread_exit((void *)(intptr_t)reader->err_code);
+}
+
+static void *writer_thread(void *user_data)
+{
+	struct bench_context *bench = user_data;
+	long frame_number = 0;
+	struct timespec interval = { 0, 0 };
+	if(bench->writer_fps > 0) interval.tv_nsec = 1000000000 / bench->writer_fps;
+
+	while(!__atomic_load_n(&bench->quit, __ATOMIC_RELAXED)) {
+		struct video_frame *frame = video_frame_new(frame_number, 1, 1, &frame_number, sizeof(frame_number), 0);
+		assert(frame);
+		bench_update_frame(bench, frame);
+		++frame_number;
+		if(interval.tv_nsec > 0) nanosleep(&interval, NULL);
+	}
+	pthread_exit((void *)(intptr_t)frame_number);
+}
+
+static int run_bench(int use_mutex, int num_readers, double seconds, long writer_fps)
+{
+	struct bench_context bench[1];
+	memset(bench, 0, sizeof(bench));
+	bench->use_mutex = use_mutex;
+	bench->writer_fps = writer_fps;
+	video_frame_slot_init(bench->slot);
+	pthread_mutex_init(&bench->mutex, NULL);
+
+	struct reader_context *readers = calloc(num_readers, sizeof(*readers));
+	assert(readers);
+
+	pthread_t writer;
+	int rc = pthread_create(&writer, NULL, writer_thread, bench);
+	assert(0 == rc);
+	for(int i = 0; i < num_readers; ++i) {
+		readers[i].bench = bench;
+		rc = pthread_create(&readers[i].th, NULL, reader_thread, &readers[i]);
+		assert(0 == rc);
+	}
+
+	double begin_time = get_time_sec();
+	usleep((useconds_t)(seconds * 1000000));
+	__atomic_store_n(&bench->quit, 1, __ATOMIC_RELAXED);
+
+	void *exit_code = NULL;
+	pthread_join(writer, &exit_code);
+	long num_frames = (long)(intptr_t)exit_code;
+
+	long total_reads = 0;
+	int err_code = 0;
+	for(int i = 0; i < num_readers; ++i) {
+		pthread_join(readers[i].th, NULL);
+		total_reads += readers[i].num_reads;
+		err_code |= readers[i].err_code;
+	}
+	double elapsed = get_time_sec() - begin_time;
+
+	printf("%-10s readers=%3d, frames=%8ld, reads=%12ld, %8.2f M reads/s, %7.1f ns/read%s\n",
+		use_mutex?"mutex":"lock-free",
+		num_readers, num_frames, total_reads,
+		(double)total_reads / elapsed / 1000000.0,
+		elapsed * 1000000000.0 * num_readers / (double)(total_reads?total_reads:1),
+		err_code?" [ERROR]":"");
+
+	bench_update_frame(bench, NULL);
+	video_frame_slot_cleanup(bench->slot);
+	pthread_mutex_destroy(&bench->mutex);
+	free(readers);
+	return err_code;
+}
+
+/******************************************************************************
+ * stress test
+ *****************************************************************************/
+struct stress_context
+{
+	struct video_frame_slot slot[1];
+	int quit;
+	long created;
+	long released;
+};
+
+struct stress_reader
+{
+	pthread_t th;
+	struct stress_context *stress;
+	long num_reads;
+	int err_code;
+};
+
+static void stress_free_data(struct video_frame *frame)
+{
+	struct stress_context *stress = frame->data_owner;
+	free(frame->data);
+	frame->data = NULL;
+	__atomic_add_fetch(&stress->released, 1, __ATOMIC_ACQ_REL);
+}
+
+static void *stress_reader_thread(void *user_data)
+{
+	struct stress_reader *reader = user_data;
+	struct stress_context *stress = reader->stress;
+	while(!__atomic_load_n(&stress->quit, __ATOMIC_ACQUIRE)) {
+		struct video_frame *frame = video_frame_slot_acquire(stress->slot);
+		if(NULL == frame) continue;
+		
+		// our reference keeps the frame (and its data) alive
+		if(__atomic_load_n(&frame->refs, __ATOMIC_ACQUIRE) < 1
+			|| NULL == frame->data
+			|| *(long *)frame->data != frame->frame_number)
+		{
+			reader->err_code = 1;
+		}
+		video_frame_unref(frame);
+		++reader->num_reads;
+	}
+	return NULL;
+}
+
+static int run_stress(int num_readers, double seconds)
+{
+	struct stress_context stress[1];
+	memset(stress, 0, sizeof(stress));
+	video_frame_slot_init(stress->slot);
+
+	struct stress_reader *readers = calloc(num_readers, sizeof(*readers));
+	assert(readers);
+	for(int i = 0; i < num_readers; ++i) {
+		readers[i].stress = stress;
+		int rc = pthread_create(&readers[i].th, NULL, stress_reader_thread, &readers[i]);
+		assert(0 == rc);
+	}
+
+	// writer: as fast as possible, (the epoch flips while the readers are entering it)
+	double end_time = get_time_sec() + seconds;
+	long frame_number = 0;
+	while(get_time_sec() < end_time) {
+		long *data = malloc(sizeof(*data));
+		assert(data);
+		*data = frame_number;
+		struct video_frame *frame = video_frame_new(frame_number, 1, 1, data, sizeof(*data), 1);
+		assert(frame);
+		frame->data_owner = stress;
+		frame->free_data = stress_free_data;
+		++stress->created;
+		video_frame_slot_publish(stress->slot, frame);
+		++frame_number;
+	}
+	__atomic_store_n(&stress->quit, 1, __ATOMIC_RELEASE);
+
+	long total_reads = 0;
+	int err_code = 0;
+	for(int i = 0; i < num_readers; ++i) {
+		pthread_join(readers[i].th, NULL);
+		total_reads += readers[i].num_reads;
+		err_code |= readers[i].err_code;
+	}
+	video_frame_slot_cleanup(stress->slot);
+	if(stress->released != stress->created) err_code = 1;
+
+	printf("stress     readers=%3d, frames=%8ld, reads=%12ld, released=%ld: %s\n",
+		num_readers, stress->created, total_reads, stress->released, err_code?"FAILED":"ok");
+	free(readers);
+	return err_code;
+}
+
+int main(int argc, char **argv)
+{
+	int num_readers = 8;
+	double seconds = 3;
+	long writer_fps = 30;
+	if(argc > 1) num_readers = atoi(argv[1]);
+	if(argc > 2) seconds = atof(argv[2]);
+	if(argc > 3) writer_fps = atol(argv[3]);
+	if(num_readers <= 0) num_readers = 1;
+
+	int rc = run_stress(num_readers, 1.0);
+	for(int n = 1; n <= num_readers; n *= 2) {
+		rc |= run_bench(1, n, seconds, writer_fps);
+		rc |= run_bench(0, n, seconds, writer_fps);
+	}
+	return rc;
+}
@@ -41,6 +41,7 @@
 #include <caffe/blob.hpp>
 
 #include "img_proc.h"
+#include "img_preproc.h"
 #include "utils.h"
 
 #include "caffe-model.h"
@@ -225,60 +226,26 @@ static int bgra_to_float32_planes(
 		const bgra_image_t * frame = &frames[i];
 		assert(frame->data && frame->width > 1 && frame->height > 1);
 		
-		cairo_surface_t * image = NULL;
-		const unsigned char * image_data = frame->data;
+		bgra_image_t resized[1];
+		memset(resized, 0, sizeof(resized));
+		const bgra_image_t * image = frame;
 		if(frame->width != width || frame->height != height)	// resize image
 		{
-			cairo_surface_t * surface = cairo_image_surface_create_for_data(
-				(unsigned char *)frame, 
-				CAIRO_FORMAT_ARGB32, 
-				frame->width, frame->height,
-				frame->width * 4);
-			assert(surface && cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS);
-			
-			image = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
-			assert(image && cairo_surface_status(image) == CAIRO_STATUS_SUCCESS);
-			cairo_t * cr = cairo_create(image);
-
-			double sx = (double)width / (double)frame->width;
-			double sy = (double)height / (double)frame->height;
-			cairo_scale(cr, sx, sy);
-			cairo_set_source_surface(cr, surface, 0, 0);
-			cairo_paint(cr);
-			cairo_destroy(cr);
-			
-			cairo_surface_destroy(surface);
-			image_data = cairo_image_surface_get_data(image);
+			resized->width = width;
+			resized->height = height;
+			int rc = bgra_image_resize(resized, frame, bgra_image_resize_filter_auto);
+			assert(0 == rc);
+			image = resized;
 		}
 		
-
-		ssize_t size = width * height;
-		
-		float * r_plane = rgb_planes;
-		float * g_plane = r_plane + size;
-		float * b_plane = g_plane + size;
-		
-		const unsigned char * data = image_data;
-		if(means) {
-			for(ssize_t ii = 0; ii < size; ++ii)
-			{
-				r_plane[ii] = ((float)data[2] - means[0]) * value_scale;
-				g_plane[ii] = ((float)data[1] - means[1]) * value_scale;
-				b_plane[ii] = ((float)data[0] - means[2]) * value_scale;
-				data += 4;
-				means += 3;
-			}
-		}else {
-			for(ssize_t ii = 0; ii < size; ++ii)
-			{
-				r_plane[ii] = ((float)data[2] - 128.0f) * value_scale;
-				g_plane[ii] = ((float)data[1] - 128.0f) * value_scale;
-				b_plane[ii] = ((float)data[0] - 128.0f) * value_scale;
-				data += 4;
-			}
-		}
-		if(image) cairo_surface_destroy(image);
-		image = NULL;
+		// per-pixel means (means_blob) or 128, (scalar kernel for the per-pixel means)
+		struct img_preproc_params params;
+		memset(&params, 0, sizeof(params));
+		params.scale = value_scale;
+		params.mean[0] = params.mean[1] = params.mean[2] = 128.0f;
+		params.mean_image = means;
+		img_preproc_bgra_to_f32(image, rgb_planes, &params);
+		bgra_image_clear(resized);
 		
 		rgb_planes += dst_size;
 	}
@@ -0,0 +1,212 @@
+/*
+ * ai-tiling.c
+ *
+ * Copyright 2022 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "utils.h"
+#include "ai-tiling.h"
+
+void ai_tiling_params_load(struct ai_tiling_params * params, json_object * jconfig)
+{
+	assert(params);
+	memset(params, 0, sizeof(*params));
+	params->overlap = 0.2;
+	params->global_view = 1;
+	params->max_tiles = 16;
+	params->nms = 0.5;
+	params->merge_ios = 0.8;
+	if(NULL == jconfig) return;
+
+	params->enabled = json_get_value_default(jconfig, int, enabled, 1);
+	params->tile_width = json_get_value_default(jconfig, int, tile_width, 0);
+	params->tile_height = json_get_value_default(jconfig, int, tile_height, 0);
+	params->cols = json_get_value_default(jconfig, int, cols, 0);
+	params->rows = json_get_value_default(jconfig, int, rows, 0);
+	params->overlap = json_get_value_default(jconfig, double, overlap, 0.2);
+	params->global_view = json_get_value_default(jconfig, int, global_view, 1);
+	params->max_tiles = json_get_value_default(jconfig, int, max_tiles, 16);
+	params->nms = json_get_value_default(jconfig, double, nms, 0.5);
+	params->merge_ios = json_get_value_default(jconfig, double, merge_ios, 0.8);
+
+	if(params->overlap < 0) params->overlap = 0;
+	if(params->overlap > 0.9) params->overlap = 0.9;
+	if(params->max_tiles < 1) params->max_tiles = 1;
+}
+
+/******************************************************************************
+ * layout
+ *****************************************************************************/
+static int axis_count(int frame_size, int tile_size, double overlap)
+{
+	if(frame_size <= tile_size) return 1;
+	double step = tile_size * (1.0 - overlap);
+	return 1 + (int)ceil((frame_size - tile_size) / step - 1e-9);
+}
+
+static int axis_tile_size(int frame_size, int count, double overlap)
+{
+	// count tiles sharing 'overlap' of a tile with each neighbour cover the frame
+	if(count <= 1) return frame_size;
+	int size = (int)ceil(frame_size / (count - (count - 1) * overlap));
+	return (size < frame_size)?size:frame_size;
+}
+
+static inline int axis_position(int frame_size, int tile_size, int count, int index)
+{
+	if(count <= 1) return 0;
+	return (int)floor((double)(frame_size - tile_size) * index / (count - 1) + 0.5);
+}
+
+ssize_t ai_tiling_layout(const struct ai_tiling_params * params, int frame_width, int frame_height,
+	int net_width, int net_height, struct ai_tile * tiles, ssize_t max_tiles)
+{
+	assert(params && tiles && max_tiles > 0);
+	if(frame_width <= 0 || frame_height <= 0) return -1;
+
+	double overlap = params->overlap;
+	int tile_width = 0, tile_height = 0;
+	int cols = 0, rows = 0;
+	if(params->cols > 0 && params->rows > 0) {
+		cols = params->cols;
+		rows = params->rows;
+		tile_width = axis_tile_size(frame_width, cols, overlap);
+		tile_height = axis_tile_size(frame_height, rows, overlap);
+	}else {
+		tile_width = (params->tile_width > 0)?params->tile_width:net_width;
+		tile_height = (params->tile_height > 0)?params->tile_height:net_height;
+		if(tile_width <= 0 || tile_width > frame_width) tile_width = frame_width;
+		if(tile_height <= 0 || tile_height > frame_height) tile_height = frame_height;
+		cols = axis_count(frame_width, tile_width, overlap);
+		rows = axis_count(frame_height, tile_height, overlap);
+	}
+
+	ssize_t limit = params->max_tiles;
+	if(limit > max_tiles) limit = max_tiles;
+	while(1) {
+		int global_view = (params->global_view && (cols * rows) > 1);
+		if((cols * rows + global_view) <= limit) break;
+
+		// too many tiles: grow them, (the engine downscales each one to the network size)
+		tile_width = (int)ceil(tile_width * 1.25);
+		tile_height = (int)ceil(tile_height * 1.25);
+		if(tile_width > frame_width) tile_width = frame_width;
+		if(tile_height > frame_height) tile_height = frame_height;
+		cols = axis_count(frame_width, tile_width, overlap);
+		rows = axis_count(frame_height, tile_height, overlap);
+	}
+
+	ssize_t count = 0;
+	for(int row = 0; row < rows; ++row) {
+		for(int col = 0; col < cols; ++col) {
+			struct ai_tile * tile = &tiles[count++];
+			tile->x = axis_position(frame_width, tile_width, cols, col);
+			tile->y = axis_position(frame_height, tile_height, rows, row);
+			tile->width = tile_width;
+			tile->height = tile_height;
+			tile->is_global = 0;
+		}
+	}
+	if(count > 1 && params->global_view) {
+		tiles[count++] = (struct ai_tile){ .width = frame_width, .height = frame_height, .is_global = 1 };
+	}
+	return count;
+}
+
+/******************************************************************************
+ * merge
+ *****************************************************************************/
+static int box_compare(const void * a, const void * b)
+{
+	const struct ai_tiling_box * box_a = a;
+	const struct ai_tiling_box * box_b = b;
+	if(box_a->confidence > box_b->confidence) return -1;
+	if(box_a->confidence < box_b->confidence) return 1;
+	return (box_a->index < box_b->index)?-1:(box_a->index > box_b->index);
+}
+
+static inline double box_intersection(const struct ai_tiling_box * a, const struct ai_tiling_box * b)
+{
+	double left = (a->x > b->x)?a->x:b->x;
+	double top = (a->y > b->y)?a->y:b->y;
+	double right = ((a->x + a->cx) < (b->x + b->cx))?(a->x + a->cx):(b->x + b->cx);
+	double bottom = ((a->y + a->cy) < (b->y + b->cy))?(a->y + a->cy):(b->y + b->cy);
+	if(right <= left || bottom <= top) return 0;
+	return (right - left) * (bottom - top);
+}
+
+static void box_union(struct ai_tiling_box * a, const struct ai_tiling_box * b)
+{
+	float right = ((a->x + a->cx) > (b->x + b->cx))?(a->x + a->cx):(b->x + b->cx);
+	float bottom = ((a->y + a->cy) > (b->y + b->cy))?(a->y + a->cy):(b->y + b->cy);
+	if(b->x < a->x) a->x = b->x;
+	if(b->y < a->y) a->y = b->y;
+	a->cx = right - a->x;
+	a->cy = bottom - a->y;
+}
+
+ssize_t ai_tiling_merge(const struct ai_tiling_params * params, struct ai_tiling_box * boxes, ssize_t count)
+{
+	assert(params);
+	if(NULL == boxes || count <= 0) return 0;
+
+	qsort(boxes, count, sizeof(*boxes), box_compare);
+	char * suppressed = calloc(count, 1);
+	assert(suppressed);
+
+	ssize_t num_kept = 0;
+	for(ssize_t i = 0; i < count; ++i) {
+		if(suppressed[i]) continue;
+		struct ai_tiling_box * box = &boxes[i];
+
+		for(ssize_t j = i + 1; j < count; ++j) {
+			const struct ai_tiling_box * other = &boxes[j];
+			if(suppressed[j] || other->klass != box->klass) continue;
+
+			double intersection = box_intersection(box, other);
+			if(intersection <= 0) continue;
+
+			double area = (double)box->cx * box->cy;
+			double other_area = (double)other->cx * other->cy;
+			double iou = intersection / (area + other_area - intersection);
+			if(iou >= params->nms) {
+				suppressed[j] = 1;
+				continue;
+			}
+
+			if(params->merge_ios > 0 && box->tile_index != other->tile_index) {
+				double smaller = (area < other_area)?area:other_area;
+				if(smaller > 0 && (intersection / smaller) >= params->merge_ios) {
+					box_union(box, other);	// the same object, cut by a seam
+					suppressed[j] = 1;
+				}
+			}
+		}
+		boxes[num_kept++] = *box;
+	}
+	free(suppressed);
+	return num_kept;
+}
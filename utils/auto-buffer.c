@@ -27,21 +27,69 @@
 #include <string.h>
 #include <assert.h>
 
+#include <unistd.h>
+#include <sys/uio.h>
+
 #include "auto-buffer.h"
 
 #define AUTO_BUFFER_ALLOCATION_SIZE	(65536)
+#define AUTO_BUFFER_CHUNKS_ALLOCATION_SIZE (64)
+#define AUTO_BUFFER_MAX_IOV (64)
+
 auto_buffer_t * auto_buffer_init(auto_buffer_t * buf, ssize_t max_size)
+{
+	return auto_buffer_init_ex(buf, auto_buffer_mode_linear, max_size);
+}
+
+auto_buffer_t * auto_buffer_init_ex(auto_buffer_t * buf, enum auto_buffer_mode mode, ssize_t max_size)
 {
 	if(NULL == buf) buf = calloc(1, sizeof(*buf));
 	assert(buf);
+	buf->mode = mode;
+	buf->compact = 0;	// opt-in, set it after init
+
+	if(mode == auto_buffer_mode_iovec) return buf;
+	if(mode == auto_buffer_mode_ring)
+	{
+		assert(max_size > 0);
+		buf->data = malloc(max_size);	// fixed capacity, no rounding
+		assert(buf->data);
+		buf->max_size = max_size;
+		return buf;
+	}
 
 	int rc = auto_buffer_resize(buf, max_size);
 	assert(0 == rc);
 	return buf;
 }
 
+static void release_chunks(auto_buffer_t * buf, ssize_t end)
+{
+	for(ssize_t i = buf->first_chunk; i < end; ++i)
+	{
+		auto_buffer_chunk_t * chunk = &buf->chunks[i];
+		if(chunk->release) chunk->release(chunk->user_data, chunk->data);
+		memset(chunk, 0, sizeof(*chunk));
+	}
+	buf->first_chunk = end;
+}
+
+void auto_buffer_reset(auto_buffer_t * buf)
+{
+	if(buf->mode == auto_buffer_mode_iovec)
+	{
+		release_chunks(buf, buf->num_chunks);
+		buf->first_chunk = 0;
+		buf->num_chunks = 0;
+	}
+	buf->cur_pos = 0;
+	buf->length = 0;
+}
+
 void auto_buffer_cleanup(auto_buffer_t * buf)
 {
+	auto_buffer_reset(buf);
+	free(buf->chunks);
 	if(buf->data)
 	{
 		free(buf->data);
@@ -53,6 +101,7 @@ void auto_buffer_cleanup(auto_buffer_t * buf)
 int auto_buffer_resize(auto_buffer_t * buf, ssize_t new_size)
 {
 	if(new_size <= buf->max_size) return 0;
+	if(buf->mode != auto_buffer_mode_linear) return -1;		// fixed capacity
 	new_size = (new_size + AUTO_BUFFER_ALLOCATION_SIZE - 1) / AUTO_BUFFER_ALLOCATION_SIZE * AUTO_BUFFER_ALLOCATION_SIZE;
 	assert(new_size > buf->max_size);
 
@@ -61,10 +110,73 @@ int auto_buffer_resize(auto_buffer_t * buf, ssize_t new_size)
 	buf->max_size = new_size;
 	return 0;
 }
+
+ssize_t auto_buffer_get_length(const auto_buffer_t * buf)
+{
+	if(buf->mode == auto_buffer_mode_linear) return buf->length - buf->cur_pos;
+	return buf->length;
+}
+
+static void free_chunk_data(void * user_data, unsigned char * data)
+{
+	free(data);
+}
+
+ssize_t auto_buffer_push_ref(auto_buffer_t * buf, unsigned char * data, ssize_t length,
+	void (* release)(void * user_data, unsigned char * data), void * user_data)
+{
+	if(NULL == data || length <= 0) return -1;
+	assert(buf->mode == auto_buffer_mode_iovec);
+
+	if(buf->first_chunk > 0 && buf->num_chunks == buf->max_chunks)	// reuse the consumed slots
+	{
+		buf->num_chunks -= buf->first_chunk;
+		memmove(buf->chunks, buf->chunks + buf->first_chunk, buf->num_chunks * sizeof(*buf->chunks));
+		buf->first_chunk = 0;
+	}
+	if(buf->num_chunks >= buf->max_chunks)
+	{
+		ssize_t new_size = buf->max_chunks + AUTO_BUFFER_CHUNKS_ALLOCATION_SIZE;
+		auto_buffer_chunk_t * chunks = realloc(buf->chunks, new_size * sizeof(*chunks));
+		assert(chunks);
+		buf->chunks = chunks;
+		buf->max_chunks = new_size;
+	}
+
+	auto_buffer_chunk_t * chunk = &buf->chunks[buf->num_chunks++];
+	chunk->data = data;
+	chunk->length = length;
+	chunk->release = release;
+	chunk->user_data = user_data;
+	buf->length += length;
+	return buf->length;
+}
+
 ssize_t auto_buffer_push_data(auto_buffer_t * buf, const void * data, ssize_t length)
 {
 	if(NULL == data || length <= 0) return -1;
 	assert(buf->length >= 0);
+
+	if(buf->mode == auto_buffer_mode_iovec)
+	{
+		unsigned char * copy = malloc(length);
+		assert(copy);
+		memcpy(copy, data, length);
+		return auto_buffer_push_ref(buf, copy, length, free_chunk_data, NULL);
+	}
+
+	if(buf->mode == auto_buffer_mode_ring)
+	{
+		if(length > (buf->max_size - buf->length)) return -1;	// full
+
+		ssize_t tail = (buf->cur_pos + buf->length) % buf->max_size;
+		ssize_t cb = buf->max_size - tail;
+		if(cb > length) cb = length;
+		memcpy(buf->data + tail, data, cb);
+		if(cb < length) memcpy(buf->data, (const unsigned char *)data + cb, length - cb);
+		buf->length += length;
+		return buf->length;
+	}
 	
 	int rc = auto_buffer_resize(buf, buf->length + length + 1);
 	assert(0 == rc);
@@ -74,13 +186,131 @@ ssize_t auto_buffer_push_data(auto_buffer_t * buf, const void * data, ssize_t le
 	buf->data[buf->length] = '\0';
 	return (buf->length - buf->cur_pos);
 }
+
+int auto_buffer_get_iovec(const auto_buffer_t * buf, struct iovec * iov, int max_iov)
+{
+	assert(iov && max_iov > 0);
+	int count = 0;
+	ssize_t length = auto_buffer_get_length(buf);
+	if(length <= 0) return 0;
+
+	switch(buf->mode)
+	{
+	case auto_buffer_mode_linear:
+		iov[count].iov_base = buf->data + buf->cur_pos;
+		iov[count++].iov_len = length;
+		break;
+	case auto_buffer_mode_ring:
+		iov[count].iov_base = buf->data + buf->cur_pos;
+		iov[count].iov_len = length;
+		if((buf->cur_pos + length) > buf->max_size)	// wrapped
+		{
+			iov[count].iov_len = buf->max_size - buf->cur_pos;
+			if(max_iov > 1)
+			{
+				iov[++count].iov_base = buf->data;
+				iov[count].iov_len = length - (buf->max_size - buf->cur_pos);
+			}
+		}
+		++count;
+		break;
+	case auto_buffer_mode_iovec:
+		for(ssize_t i = buf->first_chunk; i < buf->num_chunks && count < max_iov; ++i)
+		{
+			const auto_buffer_chunk_t * chunk = &buf->chunks[i];
+			ssize_t offset = (i == buf->first_chunk)?buf->cur_pos:0;
+			iov[count].iov_base = chunk->data + offset;
+			iov[count++].iov_len = chunk->length - offset;
+		}
+		break;
+	default:
+		break;
+	}
+	return count;
+}
+
+static void pop_iovec_chunks(auto_buffer_t * buf, ssize_t length, int release)
+{
+	ssize_t i = buf->first_chunk;
+	ssize_t offset = buf->cur_pos + length;
+	while(i < buf->num_chunks && offset >= buf->chunks[i].length)
+	{
+		offset -= buf->chunks[i].length;
+		++i;
+	}
+	if(release) release_chunks(buf, i);
+	else buf->first_chunk = i;
+	buf->cur_pos = offset;
+	buf->length -= length;
+	if(release && buf->first_chunk == buf->num_chunks) 
+	{
+		buf->first_chunk = 0;
+		buf->num_chunks = 0;
+	}
+}
+
+static void advance(auto_buffer_t * buf, ssize_t length, int release)
+{
+	switch(buf->mode)
+	{
+	case auto_buffer_mode_ring:
+		buf->cur_pos = (buf->cur_pos + length) % buf->max_size;
+		buf->length -= length;
+		if(0 == buf->length) buf->cur_pos = 0;
+		return;
+	case auto_buffer_mode_iovec:
+		pop_iovec_chunks(buf, length, release);
+		return;
+	default:
+		break;
+	}
+
+	buf->cur_pos += length;
+	assert(buf->cur_pos <= buf->length);
+	if(buf->cur_pos == buf->length)
+	{
+		auto_buffer_reset(buf);
+	}else if(buf->compact && buf->cur_pos >= AUTO_BUFFER_ALLOCATION_SIZE && buf->cur_pos >= (buf->length - buf->cur_pos))
+	{
+		// partially consumed: move the (smaller) pending part to the front, so a stream doesn't grow forever
+		buf->length -= buf->cur_pos;
+		memmove(buf->data, buf->data + buf->cur_pos, buf->length);
+		buf->data[buf->length] = '\0';
+		buf->cur_pos = 0;
+	}
+}
+
 ssize_t auto_buffer_peek_data(auto_buffer_t * buf, void * data, ssize_t length)
 {
-	ssize_t cb_avaliable = buf->length - buf->cur_pos;
+	ssize_t cb_avaliable = auto_buffer_get_length(buf);
 	if(NULL == data) return (cb_avaliable + 1);
 	
 	if(length <= 0 || length > cb_avaliable) length = cb_avaliable;
-	memcpy(data, buf->data + buf->cur_pos, length);
+	if(buf->mode == auto_buffer_mode_linear)
+	{
+		memcpy(data, buf->data + buf->cur_pos, length);
+		return length;
+	}
+
+	// gather from a shallow copy, (the chain may be longer than iov[])
+	auto_buffer_t view = *buf;
+	struct iovec iov[AUTO_BUFFER_MAX_IOV];
+	unsigned char * dst = data;
+	ssize_t bytes_left = length;
+	while(bytes_left > 0)
+	{
+		int count = auto_buffer_get_iovec(&view, iov, AUTO_BUFFER_MAX_IOV);
+		assert(count > 0);
+		for(int i = 0; i < count && bytes_left > 0; ++i)
+		{
+			ssize_t cb = iov[i].iov_len;
+			if(cb > bytes_left) cb = bytes_left;
+			memcpy(dst, iov[i].iov_base, cb);
+			dst += cb;
+			bytes_left -= cb;
+			advance(&view, cb, 0);
+		}
+	}
 	return length;
 }
 
@@ -89,12 +319,34 @@ ssize_t auto_buffer_pop_data(auto_buffer_t * buf, void * data, ssize_t length)
 	if(data)
 	{
 		length = auto_buffer_peek_data(buf, data, length);
+	}else
+	{
+		ssize_t cb_avaliable = auto_buffer_get_length(buf);
+		if(length < 0 || length > cb_avaliable) length = cb_avaliable;
 	}
-	buf->cur_pos += length;
-	
-	assert(buf->cur_pos <= buf->length);
-	if(buf->cur_pos == buf->length) auto_buffer_reset(buf);
+	advance(buf, length, 1);
 	return length;
 }
 
+ssize_t auto_buffer_writev(auto_buffer_t * buf, int fd)
+{
+	struct iovec iov[AUTO_BUFFER_MAX_IOV];
+	ssize_t total = 0;
+	while(auto_buffer_get_length(buf) > 0)
+	{
+		int count = auto_buffer_get_iovec(buf, iov, AUTO_BUFFER_MAX_IOV);
+		ssize_t cb = writev(fd, iov, count);
+		if(cb <= 0)
+		{
+			if(total > 0) break;	// would block
+			return cb;
+		}
+		auto_buffer_pop_data(buf, NULL, cb);
+		total += cb;
+	}
+	return total;
+}
+
+#undef AUTO_BUFFER_MAX_IOV
+#undef AUTO_BUFFER_CHUNKS_ALLOCATION_SIZE
 #undef AUTO_BUFFER_ALLOCATION_SIZE
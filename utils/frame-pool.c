@@ -0,0 +1,301 @@
+/*
+ * frame-pool.c
+ *
+ * Copyright 2022 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+#include <search.h>
+
+#include "frame-pool.h"
+
+#define FRAME_POOL_PAGE_SIZE		(4096)
+#define FRAME_POOL_MIN_STREAM_SIZE	(65536)
+
+// compressed frames (jpeg / png) have a variable length, round them to the next power of 2
+#define FRAME_FORMAT_IS_COMPRESSED(format) ((format) == frame_pool_format_jpeg || (format) == frame_pool_format_png)
+
+typedef struct frame_pool_key
+{
+	int width;
+	int height;
+	int format;
+	size_t capacity;
+}frame_pool_key_t;
+
+typedef struct frame_pool_bucket
+{
+	frame_pool_key_t key;
+	size_t max_size;
+	size_t length;
+	struct frame_pool_block ** blocks;	// cached (free) blocks, LIFO
+}frame_pool_bucket_t;
+
+typedef struct frame_pool_block
+{
+	void * data;		// search key, MUST be the first field
+	frame_pool_bucket_t * bucket;
+	int in_use;
+}frame_pool_block_t;
+
+static struct frame_pool
+{
+	pthread_mutex_t mutex;
+	size_t max_buckets;
+	size_t num_buckets;
+	frame_pool_bucket_t ** buckets;
+	void * blocks_root;		// tsearch root, all blocks (in-use or cached) indexed by data
+	struct frame_pool_stats stats;
+}g_frame_pool[1] = {{
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.stats.max_cached_bytes = FRAME_POOL_DEFAULT_CACHE_SIZE,
+}};
+
+static int block_compare(const void * a, const void * b)
+{
+	const void * data_a = ((const frame_pool_block_t *)a)->data;
+	const void * data_b = ((const frame_pool_block_t *)b)->data;
+	if(data_a == data_b) return 0;
+	return (data_a < data_b)?-1:1;
+}
+
+static size_t round_capacity(int format, size_t capacity)
+{
+	if(FRAME_FORMAT_IS_COMPRESSED(format))
+	{
+		size_t size = FRAME_POOL_MIN_STREAM_SIZE;
+		while(size < capacity) size <<= 1;
+		return size;
+	}
+	return (capacity + FRAME_POOL_PAGE_SIZE - 1) / FRAME_POOL_PAGE_SIZE * FRAME_POOL_PAGE_SIZE;
+}
+
+static frame_pool_bucket_t * find_or_add_bucket(struct frame_pool * pool, const frame_pool_key_t * key)
+{
+	for(size_t i = 0; i < pool->num_buckets; ++i)
+	{
+		frame_pool_bucket_t * bucket = pool->buckets[i];
+		if(bucket->key.width == key->width && bucket->key.height == key->height
+			&& bucket->key.format == key->format && bucket->key.capacity == key->capacity) return bucket;
+	}
+
+	if(pool->num_buckets >= pool->max_buckets)
+	{
+		size_t new_size = pool->max_buckets + 16;
+		frame_pool_bucket_t ** buckets = realloc(pool->buckets, new_size * sizeof(*buckets));
+		assert(buckets);
+		pool->buckets = buckets;
+		pool->max_buckets = new_size;
+	}
+
+	frame_pool_bucket_t * bucket = calloc(1, sizeof(*bucket));
+	assert(bucket);
+	bucket->key = *key;
+	pool->buckets[pool->num_buckets++] = bucket;
+	return bucket;
+}
+
+static frame_pool_block_t * find_block(struct frame_pool * pool, const void * data)
+{
+	frame_pool_block_t pattern = { .data = (void *)data };
+	void * p_node = tfind(&pattern, &pool->blocks_root, block_compare);
+	if(NULL == p_node) return NULL;
+	return *(frame_pool_block_t **)p_node;
+}
+
+static void destroy_block(struct frame_pool * pool, frame_pool_block_t * block)
+{
+	tdelete(block, &pool->blocks_root, block_compare);
+	free(block->data);
+	free(block);
+}
+
+void * frame_pool_alloc(int width, int height, int format, size_t capacity)
+{
+	if(0 == capacity) return NULL;
+	struct frame_pool * pool = g_frame_pool;
+	frame_pool_key_t key = {
+		.width = width,
+		.height = height,
+		.format = format,
+		.capacity = round_capacity(format, capacity),
+	};
+
+	pthread_mutex_lock(&pool->mutex);
+	frame_pool_bucket_t * bucket = find_or_add_bucket(pool, &key);
+	frame_pool_block_t * block = NULL;
+	if(bucket->length > 0)
+	{
+		block = bucket->blocks[--bucket->length];
+		++pool->stats.hits;
+		--pool->stats.buffers_cached;
+		pool->stats.bytes_cached -= key.capacity;
+	}else
+	{
+		block = calloc(1, sizeof(*block));
+		assert(block);
+		int rc = posix_memalign(&block->data, FRAME_POOL_ALIGNMENT, key.capacity);
+		assert(0 == rc && block->data);
+
+		block->bucket = bucket;
+		void * p_node = tsearch(block, &pool->blocks_root, block_compare);
+		assert(p_node && *(frame_pool_block_t **)p_node == block);
+		++pool->stats.misses;
+	}
+
+	block->in_use = 1;
+	++pool->stats.buffers_in_use;
+	pool->stats.bytes_in_use += key.capacity;
+	pthread_mutex_unlock(&pool->mutex);
+	return block->data;
+}
+
+void frame_pool_release(void * data)
+{
+	if(NULL == data) return;
+	struct frame_pool * pool = g_frame_pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	frame_pool_block_t * block = find_block(pool, data);
+	if(NULL == block) // not a pooled buffer
+	{
+		pthread_mutex_unlock(&pool->mutex);
+		free(data);
+		return;
+	}
+
+	assert(block->in_use);
+	frame_pool_bucket_t * bucket = block->bucket;
+	size_t capacity = bucket->key.capacity;
+
+	block->in_use = 0;
+	--pool->stats.buffers_in_use;
+	pool->stats.bytes_in_use -= capacity;
+
+	if((pool->stats.bytes_cached + capacity) > pool->stats.max_cached_bytes)
+	{
+		destroy_block(pool, block);
+		pthread_mutex_unlock(&pool->mutex);
+		return;
+	}
+
+	if(bucket->length >= bucket->max_size)
+	{
+		size_t new_size = bucket->max_size + 8;
+		frame_pool_block_t ** blocks = realloc(bucket->blocks, new_size * sizeof(*blocks));
+		assert(blocks);
+		bucket->blocks = blocks;
+		bucket->max_size = new_size;
+	}
+	bucket->blocks[bucket->length++] = block;
+	++pool->stats.buffers_cached;
+	pool->stats.bytes_cached += capacity;
+	pthread_mutex_unlock(&pool->mutex);
+	return;
+}
+
+void * frame_pool_reserve(void * data, int width, int height, int format, size_t capacity)
+{
+	if(data)
+	{
+		struct frame_pool * pool = g_frame_pool;
+		pthread_mutex_lock(&pool->mutex);
+		frame_pool_block_t * block = find_block(pool, data);
+		if(block)
+		{
+			const frame_pool_key_t * key = &block->bucket->key;
+			if(key->width == width && key->height == height && key->format == format
+				&& key->capacity >= capacity)
+			{
+				pthread_mutex_unlock(&pool->mutex);
+				return data;	// reuse
+			}
+		}
+		pthread_mutex_unlock(&pool->mutex);
+		frame_pool_release(data);
+	}
+	return frame_pool_alloc(width, height, format, capacity);
+}
+
+size_t frame_pool_get_capacity(const void * data)
+{
+	if(NULL == data) return 0;
+	struct frame_pool * pool = g_frame_pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	frame_pool_block_t * block = find_block(pool, data);
+	size_t capacity = block?block->bucket->key.capacity:0;
+	pthread_mutex_unlock(&pool->mutex);
+	return capacity;
+}
+
+static void trim_cache(struct frame_pool * pool)	// pool->mutex held
+{
+	for(size_t i = 0; i < pool->num_buckets; ++i)
+	{
+		frame_pool_bucket_t * bucket = pool->buckets[i];
+		while(bucket->length > 0)
+		{
+			frame_pool_block_t * block = bucket->blocks[--bucket->length];
+			--pool->stats.buffers_cached;
+			pool->stats.bytes_cached -= bucket->key.capacity;
+			destroy_block(pool, block);
+		}
+	}
+}
+
+void frame_pool_set_max_cached_bytes(ssize_t max_cached_bytes)
+{
+	struct frame_pool * pool = g_frame_pool;
+	if(max_cached_bytes < 0) max_cached_bytes = FRAME_POOL_DEFAULT_CACHE_SIZE;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stats.max_cached_bytes = max_cached_bytes;
+	if(pool->stats.bytes_cached > max_cached_bytes) trim_cache(pool);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+void frame_pool_get_stats(struct frame_pool_stats * stats)
+{
+	assert(stats);
+	struct frame_pool * pool = g_frame_pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	*stats = pool->stats;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+void frame_pool_trim(void)
+{
+	struct frame_pool * pool = g_frame_pool;
+	pthread_mutex_lock(&pool->mutex);
+	trim_cache(pool);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+#undef FRAME_FORMAT_IS_COMPRESSED
+#undef FRAME_POOL_MIN_STREAM_SIZE
+#undef FRAME_POOL_PAGE_SIZE
@@ -0,0 +1,425 @@
+/*
+ * img_overlay.c
+ *
+ * Copyright 2022 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// tdestroy()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <search.h>
+
+#include <cairo/cairo.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "utils.h"
+#include "img_overlay.h"
+
+/******************************************************************************
+ * building blocks
+ *
+ *   out = (src * a + dst * (255 - a)) / 255, rounded, (alpha: a + dst_alpha * (255 - a) / 255)
+ *   every kernel evaluates the same integer expression, the sse2 and scalar results are identical.
+ *****************************************************************************/
+#define div255(x) ({ unsigned int t_ = (unsigned int)(x) + 128; (t_ + (t_ >> 8)) >> 8; })
+
+static inline uint32_t blend_pixel(uint32_t dst, uint32_t src, unsigned int a)
+{
+	unsigned int inv = 255 - a;
+	uint32_t out = 0;
+	for(int shift = 0; shift < 32; shift += 8) {
+		unsigned int s = (src >> shift) & 0xff;
+		unsigned int d = (dst >> shift) & 0xff;
+		out |= (uint32_t)div255(s * a + d * inv) << shift;
+	}
+	return out;
+}
+
+#if defined(__SSE2__)
+static inline __m128i div255_epu16(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// 2 pixels (8 x u16): (src * a + dst * (255 - a)) / 255
+static inline __m128i blend_epu16(__m128i dst, __m128i src, __m128i a)
+{
+	__m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+	return div255_epu16(_mm_add_epi16(_mm_mullo_epi16(src, a), _mm_mullo_epi16(dst, inv)));
+}
+#endif
+
+void img_overlay_fill_span(uint32_t * dst, int count, uint32_t color)
+{
+	unsigned int a = color >> 24;
+	if(0 == a || count <= 0) return;
+
+	uint32_t src = color | 0xff000000;
+	if(a == 255) {
+		for(int i = 0; i < count; ++i) dst[i] = src;
+		return;
+	}
+
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i src16 = _mm_unpacklo_epi8(_mm_set1_epi32(src), zero);
+	const __m128i a16 = _mm_set1_epi16(a);
+	for(; (i + 4) <= count; i += 4) {
+		__m128i d = _mm_loadu_si128((__m128i *)(dst + i));
+		__m128i lo = blend_epu16(_mm_unpacklo_epi8(d, zero), src16, a16);
+		__m128i hi = blend_epu16(_mm_unpackhi_epi8(d, zero), src16, a16);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for(; i < count; ++i) dst[i] = blend_pixel(dst[i], src, a);
+}
+
+void img_overlay_blend_mask_scalar(uint32_t * dst, const uint8_t * mask, int count, uint32_t color)
+{
+	unsigned int ca = color >> 24;
+	uint32_t src = color | 0xff000000;
+	for(int i = 0; i < count; ++i) {
+		if(0 == mask[i]) continue;
+		dst[i] = blend_pixel(dst[i], src, div255(mask[i] * ca));
+	}
+}
+
+void img_overlay_blend_mask(uint32_t * dst, const uint8_t * mask, int count, uint32_t color)
+{
+	unsigned int ca = color >> 24;
+	if(0 == ca || count <= 0) return;
+
+	int i = 0;
+#if defined(__SSE2__)
+	uint32_t src = color | 0xff000000;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i src16 = _mm_unpacklo_epi8(_mm_set1_epi32(src), zero);
+	const __m128i ca16 = _mm_set1_epi16(ca);
+	for(; (i + 4) <= count; i += 4) {
+		uint32_t m4 = 0;
+		memcpy(&m4, mask + i, 4);
+		if(0 == m4) continue;	// glyph gaps, (most of a sprite)
+		if(m4 == 0xffffffff && ca == 255) {
+			_mm_storeu_si128((__m128i *)(dst + i), _mm_set1_epi32(src));
+			continue;
+		}
+
+		__m128i m = _mm_cvtsi32_si128(m4);
+		m = _mm_unpacklo_epi8(m, m);
+		m = _mm_unpacklo_epi16(m, m);	// (m0 x 4, m1 x 4, m2 x 4, m3 x 4)
+		__m128i a_lo = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(m, zero), ca16));
+		__m128i a_hi = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(m, zero), ca16));
+
+		__m128i d = _mm_loadu_si128((__m128i *)(dst + i));
+		__m128i lo = blend_epu16(_mm_unpacklo_epi8(d, zero), src16, a_lo);
+		__m128i hi = blend_epu16(_mm_unpackhi_epi8(d, zero), src16, a_hi);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	img_overlay_blend_mask_scalar(dst + i, mask + i, count - i, color);
+}
+
+/******************************************************************************
+ * sprites cache
+ *****************************************************************************/
+struct overlay_sprite
+{
+	int font_size;
+	char * text;
+	int width;		// x_advance, (the mask may be wider)
+	int height;		// font height (ascent + descent), the same for every word of a font size
+	int mask_width;
+	uint8_t * mask;	// mask_width * height, A8 coverage
+};
+
+struct img_overlay_private
+{
+	img_overlay_t * overlay;
+	void * sprites_root;	// tsearch root, indexed by (font_size, text)
+	struct img_overlay_stats stats;
+};
+
+static int sprite_compare(const void * a, const void * b)
+{
+	const struct overlay_sprite * sprite_a = a;
+	const struct overlay_sprite * sprite_b = b;
+	if(sprite_a->font_size != sprite_b->font_size) return sprite_a->font_size - sprite_b->font_size;
+	return strcmp(sprite_a->text, sprite_b->text);
+}
+
+static void sprite_free(void * p)
+{
+	struct overlay_sprite * sprite = p;
+	if(NULL == sprite) return;
+	free(sprite->text);
+	free(sprite->mask);
+	free(sprite);
+}
+
+static struct overlay_sprite * rasterize_word(const char * font_face, const char * text, int font_size)
+{
+	struct overlay_sprite * sprite = calloc(1, sizeof(*sprite));
+	assert(sprite);
+	sprite->font_size = font_size;
+	sprite->text = strdup(text);
+	assert(sprite->text);
+
+	// measure with a 1x1 surface, then render into the final one
+	cairo_surface_t * surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+	cairo_t * cr = cairo_create(surface);
+	cairo_select_font_face(cr, font_face, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cr, font_size);
+
+	cairo_font_extents_t font_extents;
+	cairo_text_extents_t extents;
+	cairo_font_extents(cr, &font_extents);
+	cairo_text_extents(cr, text, &extents);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+
+	sprite->width = (int)ceil(extents.x_advance);
+	sprite->height = (int)ceil(font_extents.ascent + font_extents.descent);
+	sprite->mask_width = (int)ceil(extents.x_bearing + extents.width);
+	if(sprite->mask_width < sprite->width) sprite->mask_width = sprite->width;
+	if(sprite->height <= 0 || sprite->mask_width <= 0) return sprite;	// whitespace
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_A8, sprite->mask_width, sprite->height);
+	assert(surface && cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS);
+	cr = cairo_create(surface);
+	cairo_select_font_face(cr, font_face, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cr, font_size);
+	cairo_set_source_rgba(cr, 0, 0, 0, 1);
+	cairo_move_to(cr, 0, font_extents.ascent);
+	cairo_show_text(cr, text);
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+
+	sprite->mask = malloc((size_t)sprite->mask_width * sprite->height);
+	assert(sprite->mask);
+
+	const unsigned char * data = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	for(int y = 0; y < sprite->height; ++y) {
+		memcpy(sprite->mask + (size_t)y * sprite->mask_width, data + (size_t)y * stride, sprite->mask_width);
+	}
+	cairo_surface_destroy(surface);
+	return sprite;
+}
+
+static void overlay_clear_cache(img_overlay_t * overlay)
+{
+	struct img_overlay_private * priv = overlay->priv;
+	if(NULL == priv || NULL == priv->sprites_root) return;
+
+	tdestroy(priv->sprites_root, sprite_free);
+	priv->sprites_root = NULL;
+	priv->stats.num_sprites = 0;
+}
+
+static const struct overlay_sprite * get_sprite(img_overlay_t * overlay, const char * word, int font_size)
+{
+	struct img_overlay_private * priv = overlay->priv;
+	struct overlay_sprite pattern = { .font_size = font_size, .text = (char *)word };
+
+	void * p_node = tfind(&pattern, &priv->sprites_root, sprite_compare);
+	if(p_node) {
+		++priv->stats.cache_hits;
+		return *(struct overlay_sprite **)p_node;
+	}
+
+	if(priv->stats.num_sprites >= overlay->max_sprites) {
+		overlay_clear_cache(overlay);
+		++priv->stats.cache_resets;
+	}
+
+	struct overlay_sprite * sprite = rasterize_word(overlay->font_face, word, font_size);
+	p_node = tsearch(sprite, &priv->sprites_root, sprite_compare);
+	assert(p_node && *(struct overlay_sprite **)p_node == sprite);
+	++priv->stats.num_sprites;
+	++priv->stats.cache_misses;
+	return sprite;
+}
+
+/******************************************************************************
+ * drawing
+ *****************************************************************************/
+// clip (x, y, width, height) to the image, return 0 if the area is empty
+static int clip_rect(const bgra_image_t * image, int * x, int * y, int * width, int * height)
+{
+	int x1 = *x + *width, y1 = *y + *height;
+	if(*x < 0) *x = 0;
+	if(*y < 0) *y = 0;
+	if(x1 > image->width) x1 = image->width;
+	if(y1 > image->height) y1 = image->height;
+	*width = x1 - *x;
+	*height = y1 - *y;
+	return (*width > 0 && *height > 0);
+}
+
+static int overlay_fill_rect(img_overlay_t * overlay, bgra_image_t * image, int x, int y, int width, int height, uint32_t color)
+{
+	assert(image && image->data);
+	if(0 == (color >> 24) || !clip_rect(image, &x, &y, &width, &height)) return 0;
+
+	int stride = bgra_image_stride(image);
+	unsigned char * row = image->data + (ssize_t)y * stride + x * 4;
+	for(int i = 0; i < height; ++i, row += stride) {
+		img_overlay_fill_span((uint32_t *)row, width, color);
+	}
+	return 0;
+}
+
+static int overlay_draw_box(img_overlay_t * overlay, bgra_image_t * image, int x, int y, int width, int height, int line_width, uint32_t color)
+{
+	if(width <= 0 || height <= 0) return -1;
+	if(line_width <= 0) line_width = 1;
+	if(line_width * 2 >= width || line_width * 2 >= height) return overlay_fill_rect(overlay, image, x, y, width, height, color);
+
+	// 4 disjoint strips, a translucent color is blended once per pixel
+	overlay_fill_rect(overlay, image, x, y, width, line_width, color);
+	overlay_fill_rect(overlay, image, x, y + height - line_width, width, line_width, color);
+	overlay_fill_rect(overlay, image, x, y + line_width, line_width, height - line_width * 2, color);
+	overlay_fill_rect(overlay, image, x + width - line_width, y + line_width, line_width, height - line_width * 2, color);
+	return 0;
+}
+
+static void blend_sprite(bgra_image_t * image, int x, int y, const struct overlay_sprite * sprite, uint32_t color)
+{
+	if(NULL == sprite->mask) return;
+	int x0 = x, y0 = y;
+	int width = sprite->mask_width, height = sprite->height;
+	if(!clip_rect(image, &x, &y, &width, &height)) return;
+
+	int stride = bgra_image_stride(image);
+	for(int i = 0; i < height; ++i) {
+		const uint8_t * mask = sprite->mask + (size_t)(y - y0 + i) * sprite->mask_width + (x - x0);
+		uint32_t * dst = (uint32_t *)(image->data + (ssize_t)(y + i) * stride + x * 4);
+		img_overlay_blend_mask(dst, mask, width, color);
+	}
+}
+
+/*
+ * walk the words of the text, (runs of spaces advance by the width of " ")
+ * image: nullable, measure only
+ */
+static int layout_label(img_overlay_t * overlay, bgra_image_t * image, int x, int y, const char * text, int font_size, uint32_t color)
+{
+	char word[256] = "";
+	const char * p = text;
+	int cx = 0;
+
+	while(*p) {
+		if(*p == ' ') {
+			cx += get_sprite(overlay, " ", font_size)->width;
+			++p;
+			continue;
+		}
+
+		size_t cb = strcspn(p, " ");
+		if(cb >= sizeof(word)) cb = sizeof(word) - 1;
+		memcpy(word, p, cb);
+		word[cb] = '\0';
+		p += cb;
+
+		const struct overlay_sprite * sprite = get_sprite(overlay, word, font_size);
+		if(image) blend_sprite(image, x + cx, y, sprite, color);
+		cx += sprite->width;
+	}
+	return cx;
+}
+
+static int overlay_get_label_size(img_overlay_t * overlay, const char * text, const struct img_overlay_label_style * style,
+	int * p_width, int * p_height)
+{
+	assert(text && style && style->font_size > 0);
+	int width = layout_label(overlay, NULL, 0, 0, text, style->font_size, 0);
+	int height = get_sprite(overlay, " ", style->font_size)->height;
+
+	if(p_width) *p_width = width + style->padding * 2;
+	if(p_height) *p_height = height + style->padding * 2;
+	return 0;
+}
+
+static int overlay_draw_label(img_overlay_t * overlay, bgra_image_t * image, int x, int y, const char * text,
+	const struct img_overlay_label_style * style, int * p_width, int * p_height)
+{
+	assert(image && image->data);
+	if(NULL == text || NULL == style || style->font_size <= 0) return -1;
+
+	int width = 0, height = 0;
+	if(style->bg_color >> 24) {
+		overlay_get_label_size(overlay, text, style, &width, &height);
+		overlay_fill_rect(overlay, image, x, y, width, height, style->bg_color);
+	}
+
+	int text_width = layout_label(overlay, image, x + style->padding, y + style->padding, text, style->font_size, style->color);
+	if(p_width) *p_width = text_width + style->padding * 2;
+	if(p_height) *p_height = get_sprite(overlay, " ", style->font_size)->height + style->padding * 2;
+	return 0;
+}
+
+static void overlay_get_stats(img_overlay_t * overlay, struct img_overlay_stats * stats)
+{
+	struct img_overlay_private * priv = overlay->priv;
+	assert(priv && stats);
+	*stats = priv->stats;
+}
+
+img_overlay_t * img_overlay_init(img_overlay_t * overlay, const char * font_face, void * user_data)
+{
+	if(NULL == overlay) overlay = calloc(1, sizeof(*overlay));
+	assert(overlay);
+	overlay->user_data = user_data;
+	if(NULL == font_face || !font_face[0]) font_face = IMG_OVERLAY_DEFAULT_FONT;
+	strncpy(overlay->font_face, font_face, sizeof(overlay->font_face) - 1);
+	if(overlay->max_sprites <= 0) overlay->max_sprites = IMG_OVERLAY_DEFAULT_MAX_SPRITES;
+
+	overlay->draw_box = overlay_draw_box;
+	overlay->fill_rect = overlay_fill_rect;
+	overlay->draw_label = overlay_draw_label;
+	overlay->get_label_size = overlay_get_label_size;
+	overlay->clear_cache = overlay_clear_cache;
+	overlay->get_stats = overlay_get_stats;
+
+	struct img_overlay_private * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->overlay = overlay;
+	overlay->priv = priv;
+	return overlay;
+}
+
+void img_overlay_cleanup(img_overlay_t * overlay)
+{
+	if(NULL == overlay) return;
+	overlay_clear_cache(overlay);
+	free(overlay->priv);
+	overlay->priv = NULL;
+}
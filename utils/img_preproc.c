@@ -0,0 +1,591 @@
+/*
+ * img_preproc.c
+ *
+ * Copyright 2022 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "img_preproc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMG_PREPROC_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * kernel parameters are stored in the source (bgra) order,
+ *   the channel order is applied by the plane pointers (nchw) or by a shuffle (nhwc)
+ */
+struct preproc_kernel_params
+{
+	float mean[4];	// b, g, r, (a: 0)
+	float k[4];		// scale / std
+	int swap_rb;	// nhwc only: rgb order
+};
+
+typedef void (* row_to_planes_func)(const unsigned char * src, int width, float * planes[3], const struct preproc_kernel_params * kp);
+typedef void (* row_to_hwc_func)(const unsigned char * src, int width, float * dst, const struct preproc_kernel_params * kp);
+
+/******************************************************************************
+ * scalar (reference)
+ *****************************************************************************/
+static void row_to_planes_scalar(const unsigned char * src, int width, float * planes[3], const struct preproc_kernel_params * kp)
+{
+	float * p0 = planes[0], * p1 = planes[1], * p2 = planes[2];
+	for(int col = 0; col < width; ++col, src += 4)
+	{
+		p0[col] = ((float)src[0] - kp->mean[0]) * kp->k[0];
+		p1[col] = ((float)src[1] - kp->mean[1]) * kp->k[1];
+		p2[col] = ((float)src[2] - kp->mean[2]) * kp->k[2];
+	}
+}
+
+static void row_to_hwc_scalar(const unsigned char * src, int width, float * dst, const struct preproc_kernel_params * kp)
+{
+	int c0 = kp->swap_rb?2:0;
+	int c2 = kp->swap_rb?0:2;
+	for(int col = 0; col < width; ++col, src += 4, dst += 3)
+	{
+		dst[0] = ((float)src[c0] - kp->mean[c0]) * kp->k[c0];
+		dst[1] = ((float)src[1]  - kp->mean[1])  * kp->k[1];
+		dst[2] = ((float)src[c2] - kp->mean[c2]) * kp->k[c2];
+	}
+}
+
+#ifdef IMG_PREPROC_X86
+/******************************************************************************
+ * sse2: 4 pixels per iteration
+ *****************************************************************************/
+__attribute__((target("sse2")))
+static void row_to_planes_sse2(const unsigned char * src, int width, float * planes[3], const struct preproc_kernel_params * kp)
+{
+	float * p0 = planes[0], * p1 = planes[1], * p2 = planes[2];
+	const __m128i mask = _mm_set1_epi32(0xff);
+	const __m128 m0 = _mm_set1_ps(kp->mean[0]), k0 = _mm_set1_ps(kp->k[0]);
+	const __m128 m1 = _mm_set1_ps(kp->mean[1]), k1 = _mm_set1_ps(kp->k[1]);
+	const __m128 m2 = _mm_set1_ps(kp->mean[2]), k2 = _mm_set1_ps(kp->k[2]);
+
+	int col = 0;
+	for(; (col + 4) <= width; col += 4)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + col * 4));
+		__m128 b = _mm_cvtepi32_ps(_mm_and_si128(px, mask));
+		__m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+		__m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+		_mm_storeu_ps(p0 + col, _mm_mul_ps(_mm_sub_ps(b, m0), k0));
+		_mm_storeu_ps(p1 + col, _mm_mul_ps(_mm_sub_ps(g, m1), k1));
+		_mm_storeu_ps(p2 + col, _mm_mul_ps(_mm_sub_ps(r, m2), k2));
+	}
+	if(col < width) {
+		float * tail[3] = { p0 + col, p1 + col, p2 + col };
+		row_to_planes_scalar(src + col * 4, width - col, tail, kp);
+	}
+}
+
+/*
+ * nhwc: every pixel is converted as one (b, g, r, a) vector and stored as 4 floats at dst + 3 * col,
+ *   the 4th float is overwritten by the next pixel, so the last pixel of a row is left to the scalar code.
+ */
+__attribute__((target("sse2")))
+static void row_to_hwc_sse2(const unsigned char * src, int width, float * dst, const struct preproc_kernel_params * kp)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 mean = _mm_loadu_ps(kp->mean);
+	const __m128 k = _mm_loadu_ps(kp->k);
+	const int swap_rb = kp->swap_rb;
+
+	int col = 0;
+	for(; (col + 4) < width; col += 4)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + col * 4));
+		__m128i lo = _mm_unpacklo_epi8(px, zero);
+		__m128i hi = _mm_unpackhi_epi8(px, zero);
+		__m128 f[4] = {
+			_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)),
+			_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)),
+			_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)),
+			_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)),
+		};
+		for(int i = 0; i < 4; ++i) {
+			__m128 v = _mm_mul_ps(_mm_sub_ps(f[i], mean), k);
+			if(swap_rb) v = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 1, 2));
+			_mm_storeu_ps(dst + (col + i) * 3, v);
+		}
+	}
+	row_to_hwc_scalar(src + col * 4, width - col, dst + col * 3, kp);
+}
+
+/******************************************************************************
+ * avx2: 8 pixels per iteration (nchw), 2 pixels per vector (nhwc)
+ *****************************************************************************/
+__attribute__((target("avx2")))
+static void row_to_planes_avx2(const unsigned char * src, int width, float * planes[3], const struct preproc_kernel_params * kp)
+{
+	float * p0 = planes[0], * p1 = planes[1], * p2 = planes[2];
+	const __m256i mask = _mm256_set1_epi32(0xff);
+	const __m256 m0 = _mm256_set1_ps(kp->mean[0]), k0 = _mm256_set1_ps(kp->k[0]);
+	const __m256 m1 = _mm256_set1_ps(kp->mean[1]), k1 = _mm256_set1_ps(kp->k[1]);
+	const __m256 m2 = _mm256_set1_ps(kp->mean[2]), k2 = _mm256_set1_ps(kp->k[2]);
+
+	int col = 0;
+	for(; (col + 8) <= width; col += 8)
+	{
+		__m256i px = _mm256_loadu_si256((const __m256i *)(src + col * 4));
+		__m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(px, mask));
+		__m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask));
+		__m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask));
+		_mm256_storeu_ps(p0 + col, _mm256_mul_ps(_mm256_sub_ps(b, m0), k0));
+		_mm256_storeu_ps(p1 + col, _mm256_mul_ps(_mm256_sub_ps(g, m1), k1));
+		_mm256_storeu_ps(p2 + col, _mm256_mul_ps(_mm256_sub_ps(r, m2), k2));
+	}
+	if(col < width) {
+		float * tail[3] = { p0 + col, p1 + col, p2 + col };
+		row_to_planes_sse2(src + col * 4, width - col, tail, kp);
+	}
+}
+
+__attribute__((target("avx2")))
+static void row_to_hwc_avx2(const unsigned char * src, int width, float * dst, const struct preproc_kernel_params * kp)
+{
+	const __m128 mean4 = _mm_loadu_ps(kp->mean);
+	const __m128 k4 = _mm_loadu_ps(kp->k);
+	const __m256 mean = _mm256_insertf128_ps(_mm256_castps128_ps256(mean4), mean4, 1);
+	const __m256 k = _mm256_insertf128_ps(_mm256_castps128_ps256(k4), k4, 1);
+	const int swap_rb = kp->swap_rb;
+
+	int col = 0;
+	for(; (col + 2) < width; col += 2)
+	{
+		__m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + col * 4))));
+		__m256 v = _mm256_mul_ps(_mm256_sub_ps(f, mean), k);
+		if(swap_rb) v = _mm256_permute_ps(v, _MM_SHUFFLE(3, 0, 1, 2));
+		_mm_storeu_ps(dst + col * 3, _mm256_castps256_ps128(v));
+		_mm_storeu_ps(dst + col * 3 + 3, _mm256_extractf128_ps(v, 1));
+	}
+	row_to_hwc_scalar(src + col * 4, width - col, dst + col * 3, kp);
+}
+
+/******************************************************************************
+ * avx512: 16 pixels per iteration (nchw), 4 pixels per vector (nhwc)
+ *****************************************************************************/
+__attribute__((target("avx512f")))
+static void row_to_planes_avx512(const unsigned char * src, int width, float * planes[3], const struct preproc_kernel_params * kp)
+{
+	float * p0 = planes[0], * p1 = planes[1], * p2 = planes[2];
+	const __m512i mask = _mm512_set1_epi32(0xff);
+	const __m512 m0 = _mm512_set1_ps(kp->mean[0]), k0 = _mm512_set1_ps(kp->k[0]);
+	const __m512 m1 = _mm512_set1_ps(kp->mean[1]), k1 = _mm512_set1_ps(kp->k[1]);
+	const __m512 m2 = _mm512_set1_ps(kp->mean[2]), k2 = _mm512_set1_ps(kp->k[2]);
+
+	int col = 0;
+	for(; (col + 16) <= width; col += 16)
+	{
+		__m512i px = _mm512_loadu_si512((const void *)(src + col * 4));
+		__m512 b = _mm512_cvtepi32_ps(_mm512_and_si512(px, mask));
+		__m512 g = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(px, 8), mask));
+		__m512 r = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(px, 16), mask));
+		_mm512_storeu_ps(p0 + col, _mm512_mul_ps(_mm512_sub_ps(b, m0), k0));
+		_mm512_storeu_ps(p1 + col, _mm512_mul_ps(_mm512_sub_ps(g, m1), k1));
+		_mm512_storeu_ps(p2 + col, _mm512_mul_ps(_mm512_sub_ps(r, m2), k2));
+	}
+	if(col < width) {
+		float * tail[3] = { p0 + col, p1 + col, p2 + col };
+		row_to_planes_avx2(src + col * 4, width - col, tail, kp);
+	}
+}
+
+__attribute__((target("avx512f")))
+static void row_to_hwc_avx512(const unsigned char * src, int width, float * dst, const struct preproc_kernel_params * kp)
+{
+	const __m512 mean = _mm512_broadcast_f32x4(_mm_loadu_ps(kp->mean));
+	const __m512 k = _mm512_broadcast_f32x4(_mm_loadu_ps(kp->k));
+	const int swap_rb = kp->swap_rb;
+
+	int col = 0;
+	for(; (col + 4) < width; col += 4)
+	{
+		__m512 f = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(src + col * 4))));
+		__m512 v = _mm512_mul_ps(_mm512_sub_ps(f, mean), k);
+		if(swap_rb) v = _mm512_permute_ps(v, _MM_SHUFFLE(3, 0, 1, 2));
+		_mm_storeu_ps(dst + col * 3,     _mm512_extractf32x4_ps(v, 0));
+		_mm_storeu_ps(dst + col * 3 + 3, _mm512_extractf32x4_ps(v, 1));
+		_mm_storeu_ps(dst + col * 3 + 6, _mm512_extractf32x4_ps(v, 2));
+		_mm_storeu_ps(dst + col * 3 + 9, _mm512_extractf32x4_ps(v, 3));
+	}
+	row_to_hwc_avx2(src + col * 4, width - col, dst + col * 3, kp);
+}
+#endif
+
+/******************************************************************************
+ * runtime dispatch
+ *****************************************************************************/
+static const struct
+{
+	const char * name;
+	row_to_planes_func to_planes;
+	row_to_hwc_func to_hwc;
+}s_kernels[img_preproc_isas_count] = {
+	[img_preproc_isa_scalar] = { "scalar", row_to_planes_scalar, row_to_hwc_scalar },
+#ifdef IMG_PREPROC_X86
+	[img_preproc_isa_sse2]   = { "sse2",   row_to_planes_sse2,   row_to_hwc_sse2 },
+	[img_preproc_isa_avx2]   = { "avx2",   row_to_planes_avx2,   row_to_hwc_avx2 },
+	[img_preproc_isa_avx512] = { "avx512", row_to_planes_avx512, row_to_hwc_avx512 },
+#endif
+};
+
+static int g_isa = img_preproc_isa_auto;
+
+static enum img_preproc_isa detect_isa(void)
+{
+#ifdef IMG_PREPROC_X86
+	__builtin_cpu_init();	// cpuid (+ xgetbv for the os support of the avx / avx512 states)
+	if(__builtin_cpu_supports("avx512f")) return img_preproc_isa_avx512;
+	if(__builtin_cpu_supports("avx2")) return img_preproc_isa_avx2;
+	if(__builtin_cpu_supports("sse2")) return img_preproc_isa_sse2;
+#endif
+	return img_preproc_isa_scalar;
+}
+
+enum img_preproc_isa img_preproc_get_isa(void)
+{
+	int isa = __atomic_load_n(&g_isa, __ATOMIC_RELAXED);
+	if(isa < 0) {
+		isa = detect_isa();
+		__atomic_store_n(&g_isa, isa, __ATOMIC_RELAXED);
+	}
+	return isa;
+}
+
+enum img_preproc_isa img_preproc_set_isa(enum img_preproc_isa isa)
+{
+	int max_isa = detect_isa();
+	if(isa < 0 || isa > max_isa) isa = max_isa;
+	__atomic_store_n(&g_isa, isa, __ATOMIC_RELAXED);
+	return isa;
+}
+
+const char * img_preproc_isa_to_string(enum img_preproc_isa isa)
+{
+	if(isa < 0 || isa >= img_preproc_isas_count || NULL == s_kernels[isa].name) return "unknown";
+	return s_kernels[isa].name;
+}
+
+/******************************************************************************
+ * public API
+ *****************************************************************************/
+static void row_to_f32_mean_image(const unsigned char * src, int width,
+	float * planes[3], ssize_t planes_offset, float * hwc,
+	const float * mean_image, const struct preproc_kernel_params * kp, int swap_rb)
+{
+	// mean_image is in the output channel order
+	const int out_to_src[3] = { swap_rb?2:0, 1, swap_rb?0:2 };
+	for(int col = 0; col < width; ++col, src += 4, mean_image += 3)
+	{
+		for(int c = 0; c < 3; ++c) {
+			int s = out_to_src[c];
+			float value = ((float)src[s] - mean_image[c]) * kp->k[s];
+			if(hwc) hwc[col * 3 + c] = value;
+			else planes[s][planes_offset + col] = value;
+		}
+	}
+}
+
+static void init_kernel_params(struct preproc_kernel_params * kp, const struct img_preproc_params * params)
+{
+	const int rgb_order = (params->channel_order != img_preproc_channel_order_bgr);
+
+	// output channel c ==> source channel (rgb: r = 2, g = 1, b = 0)
+	memset(kp, 0, sizeof(*kp));
+	kp->swap_rb = rgb_order;
+	float scale = (params->scale == 0.0f)?1.0f:params->scale;
+	for(int c = 0; c < 3; ++c) {
+		int s = rgb_order?(2 - c):c;
+		float std = (params->std[c] == 0.0f)?1.0f:params->std[c];
+		kp->mean[s] = params->mean[c];
+		kp->k[s] = scale / std;
+	}
+}
+
+int img_preproc_bgra_to_f32(const bgra_image_t * src, float * dst, const struct img_preproc_params * params)
+{
+	static const struct img_preproc_params default_params = { .scale = 1.0f };
+	assert(src && src->data && dst);
+	if(src->width <= 0 || src->height <= 0) return -1;
+	if(NULL == params) params = &default_params;
+
+	const int width = src->width;
+	const int height = src->height;
+	const ssize_t stride = bgra_image_stride(src);
+	const ssize_t size = (ssize_t)width * (ssize_t)height;
+	const int rgb_order = (params->channel_order != img_preproc_channel_order_bgr);
+
+	struct preproc_kernel_params kp;
+	init_kernel_params(&kp, params);
+
+	// source channel s ==> plane
+	float * planes[3] = { NULL };
+	for(int s = 0; s < 3; ++s) planes[s] = dst + size * (rgb_order?(2 - s):s);
+
+	const int nhwc = (params->layout == img_preproc_layout_nhwc);
+	if(params->mean_image) {
+		for(int row = 0; row < height; ++row) {
+			ssize_t offset = (ssize_t)row * width;
+			row_to_f32_mean_image(src->data + row * stride, width,
+				planes, offset, nhwc?(dst + offset * 3):NULL,
+				params->mean_image + offset * 3, &kp, rgb_order);
+		}
+		return 0;
+	}
+
+	enum img_preproc_isa isa = img_preproc_get_isa();
+	if(nhwc) {
+		row_to_hwc_func to_hwc = s_kernels[isa].to_hwc;
+		for(int row = 0; row < height; ++row) {
+			to_hwc(src->data + row * stride, width, dst + (ssize_t)row * width * 3, &kp);
+		}
+		return 0;
+	}
+
+	row_to_planes_func to_planes = s_kernels[isa].to_planes;
+	for(int row = 0; row < height; ++row) {
+		ssize_t offset = (ssize_t)row * width;
+		float * row_planes[3] = { planes[0] + offset, planes[1] + offset, planes[2] + offset };
+		to_planes(src->data + row * stride, width, row_planes, &kp);
+	}
+	return 0;
+}
+
+
+/******************************************************************************
+ * yuv ==> float32, fused with a bilinear resize
+ *****************************************************************************/
+struct yuv_coeffs
+{
+	float y_offset, y_scale;		// y' = (y - y_offset) * y_scale
+	float r_v, g_u, g_v, b_u;		// r = y' + r_v * v', g = y' + g_u * u' + g_v * v', b = y' + b_u * u'
+};
+
+static const struct yuv_coeffs s_yuv_coeffs[] = {
+	[yuv_image_matrix_bt601] = { 16.0f, 255.0f / 219.0f, 1.596027f, -0.391762f, -0.812968f, 2.017232f },
+	[yuv_image_matrix_bt709] = { 16.0f, 255.0f / 219.0f, 1.792741f, -0.213249f, -0.532909f, 2.112402f },
+};
+
+// bilinear taps, pixel centers are aligned: src_x = (dst_x + 0.5) * src_size / dst_size - 0.5
+struct bilinear_tap
+{
+	int x0, x1;
+	float w1;	// weight of x1
+};
+
+static inline void bilinear_tap_init(struct bilinear_tap * tap, int dst_index, int dst_size, int src_size)
+{
+	double x = (dst_index + 0.5) * (double)src_size / (double)dst_size - 0.5;
+	if(x < 0) x = 0;
+	int x0 = (int)x;
+	if(x0 > src_size - 1) x0 = src_size - 1;
+	tap->x0 = x0;
+	tap->x1 = (x0 + 1 < src_size)?(x0 + 1):x0;
+	tap->w1 = (tap->x1 == x0)?0.0f:(float)(x - x0);
+}
+
+static void init_bilinear_taps(struct bilinear_tap * taps, int dst_size, int src_size)
+{
+	for(int i = 0; i < dst_size; ++i) bilinear_tap_init(&taps[i], i, dst_size, src_size);
+}
+
+static inline float bilinear_sample(const unsigned char * row0, const unsigned char * row1, float wy,
+	const struct bilinear_tap * tap, int pixel_step)
+{
+	float top = row0[tap->x0 * pixel_step] + (row0[tap->x1 * pixel_step] - row0[tap->x0 * pixel_step]) * tap->w1;
+	float bottom = row1[tap->x0 * pixel_step] + (row1[tap->x1 * pixel_step] - row1[tap->x0 * pixel_step]) * tap->w1;
+	return top + (bottom - top) * wy;
+}
+
+/*
+ * (y, u, v) rows of resampled samples ==> bgra order planes (planes[s]: b = 0, g = 1, r = 2) or nhwc
+ *   rgb values are clamped to [0, 255] like an 8-bit conversion would do, but not rounded.
+ */
+typedef void (* yuv_row_func)(const float * y, const float * u, const float * v, int width,
+	const struct yuv_coeffs * yc, const struct preproc_kernel_params * kp, float * planes[3], float * hwc);
+
+static void yuv_row_scalar(const float * y, const float * u, const float * v, int width,
+	const struct yuv_coeffs * yc, const struct preproc_kernel_params * kp, float * planes[3], float * hwc)
+{
+	const int c0 = kp->swap_rb?2:0;
+	const int c2 = kp->swap_rb?0:2;
+	for(int col = 0; col < width; ++col)
+	{
+		float bgr[3];
+		float luma = (y[col] - yc->y_offset) * yc->y_scale;
+		if(u) {
+			float cb = u[col] - 128.0f, cr = v[col] - 128.0f;
+			bgr[0] = luma + yc->b_u * cb;
+			bgr[1] = luma + yc->g_u * cb + yc->g_v * cr;
+			bgr[2] = luma + yc->r_v * cr;
+		}else {
+			bgr[0] = bgr[1] = bgr[2] = y[col];	// gray8: full range
+		}
+		for(int s = 0; s < 3; ++s) {
+			float value = bgr[s];
+			if(value < 0.0f) value = 0.0f;
+			if(value > 255.0f) value = 255.0f;
+			bgr[s] = (value - kp->mean[s]) * kp->k[s];
+		}
+		if(hwc) {
+			hwc[col * 3 + 0] = bgr[c0];
+			hwc[col * 3 + 1] = bgr[1];
+			hwc[col * 3 + 2] = bgr[c2];
+		}else {
+			planes[0][col] = bgr[0];
+			planes[1][col] = bgr[1];
+			planes[2][col] = bgr[2];
+		}
+	}
+}
+
+#ifdef IMG_PREPROC_X86
+__attribute__((target("sse2")))
+static void yuv_row_sse2(const float * y, const float * u, const float * v, int width,
+	const struct yuv_coeffs * yc, const struct preproc_kernel_params * kp, float * planes[3], float * hwc)
+{
+	if(hwc || NULL == u) {	// nhwc and gray8 are memory bound, the scalar code is enough
+		yuv_row_scalar(y, u, v, width, yc, kp, planes, hwc);
+		return;
+	}
+	const __m128 zero = _mm_setzero_ps(), max_value = _mm_set1_ps(255.0f), bias = _mm_set1_ps(128.0f);
+	const __m128 y_offset = _mm_set1_ps(yc->y_offset), y_scale = _mm_set1_ps(yc->y_scale);
+	const __m128 r_v = _mm_set1_ps(yc->r_v), g_u = _mm_set1_ps(yc->g_u), g_v = _mm_set1_ps(yc->g_v), b_u = _mm_set1_ps(yc->b_u);
+	const __m128 m0 = _mm_set1_ps(kp->mean[0]), k0 = _mm_set1_ps(kp->k[0]);
+	const __m128 m1 = _mm_set1_ps(kp->mean[1]), k1 = _mm_set1_ps(kp->k[1]);
+	const __m128 m2 = _mm_set1_ps(kp->mean[2]), k2 = _mm_set1_ps(kp->k[2]);
+
+	int col = 0;
+	for(; (col + 4) <= width; col += 4)
+	{
+		__m128 luma = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(y + col), y_offset), y_scale);
+		__m128 cb = _mm_sub_ps(_mm_loadu_ps(u + col), bias);
+		__m128 cr = _mm_sub_ps(_mm_loadu_ps(v + col), bias);
+		__m128 b = _mm_add_ps(luma, _mm_mul_ps(b_u, cb));
+		__m128 g = _mm_add_ps(_mm_add_ps(luma, _mm_mul_ps(g_u, cb)), _mm_mul_ps(g_v, cr));
+		__m128 r = _mm_add_ps(luma, _mm_mul_ps(r_v, cr));
+		b = _mm_min_ps(_mm_max_ps(b, zero), max_value);
+		g = _mm_min_ps(_mm_max_ps(g, zero), max_value);
+		r = _mm_min_ps(_mm_max_ps(r, zero), max_value);
+		_mm_storeu_ps(planes[0] + col, _mm_mul_ps(_mm_sub_ps(b, m0), k0));
+		_mm_storeu_ps(planes[1] + col, _mm_mul_ps(_mm_sub_ps(g, m1), k1));
+		_mm_storeu_ps(planes[2] + col, _mm_mul_ps(_mm_sub_ps(r, m2), k2));
+	}
+	if(col < width) {
+		float * tail[3] = { planes[0] + col, planes[1] + col, planes[2] + col };
+		yuv_row_scalar(y + col, u + col, v + col, width - col, yc, kp, tail, NULL);
+	}
+}
+#endif
+
+int img_preproc_yuv_to_f32_resized(const yuv_image_t * src, float * dst, int dst_width, int dst_height,
+	const struct bgra_image_letterbox * roi, const struct img_preproc_params * params)
+{
+	static const struct img_preproc_params default_params = { .scale = 1.0f };
+	assert(src && src->planes[0] && dst);
+	if(src->width <= 0 || src->height <= 0 || dst_width <= 0 || dst_height <= 0) return -1;
+	if(src->format != yuv_image_format_gray8 && (NULL == src->planes[1]
+		|| (src->format == yuv_image_format_i420 && NULL == src->planes[2]))) return -1;
+	if(NULL == params) params = &default_params;
+	if(params->mean_image) return -1;	// bgra only
+
+	int roi_x = 0, roi_y = 0, roi_width = dst_width, roi_height = dst_height;
+	if(roi) {
+		roi_x = roi->x; roi_y = roi->y;
+		roi_width = roi->width; roi_height = roi->height;
+		if(roi_x < 0 || roi_y < 0 || roi_width < 1 || roi_height < 1
+			|| (roi_x + roi_width) > dst_width || (roi_y + roi_height) > dst_height) return -1;
+	}
+
+	struct preproc_kernel_params kp;
+	init_kernel_params(&kp, params);
+	const int rgb_order = kp.swap_rb;
+	const int nhwc = (params->layout == img_preproc_layout_nhwc);
+	const ssize_t plane_size = (ssize_t)dst_width * dst_height;
+	const struct yuv_coeffs * yc = &s_yuv_coeffs[(src->matrix == yuv_image_matrix_bt709)?yuv_image_matrix_bt709:yuv_image_matrix_bt601];
+
+	yuv_row_func yuv_row = yuv_row_scalar;
+#ifdef IMG_PREPROC_X86
+	if(img_preproc_get_isa() >= img_preproc_isa_sse2) yuv_row = yuv_row_sse2;
+#endif
+
+	const int has_chroma = (src->format != yuv_image_format_gray8);
+	const int chroma_width = (src->width + 1) / 2;
+	const int chroma_height = (src->height + 1) / 2;
+	const int chroma_step = (src->format == yuv_image_format_nv12)?2:1;
+
+	struct bilinear_tap * taps = calloc(roi_width * 2, sizeof(*taps));
+	float * rows = calloc(roi_width * 3, sizeof(*rows));
+	assert(taps && rows);
+	struct bilinear_tap * chroma_taps = taps + roi_width;
+	init_bilinear_taps(taps, roi_width, src->width);
+	if(has_chroma) init_bilinear_taps(chroma_taps, roi_width, chroma_width);
+
+	struct bilinear_tap row_tap, chroma_row_tap;
+	float * y_row = rows, * u_row = rows + roi_width, * v_row = rows + roi_width * 2;
+	for(int row = 0; row < roi_height; ++row)
+	{
+		bilinear_tap_init(&row_tap, row, roi_height, src->height);
+
+		const unsigned char * y0 = src->planes[0] + (ssize_t)row_tap.x0 * src->strides[0];
+		const unsigned char * y1 = src->planes[0] + (ssize_t)row_tap.x1 * src->strides[0];
+		for(int col = 0; col < roi_width; ++col) y_row[col] = bilinear_sample(y0, y1, row_tap.w1, &taps[col], 1);
+
+		if(has_chroma) {
+			bilinear_tap_init(&chroma_row_tap, row, roi_height, chroma_height);
+			const float wy = chroma_row_tap.w1;
+
+			const unsigned char * u0 = src->planes[1] + (ssize_t)chroma_row_tap.x0 * src->strides[1];
+			const unsigned char * u1 = src->planes[1] + (ssize_t)chroma_row_tap.x1 * src->strides[1];
+			const unsigned char * v0 = NULL, * v1 = NULL;
+			if(src->format == yuv_image_format_nv12) {
+				v0 = u0 + 1; v1 = u1 + 1;
+			}else {
+				v0 = src->planes[2] + (ssize_t)chroma_row_tap.x0 * src->strides[2];
+				v1 = src->planes[2] + (ssize_t)chroma_row_tap.x1 * src->strides[2];
+			}
+			for(int col = 0; col < roi_width; ++col) {
+				u_row[col] = bilinear_sample(u0, u1, wy, &chroma_taps[col], chroma_step);
+				v_row[col] = bilinear_sample(v0, v1, wy, &chroma_taps[col], chroma_step);
+			}
+		}
+
+		ssize_t offset = (ssize_t)(roi_y + row) * dst_width + roi_x;
+		if(nhwc) {
+			yuv_row(y_row, has_chroma?u_row:NULL, has_chroma?v_row:NULL, roi_width, yc, &kp, NULL, dst + offset * 3);
+		}else {
+			// source channel s ==> plane
+			float * planes[3];
+			for(int s = 0; s < 3; ++s) planes[s] = dst + plane_size * (rgb_order?(2 - s):s) + offset;
+			yuv_row(y_row, has_chroma?u_row:NULL, has_chroma?v_row:NULL, roi_width, yc, &kp, planes, NULL);
+		}
+	}
+	free(taps);
+	free(rows);
+	return 0;
+}
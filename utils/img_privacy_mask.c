@@ -0,0 +1,649 @@
+/*
+ * img_privacy_mask.c
+ *
+ * Copyright 2022 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "utils.h"
+#include "img_privacy_mask.h"
+
+#define MAX_BLOCK_SIZE (128)	// the block sums stay exact in a float, (128 * 128 * 255 < 2^24)
+
+/******************************************************************************
+ * building blocks
+ *
+ *   means: (float)sum * (1.0f / n) + 0.5f, truncated;
+ *   the sse2 and scalar kernels evaluate the same float expression, the results are identical.
+ *****************************************************************************/
+static inline uint32_t normalize_sums(const uint32_t sums[4], float scale)
+{
+	uint32_t pixel = 0;
+	for(int c = 0; c < 4; ++c) pixel |= (uint32_t)((float)sums[c] * scale + 0.5f) << (c * 8);
+	return pixel;
+}
+
+static inline void add_pixel(uint32_t sums[4], uint32_t pixel, uint32_t times)
+{
+	for(int c = 0; c < 4; ++c) sums[c] += ((pixel >> (c * 8)) & 0xff) * times;
+}
+
+static inline void sub_pixel(uint32_t sums[4], uint32_t pixel)
+{
+	for(int c = 0; c < 4; ++c) sums[c] -= (pixel >> (c * 8)) & 0xff;
+}
+
+#if defined(__SSE2__)
+static inline __m128i load_pixel_epi32(const uint32_t * pixel)
+{
+	const __m128i zero = _mm_setzero_si128();
+	return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*pixel), zero), zero);
+}
+
+static inline uint32_t normalize_epi32(__m128i sums, __m128 scale)
+{
+	__m128i v = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sums), scale), _mm_set1_ps(0.5f)));
+	v = _mm_packs_epi32(v, v);
+	return _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+}
+#endif
+
+static void fill_pixels(uint32_t * dst, int count, uint32_t color)
+{
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128i color4 = _mm_set1_epi32(color);
+	for(; (i + 4) <= count; i += 4) _mm_storeu_si128((__m128i *)(dst + i), color4);
+#endif
+	for(; i < count; ++i) dst[i] = color;
+}
+
+void img_privacy_mask_sum_span_scalar(const uint32_t * src, int count, uint32_t sums[4])
+{
+	for(int i = 0; i < count; ++i) add_pixel(sums, src[i], 1);
+}
+
+void img_privacy_mask_sum_span(const uint32_t * src, int count, uint32_t sums[4])
+{
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	for(; (i + 4) <= count; i += 4) {
+		__m128i d = _mm_loadu_si128((__m128i *)(src + i));
+		__m128i s = _mm_add_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpackhi_epi8(d, zero));	// (p0 + p2, p1 + p3)
+		acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(s, zero));
+		acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(s, zero));
+	}
+	uint32_t acc4[4];
+	_mm_storeu_si128((__m128i *)acc4, acc);
+	for(int c = 0; c < 4; ++c) sums[c] += acc4[c];
+#endif
+	for(; i < count; ++i) add_pixel(sums, src[i], 1);
+}
+
+/*
+ * box blur, two passes over a packed buffer:
+ *   horizontal: a running sum along each row, (pixels ==> scratch)
+ *   vertical:   a running sum per column, the rows are visited in order, (scratch ==> pixels)
+ */
+static void blur_rows_scalar(const uint32_t * src, uint32_t * dst, int width, int height, int radius)
+{
+	const float scale = 1.0f / (float)(2 * radius + 1);
+	for(int y = 0; y < height; ++y) {
+		const uint32_t * line = src + (size_t)y * width;
+		uint32_t * out = dst + (size_t)y * width;
+		uint32_t sums[4] = { 0 };
+		add_pixel(sums, line[0], radius + 1);
+		for(int k = 1; k <= radius; ++k) add_pixel(sums, line[(k < width)?k:(width - 1)], 1);
+
+		for(int x = 0; x < width; ++x) {
+			out[x] = normalize_sums(sums, scale);
+			int next = x + radius + 1, prev = x - radius;
+			add_pixel(sums, line[(next < width)?next:(width - 1)], 1);
+			sub_pixel(sums, line[(prev > 0)?prev:0]);
+		}
+	}
+}
+
+static void blur_columns_scalar(const uint32_t * src, uint32_t * dst, int width, int height, int radius, uint32_t * sums)
+{
+	const float scale = 1.0f / (float)(2 * radius + 1);
+	memset(sums, 0, sizeof(*sums) * width * 4);
+	for(int x = 0; x < width; ++x) add_pixel(&sums[x * 4], src[x], radius + 1);
+	for(int k = 1; k <= radius; ++k) {
+		const uint32_t * line = src + (size_t)((k < height)?k:(height - 1)) * width;
+		for(int x = 0; x < width; ++x) add_pixel(&sums[x * 4], line[x], 1);
+	}
+
+	for(int y = 0; y < height; ++y) {
+		int next = y + radius + 1, prev = y - radius;
+		const uint32_t * next_line = src + (size_t)((next < height)?next:(height - 1)) * width;
+		const uint32_t * prev_line = src + (size_t)((prev > 0)?prev:0) * width;
+		uint32_t * out = dst + (size_t)y * width;
+		for(int x = 0; x < width; ++x) {
+			out[x] = normalize_sums(&sums[x * 4], scale);
+			add_pixel(&sums[x * 4], next_line[x], 1);
+			sub_pixel(&sums[x * 4], prev_line[x]);
+		}
+	}
+}
+
+#if defined(__SSE2__)
+static void blur_rows(const uint32_t * src, uint32_t * dst, int width, int height, int radius)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / (float)(2 * radius + 1));
+	for(int y = 0; y < height; ++y) {
+		const uint32_t * line = src + (size_t)y * width;
+		uint32_t * out = dst + (size_t)y * width;
+		__m128i first = load_pixel_epi32(&line[0]);
+		__m128i sums = _mm_setzero_si128();
+		for(int k = 0; k <= radius; ++k) sums = _mm_add_epi32(sums, first);
+		for(int k = 1; k <= radius; ++k) sums = _mm_add_epi32(sums, load_pixel_epi32(&line[(k < width)?k:(width - 1)]));
+
+		for(int x = 0; x < width; ++x) {
+			out[x] = normalize_epi32(sums, scale);
+			int next = x + radius + 1, prev = x - radius;
+			sums = _mm_add_epi32(sums, load_pixel_epi32(&line[(next < width)?next:(width - 1)]));
+			sums = _mm_sub_epi32(sums, load_pixel_epi32(&line[(prev > 0)?prev:0]));
+		}
+	}
+}
+
+static void blur_columns(const uint32_t * src, uint32_t * dst, int width, int height, int radius, uint32_t * sums_buffer)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / (float)(2 * radius + 1));
+	__m128i * sums = (__m128i *)sums_buffer;	// one (b, g, r, a) sum per column, (unaligned access)
+	for(int x = 0; x < width; ++x) {
+		__m128i first = load_pixel_epi32(&src[x]);
+		__m128i sum = _mm_setzero_si128();
+		for(int k = 0; k <= radius; ++k) sum = _mm_add_epi32(sum, first);
+		for(int k = 1; k <= radius; ++k) sum = _mm_add_epi32(sum, load_pixel_epi32(&src[(size_t)((k < height)?k:(height - 1)) * width + x]));
+		_mm_storeu_si128(&sums[x], sum);
+	}
+
+	for(int y = 0; y < height; ++y) {
+		int next = y + radius + 1, prev = y - radius;
+		const uint32_t * next_line = src + (size_t)((next < height)?next:(height - 1)) * width;
+		const uint32_t * prev_line = src + (size_t)((prev > 0)?prev:0) * width;
+		uint32_t * out = dst + (size_t)y * width;
+		for(int x = 0; x < width; ++x) {
+			__m128i sum = _mm_loadu_si128(&sums[x]);
+			out[x] = normalize_epi32(sum, scale);
+			sum = _mm_add_epi32(sum, load_pixel_epi32(&next_line[x]));
+			sum = _mm_sub_epi32(sum, load_pixel_epi32(&prev_line[x]));
+			_mm_storeu_si128(&sums[x], sum);
+		}
+	}
+}
+#else
+#define blur_rows blur_rows_scalar
+#define blur_columns blur_columns_scalar
+#endif
+
+void img_privacy_mask_box_blur_scalar(uint32_t * pixels, int width, int height, int radius, uint32_t * scratch)
+{
+	if(NULL == pixels || width <= 0 || height <= 0 || radius <= 0) return;
+	assert(scratch);
+	blur_rows_scalar(pixels, scratch, width, height, radius);
+	blur_columns_scalar(scratch, pixels, width, height, radius, scratch + (size_t)width * height);
+}
+
+void img_privacy_mask_box_blur(uint32_t * pixels, int width, int height, int radius, uint32_t * scratch)
+{
+	if(NULL == pixels || width <= 0 || height <= 0 || radius <= 0) return;
+	assert(scratch);
+	blur_rows(pixels, scratch, width, height, radius);
+	blur_columns(scratch, pixels, width, height, radius, scratch + (size_t)width * height);
+}
+
+/******************************************************************************
+ * params
+ *****************************************************************************/
+enum img_privacy_mask_mode img_privacy_mask_mode_from_string(const char * mode)
+{
+	if(NULL == mode) return img_privacy_mask_mode_pixelate;
+	if(strcasecmp(mode, "blur") == 0) return img_privacy_mask_mode_blur;
+	if(strcasecmp(mode, "fill") == 0) return img_privacy_mask_mode_fill;
+	return img_privacy_mask_mode_pixelate;
+}
+
+static int load_region(struct img_privacy_mask_region * region, json_object * jpoints)
+{
+	int count = json_object_array_length(jpoints);
+	if(count < 3 || count > IMG_PRIVACY_MASK_MAX_POINTS) return -1;
+
+	for(int i = 0; i < count; ++i) {
+		json_object * jpoint = json_object_array_get_idx(jpoints, i);
+		if(NULL == jpoint || json_object_array_length(jpoint) < 2) return -1;
+		region->points[i].x = json_object_get_double(json_object_array_get_idx(jpoint, 0));
+		region->points[i].y = json_object_get_double(json_object_array_get_idx(jpoint, 1));
+	}
+	region->num_points = count;
+	return 0;
+}
+
+void img_privacy_mask_params_load(struct img_privacy_mask_params * params, json_object * jconfig)
+{
+	assert(params);
+	memset(params, 0, sizeof(*params));
+	params->mode = img_privacy_mask_mode_pixelate;
+	params->blur_passes = 2;
+	params->padding = 0.1;
+	params->min_confidence = 0.25;
+	params->num_classes = 1;
+	strncpy(params->classes[0], "face", sizeof(params->classes[0]) - 1);
+	if(NULL == jconfig) return;
+
+	params->enabled = json_get_value_default(jconfig, int, enabled, 1);
+	params->mode = img_privacy_mask_mode_from_string(json_get_value(jconfig, string, mode));
+	params->block_size = json_get_value_default(jconfig, int, block_size, 0);
+	params->blur_radius = json_get_value_default(jconfig, int, blur_radius, 0);
+	params->blur_passes = json_get_value_default(jconfig, int, blur_passes, 2);
+	params->padding = json_get_value_default(jconfig, double, padding, 0.1);
+	params->min_confidence = json_get_value_default(jconfig, double, min_confidence, 0.25);
+
+	const char * color = json_get_value(jconfig, string, color);
+	if(color) params->color = (uint32_t)strtoul(color, NULL, 0) & 0xffffff;
+
+	if(params->block_size < 0) params->block_size = 0;
+	if(params->block_size > MAX_BLOCK_SIZE) params->block_size = MAX_BLOCK_SIZE;
+	if(params->blur_passes < 1) params->blur_passes = 1;
+	if(params->padding < 0) params->padding = 0;
+
+	json_object * jclasses = NULL;
+	json_bool ok = json_object_object_get_ex(jconfig, "classes", &jclasses);
+	if(ok && jclasses) {
+		params->num_classes = 0;
+		int count = json_object_array_length(jclasses);
+		for(int i = 0; i < count && params->num_classes < IMG_PRIVACY_MASK_MAX_CLASSES; ++i) {
+			const char * name = json_object_get_string(json_object_array_get_idx(jclasses, i));
+			if(NULL == name || !name[0]) continue;
+			strncpy(params->classes[params->num_classes++], name, sizeof(params->classes[0]) - 1);
+		}
+	}
+
+	json_object * jregions = NULL;
+	ok = json_object_object_get_ex(jconfig, "regions", &jregions);
+	if(ok && jregions) {
+		int count = json_object_array_length(jregions);
+		for(int i = 0; i < count && params->num_regions < IMG_PRIVACY_MASK_MAX_REGIONS; ++i) {
+			json_object * jpoints = json_object_array_get_idx(jregions, i);
+			if(NULL == jpoints || load_region(&params->regions[params->num_regions], jpoints)) {
+				fprintf(stderr, "[WARNING]::%s(): invalid region %d, (3 ~ %d points)\n", __FUNCTION__, i, IMG_PRIVACY_MASK_MAX_POINTS);
+				continue;
+			}
+			++params->num_regions;
+		}
+	}
+}
+
+/******************************************************************************
+ * img_privacy_mask
+ *****************************************************************************/
+struct privacy_mask_private
+{
+	uint32_t * buffer;		// blur: region + scratch, pixelate: block means
+	size_t size;
+	double * crossings;		// polygon edges crossing a row
+	int max_crossings;
+};
+
+static uint32_t * reserve_buffer(struct privacy_mask_private * priv, size_t size)
+{
+	if(size > priv->size) {
+		uint32_t * buffer = realloc(priv->buffer, size * sizeof(*buffer));
+		assert(buffer);
+		priv->buffer = buffer;
+		priv->size = size;
+	}
+	return priv->buffer;
+}
+
+/*
+ * a shape: the bounding box, (clipped to the image), plus the polygon in pixels, (NULL: the box itself)
+ *   every mode visits the rows of the box and writes only the spans of the shape.
+ */
+struct mask_shape
+{
+	int x, y, width, height;
+	const struct img_privacy_mask_point * points;
+	int num_points;
+};
+
+static int shape_row_spans(struct privacy_mask_private * priv, const struct mask_shape * shape, int y, int * spans)
+{
+	if(NULL == shape->points) {
+		spans[0] = shape->x;
+		spans[1] = shape->x + shape->width;
+		return 1;
+	}
+
+	// even-odd rule at the pixel centers
+	double yc = y + 0.5;
+	int count = 0;
+	double * crossings = priv->crossings;
+	for(int i = 0, j = shape->num_points - 1; i < shape->num_points; j = i++) {
+		const struct img_privacy_mask_point * a = &shape->points[i];
+		const struct img_privacy_mask_point * b = &shape->points[j];
+		if((a->y > yc) == (b->y > yc)) continue;
+
+		double x = b->x + (yc - b->y) * (a->x - b->x) / (a->y - b->y);
+		int k = count++;
+		for(; k > 0 && crossings[k - 1] > x; --k) crossings[k] = crossings[k - 1];
+		crossings[k] = x;
+	}
+
+	int num_spans = 0;
+	int left_edge = shape->x, right_edge = shape->x + shape->width;
+	for(int i = 0; (i + 1) < count; i += 2) {
+		int left = (int)ceil(crossings[i] - 0.5);
+		int right = (int)ceil(crossings[i + 1] - 0.5);
+		if(left < left_edge) left = left_edge;
+		if(right > right_edge) right = right_edge;
+		if(right <= left) continue;
+		spans[num_spans * 2] = left;
+		spans[num_spans * 2 + 1] = right;
+		++num_spans;
+	}
+	return num_spans;
+}
+
+static inline int auto_size(const struct mask_shape * shape, int size, int divisor, int min_size)
+{
+	if(size > 0) return size;
+	int side = (shape->width < shape->height)?shape->width:shape->height;
+	size = side / divisor;
+	return (size < min_size)?min_size:size;
+}
+
+static void mask_fill(img_privacy_mask_t * mask, bgra_image_t * image, const struct mask_shape * shape, int * spans)
+{
+	struct privacy_mask_private * priv = mask->priv;
+	int stride = bgra_image_stride(image);
+	uint32_t color = mask->params->color | 0xff000000;
+	for(int y = shape->y; y < shape->y + shape->height; ++y) {
+		uint32_t * line = (uint32_t *)(image->data + (size_t)y * stride);
+		int num_spans = shape_row_spans(priv, shape, y, spans);
+		for(int i = 0; i < num_spans; ++i) fill_pixels(line + spans[i * 2], spans[i * 2 + 1] - spans[i * 2], color);
+	}
+}
+
+static void mask_pixelate(img_privacy_mask_t * mask, bgra_image_t * image, const struct mask_shape * shape, int * spans)
+{
+	struct privacy_mask_private * priv = mask->priv;
+	int stride = bgra_image_stride(image);
+	int block_size = auto_size(shape, mask->params->block_size, 6, 4);
+	if(block_size > MAX_BLOCK_SIZE) block_size = MAX_BLOCK_SIZE;
+
+	// blocks are aligned to the bounding box, the means cover the whole box, (the polygon only selects the output)
+	int num_blocks = (shape->width + block_size - 1) / block_size;
+	uint32_t * means = reserve_buffer(priv, num_blocks);
+
+	for(int block_y = shape->y; block_y < shape->y + shape->height; block_y += block_size) {
+		int block_height = shape->y + shape->height - block_y;
+		if(block_height > block_size) block_height = block_size;
+
+		for(int b = 0; b < num_blocks; ++b) {
+			int x = shape->x + b * block_size;
+			int block_width = shape->x + shape->width - x;
+			if(block_width > block_size) block_width = block_size;
+
+			uint32_t sums[4] = { 0 };
+			for(int y = block_y; y < block_y + block_height; ++y) {
+				img_privacy_mask_sum_span((uint32_t *)(image->data + (size_t)y * stride) + x, block_width, sums);
+			}
+			means[b] = normalize_sums(sums, 1.0f / (float)(block_width * block_height));
+		}
+
+		for(int y = block_y; y < block_y + block_height; ++y) {
+			uint32_t * line = (uint32_t *)(image->data + (size_t)y * stride);
+			int num_spans = shape_row_spans(priv, shape, y, spans);
+			for(int i = 0; i < num_spans; ++i) {
+				for(int x = spans[i * 2]; x < spans[i * 2 + 1]; ) {
+					int b = (x - shape->x) / block_size;
+					int end = shape->x + (b + 1) * block_size;
+					if(end > spans[i * 2 + 1]) end = spans[i * 2 + 1];
+					fill_pixels(line + x, end - x, means[b]);
+					x = end;
+				}
+			}
+		}
+	}
+}
+
+static void mask_blur(img_privacy_mask_t * mask, bgra_image_t * image, const struct mask_shape * shape, int * spans)
+{
+	struct privacy_mask_private * priv = mask->priv;
+	int stride = bgra_image_stride(image);
+	int radius = auto_size(shape, mask->params->blur_radius, 8, 2);
+	int width = shape->width, height = shape->height;
+
+	// the box is blurred in a packed copy, then only the spans of the shape are copied back
+	size_t region_size = (size_t)width * height;
+	uint32_t * region = reserve_buffer(priv, region_size * 2 + (size_t)width * 4);
+	uint32_t * scratch = region + region_size;
+	for(int y = 0; y < height; ++y) {
+		memcpy(region + (size_t)y * width, image->data + (size_t)(shape->y + y) * stride + shape->x * 4, width * 4);
+	}
+	for(int pass = 0; pass < mask->params->blur_passes; ++pass) img_privacy_mask_box_blur(region, width, height, radius, scratch);
+
+	for(int y = shape->y; y < shape->y + shape->height; ++y) {
+		uint32_t * line = (uint32_t *)(image->data + (size_t)y * stride);
+		const uint32_t * blurred = region + (size_t)(y - shape->y) * width - shape->x;
+		int num_spans = shape_row_spans(priv, shape, y, spans);
+		for(int i = 0; i < num_spans; ++i) {
+			memcpy(line + spans[i * 2], blurred + spans[i * 2], (spans[i * 2 + 1] - spans[i * 2]) * 4);
+		}
+	}
+}
+
+static int mask_shape(img_privacy_mask_t * mask, bgra_image_t * image, const struct mask_shape * shape)
+{
+	struct privacy_mask_private * priv = mask->priv;
+	if(shape->width <= 0 || shape->height <= 0) return -1;
+
+	int spans_buffer[2 + IMG_PRIVACY_MASK_MAX_POINTS];
+	int * spans = spans_buffer;
+	if(shape->points) {
+		if(shape->num_points > priv->max_crossings) {
+			double * crossings = realloc(priv->crossings, shape->num_points * sizeof(*crossings));
+			assert(crossings);
+			priv->crossings = crossings;
+			priv->max_crossings = shape->num_points;
+		}
+		if(shape->num_points > IMG_PRIVACY_MASK_MAX_POINTS) {
+			spans = malloc((shape->num_points + 2) * sizeof(*spans));
+			assert(spans);
+		}
+	}
+
+	switch(mask->params->mode) {
+	case img_privacy_mask_mode_blur: mask_blur(mask, image, shape, spans); break;
+	case img_privacy_mask_mode_fill: mask_fill(mask, image, shape, spans); break;
+	default: mask_pixelate(mask, image, shape, spans); break;
+	}
+
+	if(spans != spans_buffer) free(spans);
+	return 0;
+}
+
+static int clip_rect(const bgra_image_t * image, int * x, int * y, int * width, int * height)
+{
+	int left = (*x > 0)?*x:0;
+	int top = (*y > 0)?*y:0;
+	int right = ((*x + *width) < image->width)?(*x + *width):image->width;
+	int bottom = ((*y + *height) < image->height)?(*y + *height):image->height;
+	if(right <= left || bottom <= top) return -1;
+	*x = left; *y = top;
+	*width = right - left; *height = bottom - top;
+	return 0;
+}
+
+static int privacy_mask_rect(img_privacy_mask_t * mask, bgra_image_t * image, int x, int y, int width, int height)
+{
+	assert(mask && image && image->data);
+	if(clip_rect(image, &x, &y, &width, &height)) return -1;
+	struct mask_shape shape = { .x = x, .y = y, .width = width, .height = height };
+	return mask_shape(mask, image, &shape);
+}
+
+static int privacy_mask_polygon(img_privacy_mask_t * mask, bgra_image_t * image, const struct img_privacy_mask_point * points, int num_points)
+{
+	assert(mask && image && image->data);
+	if(NULL == points || num_points < 3) return -1;
+
+	double left = points[0].x, top = points[0].y, right = left, bottom = top;
+	for(int i = 1; i < num_points; ++i) {
+		if(points[i].x < left) left = points[i].x;
+		if(points[i].x > right) right = points[i].x;
+		if(points[i].y < top) top = points[i].y;
+		if(points[i].y > bottom) bottom = points[i].y;
+	}
+
+	int x = (int)floor(left), y = (int)floor(top);
+	int width = (int)ceil(right) - x, height = (int)ceil(bottom) - y;
+	if(clip_rect(image, &x, &y, &width, &height)) return -1;
+
+	struct mask_shape shape = { .x = x, .y = y, .width = width, .height = height, .points = points, .num_points = num_points };
+	return mask_shape(mask, image, &shape);
+}
+
+/*
+ * detections
+ */
+static int is_target_class(const struct img_privacy_mask_params * params, const char * class_name)
+{
+	if(params->num_classes <= 0) return 1;
+	if(NULL == class_name) return 0;
+	for(int i = 0; i < params->num_classes; ++i) {
+		if(strcasecmp(params->classes[i], class_name) == 0) return 1;
+	}
+	return 0;
+}
+
+static int is_target(const struct img_privacy_mask_params * params, json_object * jdet)
+{
+	if(NULL == jdet) return 0;
+	double confidence = json_get_value_default(jdet, double, confidence, 1.0);
+	if(confidence < params->min_confidence) return 0;
+	return is_target_class(params, json_get_value(jdet, string, class));
+}
+
+static ssize_t foreach_target(img_privacy_mask_t * mask, bgra_image_t * image, json_object * jresult)
+{
+	static const char * s_arrays[] = { "detections", "faces" };
+	const struct img_privacy_mask_params * params = mask->params;
+	ssize_t count = 0;
+
+	for(size_t a = 0; jresult && a < sizeof(s_arrays) / sizeof(s_arrays[0]); ++a) {
+		json_object * jdetections = NULL;
+		json_bool ok = json_object_object_get_ex(jresult, s_arrays[a], &jdetections);
+		if(!ok || NULL == jdetections) continue;
+
+		int num_detections = json_object_array_length(jdetections);
+		for(int i = 0; i < num_detections; ++i) {
+			json_object * jdet = json_object_array_get_idx(jdetections, i);
+			if(!is_target(params, jdet)) continue;
+			++count;
+			if(NULL == image) continue;
+
+			double left = json_get_value(jdet, double, left);
+			double top = json_get_value(jdet, double, top);
+			double width = json_get_value(jdet, double, width);
+			double height = json_get_value(jdet, double, height);
+			left -= width * params->padding;
+			top -= height * params->padding;
+			width *= 1.0 + 2.0 * params->padding;
+			height *= 1.0 + 2.0 * params->padding;
+
+			// (1e-6: rounding errors of the normalized values, e.g. 0.2 * 400)
+			int x = (int)floor(left * image->width + 1e-6);
+			int y = (int)floor(top * image->height + 1e-6);
+			privacy_mask_rect(mask, image, x, y,
+				(int)ceil((left + width) * image->width - 1e-6) - x,
+				(int)ceil((top + height) * image->height - 1e-6) - y);
+		}
+	}
+
+	count += params->num_regions;
+	for(int i = 0; image && i < params->num_regions; ++i) {
+		const struct img_privacy_mask_region * region = &params->regions[i];
+		struct img_privacy_mask_point points[IMG_PRIVACY_MASK_MAX_POINTS];
+		for(int k = 0; k < region->num_points; ++k) {
+			points[k].x = region->points[k].x * image->width;
+			points[k].y = region->points[k].y * image->height;
+		}
+		privacy_mask_polygon(mask, image, points, region->num_points);
+	}
+	return count;
+}
+
+static ssize_t privacy_mask_count_targets(img_privacy_mask_t * mask, json_object * jresult)
+{
+	return foreach_target(mask, NULL, jresult);
+}
+
+static ssize_t privacy_mask_apply(img_privacy_mask_t * mask, bgra_image_t * image, json_object * jresult)
+{
+	assert(mask && image && image->data);
+	return foreach_target(mask, image, jresult);
+}
+
+img_privacy_mask_t * img_privacy_mask_init(img_privacy_mask_t * mask, const struct img_privacy_mask_params * params, void * user_data)
+{
+	if(NULL == mask) mask = calloc(1, sizeof(*mask));
+	assert(mask);
+	mask->user_data = user_data;
+
+	if(params) *mask->params = *params;
+	else img_privacy_mask_params_load(mask->params, NULL);
+
+	struct privacy_mask_private * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	mask->priv = priv;
+
+	mask->mask_rect = privacy_mask_rect;
+	mask->mask_polygon = privacy_mask_polygon;
+	mask->count_targets = privacy_mask_count_targets;
+	mask->apply = privacy_mask_apply;
+	return mask;
+}
+
+void img_privacy_mask_cleanup(img_privacy_mask_t * mask)
+{
+	if(NULL == mask) return;
+	struct privacy_mask_private * priv = mask->priv;
+	mask->priv = NULL;
+	if(priv) {
+		free(priv->buffer);
+		free(priv->crossings);
+		free(priv);
+	}
+}
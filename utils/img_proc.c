@@ -28,6 +28,8 @@
 #include <assert.h>
 
 #include "img_proc.h"
+#include "frame-pool.h"
+#include "utils.h"
 #include <cairo/cairo.h>
 
 bgra_image_t * bgra_image_init(bgra_image_t * image, int width, int height, const unsigned char * image_data)
@@ -40,14 +42,21 @@ bgra_image_t * bgra_image_init(bgra_image_t * image, int width, int height, cons
 	
 	ssize_t size = width * height * channels;
 	assert(size > 0);
+	
+	if(image->parent) // detach from the parent image
+	{
+		image->data = NULL;
+		image->parent = NULL;
+	}
 
-	unsigned char * data = realloc(image->data, size);
+	unsigned char * data = frame_pool_reserve(image->data, width, height, frame_pool_format_bgra, size);
 	assert(data);
 
 	image->data = data;
 	image->width = width;
 	image->height = height;
 	image->channels = channels;
+	image->stride = width * channels;
 
 	if(image_data)
 	{
@@ -60,14 +69,521 @@ bgra_image_t * bgra_image_init(bgra_image_t * image, int width, int height, cons
 void bgra_image_clear(bgra_image_t * image)
 {
 	if(NULL == image) return;
-	free(image->data);
+	if(NULL == image->parent) frame_pool_release(image->data);
 	memset(image, 0, sizeof(*image));
 	return;
 }
 
+bgra_image_t * bgra_image_view(bgra_image_t * view, const bgra_image_t * parent, int x, int y, int width, int height)
+{
+	assert(parent && parent->data);
+	if(x < 0) { width += x; x = 0; }
+	if(y < 0) { height += y; y = 0; }
+	if((x + width) > parent->width) width = parent->width - x;
+	if((y + height) > parent->height) height = parent->height - y;
+	if(width < 1 || height < 1) return NULL;
+	
+	if(NULL == view) view = calloc(1, sizeof(*view));
+	else bgra_image_clear(view);
+	assert(view);
+	
+	int stride = bgra_image_stride(parent);
+	view->data = parent->data + (ssize_t)y * stride + x * 4;
+	view->width = width;
+	view->height = height;
+	view->channels = 4;
+	view->stride = stride;
+	view->parent = parent;
+	return view;
+}
+
+bgra_image_t * bgra_image_copy(bgra_image_t * dst, const bgra_image_t * src)
+{
+	assert(src && src->data);
+	assert(dst != src);
+	
+	int src_stride = bgra_image_stride(src);
+	if(src_stride == src->width * 4) return bgra_image_init(dst, src->width, src->height, src->data);
+	
+	dst = bgra_image_init(dst, src->width, src->height, NULL);
+	assert(dst);
+	
+	const unsigned char * src_row = src->data;
+	unsigned char * dst_row = dst->data;
+	for(int row = 0; row < src->height; ++row)
+	{
+		memcpy(dst_row, src_row, src->width * 4);
+		src_row += src_stride;
+		dst_row += dst->stride;
+	}
+	return dst;
+}
+
+
+/******************************************************************************
+ * resize
+ *****************************************************************************/
+#include <pthread.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define RESIZE_CACHE_SIZE (16)
+
+/*
+ * resize_axis: dst[i] = sum(weights[i * taps + t] * src[starts[i] + t]), t in [0, taps)
+ *   (starts[i] + taps) <= src_size
+ */
+struct resize_axis
+{
+	int src_size;
+	int dst_size;
+	int taps;
+	int * starts;
+	float * weights;
+};
+
+struct resize_coeffs
+{
+	int src_width, src_height;
+	int dst_width, dst_height;
+	enum bgra_image_resize_filter filter;
+
+	long refs;
+	int cached;
+	struct resize_axis x, y;
+};
+
+static struct
+{
+	pthread_mutex_t mutex;
+	int next_slot;
+	struct resize_coeffs * coeffs[RESIZE_CACHE_SIZE];
+}g_resize_cache[1] = {{
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+}};
+
+static inline int floor_to_int(double value)
+{
+	int i = (int)value;
+	return (value < i)?(i - 1):i;
+}
+
+static void resize_axis_init(struct resize_axis * axis, int src_size, int dst_size, enum bgra_image_resize_filter filter)
+{
+	const double scale = (double)src_size / (double)dst_size;
+	int use_area = (filter != bgra_image_resize_filter_bilinear) && (scale > 1.0);
+
+	int taps = 2;
+	if(use_area) taps = floor_to_int(scale) + 2;
+	if(taps > src_size) taps = src_size;
+
+	axis->src_size = src_size;
+	axis->dst_size = dst_size;
+	axis->taps = taps;
+	axis->starts = calloc(dst_size, sizeof(*axis->starts));
+	axis->weights = calloc((size_t)dst_size * taps, sizeof(*axis->weights));
+	assert(axis->starts && axis->weights);
+
+	for(int i = 0; i < dst_size; ++i)
+	{
+		float * weights = axis->weights + (size_t)i * taps;
+		int first = 0;
+		if(use_area)
+		{
+			double begin = i * scale;
+			double end = begin + scale;
+			first = floor_to_int(begin);
+			for(int t = 0; t < taps; ++t)
+			{
+				int pos = first + t;
+				double overlap = ((end < pos + 1)?end:(pos + 1)) - ((begin > pos)?begin:pos);
+				if(overlap > 0 && pos < src_size) weights[t] = (float)(overlap / scale);
+			}
+		}else
+		{
+			double pos = (i + 0.5) * scale - 0.5;
+			if(pos < 0) pos = 0;
+			first = floor_to_int(pos);
+			weights[0] = 1.0f;
+			if(taps > 1 && first < (src_size - 1))
+			{
+				float frac = (float)(pos - first);
+				weights[0] = 1.0f - frac;
+				weights[1] = frac;
+			}
+		}
+
+		// clamp to the last pixels: shift the window left and the weights right
+		int shift = (first + taps) - src_size;
+		if(shift > 0)
+		{
+			memmove(weights + shift, weights, (taps - shift) * sizeof(*weights));
+			memset(weights, 0, shift * sizeof(*weights));
+			first -= shift;
+		}
+		axis->starts[i] = first;
+	}
+}
+
+static void resize_axis_cleanup(struct resize_axis * axis)
+{
+	free(axis->starts);
+	free(axis->weights);
+	memset(axis, 0, sizeof(*axis));
+}
+
+static void resize_coeffs_free(struct resize_coeffs * coeffs)
+{
+	resize_axis_cleanup(&coeffs->x);
+	resize_axis_cleanup(&coeffs->y);
+	free(coeffs);
+}
+
+static struct resize_coeffs * resize_coeffs_acquire(int src_width, int src_height, int dst_width, int dst_height,
+	enum bgra_image_resize_filter filter)
+{
+	pthread_mutex_lock(&g_resize_cache->mutex);
+	for(int i = 0; i < RESIZE_CACHE_SIZE; ++i)
+	{
+		struct resize_coeffs * coeffs = g_resize_cache->coeffs[i];
+		if(coeffs && coeffs->src_width == src_width && coeffs->src_height == src_height
+			&& coeffs->dst_width == dst_width && coeffs->dst_height == dst_height
+			&& coeffs->filter == filter)
+		{
+			++coeffs->refs;
+			pthread_mutex_unlock(&g_resize_cache->mutex);
+			return coeffs;
+		}
+	}
+	pthread_mutex_unlock(&g_resize_cache->mutex);
+
+	struct resize_coeffs * coeffs = calloc(1, sizeof(*coeffs));
+	assert(coeffs);
+	coeffs->src_width = src_width;
+	coeffs->src_height = src_height;
+	coeffs->dst_width = dst_width;
+	coeffs->dst_height = dst_height;
+	coeffs->filter = filter;
+	coeffs->refs = 1;
+	resize_axis_init(&coeffs->x, src_width, dst_width, filter);
+	resize_axis_init(&coeffs->y, src_height, dst_height, filter);
+
+	// replace a cache slot which is not in use, (round-robin)
+	pthread_mutex_lock(&g_resize_cache->mutex);
+	for(int i = 0; i < RESIZE_CACHE_SIZE; ++i)
+	{
+		int slot = (g_resize_cache->next_slot + i) % RESIZE_CACHE_SIZE;
+		struct resize_coeffs * old_coeffs = g_resize_cache->coeffs[slot];
+		if(old_coeffs && old_coeffs->refs > 0) continue;
+
+		if(old_coeffs) resize_coeffs_free(old_coeffs);
+		g_resize_cache->coeffs[slot] = coeffs;
+		g_resize_cache->next_slot = (slot + 1) % RESIZE_CACHE_SIZE;
+		coeffs->cached = 1;
+		break;
+	}
+	pthread_mutex_unlock(&g_resize_cache->mutex);
+	return coeffs;
+}
+
+static void resize_coeffs_release(struct resize_coeffs * coeffs)
+{
+	pthread_mutex_lock(&g_resize_cache->mutex);
+	int should_free = (0 == --coeffs->refs) && !coeffs->cached;
+	pthread_mutex_unlock(&g_resize_cache->mutex);
+	if(should_free) resize_coeffs_free(coeffs);
+}
+
+void bgra_image_resize_cache_clear(void)
+{
+	pthread_mutex_lock(&g_resize_cache->mutex);
+	for(int i = 0; i < RESIZE_CACHE_SIZE; ++i)
+	{
+		struct resize_coeffs * coeffs = g_resize_cache->coeffs[i];
+		if(NULL == coeffs) continue;
+		g_resize_cache->coeffs[i] = NULL;
+		coeffs->cached = 0;
+		if(0 == coeffs->refs) resize_coeffs_free(coeffs);	// otherwise freed by the last user
+	}
+	pthread_mutex_unlock(&g_resize_cache->mutex);
+}
+
+static void resize_horizontal(const unsigned char * src, float * dst, const struct resize_axis * axis)
+{
+	const int taps = axis->taps;
+	const float * weights = axis->weights;
+	for(int i = 0; i < axis->dst_size; ++i, weights += taps, dst += 4)
+	{
+		const unsigned char * p = src + axis->starts[i] * 4;
+#if defined(__SSE2__)
+		const __m128i zero = _mm_setzero_si128();
+		__m128 sum = _mm_setzero_ps();
+		for(int t = 0; t < taps; ++t, p += 4)
+		{
+			int32_t value;
+			memcpy(&value, p, sizeof(value));
+			__m128i px = _mm_cvtsi32_si128(value);
+			px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(px, zero), zero);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_set1_ps(weights[t])));
+		}
+		_mm_storeu_ps(dst, sum);
+#else
+		float b = 0, g = 0, r = 0, a = 0;
+		for(int t = 0; t < taps; ++t, p += 4)
+		{
+			b += weights[t] * p[0];
+			g += weights[t] * p[1];
+			r += weights[t] * p[2];
+			a += weights[t] * p[3];
+		}
+		dst[0] = b; dst[1] = g; dst[2] = r; dst[3] = a;
+#endif
+	}
+}
+
+static void resize_vertical(float ** rows, const float * weights, int taps, unsigned char * dst, int length)
+{
+	int i = 0;
+#if defined(__SSE2__)
+	for(; (i + 16) <= length; i += 16)
+	{
+		__m128 sum[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+		for(int t = 0; t < taps; ++t)
+		{
+			const __m128 w = _mm_set1_ps(weights[t]);
+			const float * row = rows[t] + i;
+			sum[0] = _mm_add_ps(sum[0], _mm_mul_ps(_mm_loadu_ps(row), w));
+			sum[1] = _mm_add_ps(sum[1], _mm_mul_ps(_mm_loadu_ps(row + 4), w));
+			sum[2] = _mm_add_ps(sum[2], _mm_mul_ps(_mm_loadu_ps(row + 8), w));
+			sum[3] = _mm_add_ps(sum[3], _mm_mul_ps(_mm_loadu_ps(row + 12), w));
+		}
+		// round to nearest, saturate to [0, 255]
+		__m128i lo = _mm_packs_epi32(_mm_cvtps_epi32(sum[0]), _mm_cvtps_epi32(sum[1]));
+		__m128i hi = _mm_packs_epi32(_mm_cvtps_epi32(sum[2]), _mm_cvtps_epi32(sum[3]));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for(; i < length; ++i)
+	{
+		float sum = 0;
+		for(int t = 0; t < taps; ++t) sum += weights[t] * rows[t][i];
+		int value = (int)(sum + 0.5f);
+		dst[i] = (value < 0)?0:(value > 255)?255:value;
+	}
+}
+
+int bgra_image_resize(bgra_image_t * dst, const bgra_image_t * src, enum bgra_image_resize_filter filter)
+{
+	assert(dst && src && src->data);
+	if(src->width < 1 || src->height < 1 || dst->width < 1 || dst->height < 1) return -1;
+	if(NULL == dst->data && NULL == bgra_image_init(dst, dst->width, dst->height, NULL)) return -1;
+
+	struct resize_coeffs * coeffs = resize_coeffs_acquire(src->width, src->height, dst->width, dst->height, filter);
+	assert(coeffs);
+
+	const struct resize_axis * x_axis = &coeffs->x;
+	const struct resize_axis * y_axis = &coeffs->y;
+	const int taps = y_axis->taps;
+	const int length = dst->width * 4;
+	const ssize_t src_stride = bgra_image_stride(src);
+	const ssize_t dst_stride = bgra_image_stride(dst);
+
+	// ring of horizontally resampled rows, src row r is cached at (r % taps)
+	float * buffer = malloc(sizeof(*buffer) * length * taps);
+	float ** rows = calloc(taps * 2, sizeof(*rows));
+	int * row_ids = malloc(sizeof(*row_ids) * taps);
+	assert(buffer && rows && row_ids);
+	float ** window = rows + taps;
+
+	for(int t = 0; t < taps; ++t)
+	{
+		rows[t] = buffer + (size_t)t * length;
+		row_ids[t] = -1;
+	}
+
+	for(int dy = 0; dy < dst->height; ++dy)
+	{
+		int start = y_axis->starts[dy];
+		for(int t = 0; t < taps; ++t)
+		{
+			int src_row = start + t;
+			int slot = src_row % taps;
+			if(row_ids[slot] != src_row)
+			{
+				resize_horizontal(src->data + src_row * src_stride, rows[slot], x_axis);
+				row_ids[slot] = src_row;
+			}
+			window[t] = rows[slot];
+		}
+		resize_vertical(window, y_axis->weights + (size_t)dy * taps, taps, dst->data + dy * dst_stride, length);
+	}
+
+	free(row_ids);
+	free(rows);
+	free(buffer);
+	resize_coeffs_release(coeffs);
+	return 0;
+}
+
+int bgra_image_letterbox(bgra_image_t * dst, const bgra_image_t * src, enum bgra_image_resize_filter filter,
+	uint32_t fill_color, struct bgra_image_letterbox * letterbox)
+{
+	assert(dst && src && src->data);
+	if(src->width < 1 || src->height < 1 || dst->width < 1 || dst->height < 1) return -1;
+	if(NULL == dst->data && NULL == bgra_image_init(dst, dst->width, dst->height, NULL)) return -1;
+
+	struct bgra_image_letterbox geometry[1];
+	bgra_image_letterbox_init(geometry, src->width, src->height, dst->width, dst->height);
+	const int x = geometry->x, y = geometry->y;
+	const int width = geometry->width, height = geometry->height;
+
+	// borders
+	const ssize_t dst_stride = bgra_image_stride(dst);
+	for(int row = 0; row < dst->height; ++row)
+	{
+		uint32_t * pixels = (uint32_t *)(dst->data + row * dst_stride);
+		if(row < y || row >= (y + height))
+		{
+			for(int col = 0; col < dst->width; ++col) pixels[col] = fill_color;
+			continue;
+		}
+		for(int col = 0; col < x; ++col) pixels[col] = fill_color;
+		for(int col = x + width; col < dst->width; ++col) pixels[col] = fill_color;
+	}
+
+	bgra_image_t view[1];
+	memset(view, 0, sizeof(view));
+	bgra_image_view(view, dst, x, y, width, height);
+	int rc = bgra_image_resize(view, src, filter);
+
+	if(letterbox) *letterbox = *geometry;
+	return rc;
+}
+
+void bgra_image_letterbox_init(struct bgra_image_letterbox * letterbox, int src_width, int src_height, int dst_width, int dst_height)
+{
+	assert(letterbox && src_width > 0 && src_height > 0 && dst_width > 0 && dst_height > 0);
+	double scale_x = (double)dst_width / (double)src_width;
+	double scale_y = (double)dst_height / (double)src_height;
+	double scale = (scale_x < scale_y)?scale_x:scale_y;
+
+	int width = (int)(src_width * scale + 0.5);
+	int height = (int)(src_height * scale + 0.5);
+	if(width < 1) width = 1;
+	if(height < 1) height = 1;
+	if(width > dst_width) width = dst_width;
+	if(height > dst_height) height = dst_height;
+
+	letterbox->scale_x = (double)width / (double)src_width;
+	letterbox->scale_y = (double)height / (double)src_height;
+	letterbox->x = (dst_width - width) / 2;
+	letterbox->y = (dst_height - height) / 2;
+	letterbox->width = width;
+	letterbox->height = height;
+}
+
+
+/******************************************************************************
+ * yuv_image
+ *****************************************************************************/
+#define YUV_ROUND_UP_4(n) (((n) + 3) & ~3)
+ssize_t yuv_image_layout(enum yuv_image_format format, int width, int height, int strides[3], ssize_t offsets[3])
+{
+	if(width < 1 || height < 1) return -1;
+	int dummy_strides[3];
+	ssize_t dummy_offsets[3];
+	if(NULL == strides) strides = dummy_strides;
+	if(NULL == offsets) offsets = dummy_offsets;
+	memset(strides, 0, sizeof(int) * 3);
+	memset(offsets, 0, sizeof(ssize_t) * 3);
+
+	const int chroma_width = (width + 1) / 2;
+	const int chroma_height = (height + 1) / 2;
+	strides[0] = YUV_ROUND_UP_4(width);
+	ssize_t luma_size = (ssize_t)strides[0] * height;
+
+	switch(format)
+	{
+	case yuv_image_format_gray8:
+		return luma_size;
+	case yuv_image_format_nv12:
+		strides[1] = YUV_ROUND_UP_4(chroma_width * 2);
+		offsets[1] = (ssize_t)strides[0] * (chroma_height * 2);
+		return offsets[1] + (ssize_t)strides[1] * chroma_height;
+	case yuv_image_format_i420:
+		strides[1] = strides[2] = YUV_ROUND_UP_4(chroma_width);
+		offsets[1] = (ssize_t)strides[0] * (chroma_height * 2);
+		offsets[2] = offsets[1] + (ssize_t)strides[1] * chroma_height;
+		return offsets[2] + (ssize_t)strides[2] * chroma_height;
+	default:
+		break;
+	}
+	return -1;
+}
+#undef YUV_ROUND_UP_4
+
+int yuv_image_init(yuv_image_t * image, enum yuv_image_format format, int width, int height,
+	const unsigned char * data, ssize_t length)
+{
+	assert(image && data);
+	ssize_t offsets[3] = { 0 };
+	ssize_t size = yuv_image_layout(format, width, height, image->strides, offsets);
+	if(size < 0 || length < size) return -1;
+
+	image->format = format;
+	image->width = width;
+	image->height = height;
+	image->planes[0] = data;
+	image->planes[1] = offsets[1]?(data + offsets[1]):NULL;
+	image->planes[2] = offsets[2]?(data + offsets[2]):NULL;
+	return 0;
+}
+
+yuv_image_t * yuv_image_view(yuv_image_t * view, const yuv_image_t * parent, int x, int y, int width, int height)
+{
+	assert(view && parent && parent->planes[0]);
+	if(x < 0) { width += x; x = 0; }
+	if(y < 0) { height += y; y = 0; }
+	width += x & 1; x &= ~1;
+	height += y & 1; y &= ~1;
+	if(x + width > parent->width) width = parent->width - x;
+	if(y + height > parent->height) height = parent->height - y;
+	if(width <= 0 || height <= 0) return NULL;
+
+	*view = *parent;
+	view->width = width;
+	view->height = height;
+	view->planes[0] = parent->planes[0] + (ssize_t)y * parent->strides[0] + x;
+	switch(parent->format)
+	{
+	case yuv_image_format_nv12:
+		view->planes[1] = parent->planes[1] + (ssize_t)(y / 2) * parent->strides[1] + x;	// (u, v) pairs
+		break;
+	case yuv_image_format_i420:
+		view->planes[1] = parent->planes[1] + (ssize_t)(y / 2) * parent->strides[1] + x / 2;
+		view->planes[2] = parent->planes[2] + (ssize_t)(y / 2) * parent->strides[2] + x / 2;
+		break;
+	default:
+		break;
+	}
+	return view;
+}
+
+enum yuv_image_format yuv_image_format_from_string(const char * format)
+{
+	if(NULL == format) return yuv_image_format_unknown;
+	if(strcasecmp(format, "NV12") == 0) return yuv_image_format_nv12;
+	if(strcasecmp(format, "I420") == 0) return yuv_image_format_i420;
+	if(strcasecmp(format, "GRAY8") == 0) return yuv_image_format_gray8;
+	return yuv_image_format_unknown;
+}
+#undef RESIZE_CACHE_SIZE
 
 
 #include <jpeglib.h>
+#include <jerror.h>
+#include <png.h>
 #include <cairo/cairo.h>
 #include <glib.h>
 #include <gio/gio.h>
@@ -76,25 +592,142 @@ void bgra_image_clear(bgra_image_t * image)
 #include <unistd.h>
 #include <setjmp.h>
 
-enum image_type
+/******************************************************************************
+ * probe: header-only parsing
+ *****************************************************************************/
+static const unsigned char s_png_signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+static const unsigned char s_png_iend_chunk[12] = { 0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82 };
+
+static inline uint32_t read_be16(const unsigned char * p) { return ((uint32_t)p[0] << 8) | p[1]; }
+static inline uint32_t read_be32(const unsigned char * p)
 {
-	image_type_unknown,
-	image_type_png,
-	image_type_jpeg,
-};
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+enum img_utils_image_type img_utils_guess_image_type(const unsigned char * data, size_t length)
+{
+	if(NULL == data) return img_utils_image_type_unknown;
+	if(length >= 2 && data[0] == 0xFF && data[1] == 0xD8) return img_utils_image_type_jpeg;
+	if(length >= sizeof(s_png_signature) && 0 == memcmp(data, s_png_signature, sizeof(s_png_signature))) return img_utils_image_type_png;
+	return img_utils_image_type_unknown;
+}
+
+static int probe_png(const unsigned char * png, size_t length, struct img_utils_image_info * info)
+{
+	// signature(8) + IHDR: length(4) "IHDR"(4) width(4) height(4) bit_depth(1) color_type(1) compression(1) filter(1) interlace(1) crc(4)
+	info->truncated = (length < (8 + 25 + sizeof(s_png_iend_chunk)))
+		|| memcmp(png + length - sizeof(s_png_iend_chunk), s_png_iend_chunk, sizeof(s_png_iend_chunk));
+	if(length < (8 + 25)) return -1;
+
+	const unsigned char * ihdr = png + 8;
+	if(read_be32(ihdr) != 13 || memcmp(ihdr + 4, "IHDR", 4)) return -1;
+
+	uint32_t width = read_be32(ihdr + 8);
+	uint32_t height = read_be32(ihdr + 12);
+	if(width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF) return -1;
+
+	int color_type = ihdr[17];
+	int channels = 0;
+	switch(color_type)
+	{
+	case 0: channels = 1; break;	// gray
+	case 2: channels = 3; break;	// rgb
+	case 3: channels = 3; break;	// palette
+	case 4: channels = 2; break;	// gray + alpha
+	case 6: channels = 4; break;	// rgba
+	default: return -1;
+	}
+
+	info->width = width;
+	info->height = height;
+	info->channels = channels;
+	info->bit_depth = ihdr[16];
+	return 0;
+}
+
+static int probe_jpeg(const unsigned char * jpeg, size_t length, struct img_utils_image_info * info)
+{
+	// EOI, (some encoders pad the stream with zeros)
+	size_t end = length;
+	while(end > 2 && jpeg[end - 1] == 0) --end;
+	info->truncated = !(end >= 4 && jpeg[end - 2] == 0xFF && jpeg[end - 1] == 0xD9);
+
+	const unsigned char * p = jpeg + 2;	// SOI
+	const unsigned char * p_end = jpeg + length;
+	while(p < p_end)
+	{
+		// like libjpeg's next_marker(): skip any garbage and fill bytes before the marker
+		if(*p != 0xFF) { ++p; continue; }
+		while(p < p_end && *p == 0xFF) ++p;
+		if(p >= p_end) break;
+
+		int marker = *p++;
+		if(marker == 0x00) continue;	// stuffed byte, not a marker
+		if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) continue;	// TEM, RSTn: no payload
+		if(marker == 0xD8) continue;	// SOI again, (libjpeg treats it as an error, but nothing to read)
+		if(marker == 0xD9 || marker == 0xDA) return -1;	// EOI / SOS before any SOF
+
+		if((p_end - p) < 2) break;
+		uint32_t segment_length = read_be16(p);
+
+		int is_sof = (marker >= 0xC0 && marker <= 0xCF) && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+		if(is_sof)
+		{
+			// length(2) precision(1) height(2) width(2) components(1)
+			if(segment_length < 8) return -1;
+			if((p_end - p) < 8) break;
+			uint32_t height = read_be16(p + 3);
+			uint32_t width = read_be16(p + 5);
+			if(width == 0 || height == 0) return -1;	// DNL is not supported, (neither by libjpeg)
+
+			info->bit_depth = p[2];
+			info->height = height;
+			info->width = width;
+			info->channels = p[7];
+			info->progressive = (marker == 0xC2 || marker == 0xC6 || marker == 0xCA || marker == 0xCE);
+			return 0;
+		}
+
+		if(segment_length < 2) segment_length = 2;	// libjpeg skips nothing, and resyncs on the next 0xFF
+		if((size_t)(p_end - p) < segment_length) break;
+		p += segment_length;
+	}
+
+	info->truncated = 1;	// the header itself is incomplete
+	return -1;
+}
 
-// guess mime-type byfilename or image_data
-static inline enum image_type guess_image_type(const char * filename, const unsigned char * image_data, size_t size)
+int img_utils_probe(const unsigned char * data, size_t length, struct img_utils_image_info * info)
 {
+	struct img_utils_image_info dummy[1];
+	if(NULL == info) info = dummy;
+	memset(info, 0, sizeof(*info));
+
+	info->type = img_utils_guess_image_type(data, length);
+	switch(info->type)
+	{
+	case img_utils_image_type_jpeg: return probe_jpeg(data, length, info);
+	case img_utils_image_type_png: return probe_png(data, length, info);
+	default:
+		break;
+	}
+	return -1;
+}
+
+// guess the type by magic bytes (image_data), or by the filename extension
+static inline enum img_utils_image_type guess_image_type(const char * filename, const unsigned char * image_data, size_t size)
+{
+	if(image_data) return img_utils_guess_image_type(image_data, size);
+
 	gboolean uncertain = TRUE;
 	gchar * mime_type = NULL; 
-	enum image_type type = image_type_unknown;
-	mime_type = g_content_type_guess(filename, image_data, size, &uncertain);
+	enum img_utils_image_type type = img_utils_image_type_unknown;
+	mime_type = g_content_type_guess(filename, NULL, 0, &uncertain);
 	
 	if(!uncertain && mime_type)
 	{
-		if(strcasecmp(mime_type, "image/jpeg") == 0) type = image_type_jpeg;
-		else if(strcasecmp(mime_type, "image/png") == 0) type = image_type_png;
+		if(strcasecmp(mime_type, "image/jpeg") == 0) type = img_utils_image_type_jpeg;
+		else if(strcasecmp(mime_type, "image/png") == 0) type = img_utils_image_type_png;
 		else
 		{
 			fprintf(stderr, "unsupported image type: %s\n", mime_type);
@@ -108,13 +741,22 @@ static inline enum image_type guess_image_type(const char * filename, const unsi
 }
 
 
+/******************************************************************************
+ * libjpeg codec contexts: one decompressor and one compressor per thread,
+ *   created on first use and reset (jpeg_abort / jpeg_finish) between images,
+ *   so the permanent memory pools, the source manager and the output buffer are reused.
+ *   released when the thread exits, (or by img_utils_jpeg_thread_context_release())
+ *****************************************************************************/
+#define JPEG_OUTPUT_BUFFER_MIN_SIZE	(64 * 1024)
+#define JPEG_OUTPUT_BUFFER_MAX_KEEP	(16 * 1024 * 1024)	// larger buffers are released after use
+
 typedef struct custom_jpeg_err
 {
 	struct jpeg_error_mgr base[1];
 	jmp_buf setjmp_buffer;
 }custom_jpeg_err_t;
 
-static void on_jpeg_decompress_error(j_common_ptr cinfo)
+static void on_jpeg_error(j_common_ptr cinfo)
 {
 	custom_jpeg_err_t * jerr = (custom_jpeg_err_t *)cinfo->err;
 	assert(jerr);
@@ -123,94 +765,406 @@ static void on_jpeg_decompress_error(j_common_ptr cinfo)
 	longjmp(jerr->setjmp_buffer, 1);
 }
 
-int img_utils_get_jpeg_size(const unsigned char * jpeg, size_t length, int * p_width, int * p_height)
+struct jpeg_mem_writer
 {
-	struct jpeg_decompress_struct cinfo;
-	struct jpeg_error_mgr jerr;
-	memset(&cinfo, 0, sizeof(cinfo));
-	memset(&jerr, 0, sizeof(jerr));
+	struct jpeg_destination_mgr base[1];
+	unsigned char * buffer;
+	size_t max_size;
+	size_t length;
+};
 
-	cinfo.err = jpeg_std_error(&jerr);
-	
-	jpeg_create_decompress(&cinfo);
-	jpeg_mem_src(&cinfo, jpeg, length);
-	int width = 0;
-	int height = 0;
-	
-	int rc = jpeg_read_header(&cinfo, FALSE);
-	if(rc != JPEG_HEADER_OK) return -1;
+struct jpeg_thread_context
+{
+	struct jpeg_decompress_struct dinfo;
+	custom_jpeg_err_t dinfo_err[1];
+	int dinfo_created;
+
+	struct jpeg_compress_struct cinfo;
+	custom_jpeg_err_t cinfo_err[1];
+	int cinfo_created;
+	struct jpeg_mem_writer writer[1];
+};
+
+static void on_jpeg_init_destination(j_compress_ptr cinfo)
+{
+	struct jpeg_mem_writer * writer = (struct jpeg_mem_writer *)cinfo->dest;
+	if(NULL == writer->buffer)
+	{
+		writer->max_size = JPEG_OUTPUT_BUFFER_MIN_SIZE;
+		writer->buffer = malloc(writer->max_size);
+		if(NULL == writer->buffer) ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
+	}
+	writer->length = 0;
+	writer->base->next_output_byte = writer->buffer;
+	writer->base->free_in_buffer = writer->max_size;
+}
 
-	width = cinfo.image_width;
-	height = cinfo.image_height;
+static boolean on_jpeg_empty_output_buffer(j_compress_ptr cinfo)
+{
+	// libjpeg calls this only when the buffer is full
+	struct jpeg_mem_writer * writer = (struct jpeg_mem_writer *)cinfo->dest;
+	size_t new_size = writer->max_size * 2;
+	unsigned char * buffer = realloc(writer->buffer, new_size);
+	if(NULL == buffer) ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
 
-	if(p_width) *p_width = width;
-	if(p_height) * p_height = height;
+	writer->base->next_output_byte = buffer + writer->max_size;
+	writer->base->free_in_buffer = new_size - writer->max_size;
+	writer->buffer = buffer;
+	writer->max_size = new_size;
+	return TRUE;
+}
 
-	jpeg_destroy_decompress(&cinfo);
-	
+static void on_jpeg_term_destination(j_compress_ptr cinfo)
+{
+	struct jpeg_mem_writer * writer = (struct jpeg_mem_writer *)cinfo->dest;
+	writer->length = writer->max_size - writer->base->free_in_buffer;
+}
+
+static void jpeg_thread_context_free(void * user_data)
+{
+	struct jpeg_thread_context * ctx = user_data;
+	if(NULL == ctx) return;
+	if(ctx->dinfo_created) jpeg_destroy_decompress(&ctx->dinfo);
+	if(ctx->cinfo_created) jpeg_destroy_compress(&ctx->cinfo);
+	free(ctx->writer->buffer);
+	free(ctx);
+}
+
+static pthread_key_t s_jpeg_context_key;
+static pthread_once_t s_jpeg_context_once = PTHREAD_ONCE_INIT;
+static void jpeg_context_key_init(void)
+{
+	int rc = pthread_key_create(&s_jpeg_context_key, jpeg_thread_context_free);
+	assert(0 == rc);
+}
+
+static struct jpeg_thread_context * jpeg_thread_context_get(void)
+{
+	pthread_once(&s_jpeg_context_once, jpeg_context_key_init);
+	struct jpeg_thread_context * ctx = pthread_getspecific(s_jpeg_context_key);
+	if(ctx) return ctx;
+
+	ctx = calloc(1, sizeof(*ctx));
+	assert(ctx);
+	pthread_setspecific(s_jpeg_context_key, ctx);
+	return ctx;
+}
+
+void img_utils_jpeg_thread_context_release(void)
+{
+	pthread_once(&s_jpeg_context_once, jpeg_context_key_init);
+	struct jpeg_thread_context * ctx = pthread_getspecific(s_jpeg_context_key);
+	if(NULL == ctx) return;
+	pthread_setspecific(s_jpeg_context_key, NULL);
+	jpeg_thread_context_free(ctx);
+}
+
+static struct jpeg_decompress_struct * jpeg_thread_decompressor(struct jpeg_thread_context * ctx)
+{
+	struct jpeg_decompress_struct * dinfo = &ctx->dinfo;
+	if(!ctx->dinfo_created)
+	{
+		dinfo->err = jpeg_std_error(ctx->dinfo_err->base);
+		ctx->dinfo_err->base->error_exit = on_jpeg_error;
+		jpeg_create_decompress(dinfo);
+		ctx->dinfo_created = 1;
+	}
+	return dinfo;
+}
+
+static struct jpeg_compress_struct * jpeg_thread_compressor(struct jpeg_thread_context * ctx)
+{
+	struct jpeg_compress_struct * cinfo = &ctx->cinfo;
+	if(!ctx->cinfo_created)
+	{
+		cinfo->err = jpeg_std_error(ctx->cinfo_err->base);
+		ctx->cinfo_err->base->error_exit = on_jpeg_error;
+		jpeg_create_compress(cinfo);
+
+		struct jpeg_mem_writer * writer = ctx->writer;
+		writer->base->init_destination = on_jpeg_init_destination;
+		writer->base->empty_output_buffer = on_jpeg_empty_output_buffer;
+		writer->base->term_destination = on_jpeg_term_destination;
+		cinfo->dest = writer->base;
+		ctx->cinfo_created = 1;
+	}
+	return cinfo;
+}
+
+int img_utils_get_jpeg_size(const unsigned char * jpeg, size_t length, int * p_width, int * p_height)
+{
+	struct img_utils_image_info info[1];
+	int rc = img_utils_probe(jpeg, length, info);
+	if(rc || info->type != img_utils_image_type_jpeg) return -1;
+
+	if(p_width) *p_width = info->width;
+	if(p_height) *p_height = info->height;
 	return 0;
 }
 
-int bgra_image_from_jpeg_stream(bgra_image_t * image, const unsigned char * jpeg, size_t length)
+/*
+ * min_width, min_height: (> 0) let libjpeg scale the image down by 1/2, 1/4 or 1/8 in the IDCT,
+ *   the largest reduction whose output still covers (min_width x min_height) is used.
+ * flags: enum bgra_image_jpeg_decode_flags
+ */
+#define JPEG_MAX_ROW_GROUP	(16)
+static int jpeg_decode(bgra_image_t * image, const unsigned char * jpeg, size_t length, int min_width, int min_height, int flags)
 {
 	int rc = -1;
-	struct jpeg_decompress_struct cinfo;
-	memset(&cinfo, 0, sizeof(cinfo));
-	
-	custom_jpeg_err_t jerr;
-	memset(&jerr, 0, sizeof(jerr));
-	
-	cinfo.err = jpeg_std_error((struct jpeg_error_mgr *)&jerr);
-	jerr.base->error_exit = on_jpeg_decompress_error;
-	if(setjmp(jerr.setjmp_buffer))
+	struct jpeg_thread_context * ctx = jpeg_thread_context_get();
+	struct jpeg_decompress_struct * cinfo = jpeg_thread_decompressor(ctx);
+	if(setjmp(ctx->dinfo_err->setjmp_buffer))
 	{
 		goto label_cleanup;
 	}
 	
-	jpeg_create_decompress(&cinfo);
-	jpeg_mem_src(&cinfo, jpeg, length);
-	int width = 0;
-	int height = 0;
-	
-	(void)jpeg_read_header(&cinfo, TRUE);
-	
-	cinfo.out_color_space = JCS_EXT_BGRA;
-	(void)jpeg_start_decompress(&cinfo);
-	
-	printf("dst size: %d x %d, channels=%d color_space=%d\n", 
-		cinfo.output_width, cinfo.output_height, 
-		cinfo.output_components,
-		cinfo.out_color_space);
-
-	width = cinfo.output_width;
-	height = cinfo.output_height;
-	printf("-->image size: %d x %d\n", width, height);
-	
+	jpeg_mem_src(cinfo, jpeg, length);		// the source manager is allocated only once (permanent pool)
+	(void)jpeg_read_header(cinfo, TRUE);	// resets the decompression parameters to the defaults
 	
-	assert(cinfo.out_color_space == JCS_EXT_BGRA);
+	cinfo->out_color_space = JCS_EXT_BGRA;
+	if(flags & bgra_image_jpeg_decode_flag_fast_idct) cinfo->dct_method = JDCT_IFAST;
+	if(flags & bgra_image_jpeg_decode_flag_no_fancy_upsampling) cinfo->do_fancy_upsampling = FALSE;
+	if(min_width > 0 || min_height > 0)
+	{
+		int denom = 8;
+		for(; denom > 1; denom /= 2)
+		{
+			cinfo->scale_num = 1;
+			cinfo->scale_denom = denom;
+			jpeg_calc_output_dimensions(cinfo);
+			if((int)cinfo->output_width >= min_width && (int)cinfo->output_height >= min_height) break;
+		}
+		cinfo->scale_num = 1;
+		cinfo->scale_denom = denom;
+	}
+	(void)jpeg_start_decompress(cinfo);
+	assert(cinfo->out_color_space == JCS_EXT_BGRA);
+
+	int width = cinfo->output_width;
+	int height = cinfo->output_height;
+	debug_printf("%s(): %d x %d ==> %d x %d (1/%d), rec_outbuf_height=%d, flags=0x%x", __FUNCTION__,
+		cinfo->image_width, cinfo->image_height, width, height,
+		(int)cinfo->scale_denom, cinfo->rec_outbuf_height, flags);
+
 	image = bgra_image_init(image, width, height, NULL);
 	assert(image);
 	
-	unsigned char * row = image->data;
-	int row_stride = image->width * 4;
-	JSAMPLE * row_pointer[1];
-	memset(row_pointer, 0, sizeof(row_pointer));
-	while(cinfo.output_scanline < cinfo.output_height)
+	// read whole row groups (rec_outbuf_height rows, up to 4 for 4:2:0 with fancy upsampling)
+	// straight into the image, so libjpeg doesn't have to buffer and copy the leftover rows.
+	int row_group = cinfo->rec_outbuf_height;
+	if(row_group < 1) row_group = 1;
+	if(row_group > JPEG_MAX_ROW_GROUP) row_group = JPEG_MAX_ROW_GROUP;
+	
+	JSAMPROW row_pointers[JPEG_MAX_ROW_GROUP];
+	int row_stride = bgra_image_stride(image);
+	while(cinfo->output_scanline < cinfo->output_height)
 	{
-		row_pointer[0] = (JSAMPLE *)row;
-		int n = jpeg_read_scanlines(&cinfo, row_pointer, 1);
-		assert(n == 1);
+		int y = cinfo->output_scanline;
+		int rows = height - y;
+		if(rows > row_group) rows = row_group;
+		for(int i = 0; i < rows; ++i) row_pointers[i] = (JSAMPROW)(image->data + (ssize_t)(y + i) * row_stride);
 		
-		row += row_stride;
+		int n = jpeg_read_scanlines(cinfo, row_pointers, rows);
+		if(n <= 0) break;	// suspended, (never happens with the memory source)
 	}
 	
-	rc = 0;
+	jpeg_finish_decompress(cinfo);		// back to the idle state, ready for the next image
+	return 0;
 label_cleanup:
-	jpeg_finish_decompress(&cinfo);
-
-	jpeg_destroy_decompress(&cinfo);
+	// after an error, finish_decompress() would fail again: abort to reset the decompressor
+	jpeg_abort_decompress(cinfo);
 	return rc;
+}
+#undef JPEG_MAX_ROW_GROUP
 
+int bgra_image_from_jpeg_stream(bgra_image_t * image, const unsigned char * jpeg, size_t length)
+{
+	return jpeg_decode(image, jpeg, length, 0, 0, 0);
+}
+
+int bgra_image_from_jpeg_stream_scaled(bgra_image_t * image, const unsigned char * jpeg, size_t length, int min_width, int min_height)
+{
+	return jpeg_decode(image, jpeg, length, min_width, min_height, 0);
+}
+
+int bgra_image_from_jpeg_stream_ex(bgra_image_t * image, const unsigned char * jpeg, size_t length, int min_width, int min_height, int flags)
+{
+	return jpeg_decode(image, jpeg, length, min_width, min_height, flags);
+}
+
+#if defined(LIBJPEG_TURBO_VERSION)
+/*
+ * roi decode: only the iMCU rows / columns covering the rect are decoded
+ *   jpeg_crop_scanline() widens the columns to the iMCU boundaries, the extra columns are dropped while copying;
+ *   the rows above the rect are skipped (jpeg_skip_scanlines), the rows below are never decoded (jpeg_abort).
+ */
+static int jpeg_decode_roi(bgra_image_t * image, const unsigned char * jpeg, size_t length,
+	int x, int y, int width, int height, int min_width, int min_height, int flags)
+{
+	struct jpeg_thread_context * ctx = jpeg_thread_context_get();
+	struct jpeg_decompress_struct * cinfo = jpeg_thread_decompressor(ctx);
+	unsigned char * volatile scratch = NULL;
+	if(setjmp(ctx->dinfo_err->setjmp_buffer))
+	{
+		jpeg_abort_decompress(cinfo);
+		free(scratch);
+		return -1;
+	}
+
+	jpeg_mem_src(cinfo, jpeg, length);
+	(void)jpeg_read_header(cinfo, TRUE);
+
+	// clip to the image
+	if(x < 0) { width += x; x = 0; }
+	if(y < 0) { height += y; y = 0; }
+	if((x + width) > (int)cinfo->image_width) width = cinfo->image_width - x;
+	if((y + height) > (int)cinfo->image_height) height = cinfo->image_height - y;
+	if(width < 1 || height < 1)
+	{
+		jpeg_abort_decompress(cinfo);
+		return -1;
+	}
+
+	cinfo->out_color_space = JCS_EXT_BGRA;
+	if(flags & bgra_image_jpeg_decode_flag_fast_idct) cinfo->dct_method = JDCT_IFAST;
+	if(flags & bgra_image_jpeg_decode_flag_no_fancy_upsampling) cinfo->do_fancy_upsampling = FALSE;
+
+	int denom = 1;
+	if(min_width > 0 || min_height > 0)
+	{
+		for(denom = 8; denom > 1; denom /= 2)
+		{
+			if((width / denom) >= min_width && (height / denom) >= min_height) break;
+		}
+	}
+	cinfo->scale_num = 1;
+	cinfo->scale_denom = denom;
+	(void)jpeg_start_decompress(cinfo);
+	assert(cinfo->out_color_space == JCS_EXT_BGRA);
+
+	// the rect in output (scaled) coordinates
+	int left = x / denom;
+	int top = y / denom;
+	int right = (x + width + denom - 1) / denom;
+	int bottom = (y + height + denom - 1) / denom;
+	if(right > (int)cinfo->output_width) right = cinfo->output_width;
+	if(bottom > (int)cinfo->output_height) bottom = cinfo->output_height;
+	if(right <= left) right = left + 1;
+	if(bottom <= top) bottom = top + 1;
+
+	// keep a margin of chroma samples on both sides, so that the (fancy) upsampler sees the same neighbours
+	// as in a full decode, otherwise the edge columns of the crop would be replicated.
+	int margin = cinfo->max_h_samp_factor;
+	int crop_left = (left > margin)?(left - margin):0;
+	int crop_right = right + margin;
+	if(crop_right > (int)cinfo->output_width) crop_right = cinfo->output_width;
+
+	JDIMENSION crop_x = crop_left;
+	JDIMENSION crop_width = crop_right - crop_left;
+	jpeg_crop_scanline(cinfo, &crop_x, &crop_width);	// crop_x: aligned down to an iMCU column
+	int skip_columns = left - (int)crop_x;
+	assert(skip_columns >= 0 && (int)crop_width >= (right - left + skip_columns));
+
+	if(top > 0) jpeg_skip_scanlines(cinfo, top);
+
+	image = bgra_image_init(image, right - left, bottom - top, NULL);
+	assert(image);
+	debug_printf("%s(): roi(%d,%d %dx%d) 1/%d ==> %dx%d, crop: x=%u width=%u",
+		__FUNCTION__, x, y, width, height, denom, image->width, image->height,
+		(unsigned int)crop_x, (unsigned int)crop_width);
+
+	int row_group = cinfo->rec_outbuf_height;
+	if(row_group < 1) row_group = 1;
+	if(row_group > 16) row_group = 16;
+	JSAMPROW row_pointers[16];
+
+	int row_stride = bgra_image_stride(image);
+	int direct = (skip_columns == 0 && (int)crop_width == image->width);
+	size_t scratch_stride = (size_t)crop_width * 4;
+	if(!direct)
+	{
+		scratch = malloc(scratch_stride * row_group);
+		assert(scratch);
+	}
+
+	while((int)cinfo->output_scanline < bottom)
+	{
+		int row = cinfo->output_scanline - top;
+		int rows = bottom - (int)cinfo->output_scanline;
+		if(rows > row_group) rows = row_group;
+		for(int i = 0; i < rows; ++i)
+		{
+			row_pointers[i] = direct?(JSAMPROW)(image->data + (ssize_t)(row + i) * row_stride)
+				:(JSAMPROW)(scratch + scratch_stride * i);
+		}
+		int n = jpeg_read_scanlines(cinfo, row_pointers, rows);
+		if(n <= 0) break;
+		if(!direct)
+		{
+			for(int i = 0; i < n; ++i)
+			{
+				memcpy(image->data + (ssize_t)(row + i) * row_stride, scratch + scratch_stride * i + skip_columns * 4,
+					image->width * 4);
+			}
+		}
+	}
+	free(scratch);
+	scratch = NULL;
+
+	jpeg_abort_decompress(cinfo);	// the rows below the rect are not needed
+	return 0;
+}
+#else
+static int jpeg_decode_roi(bgra_image_t * image, const unsigned char * jpeg, size_t length,
+	int x, int y, int width, int height, int min_width, int min_height, int flags)
+{
+	// libjpeg without jpeg_crop_scanline(): full decode followed by a crop
+	bgra_image_t decoded[1], view[1];
+	memset(decoded, 0, sizeof(decoded));
+	memset(view, 0, sizeof(view));
+	int rc = jpeg_decode(decoded, jpeg, length, 0, 0, flags);
+	if(0 == rc) rc = (NULL == bgra_image_view(view, decoded, x, y, width, height));
+	if(0 == rc && (min_width > 0 || min_height > 0))
+	{
+		// the same size as the scaled (1/2, 1/4, 1/8) decode of the turbo path
+		int denom = 8;
+		for(; denom > 1; denom /= 2)
+		{
+			if((view->width / denom) >= min_width && (view->height / denom) >= min_height) break;
+		}
+		x = (x > 0)?x:0;
+		y = (y > 0)?y:0;
+		int scaled_width = (x + view->width + denom - 1) / denom - x / denom;
+		int scaled_height = (y + view->height + denom - 1) / denom - y / denom;
+		if(denom == 1) rc = (NULL == bgra_image_copy(image, view));
+		else if(NULL == bgra_image_init(image, scaled_width, scaled_height, NULL)) rc = -1;
+		else rc = bgra_image_resize(image, view, bgra_image_resize_filter_area);
+	}else if(0 == rc)
+	{
+		rc = (NULL == bgra_image_copy(image, view));
+	}
+	bgra_image_clear(decoded);
+	return rc?-1:0;
+}
+#endif
+
+int bgra_image_from_jpeg_stream_roi(bgra_image_t * image, const unsigned char * jpeg, size_t length,
+	int x, int y, int width, int height, int min_width, int min_height, int flags)
+{
+	assert(image);
+	return jpeg_decode_roi(image, jpeg, length, x, y, width, height, min_width, min_height, flags);
+}
+
+int bgra_image_from_jpeg_stream_resized(bgra_image_t * dst, const unsigned char * jpeg, size_t length, enum bgra_image_resize_filter filter)
+{
+	assert(dst && dst->width > 0 && dst->height > 0);
+	bgra_image_t decoded[1];
+	memset(decoded, 0, sizeof(decoded));
+
+	int rc = jpeg_decode(decoded, jpeg, length, dst->width, dst->height, 0);
+	if(0 == rc) rc = bgra_image_resize(dst, decoded, filter);
+	bgra_image_clear(decoded);
+	return rc;
 }
 
 typedef struct png_closure
@@ -241,12 +1195,14 @@ int bgra_image_from_png_stream(bgra_image_t * image, const unsigned char * png,
 		closure);
 	
 	if(surface) {
-		unsigned char * image_data = cairo_image_surface_get_data(surface);
-		int width = cairo_image_surface_get_width(surface);
-		int height = cairo_image_surface_get_height(surface);
-		
-		image = bgra_image_init(image, width, height, image_data);
-		if(image != NULL) rc = 0;
+		bgra_image_t png_image = {
+			.data = cairo_image_surface_get_data(surface),
+			.width = cairo_image_surface_get_width(surface),
+			.height = cairo_image_surface_get_height(surface),
+			.stride = cairo_image_surface_get_stride(surface),
+		};
+		if(png_image.data) image = bgra_image_copy(image, &png_image);
+		if(png_image.data && image != NULL) rc = 0;
 	}
 	if(surface) cairo_surface_destroy(surface);
 	return rc;
@@ -254,15 +1210,12 @@ int bgra_image_from_png_stream(bgra_image_t * image, const unsigned char * png,
 
 int img_utils_get_png_size(const unsigned char * png, size_t length, int * p_width, int * p_height)
 {
-	bgra_image_t bgra[1];
-	memset(bgra, 0, sizeof(bgra));
-	int rc = bgra_image_from_png_stream(bgra, png, length);
-	if(rc) return -1;
-
-	if(p_width) *p_width = bgra->width;
-	if(p_height) * p_height = bgra->height;
+	struct img_utils_image_info info[1];
+	int rc = img_utils_probe(png, length, info);
+	if(rc || info->type != img_utils_image_type_png) return -1;
 
-	bgra_image_clear(bgra);
+	if(p_width) *p_width = info->width;
+	if(p_height) *p_height = info->height;
 	return 0;
 }
 
@@ -271,11 +1224,11 @@ int bgra_image_load_data(bgra_image_t * image,
 	const void * image_data, // image_data: png or jpeg format
 	size_t length)
 {
-	enum image_type type = guess_image_type(NULL, image_data, length);
+	enum img_utils_image_type type = guess_image_type(NULL, image_data, length);
 	switch(type)
 	{
-	case image_type_jpeg: bgra_image_from_jpeg_stream(image, image_data, length); break;
-	case image_type_png: bgra_image_from_png_stream(image, image_data, length); break;
+	case img_utils_image_type_jpeg: bgra_image_from_jpeg_stream(image, image_data, length); break;
+	case img_utils_image_type_png: bgra_image_from_png_stream(image, image_data, length); break;
 	default:
 		fprintf(stderr, "[WARNING]::%s()::unable to load image! (UNKNOWN TYPE)\n", __FUNCTION__);
 		return -1;
@@ -333,63 +1286,241 @@ int bgra_image_load_from_file(bgra_image_t * image, const char * filename)
 }
 
 
-ssize_t bgra_image_to_jpeg_stream(bgra_image_t * image, unsigned char ** jpeg_stream, int quality)
+/*
+ * encode with the thread's compressor into its (reused) output buffer
+ * return the length of the stream, 0 on error
+ */
+static size_t jpeg_encode(struct jpeg_thread_context * ctx, const bgra_image_t * image, const struct bgra_image_jpeg_options * options)
 {
-	struct jpeg_compress_struct cinfo;
-	struct jpeg_error_mgr jerr;
-	memset(&jerr, 0, sizeof(jerr));
+	struct jpeg_compress_struct * cinfo = jpeg_thread_compressor(ctx);
+	if(setjmp(ctx->cinfo_err->setjmp_buffer))
+	{
+		jpeg_abort_compress(cinfo);
+		return 0;
+	}
 	
-	memset(&cinfo, 0, sizeof(cinfo));
+	cinfo->image_width = image->width;
+	cinfo->image_height = image->height;
+	cinfo->input_components = 4;
+	cinfo->in_color_space = JCS_EXT_BGRA;
+	jpeg_set_defaults(cinfo);
+	jpeg_set_quality(cinfo, (options->quality > 0)?options->quality:95, TRUE);
 	
-	int rc = 0;
-	unsigned long cb_jpeg = 0;
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_compress(&cinfo);
-	jpeg_mem_dest(&cinfo, jpeg_stream, &cb_jpeg);
-	
-	cinfo.image_width = image->width;
-	cinfo.image_height = image->height;
-	cinfo.input_components = 4;
-	cinfo.in_color_space = JCS_EXT_BGRA;
-	jpeg_set_defaults(&cinfo);
-	jpeg_set_quality(&cinfo, quality, TRUE);
+	// jpeg_set_defaults(): YCbCr 4:2:0
+	switch(options->subsampling)
+	{
+	case bgra_image_jpeg_subsampling_444: 
+		cinfo->comp_info[0].h_samp_factor = 1; 
+		cinfo->comp_info[0].v_samp_factor = 1; 
+		break;
+	case bgra_image_jpeg_subsampling_422: 
+		cinfo->comp_info[0].h_samp_factor = 2; 
+		cinfo->comp_info[0].v_samp_factor = 1; 
+		break;
+	default:
+		break;
+	}
+	if(options->optimize_coding) cinfo->optimize_coding = TRUE;
+	if(options->fast_dct) cinfo->dct_method = JDCT_IFAST;
 	
-	jpeg_start_compress(&cinfo, TRUE);
+	jpeg_start_compress(cinfo, TRUE);
 	JSAMPROW row_pointer[1] = { NULL };
 	
 	unsigned char * row = image->data;
-	int row_stride = image->stride?image->stride:(image->width * 4);
-	while(cinfo.next_scanline < cinfo.image_height)
+	int row_stride = bgra_image_stride(image);
+	while(cinfo->next_scanline < cinfo->image_height)
 	{
 		row_pointer[0] = (JSAMPLE *)row;
-		int n = jpeg_write_scanlines(&cinfo, row_pointer, 1);
-		if(n != 1) { rc = -1; break; }
+		int n = jpeg_write_scanlines(cinfo, row_pointer, 1);
+		if(n != 1) { 
+			jpeg_abort_compress(cinfo);
+			return 0;
+		}
 		row += row_stride;
 	}
-	jpeg_finish_compress(&cinfo);
-	jpeg_destroy_compress(&cinfo);
-	if(rc) return 0;
+	jpeg_finish_compress(cinfo);
+	return ctx->writer->length;
+}
+
+static void jpeg_encode_done(struct jpeg_thread_context * ctx)
+{
+	struct jpeg_mem_writer * writer = ctx->writer;
+	if(writer->max_size > JPEG_OUTPUT_BUFFER_MAX_KEEP)
+	{
+		free(writer->buffer);
+		writer->buffer = NULL;
+		writer->max_size = 0;
+	}
+	writer->length = 0;
+}
+
+ssize_t bgra_image_to_jpeg_stream_ex(const bgra_image_t * image, unsigned char ** jpeg_stream, const struct bgra_image_jpeg_options * options)
+{
+	assert(image && image->data && jpeg_stream);
+	static const struct bgra_image_jpeg_options default_options = { .quality = 95 };
+	if(NULL == options) options = &default_options;
 	
+	struct jpeg_thread_context * ctx = jpeg_thread_context_get();
+	size_t cb_jpeg = jpeg_encode(ctx, image, options);
+	if(cb_jpeg > 0)
+	{
+		// exact-size copy for the caller, the work buffer is kept
+		unsigned char * jpeg = malloc(cb_jpeg);
+		assert(jpeg);
+		memcpy(jpeg, ctx->writer->buffer, cb_jpeg);
+		*jpeg_stream = jpeg;
+	}
+	jpeg_encode_done(ctx);
 	return cb_jpeg;
 }
+
+ssize_t bgra_image_to_jpeg_stream(bgra_image_t * image, unsigned char ** jpeg_stream, int quality)
+{
+	struct bgra_image_jpeg_options options = { .quality = quality };
+	return bgra_image_to_jpeg_stream_ex(image, jpeg_stream, &options);
+}
+
+struct bgra_image_png_options * bgra_image_png_options_init(struct bgra_image_png_options * options,
+	enum bgra_image_png_preset preset, enum bgra_image_png_format format)
+{
+	static const struct bgra_image_png_options s_presets[] = {
+		[bgra_image_png_preset_fastest]  = { .compression_level = 1, .filters = bgra_image_png_filter_none, .strategy = bgra_image_png_strategy_rle },
+		[bgra_image_png_preset_fast]     = { .compression_level = 1, .filters = bgra_image_png_filter_sub, .strategy = bgra_image_png_strategy_default },
+		[bgra_image_png_preset_default]  = { .compression_level = 6, .filters = bgra_image_png_filter_all, .strategy = bgra_image_png_strategy_default },
+		[bgra_image_png_preset_smallest] = { .compression_level = 9, .filters = bgra_image_png_filter_all, .strategy = bgra_image_png_strategy_default },
+	};
+	if(NULL == options) options = calloc(1, sizeof(*options));
+	assert(options);
+
+	if(preset < 0 || preset > bgra_image_png_preset_smallest) preset = bgra_image_png_preset_fast;
+	*options = s_presets[preset];
+	options->format = format;
+	return options;
+}
+
+struct png_mem_writer
+{
+	unsigned char * data;
+	size_t length;
+	size_t max_size;
+};
+
+static void on_png_write(png_structp png, png_bytep data, png_size_t length)
+{
+	struct png_mem_writer * writer = png_get_io_ptr(png);
+	if((writer->length + length) > writer->max_size)
+	{
+		size_t new_size = writer->max_size?writer->max_size:65536;
+		while(new_size < (writer->length + length)) new_size *= 2;
+		unsigned char * buf = realloc(writer->data, new_size);
+		if(NULL == buf) png_error(png, "out of memory");
+		writer->data = buf;
+		writer->max_size = new_size;
+	}
+	memcpy(writer->data + writer->length, data, length);
+	writer->length += length;
+}
+
+static void on_png_flush(png_structp png)
+{
+	return;
+}
+
+ssize_t bgra_image_to_png_stream_ex(const bgra_image_t * image, unsigned char ** png_stream,
+	const struct bgra_image_png_options * options)
+{
+	assert(image && image->data && png_stream);
+	struct bgra_image_png_options default_options;
+	if(NULL == options) options = bgra_image_png_options_init(&default_options, bgra_image_png_preset_fast, bgra_image_png_format_rgba);
+
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info = png ? png_create_info_struct(png) : NULL;
+	if(NULL == png || NULL == info)
+	{
+		png_destroy_write_struct(&png, &info);
+		return 0;
+	}
+
+	int color_type = PNG_COLOR_TYPE_RGB_ALPHA;
+	if(options->format == bgra_image_png_format_rgb) color_type = PNG_COLOR_TYPE_RGB;
+	else if(options->format == bgra_image_png_format_gray) color_type = PNG_COLOR_TYPE_GRAY;
+
+	// pre-size the output: about 1/4 of the raw size
+	struct png_mem_writer writer[1];
+	memset(writer, 0, sizeof(writer));
+	writer->max_size = (size_t)image->width * image->height + 4096;
+	writer->data = malloc(writer->max_size);
+	assert(writer->data);
+
+	unsigned char * gray_row = NULL;
+	if(color_type == PNG_COLOR_TYPE_GRAY)
+	{
+		gray_row = malloc(image->width);
+		assert(gray_row);
+	}
+
+	if(setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_write_struct(&png, &info);
+		free(writer->data);
+		free(gray_row);
+		*png_stream = NULL;
+		return 0;
+	}
+
+	png_set_write_fn(png, writer, on_png_write, on_png_flush);
+	png_set_IHDR(png, info, image->width, image->height, 8, color_type,
+		PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_set_compression_level(png, options->compression_level);
+	png_set_compression_strategy(png, options->strategy);
+	png_set_filter(png, PNG_FILTER_TYPE_BASE, options->filters?options->filters:PNG_ALL_FILTERS);
+	png_write_info(png, info);
+
+	if(color_type != PNG_COLOR_TYPE_GRAY) png_set_bgr(png);
+	if(color_type == PNG_COLOR_TYPE_RGB) png_set_filler(png, 0, PNG_FILLER_AFTER);	// drop the alpha byte
+
+	const unsigned char * row = image->data;
+	const ssize_t stride = bgra_image_stride(image);
+	for(int y = 0; y < image->height; ++y, row += stride)
+	{
+		if(gray_row)
+		{
+			const unsigned char * bgra = row;
+			for(int x = 0; x < image->width; ++x, bgra += 4)
+			{
+				gray_row[x] = (bgra[2] * 77 + bgra[1] * 150 + bgra[0] * 29 + 128) >> 8;
+			}
+			png_write_row(png, gray_row);
+		}else
+		{
+			png_write_row(png, (png_const_bytep)row);
+		}
+	}
+	png_write_end(png, NULL);
+	png_destroy_write_struct(&png, &info);
+	free(gray_row);
+
+	*png_stream = writer->data;
+	return writer->length;
+}
+
 ssize_t bgra_image_to_png_stream(bgra_image_t * image, unsigned char ** png_stream)
 {
-	
-	return 0;
+	return bgra_image_to_png_stream_ex(image, png_stream, NULL);
 }
 
 int bgra_image_save_to_file(bgra_image_t * image, const char * filename, int quality)	// quality(0 ~ 100): for jpeg only, default 95
 {
-	enum image_type type = guess_image_type(filename, NULL, 0);
-	if(type == image_type_unknown)
+	enum img_utils_image_type type = guess_image_type(filename, NULL, 0);
+	if(type == img_utils_image_type_unknown)
 	{
-		type = image_type_png;		// default --> save as png file
+		type = img_utils_image_type_png;		// default --> save as png file
 	}
 	
-	if(type == image_type_png)
+	if(type == img_utils_image_type_png)
 	{
 		bgra_image_save_to_png(image, filename);
-	}else if(type == image_type_jpeg)
+	}else if(type == img_utils_image_type_jpeg)
 	{
 		bgra_image_save_to_jpeg(image, filename, quality);
 	}else
@@ -402,12 +1533,6 @@ int bgra_image_save_to_file(bgra_image_t * image, const char * filename, int qua
 
 int bgra_image_save_to_jpeg(bgra_image_t * image, const char * filename, int quality)
 {
-	struct jpeg_compress_struct cinfo;
-	struct jpeg_error_mgr jerr;
-	
-	int rc = 0;
-	memset(&cinfo, 0, sizeof(cinfo));
-	
 	FILE * fp = fopen(filename, "wb");
 	if(NULL == fp)
 	{
@@ -416,46 +1541,33 @@ int bgra_image_save_to_jpeg(bgra_image_t * image, const char * filename, int qua
 		return err;
 	}
 	
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_compress(&cinfo);
-	jpeg_stdio_dest(&cinfo, fp);
-	
-	cinfo.image_width = image->width;
-	cinfo.image_height = image->height;
-	cinfo.input_components = 4;
-	cinfo.in_color_space = JCS_EXT_BGRA;
-	jpeg_set_defaults(&cinfo);
-	jpeg_set_quality(&cinfo, quality, TRUE);
-	
-	jpeg_start_compress(&cinfo, TRUE);
-	JSAMPROW row_pointer[1] = { NULL };
-	
-	unsigned char * row = image->data;
-	int row_stride = image->stride?image->stride:(image->width * 4);
-	while(cinfo.next_scanline < cinfo.image_height)
-	{
-		row_pointer[0] = (JSAMPLE *)row;
-		int n = jpeg_write_scanlines(&cinfo, row_pointer, 1);
-		if(n != 1) { rc = -1; break;  }
-		row += row_stride;
-	}
-	jpeg_finish_compress(&cinfo);
+	int rc = -1;
+	struct jpeg_thread_context * ctx = jpeg_thread_context_get();
+	struct bgra_image_jpeg_options options = { .quality = quality };
+	size_t cb_jpeg = jpeg_encode(ctx, image, &options);
+	if(cb_jpeg > 0 && fwrite(ctx->writer->buffer, 1, cb_jpeg, fp) == cb_jpeg) rc = 0;
+	jpeg_encode_done(ctx);
 	fclose(fp);
-	jpeg_destroy_compress(&cinfo);
 	return rc;
 }
 
 int bgra_image_save_to_png(bgra_image_t * image, const char * filename)
 {
+	unsigned char * png = NULL;
+	ssize_t cb_png = bgra_image_to_png_stream_ex(image, &png, NULL);
+	if(cb_png <= 0) return -1;
+	
 	int rc = -1;
-	cairo_surface_t * png = cairo_image_surface_create_for_data(image->data,
-		CAIRO_FORMAT_ARGB32,
-		image->width, image->height,
-		image->stride?image->stride:(image->width * 4));
-	if(png && cairo_surface_status(png) == CAIRO_STATUS_SUCCESS)
+	FILE * fp = fopen(filename, "wb");
+	if(NULL == fp)
 	{
-		rc = cairo_surface_write_to_png(png, filename);
+		int err = errno;
+		fprintf(stderr, "[WARNING]::%s(%s)::%s\n", __FUNCTION__, filename, strerror(err));
+		free(png);
+		return err;
 	}
-	if(png) cairo_surface_destroy(png);
+	if(fwrite(png, 1, cb_png, fp) == (size_t)cb_png) rc = 0;
+	fclose(fp);
+	free(png);
 	return rc;
 }
@@ -29,11 +29,15 @@
 
 #include "img_proc.h"
 #include "input-frame.h"
+#include "frame-pool.h"
 #include <json-c/json.h>
 
 
-static const char * input_image_type_string[input_frame_type_png + 1] = {
+static const char * input_image_type_string[input_frame_type_gray8 + 1] = {
 	[input_frame_type_bgra] = "BGRA",
+	[input_frame_type_nv12] = "NV12",
+	[input_frame_type_i420] = "I420",
+	[input_frame_type_gray8] = "GRAY8",
 #ifndef _WIN32
 	[input_frame_type_jpeg] = "image/jpeg",
 	[input_frame_type_png] = "image/png",
@@ -85,6 +89,13 @@ enum input_frame_type input_frame_type_from_string(const char * sz_type)
 			if(image_flags) { type = input_frame_type_invalid; break; }
 			image_flags = 1;
 			type |= input_frame_type_png;
+		}else if(strcasecmp(t, "nv12") == 0 || strcasecmp(t, "i420") == 0 || strcasecmp(t, "gray8") == 0)
+		{
+			if(image_flags) { type = input_frame_type_invalid; break; }
+			image_flags = 1;
+			if(strcasecmp(t, "nv12") == 0) type |= input_frame_type_nv12;
+			else if(strcasecmp(t, "i420") == 0) type |= input_frame_type_i420;
+			else type |= input_frame_type_gray8;
 		}else if(strcasecmp(t, "bgra") == 0 || strcasecmp(t, "bgr") || strcasecmp(t, "grayscale") == 0)
 		{
 			if(image_flags) { type = input_frame_type_invalid; break; }
@@ -119,6 +130,9 @@ ssize_t	input_frame_type_to_string(enum input_frame_type type, char sz_type[], s
 		case input_frame_type_bgra:
 		case input_frame_type_jpeg:
 		case input_frame_type_png:
+		case input_frame_type_nv12:
+		case input_frame_type_i420:
+		case input_frame_type_gray8:
 			cb = snprintf(p, p_end - p, "%s",  input_image_type_string[img_type]);
 			break;
 		default:
@@ -139,12 +153,67 @@ ssize_t	input_frame_type_to_string(enum input_frame_type type, char sz_type[], s
 	return p_end - p;
 }
 
+/*********************************
+ * input_frame_payload
+ *********************************/
+static input_frame_payload_t * input_frame_payload_new(unsigned char * data, ssize_t length, char * json_str, ssize_t cb_json)
+{
+	input_frame_payload_t * payload = calloc(1, sizeof(*payload));
+	assert(payload);
+	
+	payload->refs = 1;
+	payload->data = data;
+	payload->length = length;
+	payload->json_str = json_str;
+	payload->cb_json = cb_json;
+	return payload;
+}
+
+input_frame_payload_t * input_frame_payload_addref(input_frame_payload_t * payload)
+{
+	if(NULL == payload) return NULL;
+	long refs = __atomic_add_fetch(&payload->refs, 1, __ATOMIC_RELAXED);
+	assert(refs > 1);
+	(void)refs;
+	return payload;
+}
+
+void input_frame_payload_unref(input_frame_payload_t * payload)
+{
+	if(NULL == payload) return;
+	if(0 == __atomic_sub_fetch(&payload->refs, 1, __ATOMIC_ACQ_REL))
+	{
+		frame_pool_release(payload->data);
+		free(payload->json_str);
+		free(payload);
+	}
+	return;
+}
+
+static void input_frame_detach_payload(input_frame_t * frame)
+{
+	if(NULL == frame->payload) return;
+	
+	// (data, json_str) are owned by the payload
+	input_frame_payload_unref(frame->payload);
+	frame->payload = NULL;
+	frame->data = NULL;
+	frame->json_str = NULL;
+	frame->cb_json = 0;
+	return;
+}
+
 void input_frame_clear(input_frame_t * frame)
 {
 	if(NULL == frame) return;
-	if(frame->data)
+	if(frame->payload)
 	{
-		free(frame->data);
+		input_frame_detach_payload(frame);
+	}
+	
+	if(frame->data && NULL == frame->parent)
+	{
+		frame_pool_release(frame->data);
 		frame->data = NULL;
 	}
 
@@ -177,6 +246,7 @@ input_frame_t * input_frame_new()
 int input_frame_set_json(input_frame_t * frame, const char * json_str, ssize_t cb_json)
 {
 	assert(frame);
+	if(frame->payload) input_frame_make_writable(frame);
 
 	if(frame->json_str) {
 
@@ -207,13 +277,13 @@ int input_frame_set_json(input_frame_t * frame, const char * json_str, ssize_t c
 int input_frame_set_bgra(input_frame_t * frame, const bgra_image_t * bgra, const char * json_str, ssize_t cb_json)
 {
 	assert(frame);
+	input_frame_detach_payload(frame);
 	frame->type = input_frame_type_unknown;
 	if(bgra)
 	{
 		frame->type |= input_frame_type_bgra;
-		bgra_image_init(frame->bgra, bgra->width, bgra->height, bgra->data);
+		bgra_image_copy(frame->bgra, bgra);	// views are packed, stride == width * 4
 		frame->bgra->channels = bgra->channels;
-		frame->bgra->stride = bgra->stride;
 
 	}
 	if(json_str) input_frame_set_json(frame, json_str, cb_json);
@@ -224,6 +294,7 @@ int input_frame_set_bgra(input_frame_t * frame, const bgra_image_t * bgra, const
 int input_frame_set_jpeg(input_frame_t * frame, const unsigned char * data, ssize_t length, const char * json_str, ssize_t cb_json)
 {
 	assert(frame);
+	input_frame_detach_payload(frame);
 	frame->type = input_frame_type_unknown;
 	if(data)
 	{
@@ -235,7 +306,7 @@ int input_frame_set_jpeg(input_frame_t * frame, const unsigned char * data, ssiz
 		if(0 == rc && width > 0 && height > 0)
 		{
 			frame->type |= input_frame_type_jpeg;
-			unsigned char * buf = realloc(frame->data, length);
+			unsigned char * buf = frame_pool_reserve(frame->data, width, height, input_frame_type_jpeg, length);
 			assert(buf);
 			memcpy(buf, data, length);
 			
@@ -255,6 +326,7 @@ int input_frame_set_jpeg(input_frame_t * frame, const unsigned char * data, ssiz
 int input_frame_set_png(input_frame_t * frame, const unsigned char * data, ssize_t length, const char * json_str, ssize_t cb_json)
 {
 	assert(frame);
+	input_frame_detach_payload(frame);
 	frame->type = input_frame_type_unknown;
 	if(data)
 	{
@@ -266,7 +338,7 @@ int input_frame_set_png(input_frame_t * frame, const unsigned char * data, ssize
 		if(0 == rc && width > 0 && height > 0)
 		{
 			frame->type |= input_frame_type_png;
-			unsigned char * buf = realloc(frame->data, length);
+			unsigned char * buf = frame_pool_reserve(frame->data, width, height, input_frame_type_png, length);
 			assert(buf);
 			memcpy(buf, data, length);
 		
@@ -284,6 +356,56 @@ int input_frame_set_png(input_frame_t * frame, const unsigned char * data, ssize
 	return 0;
 }
 
+enum yuv_image_format input_frame_type_to_yuv_format(enum input_frame_type type)
+{
+	switch(type & input_frame_type_image_masks)
+	{
+	case input_frame_type_nv12: return yuv_image_format_nv12;
+	case input_frame_type_i420: return yuv_image_format_i420;
+	case input_frame_type_gray8: return yuv_image_format_gray8;
+	default: break;
+	}
+	return yuv_image_format_unknown;
+}
+
+int input_frame_set_yuv(input_frame_t * frame, enum input_frame_type type, const unsigned char * data, ssize_t length,
+	int width, int height, const char * json_str, ssize_t cb_json)
+{
+	assert(frame);
+	input_frame_detach_payload(frame);
+	frame->type = input_frame_type_unknown;
+	if(data)
+	{
+		int strides[3] = { 0 };
+		ssize_t size = yuv_image_layout(input_frame_type_to_yuv_format(type), width, height, strides, NULL);
+		if(size <= 0 || length < size) return -1;
+
+		type &= input_frame_type_image_masks;
+		unsigned char * buf = frame_pool_reserve(frame->data, width, height, type, size);
+		assert(buf);
+		memcpy(buf, data, size);
+
+		frame->type |= type;
+		frame->data = buf;
+		frame->length = size;
+		frame->width = width;
+		frame->height = height;
+		frame->channels = 1;
+		frame->stride = strides[0];
+	}
+	if(json_str) input_frame_set_json(frame, json_str, cb_json);
+	return 0;
+}
+
+int input_frame_get_yuv(const input_frame_t * frame, yuv_image_t * yuv)
+{
+	assert(frame && yuv);
+	enum yuv_image_format format = input_frame_type_to_yuv_format(frame->type);
+	if(format == yuv_image_format_unknown || NULL == frame->data) return -1;
+	memset(yuv, 0, sizeof(*yuv));
+	yuv->matrix = (frame->height >= 720)?yuv_image_matrix_bt709:yuv_image_matrix_bt601;	// GStreamer's default colorimetry
+	return yuv_image_init(yuv, format, frame->width, frame->height, frame->data, frame->length);
+}
 
 input_frame_t * input_frame_copy(input_frame_t * _dst, const input_frame_t * src)
 {
@@ -314,6 +436,12 @@ input_frame_t * input_frame_copy(input_frame_t * _dst, const input_frame_t * src
 			rc = input_frame_set_jpeg(dst, src->data, src->length, src->json_str, src->cb_json);
 		}
 		break;
+	case input_frame_type_nv12:
+	case input_frame_type_i420:
+	case input_frame_type_gray8:
+		if(src->length <= 0) break;
+		rc = input_frame_set_yuv(dst, image_type, src->data, src->length, src->width, src->height, src->json_str, src->cb_json);
+		break;
 	default:
 		break;
 	}
@@ -334,3 +462,97 @@ input_frame_t * input_frame_copy(input_frame_t * _dst, const input_frame_t * src
 	
 	return dst;
 }
+
+
+/*********************************
+ * input_frame: zero-copy helpers
+ *********************************/
+static ssize_t input_frame_get_image_size(const input_frame_t * frame)
+{
+	int image_type = frame->type & input_frame_type_image_masks;
+	if(image_type != input_frame_type_bgra) return frame->length;
+	
+	return (ssize_t)bgra_image_stride(frame->bgra) * frame->height;
+}
+
+int input_frame_share(input_frame_t * frame)
+{
+	assert(frame);
+	if(frame->payload) return 0;	// already shared
+	if(NULL == frame->data && NULL == frame->json_str) return -1;
+	
+	if(frame->parent)	// a view doesn't own its buffer
+	{
+		bgra_image_t view = *frame->bgra;
+		memset(frame->bgra, 0, sizeof(frame->bgra));
+		bgra_image_copy(frame->bgra, &view);
+	}
+	
+	// take ownership of the frame's own buffers, no copy
+	frame->payload = input_frame_payload_new(frame->data, input_frame_get_image_size(frame), 
+		frame->json_str, frame->cb_json);
+	return 0;
+}
+
+input_frame_t * input_frame_ref(input_frame_t * dst, const input_frame_t * src)
+{
+	assert(src);
+	if(dst == src) return dst;
+	
+	if(NULL == src->payload)
+	{
+		// publish a private copy once, then share it
+		input_frame_t * tmp = input_frame_copy(NULL, src);
+		if(NULL == tmp) return NULL;
+		
+		input_frame_share(tmp);
+		dst = input_frame_ref(dst, tmp);
+		input_frame_free(tmp);
+		return dst;
+	}
+	
+	if(NULL == dst) dst = input_frame_new();
+	else input_frame_clear(dst);
+	assert(dst);
+	
+	*dst = *src;
+	dst->meta_data = NULL;	// not owned by the frame
+	dst->payload = input_frame_payload_addref(src->payload);
+	return dst;
+}
+
+int input_frame_make_writable(input_frame_t * frame)
+{
+	assert(frame);
+	input_frame_payload_t * payload = frame->payload;
+	if(NULL == payload) return 0;
+	
+	if(__atomic_load_n(&payload->refs, __ATOMIC_ACQUIRE) == 1)
+	{
+		// no other readers: take the buffers back
+		payload->data = NULL;
+		payload->json_str = NULL;
+	}else
+	{
+		unsigned char * data = NULL;
+		char * json_str = NULL;
+		if(frame->data && payload->length > 0)
+		{
+			data = frame_pool_alloc(frame->width, frame->height, frame->type & input_frame_type_image_masks, payload->length);
+			assert(data);
+			memcpy(data, frame->data, payload->length);
+		}
+		if(frame->json_str)
+		{
+			json_str = calloc(1, frame->cb_json + 1);
+			assert(json_str);
+			memcpy(json_str, frame->json_str, frame->cb_json);
+		}
+		frame->data = data;
+		frame->json_str = json_str;
+	}
+	
+	frame->payload = NULL;
+	input_frame_payload_unref(payload);
+	return 0;
+}
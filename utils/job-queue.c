@@ -0,0 +1,222 @@
+/*
+ * job-queue.c
+ *
+ * Copyright 2022 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <errno.h>
+
+#include <pthread.h>
+
+#include "job-queue.h"
+
+double job_queue_get_time_sec(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+/******************************************************************************
+ * job_future
+ *****************************************************************************/
+job_future_t * job_future_init(job_future_t * future)
+{
+	if(NULL == future) future = calloc(1, sizeof(*future));
+	assert(future);
+	future->refs = 1;
+	future->done = 0;
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&future->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&future->mutex, NULL);
+	return future;
+}
+
+void job_future_cleanup(job_future_t * future)
+{
+	if(NULL == future) return;
+	pthread_mutex_destroy(&future->mutex);
+	pthread_cond_destroy(&future->cond);
+}
+
+void job_future_addref(job_future_t * future)
+{
+	__atomic_add_fetch(&future->refs, 1, __ATOMIC_ACQ_REL);
+}
+
+int job_future_unref(job_future_t * future)
+{
+	return (0 == __atomic_sub_fetch(&future->refs, 1, __ATOMIC_ACQ_REL));
+}
+
+void job_future_set_done(job_future_t * future)
+{
+	pthread_mutex_lock(&future->mutex);
+	future->done = 1;
+	pthread_cond_broadcast(&future->cond);
+	pthread_mutex_unlock(&future->mutex);
+}
+
+int job_future_wait(job_future_t * future, long timeout_ms)
+{
+	assert(future);
+	struct timespec abstime = { 0 };
+	if(timeout_ms >= 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &abstime);
+		abstime.tv_sec += timeout_ms / 1000;
+		abstime.tv_nsec += (timeout_ms % 1000) * 1000000;
+		if(abstime.tv_nsec >= 1000000000)
+		{
+			++abstime.tv_sec;
+			abstime.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&future->mutex);
+	while(!future->done)
+	{
+		if(timeout_ms < 0)
+		{
+			pthread_cond_wait(&future->cond, &future->mutex);
+		}else if(pthread_cond_timedwait(&future->cond, &future->mutex, &abstime) == ETIMEDOUT)
+		{
+			break;
+		}
+	}
+	int done = future->done;
+	pthread_mutex_unlock(&future->mutex);
+	return done;
+}
+
+/******************************************************************************
+ * job_queue
+ *****************************************************************************/
+job_queue_t * job_queue_init(job_queue_t * queue, int max_pending)
+{
+	if(NULL == queue) queue = calloc(1, sizeof(*queue));
+	assert(queue);
+	memset(queue, 0, sizeof(*queue));
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->not_empty, NULL);
+	pthread_cond_init(&queue->not_full, NULL);
+	if(max_pending > 0) job_queue_set_capacity(queue, max_pending);
+	return queue;
+}
+
+void job_queue_cleanup(job_queue_t * queue)
+{
+	if(NULL == queue) return;
+	assert(0 == queue->length);
+	pthread_mutex_destroy(&queue->mutex);
+	pthread_cond_destroy(&queue->not_empty);
+	pthread_cond_destroy(&queue->not_full);
+	free(queue->jobs);
+	queue->jobs = NULL;
+	queue->max_pending = 0;
+}
+
+void job_queue_set_capacity(job_queue_t * queue, int max_pending)
+{
+	assert(queue && 0 == queue->length && max_pending > 0);
+	void ** jobs = realloc(queue->jobs, max_pending * sizeof(*jobs));
+	assert(jobs);
+	queue->jobs = jobs;
+	queue->max_pending = max_pending;
+	queue->start_pos = 0;
+}
+
+int job_queue_is_full(const job_queue_t * queue)
+{
+	return queue->quit || queue->length >= queue->max_pending;
+}
+
+int job_queue_push(job_queue_t * queue, void * job, int wait_if_full)
+{
+	while(wait_if_full && !queue->quit && queue->length >= queue->max_pending)
+	{
+		pthread_cond_wait(&queue->not_full, &queue->mutex);
+	}
+	if(job_queue_is_full(queue)) return -1;
+
+	queue->jobs[(queue->start_pos + queue->length) % queue->max_pending] = job;
+	++queue->length;
+	pthread_cond_signal(&queue->not_empty);
+	return 0;
+}
+
+int job_queue_pop(job_queue_t * queue, void ** jobs, int max_count)
+{
+	assert(max_count > 0);
+	while(!queue->quit && queue->length == 0) pthread_cond_wait(&queue->not_empty, &queue->mutex);
+	if(queue->quit) return 0;
+
+	int count = (queue->length < max_count)?queue->length:max_count;
+	for(int i = 0; i < count; ++i)
+	{
+		jobs[i] = queue->jobs[queue->start_pos];
+		queue->start_pos = (queue->start_pos + 1) % queue->max_pending;
+	}
+	queue->length -= count;
+	pthread_cond_broadcast(&queue->not_full);
+	if(queue->length > 0) pthread_cond_signal(&queue->not_empty);
+	return count;
+}
+
+void job_queue_stop(job_queue_t * queue)
+{
+	pthread_mutex_lock(&queue->mutex);
+	queue->quit = 1;
+	pthread_cond_broadcast(&queue->not_empty);
+	pthread_cond_broadcast(&queue->not_full);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+int job_queue_cancel_all(job_queue_t * queue, void (* cancel)(void * job, void * user_data), void * user_data)
+{
+	assert(queue->quit && cancel);
+	int num_cancelled = 0;
+	while(1)
+	{
+		pthread_mutex_lock(&queue->mutex);
+		void * job = NULL;
+		if(queue->length > 0)
+		{
+			job = queue->jobs[queue->start_pos];
+			queue->start_pos = (queue->start_pos + 1) % queue->max_pending;
+			--queue->length;
+		}
+		pthread_mutex_unlock(&queue->mutex);
+		if(NULL == job) break;
+
+		cancel(job, user_data);
+		++num_cancelled;
+	}
+	return num_cancelled;
+}
@@ -0,0 +1,296 @@
+/*
+ * jpeg-encode-service.c
+ *
+ * Copyright 2022 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "jpeg-encode-service.h"
+#include "job-queue.h"
+
+#define JPEG_ENCODE_MAX_WORKERS		(8)
+
+/******************************************************************************
+ * jpeg_encode_job
+ *****************************************************************************/
+struct job_private
+{
+	jpeg_encode_job_t base[1];	// MUST be the first field
+	job_future_t future[1];
+	double submit_time;
+};
+
+static struct job_private * job_private_new(void)
+{
+	struct job_private * job = calloc(1, sizeof(*job));
+	assert(job);
+	job_future_init(job->future);
+	return job;
+}
+
+static void job_private_free(struct job_private * job)
+{
+	bgra_image_clear(job->base->image);
+	free(job->base->jpeg);
+	job_future_cleanup(job->future);
+	free(job);
+}
+
+void jpeg_encode_job_unref(jpeg_encode_job_t * job)
+{
+	if(NULL == job) return;
+	struct job_private * priv = (struct job_private *)job;
+	if(job_future_unref(priv->future)) job_private_free(priv);
+}
+
+static void job_complete(struct job_private * job, int status)
+{
+	job->base->status = status;
+
+	// the callback sees the results before the waiters do, (it may take the data)
+	if(job->base->on_completed) job->base->on_completed(job->base);
+	job_future_set_done(job->future);
+}
+
+int jpeg_encode_job_wait(jpeg_encode_job_t * job, long timeout_ms)
+{
+	assert(job);
+	struct job_private * priv = (struct job_private *)job;
+	return job_future_wait(priv->future, timeout_ms)?job->status:jpeg_encode_job_status_pending;
+}
+
+unsigned char * jpeg_encode_job_take_data(jpeg_encode_job_t * job, size_t * p_length)
+{
+	assert(job);
+	unsigned char * jpeg = job->jpeg;
+	if(p_length) *p_length = job->length;
+	job->jpeg = NULL;
+	job->length = 0;
+	return jpeg;
+}
+
+/******************************************************************************
+ * jpeg_encode_service
+ *****************************************************************************/
+struct jpeg_encode_service_private
+{
+	jpeg_encode_service_t * service;
+	job_queue_t queue[1];	// queue->mutex also guards the stats
+
+	int num_workers;
+	pthread_t workers[JPEG_ENCODE_MAX_WORKERS];
+
+	struct jpeg_encode_service_stats stats;
+};
+
+static void * worker_thread(void * user_data)
+{
+	struct jpeg_encode_service_private * priv = user_data;
+	while(1)
+	{
+		struct job_private * job = NULL;
+		pthread_mutex_lock(&priv->queue->mutex);
+		int count = job_queue_pop(priv->queue, (void **)&job, 1);
+		pthread_mutex_unlock(&priv->queue->mutex);
+		if(0 == count) break;
+
+		jpeg_encode_job_t * base = job->base;
+		double begin_time = job_queue_get_time_sec();
+		base->queued_time = begin_time - job->submit_time;
+
+		ssize_t length = bgra_image_to_jpeg_stream_ex(base->image, &base->jpeg, &base->options);
+		base->encode_time = job_queue_get_time_sec() - begin_time;
+		base->length = (length > 0)?length:0;
+
+		double encode_time = base->encode_time;
+		job_complete(job, (length > 0)?jpeg_encode_job_status_completed:jpeg_encode_job_status_failed);
+		jpeg_encode_job_unref(base);	// the source image goes back to the pool with the last reference
+
+		// counted once the callback has returned
+		pthread_mutex_lock(&priv->queue->mutex);
+		if(length > 0)
+		{
+			++priv->stats.completed;
+			priv->stats.encode_time += encode_time;
+		}else
+		{
+			++priv->stats.failed;
+		}
+		pthread_mutex_unlock(&priv->queue->mutex);
+	}
+
+	img_utils_jpeg_thread_context_release();
+	return NULL;
+}
+
+static int jpeg_encode_service_submit(struct jpeg_encode_service * service, bgra_image_t * image,
+	const struct bgra_image_jpeg_options * options, int flags,
+	void (* on_completed)(jpeg_encode_job_t * job), void * user_data,
+	jpeg_encode_job_t ** p_job)
+{
+	assert(service && service->priv);
+	assert(image && image->data && image->width > 0 && image->height > 0);
+	struct jpeg_encode_service_private * priv = service->priv;
+
+	// fast path: drop without touching the image
+	pthread_mutex_lock(&priv->queue->mutex);
+	++priv->stats.submitted;
+	int full = priv->queue->quit || (job_queue_is_full(priv->queue) && !(flags & jpeg_encode_flag_wait_if_full));
+	if(full) ++priv->stats.dropped;
+	pthread_mutex_unlock(&priv->queue->mutex);
+	if(p_job) *p_job = NULL;
+	if(full) return -1;
+
+	// copy (or adopt) the image outside the lock
+	struct job_private * job = job_private_new();
+	jpeg_encode_job_t * base = job->base;
+	base->user_data = user_data;
+	base->on_completed = on_completed;
+	if(options) base->options = *options;
+	int adopted = ((flags & jpeg_encode_flag_adopt_image) && NULL == image->parent);
+	if(adopted)
+	{
+		*base->image = *image;
+		memset(image, 0, sizeof(*image));
+	}else
+	{
+		bgra_image_copy(base->image, image);
+	}
+
+	pthread_mutex_lock(&priv->queue->mutex);
+	if(job_queue_push(priv->queue, job, (flags & jpeg_encode_flag_wait_if_full)))
+	{
+		++priv->stats.dropped;
+		pthread_mutex_unlock(&priv->queue->mutex);
+
+		// the caller keeps the ownership of the image on failure
+		if(adopted)
+		{
+			*image = *base->image;
+			memset(base->image, 0, sizeof(base->image));
+		}
+		job_private_free(job);
+		return -1;
+	}
+
+	job->submit_time = job_queue_get_time_sec();	// the workers can't pop it before the lock is released
+	if(p_job)
+	{
+		job_future_addref(job->future);	// not shared yet
+		*p_job = base;
+	}
+	pthread_mutex_unlock(&priv->queue->mutex);
+	return 0;
+}
+
+static void jpeg_encode_service_get_stats(struct jpeg_encode_service * service, struct jpeg_encode_service_stats * stats)
+{
+	assert(service && service->priv && stats);
+	struct jpeg_encode_service_private * priv = service->priv;
+	pthread_mutex_lock(&priv->queue->mutex);
+	*stats = priv->stats;
+	stats->pending = priv->queue->length;
+	pthread_mutex_unlock(&priv->queue->mutex);
+}
+
+jpeg_encode_service_t * jpeg_encode_service_init(jpeg_encode_service_t * service, int num_workers, int max_pending, void * user_data)
+{
+	if(num_workers <= 0)
+	{
+		long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		num_workers = (num_cpus > 1)?(num_cpus / 2):1;
+	}
+	if(num_workers > JPEG_ENCODE_MAX_WORKERS) num_workers = JPEG_ENCODE_MAX_WORKERS;
+	if(max_pending <= 0) max_pending = num_workers * 4;
+
+	if(NULL == service) service = calloc(1, sizeof(*service));
+	assert(service);
+	service->user_data = user_data;
+	service->num_workers = num_workers;
+	service->max_pending = max_pending;
+	service->submit = jpeg_encode_service_submit;
+	service->get_stats = jpeg_encode_service_get_stats;
+
+	struct jpeg_encode_service_private * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->service = service;
+	job_queue_init(priv->queue, max_pending);
+	service->priv = priv;
+
+	for(int i = 0; i < num_workers; ++i)
+	{
+		int rc = pthread_create(&priv->workers[i], NULL, worker_thread, priv);
+		assert(0 == rc);
+		priv->num_workers = i + 1;
+	}
+	return service;
+}
+
+static void cancel_job(void * job_ptr, void * user_data)
+{
+	struct jpeg_encode_service_private * priv = user_data;
+	struct job_private * job = job_ptr;
+
+	pthread_mutex_lock(&priv->queue->mutex);
+	++priv->stats.cancelled;
+	pthread_mutex_unlock(&priv->queue->mutex);
+
+	bgra_image_clear(job->base->image);
+	job_complete(job, jpeg_encode_job_status_cancelled);
+	jpeg_encode_job_unref(job->base);
+}
+
+void jpeg_encode_service_cleanup(jpeg_encode_service_t * service)
+{
+	if(NULL == service || NULL == service->priv) return;
+	struct jpeg_encode_service_private * priv = service->priv;
+
+	job_queue_stop(priv->queue);
+	for(int i = 0; i < priv->num_workers; ++i) pthread_join(priv->workers[i], NULL);
+	priv->num_workers = 0;
+
+	// cancel the pending jobs
+	job_queue_cancel_all(priv->queue, cancel_job, priv);
+	job_queue_cleanup(priv->queue);
+	free(priv);
+	service->priv = NULL;
+}
+
+static jpeg_encode_service_t s_default_service[1];
+static pthread_once_t s_default_service_once = PTHREAD_ONCE_INIT;
+static void default_service_init(void)
+{
+	jpeg_encode_service_init(s_default_service, 0, 0, NULL);
+}
+
+jpeg_encode_service_t * jpeg_encode_service_get_default(void)
+{
+	pthread_once(&s_default_service_once, default_service_init);
+	return s_default_service;
+}
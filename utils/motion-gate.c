@@ -0,0 +1,313 @@
+/*
+ * motion-gate.c
+ *
+ * Copyright 2022 chehw <htc.chehw@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "utils.h"
+#include "motion-gate.h"
+
+static inline int64_t get_monotonic_ms(void)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/******************************************************************************
+ * building blocks
+ *****************************************************************************/
+void motion_gate_bgra_to_luma(const bgra_image_t * image, uint8_t * luma, int luma_stride)
+{
+	assert(image && image->data && luma);
+	int stride = bgra_image_stride(image);
+	for(int y = 0; y < image->height; ++y)
+	{
+		const unsigned char * bgra = image->data + (ssize_t)y * stride;
+		uint8_t * dst = luma + (ssize_t)y * luma_stride;
+		for(int x = 0; x < image->width; ++x, bgra += 4)
+		{
+			dst[x] = (bgra[2] * 77 + bgra[1] * 150 + bgra[0] * 29 + 128) >> 8;
+		}
+	}
+}
+
+/*
+ * block_size: a multiple of 8, the sums are accumulated per 8-pixel group (psadbw granularity)
+ */
+void motion_gate_block_sad(const uint8_t * luma, const uint8_t * background, int width, int height, int stride,
+	int block_size, uint32_t * block_sads)
+{
+	assert(block_size >= 8 && (block_size % 8) == 0);
+	int blocks_x = width / block_size;
+	int blocks_y = height / block_size;
+	int groups_x = blocks_x * block_size / 8;	// 8-pixel groups per row
+	int groups_per_block = block_size / 8;
+	memset(block_sads, 0, sizeof(*block_sads) * blocks_x * blocks_y);
+
+	for(int y = 0; y < blocks_y * block_size; ++y)
+	{
+		const uint8_t * cur = luma + (ssize_t)y * stride;
+		const uint8_t * bg = background + (ssize_t)y * stride;
+		uint32_t * sads = block_sads + (y / block_size) * blocks_x;
+
+		int g = 0;
+#if defined(__SSE2__)
+		for(; (g + 2) <= groups_x; g += 2)
+		{
+			__m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(cur + g * 8)),
+				_mm_loadu_si128((const __m128i *)(bg + g * 8)));
+			sads[g / groups_per_block] += _mm_cvtsi128_si32(sad);
+			sads[(g + 1) / groups_per_block] += _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+		}
+		for(; g < groups_x; ++g)
+		{
+			__m128i sad = _mm_sad_epu8(_mm_loadl_epi64((const __m128i *)(cur + g * 8)),
+				_mm_loadl_epi64((const __m128i *)(bg + g * 8)));
+			sads[g / groups_per_block] += _mm_cvtsi128_si32(sad);
+		}
+#else
+		for(; g < groups_x; ++g)
+		{
+			uint32_t sum = 0;
+			for(int i = 0; i < 8; ++i) sum += abs((int)cur[g * 8 + i] - (int)bg[g * 8 + i]);
+			sads[g / groups_per_block] += sum;
+		}
+#endif
+	}
+}
+
+/******************************************************************************
+ * motion_gate
+ *****************************************************************************/
+struct motion_gate_private
+{
+	motion_gate_t * gate;
+	int width, height;		// thumbnail, (multiples of block_size)
+	int blocks_x, blocks_y;
+
+	bgra_image_t decoded[1];	// jpeg input
+	bgra_image_t thumbnail[1];
+	uint8_t * luma;
+	uint8_t * background;
+	uint16_t * background_acc;	// 8.8 fixed point running average
+	uint32_t * block_sads;
+
+	int has_background;
+	int src_width, src_height;
+	int64_t last_inference_ms;
+	int64_t last_motion_ms;
+};
+
+void motion_gate_params_load(struct motion_gate_params * params, json_object * jconfig)
+{
+	assert(params);
+	params->enabled = json_get_value_default(jconfig, int, enabled, 1);
+	params->width = json_get_value_default(jconfig, int, width, 64);
+	params->height = json_get_value_default(jconfig, int, height, 48);
+	params->block_size = json_get_value_default(jconfig, int, block_size, 8);
+	params->block_threshold = json_get_value_default(jconfig, int, block_threshold, 12);
+	params->threshold = json_get_value_default(jconfig, double, threshold, 0.01);
+	params->background_shift = json_get_value_default(jconfig, int, background_shift, 4);
+	params->refresh_interval_ms = json_get_value_default(jconfig, int, refresh_interval_ms, 5000);
+	params->hold_ms = json_get_value_default(jconfig, int, hold_ms, 1000);
+}
+
+json_object * motion_gate_result_to_json(const struct motion_gate_result * result)
+{
+	assert(result);
+	json_object * jresult = json_object_new_object();
+	json_object_object_add(jresult, "score", json_object_new_double(result->score));
+	json_object_object_add(jresult, "changed_ratio", json_object_new_double(result->changed_ratio));
+	json_object_object_add(jresult, "changed_blocks", json_object_new_int(result->changed_blocks));
+	json_object_object_add(jresult, "num_blocks", json_object_new_int(result->num_blocks));
+	json_object_object_add(jresult, "triggered", json_object_new_boolean(result->triggered));
+	json_object_object_add(jresult, "forced", json_object_new_boolean(result->forced));
+	return jresult;
+}
+
+static void motion_gate_reset(struct motion_gate * gate)
+{
+	struct motion_gate_private * priv = gate->priv;
+	priv->has_background = 0;
+}
+
+static void update_background(struct motion_gate_private * priv, int shift)
+{
+	ssize_t size = (ssize_t)priv->width * priv->height;
+	uint8_t * luma = priv->luma;
+	uint8_t * background = priv->background;
+	uint16_t * acc = priv->background_acc;
+	for(ssize_t i = 0; i < size; ++i)
+	{
+		int value = acc[i];
+		value += (((int)luma[i] << 8) - value) >> shift;
+		acc[i] = value;
+		background[i] = (value + 128) >> 8;
+	}
+}
+
+static int motion_gate_update_bgra(struct motion_gate * gate, const bgra_image_t * image, int64_t timestamp_ms, struct motion_gate_result * result)
+{
+	assert(gate && gate->priv && image && image->data);
+	struct motion_gate_private * priv = gate->priv;
+	const struct motion_gate_params * params = gate->params;
+	struct motion_gate_result dummy[1];
+	if(NULL == result) result = dummy;
+	memset(result, 0, sizeof(*result));
+	if(0 == timestamp_ms) timestamp_ms = get_monotonic_ms();
+
+	bgra_image_t * thumbnail = priv->thumbnail;
+	if(bgra_image_resize(thumbnail, image, bgra_image_resize_filter_area))
+	{
+		result->triggered = 1;
+		return -1;
+	}
+	motion_gate_bgra_to_luma(thumbnail, priv->luma, priv->width);
+
+	result->num_blocks = priv->blocks_x * priv->blocks_y;
+	if(!priv->has_background || image->width != priv->src_width || image->height != priv->src_height)
+	{
+		ssize_t size = (ssize_t)priv->width * priv->height;
+		memcpy(priv->background, priv->luma, size);
+		for(ssize_t i = 0; i < size; ++i) priv->background_acc[i] = (uint16_t)priv->luma[i] << 8;
+		priv->has_background = 1;
+		priv->src_width = image->width;
+		priv->src_height = image->height;
+		priv->last_inference_ms = timestamp_ms;
+		priv->last_motion_ms = 0;
+
+		result->triggered = 1;
+		result->forced = 1;
+		return 0;
+	}
+
+	motion_gate_block_sad(priv->luma, priv->background, priv->width, priv->height, priv->width,
+		params->block_size, priv->block_sads);
+
+	uint64_t total_sad = 0;
+	uint32_t block_threshold = (uint32_t)params->block_threshold * params->block_size * params->block_size;
+	for(int i = 0; i < result->num_blocks; ++i)
+	{
+		total_sad += priv->block_sads[i];
+		if(priv->block_sads[i] > block_threshold) ++result->changed_blocks;
+	}
+	result->score = (double)total_sad / ((double)priv->width * priv->height * 255.0);
+	result->changed_ratio = (double)result->changed_blocks / (double)result->num_blocks;
+
+	int motion = (result->changed_blocks > 0 && result->changed_ratio >= params->threshold);
+	if(motion) priv->last_motion_ms = timestamp_ms;
+	int hold = (priv->last_motion_ms > 0 && (timestamp_ms - priv->last_motion_ms) < params->hold_ms);
+	int refresh = (params->refresh_interval_ms > 0 && (timestamp_ms - priv->last_inference_ms) >= params->refresh_interval_ms);
+
+	result->triggered = (!params->enabled || motion || hold || refresh);
+	result->forced = (result->triggered && params->enabled && !motion && !hold);
+	if(result->triggered) priv->last_inference_ms = timestamp_ms;
+
+	update_background(priv, params->background_shift);
+	return 0;
+}
+
+static int motion_gate_update_jpeg(struct motion_gate * gate, const unsigned char * jpeg, size_t length, int64_t timestamp_ms, struct motion_gate_result * result)
+{
+	assert(gate && gate->priv);
+	struct motion_gate_private * priv = gate->priv;
+
+	// only a thumbnail is needed: decode at 1/8 ~ 1/2 scale, fast IDCT, no fancy upsampling
+	int rc = bgra_image_from_jpeg_stream_ex(priv->decoded, jpeg, length, priv->width, priv->height,
+		bgra_image_jpeg_decode_flags_fast);
+	if(rc)
+	{
+		if(result)
+		{
+			memset(result, 0, sizeof(*result));
+			result->triggered = 1;
+		}
+		return -1;
+	}
+	return motion_gate_update_bgra(gate, priv->decoded, timestamp_ms, result);
+}
+
+motion_gate_t * motion_gate_init(motion_gate_t * gate, const struct motion_gate_params * params, void * user_data)
+{
+	if(NULL == gate) gate = calloc(1, sizeof(*gate));
+	assert(gate);
+	gate->user_data = user_data;
+	gate->update_bgra = motion_gate_update_bgra;
+	gate->update_jpeg = motion_gate_update_jpeg;
+	gate->reset = motion_gate_reset;
+
+	if(params) *gate->params = *params;
+	else motion_gate_params_load(gate->params, NULL);
+
+	struct motion_gate_params * p = gate->params;
+	if(p->block_size < 8) p->block_size = 8;
+	p->block_size &= ~7;
+	if(p->width < p->block_size) p->width = p->block_size;
+	if(p->height < p->block_size) p->height = p->block_size;
+	p->width -= p->width % p->block_size;
+	p->height -= p->height % p->block_size;
+	if(p->background_shift < 0) p->background_shift = 0;
+	if(p->background_shift > 8) p->background_shift = 8;
+
+	struct motion_gate_private * priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	priv->gate = gate;
+	priv->width = p->width;
+	priv->height = p->height;
+	priv->blocks_x = p->width / p->block_size;
+	priv->blocks_y = p->height / p->block_size;
+
+	ssize_t size = (ssize_t)priv->width * priv->height;
+	priv->luma = calloc(size, 1);
+	priv->background = calloc(size, 1);
+	priv->background_acc = calloc(size, sizeof(*priv->background_acc));
+	priv->block_sads = calloc(priv->blocks_x * priv->blocks_y, sizeof(*priv->block_sads));
+	assert(priv->luma && priv->background && priv->background_acc && priv->block_sads);
+
+	priv->thumbnail->width = priv->width;	// bgra_image_resize() target size
+	priv->thumbnail->height = priv->height;
+	gate->priv = priv;
+	return gate;
+}
+
+void motion_gate_cleanup(motion_gate_t * gate)
+{
+	if(NULL == gate || NULL == gate->priv) return;
+	struct motion_gate_private * priv = gate->priv;
+	bgra_image_clear(priv->decoded);
+	bgra_image_clear(priv->thumbnail);
+	free(priv->luma);
+	free(priv->background);
+	free(priv->background_acc);
+	free(priv->block_sads);
+	free(priv);
+	gate->priv = NULL;
+}
@@ -29,12 +29,125 @@
 
 #include "img_proc.h"
 
+/*
+ * usage: test-imgproc [image file]
+ *   without an image file, a synthetic 4:2:0 camera-like frame is used, (no fixtures needed)
+ */
+
+#define NUM_RANDOM_RECTS (300)
+
+static void make_synthetic_image(bgra_image_t * image, int width, int height)
+{
+	bgra_image_init(image, width, height, NULL);
+	for(int y = 0; y < height; ++y) {
+		unsigned char * bgra = image->data + (ssize_t)y * bgra_image_stride(image);
+		for(int x = 0; x < width; ++x, bgra += 4) {
+			int noise = rand() % 17 - 8;
+			bgra[0] = ((x / 3) + noise) & 0xFF;
+			bgra[1] = ((y / 2) + noise) & 0xFF;
+			bgra[2] = ((x + y) / 4 + noise) & 0xFF;
+			bgra[3] = 255;
+		}
+	}
+}
+
+static void random_rect(int width, int height, int min_size, int * x, int * y, int * w, int * h)
+{
+	*w = min_size + rand() % (width - min_size + 1);
+	*h = min_size + rand() % (height - min_size + 1);
+	*x = rand() % (width - *w + 1);
+	*y = rand() % (height - *h + 1);
+}
+
+/* image (width x height) must equal ref cropped at (x, y) */
+static int compare_crop(const bgra_image_t * image, const bgra_image_t * ref, int x, int y)
+{
+	if(x < 0 || y < 0 || (x + image->width) > ref->width || (y + image->height) > ref->height) return -1;
+	for(int row = 0; row < image->height; ++row) {
+		if(memcmp(image->data + (ssize_t)row * bgra_image_stride(image),
+			ref->data + (ssize_t)(y + row) * bgra_image_stride(ref) + x * 4,
+			image->width * 4)) return -1;
+	}
+	return 0;
+}
+
+/*
+ * roi decode over random rects: the same pixels as a full decode followed by a crop,
+ *   at full size and at 1/2 scale, (the reference is a full decode at the same scale)
+ */
+static int test_roi_decode_random(const unsigned char * jpeg, size_t cb_jpeg)
+{
+	bgra_image_t full[1], half[1];
+	memset(full, 0, sizeof(full));
+	memset(half, 0, sizeof(half));
+	int rc = bgra_image_from_jpeg_stream(full, jpeg, cb_jpeg);
+	assert(0 == rc);
+	rc = bgra_image_from_jpeg_stream_scaled(half, jpeg, cb_jpeg, full->width / 2, full->height / 2);
+	assert(0 == rc && half->width == (full->width + 1) / 2);
+
+	int failed = 0;
+	for(int i = 0; i < NUM_RANDOM_RECTS; ++i) {
+		int x, y, w, h;
+		random_rect(full->width, full->height, 16, &x, &y, &w, &h);
+
+		bgra_image_t roi[1];
+		memset(roi, 0, sizeof(roi));
+		rc = bgra_image_from_jpeg_stream_roi(roi, jpeg, cb_jpeg, x, y, w, h, 0, 0, 0);
+		if(rc || roi->width != w || roi->height != h || compare_crop(roi, full, x, y)) {
+			fprintf(stderr, "[FAILED] roi(%d,%d %dx%d)\n", x, y, w, h);
+			++failed;
+		}
+		bgra_image_clear(roi);
+
+		// min size (w/2 x h/2): 1/2 scale
+		rc = bgra_image_from_jpeg_stream_roi(roi, jpeg, cb_jpeg, x, y, w, h, w / 2, h / 2, 0);
+		if(rc || roi->width != (x + w + 1) / 2 - x / 2 || roi->height != (y + h + 1) / 2 - y / 2
+			|| compare_crop(roi, half, x / 2, y / 2)) {
+			fprintf(stderr, "[FAILED] roi(%d,%d %dx%d) 1/2\n", x, y, w, h);
+			++failed;
+		}
+		bgra_image_clear(roi);
+	}
+	printf("roi decode: %d random rects, full and 1/2 scale, bit-exact: %s\n", NUM_RANDOM_RECTS, failed?"FAILED":"ok");
+	bgra_image_clear(half);
+	bgra_image_clear(full);
+	return failed?-1:0;
+}
+
+/* strided views over random rects: the same pixels as a cropped copy */
+static int test_view_random(const bgra_image_t * bgra)
+{
+	int failed = 0;
+	for(int i = 0; i < NUM_RANDOM_RECTS; ++i) {
+		int x, y, w, h;
+		random_rect(bgra->width, bgra->height, 1, &x, &y, &w, &h);
+
+		bgra_image_t view[1], packed[1];
+		memset(view, 0, sizeof(view));
+		memset(packed, 0, sizeof(packed));
+		bgra_image_view(view, bgra, x, y, w, h);
+		bgra_image_copy(packed, view);
+		if(view->parent != bgra || view->data != bgra->data + (ssize_t)y * bgra_image_stride(bgra) + x * 4
+			|| packed->width != w || packed->height != h || packed->stride != w * 4
+			|| compare_crop(packed, bgra, x, y)) {
+			fprintf(stderr, "[FAILED] view(%d,%d %dx%d)\n", x, y, w, h);
+			++failed;
+		}
+		bgra_image_clear(packed);
+		bgra_image_clear(view);
+	}
+	printf("view: %d random rects == cropped copy: %s\n", NUM_RANDOM_RECTS, failed?"FAILED":"ok");
+	return failed?-1:0;
+}
+
 int main(int argc, char **argv)
 {
 	bgra_image_t bgra[1];
 	memset(bgra, 0, sizeof(bgra));
 	
-	bgra_image_load_from_file(bgra, "1.png");
+	srand(12345);
+	if(argc > 1) bgra_image_load_from_file(bgra, argv[1]);
+	else make_synthetic_image(bgra, 1280, 720);
 	assert(bgra->data && bgra->width > 0 && bgra->height);
 	
 	unsigned char * jpeg = NULL;
@@ -51,7 +164,40 @@ int main(int argc, char **argv)
 	
 	fclose(fp);
 	
+	// roi decode: same pixels as a full decode followed by a crop
+	int rc = test_roi_decode_random(jpeg, cb_jpeg);
+	assert(0 == rc);
+	
+	free(jpeg);
+	jpeg = NULL;
+	
+	// zero-copy ROI view: center crop, then random rects
+	rc = test_view_random(bgra);
+	assert(0 == rc);
+	
+	bgra_image_t roi[1];
+	memset(roi, 0, sizeof(roi));
+	int x = bgra->width / 4, y = bgra->height / 4;
+	bgra_image_view(roi, bgra, x, y, bgra->width / 2, bgra->height / 2);
+	assert(roi->parent == bgra && roi->stride == bgra_image_stride(bgra));
+	
+	cb_jpeg = bgra_image_to_jpeg_stream(roi, &jpeg, 90);
+	assert(cb_jpeg > 0 && jpeg);
 	free(jpeg);
+	
+	// letterbox into a square network input, then map the roi's center back
+	bgra_image_t letterboxed[1];
+	memset(letterboxed, 0, sizeof(letterboxed));
+	letterboxed->width = 416;
+	letterboxed->height = 416;
+	struct bgra_image_letterbox lb;
+	rc = bgra_image_letterbox(letterboxed, bgra, bgra_image_resize_filter_auto, 0xff808080, &lb);
+	assert(0 == rc && lb.width <= 416 && lb.height <= 416);
+	assert(lb.width == 416 || lb.height == 416);
+	if(lb.x > 0 || lb.y > 0) assert(*(uint32_t *)letterboxed->data == 0xff808080);	// border
+	bgra_image_clear(letterboxed);
+	
+	bgra_image_clear(roi);		// does not free the parent's buffer
 	bgra_image_clear(bgra);
 	
 	return 0;
@@ -29,6 +29,8 @@
 #include <string.h>
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
+#include <errno.h>
 
 #include <gst/app/gstappsink.h>
 
@@ -36,6 +38,7 @@
 #include <sys/stat.h>
 #include "utils.h"
 #include "video_source_common.h"
+#include "frame-pool.h"
 
 #define PROTOCOL_rtsp       "rtsp://"
 #define PROTOCOL_rtspt      "rtspt://"
@@ -201,7 +204,7 @@ struct video_frame *video_frame_new(long frame_number, int width, int height, co
 		if(take_memory) frame->data = (unsigned char *)image_data;
 		else {
 			if(length > 0) {
-				frame->data = malloc(length);
+				frame->data = frame_pool_alloc(width, height, video_frame_type_unknown, length);
 				assert(frame->data);
 				memcpy(frame->data, image_data, length);
 			}
@@ -211,24 +214,177 @@ struct video_frame *video_frame_new(long frame_number, int width, int height, co
 	frame->refs = 1;
 	return frame;
 }
+struct gst_sample_data
+{
+	GstSample *sample;
+	GstBuffer *buffer;
+	GstMapInfo map;
+};
+static void gst_sample_data_free(struct video_frame *frame)
+{
+	struct gst_sample_data *owner = frame->data_owner;
+	frame->data_owner = NULL;
+	if(NULL == owner) return;
+	
+	gst_buffer_unmap(owner->buffer, &owner->map);
+	gst_sample_unref(owner->sample);
+	free(owner);
+}
+
+struct video_frame *video_frame_new_from_gst_sample(long frame_number, int width, int height, GstSample *sample)
+{
+	assert(sample);
+	GstBuffer *buffer = gst_sample_get_buffer(sample);
+	if(NULL == buffer) return NULL;
+	
+	struct gst_sample_data *owner = calloc(1, sizeof(*owner));
+	assert(owner);
+	if(!gst_buffer_map(buffer, &owner->map, GST_MAP_READ)) {
+		free(owner);
+		return NULL;
+	}
+	owner->sample = gst_sample_ref(sample);
+	owner->buffer = buffer;	// owned by the sample
+	
+	struct video_frame *frame = video_frame_new(frame_number, width, height, NULL, owner->map.size, 0);
+	assert(frame);
+	frame->data = owner->map.data;
+	frame->data_owner = owner;
+	frame->free_data = gst_sample_data_free;
+	return frame;
+}
+
 void video_frame_unref(struct video_frame *frame)
 {
-	if(NULL == frame || frame->refs <= 0) return;
-	if(0 == --frame->refs) {
-		debug_printf("%s(refs=%ld) ==> free object(%p)\n", __FUNCTION__, frame->refs, frame);
-		if(frame->data) { free(frame->data); frame->data = NULL; }
+	if(NULL == frame) return;
+	long refs = __atomic_sub_fetch(&frame->refs, 1, __ATOMIC_ACQ_REL);
+	assert(refs >= 0);
+	if(0 == refs) {
+		debug_printf("%s(refs=%ld) ==> free object(%p)\n", __FUNCTION__, refs, frame);
+		if(frame->free_data) frame->free_data(frame);
+		else if(frame->data) frame_pool_release(frame->data);
+		frame->data = NULL;
 		free(frame);
 	}
 	return;
 }
 struct video_frame *video_frame_addref(struct video_frame *frame)
 {
-	if(NULL == frame || frame->refs <= 0) return NULL;
-	++frame->refs;
-	debug_printf("%s(refs=%ld): frame=%p\n", __FUNCTION__, frame->refs, frame);
+	if(NULL == frame) return NULL;
+	long refs = __atomic_add_fetch(&frame->refs, 1, __ATOMIC_RELAXED);
+	assert(refs > 1);
+	debug_printf("%s(refs=%ld): frame=%p\n", __FUNCTION__, refs, frame);
 	return frame;
 }
 
+/******************************************************************************
+ * video_frame_slot
+******************************************************************************/
+#define VIDEO_FRAME_SLOT_SPIN_COUNT (128)
+
+struct video_frame_slot *video_frame_slot_init(struct video_frame_slot *slot)
+{
+	if(NULL == slot) slot = calloc(1, sizeof(*slot));
+	assert(slot);
+	memset(slot, 0, sizeof(*slot));
+	slot->frame_number = -1;
+	
+	int rc = pthread_mutex_init(&slot->writer_mutex, NULL);
+	assert(0 == rc);
+	
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	rc = pthread_cond_init(&slot->cond, &attr);
+	assert(0 == rc);
+	pthread_condattr_destroy(&attr);
+	return slot;
+}
+
+void video_frame_slot_cleanup(struct video_frame_slot *slot)
+{
+	if(NULL == slot) return;
+	video_frame_slot_publish(slot, NULL);
+	pthread_cond_destroy(&slot->cond);
+	pthread_mutex_destroy(&slot->writer_mutex);
+}
+
+struct video_frame *video_frame_slot_acquire(struct video_frame_slot *slot)
+{
+	assert(slot);
+	unsigned long epoch = 0;
+	while(1) {
+		epoch = __atomic_load_n(&slot->epoch, __ATOMIC_SEQ_CST) & 1;
+		__atomic_add_fetch(&slot->readers[epoch], 1, __ATOMIC_SEQ_CST);
+		
+		// a writer that flipped the epoch before we were counted did not wait for us: enter the new one
+		if((__atomic_load_n(&slot->epoch, __ATOMIC_SEQ_CST) & 1) == epoch) break;
+		__atomic_sub_fetch(&slot->readers[epoch], 1, __ATOMIC_RELEASE);
+	}
+	
+	// the writer can not drop this reference until we leave the epoch
+	struct video_frame *frame = __atomic_load_n(&slot->frame, __ATOMIC_SEQ_CST);
+	if(frame) video_frame_addref(frame);
+	
+	__atomic_sub_fetch(&slot->readers[epoch], 1, __ATOMIC_RELEASE);
+	return frame;
+}
+
+long video_frame_slot_publish(struct video_frame_slot *slot, struct video_frame *frame)
+{
+	assert(slot);
+	long frame_number = frame?frame->frame_number:-1;
+	
+	pthread_mutex_lock(&slot->writer_mutex);
+	struct video_frame *old_frame = __atomic_exchange_n(&slot->frame, frame, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&slot->frame_number, frame_number, __ATOMIC_RELEASE);
+	
+	// start a new epoch and wait for the readers which may still see the old frame
+	unsigned long epoch = __atomic_fetch_add(&slot->epoch, 1, __ATOMIC_SEQ_CST) & 1;
+	for(int spins = 0; __atomic_load_n(&slot->readers[epoch], __ATOMIC_ACQUIRE) != 0; ++spins) {
+		if(spins >= VIDEO_FRAME_SLOT_SPIN_COUNT) sched_yield();
+	}
+	if(slot->waiters > 0) pthread_cond_broadcast(&slot->cond);
+	pthread_mutex_unlock(&slot->writer_mutex);
+	
+	if(old_frame) video_frame_unref(old_frame);
+	return frame_number;
+}
+
+struct video_frame *video_frame_slot_wait(struct video_frame_slot *slot, long prev_frame, long timeout_ms)
+{
+	assert(slot);
+	struct timespec abstime = { 0 };
+	if(timeout_ms > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &abstime);
+		abstime.tv_sec += timeout_ms / 1000;
+		abstime.tv_nsec += (timeout_ms % 1000) * 1000000;
+		if(abstime.tv_nsec >= 1000000000) {
+			++abstime.tv_sec;
+			abstime.tv_nsec -= 1000000000;
+		}
+	}
+	
+#define frame_unchanged(slot) (NULL == slot->frame || slot->frame_number == prev_frame)
+	int rc = 0;
+	pthread_mutex_lock(&slot->writer_mutex);
+	++slot->waiters;
+	while(timeout_ms != 0 && frame_unchanged(slot)) {
+		if(timeout_ms < 0) rc = pthread_cond_wait(&slot->cond, &slot->writer_mutex);
+		else rc = pthread_cond_timedwait(&slot->cond, &slot->writer_mutex, &abstime);
+		if(rc == ETIMEDOUT) break;
+	}
+	--slot->waiters;
+	
+	// the frame can only be replaced by a writer, which needs writer_mutex
+	struct video_frame *frame = NULL;
+	if(!frame_unchanged(slot)) frame = video_frame_addref(slot->frame);
+	pthread_mutex_unlock(&slot->writer_mutex);
+#undef frame_unchanged
+	return frame;
+}
+#undef VIDEO_FRAME_SLOT_SPIN_COUNT
+
 /******************************************************************************
  * video_source_common
 ******************************************************************************/
@@ -259,6 +415,7 @@ struct video_source_common *video_source_common_init(struct video_source_common
 	
 	int rc = pthread_mutex_init(&video->mutex, NULL);
 	assert(0 == rc);
+	video_frame_slot_init(video->current_frame);
 	
 	video->frame_type = frame_type;
 	
@@ -295,6 +452,7 @@ void video_source_common_cleanup(struct video_source_common *video)
 		printf("pipeline state: %d\n", (int) state);
 		gst_object_unref(pipeline);
 	}
+	video_frame_slot_cleanup(video->current_frame);
 }
 
 
@@ -371,8 +529,16 @@ static inline int make_launch_command(char command[static 8192], size_t size,
 	cb = snprintf(p, p_end -p, " ! capsfilter name=caps caps=video/x-raw");
 	assert(cb > 0);
 	p += cb;
-	if(frame_type == video_frame_type_bgra) {
-		cb = snprintf(p, p_end -p, ",format=BGRA");
+	const char * caps_format = NULL;
+	switch(frame_type) {
+	case video_frame_type_bgra: caps_format = "BGRA"; break;
+	case video_frame_type_nv12: caps_format = "{NV12,I420}"; break;	// videoconvert is passthrough for either one
+	case video_frame_type_i420: caps_format = "{I420,NV12}"; break;
+	case video_frame_type_gray8: caps_format = "GRAY8"; break;
+	default: break;
+	}
+	if(caps_format) {
+		cb = snprintf(p, p_end -p, ",format=%s", caps_format);
 		assert(cb > 0);
 		p += cb;
 	}
@@ -461,26 +627,24 @@ GstFlowReturn on_app_sink_new_sample(GstAppSink *sink, gpointer user_data)
 		gst_structure_get_int(info, "height", &height);
 		assert(width > 0 && height > 0);
 		
-		GstBuffer *buffer = gst_sample_get_buffer(sample);
-		if(buffer) {
-			GstMapInfo map;
-			memset(&map, 0, sizeof(map));
-			gst_buffer_map(buffer, &map, GST_MAP_READ);
-			
-			struct video_frame *frame = video_frame_new(video->frame_number, 
-				width, height, 
-				map.data, map.size, 0);
-			assert(frame);
-			frame->type = video->frame_type;
+		// nv12 / i420: the negotiated one, (the buffer layout is checked by yuv_image_init() on the consumer side)
+		enum video_frame_type frame_type = video->frame_type;
+		if(frame_type == video_frame_type_nv12 || frame_type == video_frame_type_i420) {
+			const char *format = gst_structure_get_string(info, "format");
+			frame_type = (format && strcasecmp(format, "I420") == 0)?video_frame_type_i420:video_frame_type_nv12;
+		}
+		
+		// no copy: the frame keeps the sample (and its mapped buffer) alive until the last reference is dropped
+		struct video_frame *frame = video_frame_new_from_gst_sample(video->frame_number, width, height, sample);
+		if(frame) {
+			frame->type = frame_type;
 			
-			pthread_mutex_lock(&video->mutex);
-			if(video->current_frame) video_frame_unref(video->current_frame);
-			video->current_frame = frame;
-			pthread_mutex_unlock(&video->mutex);
+			// keep a reference for on_new_frame(), the slot may be republished by then
+			video_frame_addref(frame);
+			video_frame_slot_publish(video->current_frame, frame);
 			
 			if(video->on_new_frame) video->on_new_frame(video, frame, video->user_data);
-			
-			gst_buffer_unmap(buffer, &map);
+			video_frame_unref(frame);
 		}
 		gst_sample_unref(sample);
 	}
@@ -608,10 +772,7 @@ static int video_init(struct video_source_common *video, const char *uri, int wi
 		video->frame_number = -1;
 		video->begin_ticks_ms = 0;
 		video->begin_timestamp_ms = 0;
-		if(video->current_frame) {
-			video_frame_unref(video->current_frame);
-			video->current_frame = NULL;
-		}
+		video_frame_slot_publish(video->current_frame, NULL);
 		video->settings_changed = 0;
 	}
 	
@@ -667,10 +828,7 @@ static int video_init_command(struct video_source_common *video, const char *gst
 
 static struct video_frame * video_get_frame(struct video_source_common * video)
 {
-	pthread_mutex_lock(&video->mutex);
-	struct video_frame *frame = video_frame_addref(video->current_frame);
-	pthread_mutex_unlock(&video->mutex);
-	return frame;
+	return video_frame_slot_acquire(video->current_frame);
 }
 static int video_play(struct video_source_common * video)
 {